@@ -20,6 +20,11 @@ CREATE OR REPLACE FUNCTION pgstrom.arrow_fdw_truncate(regclass)
   AS 'MODULE_PATHNAME','pgstrom_arrow_fdw_truncate'
   LANGUAGE C STRICT;
 
+CREATE OR REPLACE FUNCTION pgstrom.arrow_fdw_compaction(regclass)
+  RETURNS int
+  AS 'MODULE_PATHNAME','pgstrom_arrow_fdw_compaction'
+  LANGUAGE C STRICT;
+
 CREATE OR REPLACE FUNCTION
 pgstrom.arrow_fdw_export_cupy(regclass, text[] = null, int = null)
   RETURNS text
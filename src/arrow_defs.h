@@ -15,6 +15,7 @@ typedef enum
 	ArrowMetadataVersion__V2 = 1,		/* not supported */
 	ArrowMetadataVersion__V3 = 2,		/* not supported */
 	ArrowMetadataVersion__V4 = 3,
+	ArrowMetadataVersion__V5 = 4,
 } ArrowMetadataVersion;
 
 /*
@@ -105,6 +106,23 @@ typedef enum
 	ArrowPrecision__Double		= 2,
 } ArrowPrecision;
 
+/*
+ * CompressionType : byte
+ */
+typedef enum
+{
+	ArrowCompressionType__LZ4_FRAME	= 0,
+	ArrowCompressionType__ZSTD		= 1,
+} ArrowCompressionType;
+
+/*
+ * BodyCompressionMethod : byte
+ */
+typedef enum
+{
+	ArrowBodyCompressionMethod__BUFFER	= 0,
+} ArrowBodyCompressionMethod;
+
 /*
  * UnionMode : short
  */
@@ -175,6 +193,7 @@ typedef enum
 	ArrowNodeTag__Field,
 	ArrowNodeTag__FieldNode,
 	ArrowNodeTag__Buffer,
+	ArrowNodeTag__BodyCompression,
 	ArrowNodeTag__Schema,
 	ArrowNodeTag__RecordBatch,
 	ArrowNodeTag__DictionaryBatch,
@@ -359,6 +378,19 @@ typedef struct		ArrowBuffer
 	int64_t			length;
 } ArrowBuffer;
 
+/*
+ * BodyCompression
+ *
+ * Each buffer is prefixed by the uncompressed length in int64; -1 means
+ * the buffer is not compressed actually.
+ */
+typedef struct		ArrowBodyCompression
+{
+	ArrowNode		node;
+	ArrowCompressionType codec;
+	ArrowBodyCompressionMethod method;
+} ArrowBodyCompression;
+
 /*
  * KeyValue
  */
@@ -439,6 +471,8 @@ typedef struct		ArrowRecordBatch
 	/* vector of Buffer */
 	ArrowBuffer	    *buffers;
 	int				_num_buffers;
+	/* optional compression of the body */
+	ArrowBodyCompression *compression;
 } ArrowRecordBatch;
 
 /*
@@ -19,6 +19,12 @@
 #include "arrow_defs.h"
 #include "arrow_ipc.h"
 #include "cuda_numeric.cu"
+#ifdef WITH_LZ4
+#include <lz4frame.h>
+#endif
+#ifdef WITH_ZSTD
+#include <zstd.h>
+#endif
 
 /*
  * RecordBatchState
@@ -36,6 +42,20 @@ typedef struct RecordBatchFieldState
 	size_t		values_length;
 	off_t		extra_offset;
 	size_t		extra_length;
+	uint32		extra_base;			/* base of the offsets, if sliced */
+	/* dictionary-encoded values, if dict_unitsz > 0 */
+	int			dict_unitsz;		/* width of the indices */
+	int64		dict_nitems;		/* number of the dictionary entries */
+	off_t		dict_values_offset;	/* offsets of the dictionary (absolute) */
+	size_t		dict_values_length;
+	off_t		dict_extra_offset;	/* body of the dictionary (absolute) */
+	size_t		dict_extra_length;
+	/* min/max statistics, if any */
+	bool		stat_valid;
+	Datum		stat_min;
+	Datum		stat_max;
+	/* bloom filter in the sidecar file, if bloom_offset > 0 */
+	off_t		bloom_offset;
 	int			num_children;
 	struct RecordBatchFieldState *children;
 } RecordBatchFieldState;
@@ -48,6 +68,9 @@ typedef struct RecordBatchState
 	off_t		rb_offset;	/* offset from the head */
 	size_t		rb_length;	/* length of the entire RecordBatch */
 	int64		rb_nitems;	/* number of items */
+	bool		rb_sliced;	/* true, if a row-range of the RecordBatch */
+	bool		rb_compressed;	/* true, if buffers are compressed */
+	ArrowCompressionType rb_codec;	/* codec of the compressed buffers */
 	/* per column information */
 	int			ncols;
 	RecordBatchFieldState columns[FLEXIBLE_ARRAY_MEMBER];
@@ -63,11 +86,21 @@ typedef struct
 	uint32		hash;
 } MetadataCacheKey;
 
+/*
+ * NOTE: arrowMetadataCache is immutable once it gets linked to the hash_slots,
+ * except for 'referenced' flag and 'lru_chain', because lock-free readers may
+ * walk on the entries. Entries detached from the hash_slots are linked to the
+ * retire_list using 'lru_chain', then released after all the concurrent
+ * readers, that began prior to the detach ('retire_epoch'), have gone.
+ * The retired entries are still accounted in 'consumed' until released.
+ */
 typedef struct
 {
 	dlist_node	chain;
-	dlist_node	lru_chain;
+	dlist_node	lru_chain;	/* or, retire_list once detached */
 	dlist_head	siblings;	/* if two or more record batches per file */
+	bool		referenced;	/* second chance flag for clock reclaim */
+	uint64		retire_epoch;
 	/* key of RecordBatch metadata cache */
 	struct stat	stat_buf;
 	uint32		hash;
@@ -76,18 +109,83 @@ typedef struct
 	off_t		rb_offset;	/* offset from the head */
     size_t		rb_length;	/* length of the entire RecordBatch */
     int64		rb_nitems;	/* number of items */
+	bool		rb_compressed;	/* true, if buffers are compressed */
+	ArrowCompressionType rb_codec;	/* codec of the compressed buffers */
 	int			ncols;
 	int			nfields;	/* length of fstate[] array */
 	RecordBatchFieldState fstate[FLEXIBLE_ARRAY_MEMBER];
 } arrowMetadataCache;
 
+/*
+ * persistent metadata index (on the sidecar file)
+ *
+ * The file begins with arrowMetadataIndexHeader, then arrowMetadataIndexRecord
+ * per arrow file follows. Each record has the pathname and flattened
+ * RecordBatchFieldState of the RecordBatches, like arrowMetadataCache.
+ * Records are appended only, so the last one wins if two or more records
+ * have same (st_dev, st_ino). Once obsolete records consume more than half
+ * of the file, the backend that appended the last record rewrites the file
+ * with the live records only, then other backends re-open the new file.
+ */
+#define ARROW_METADATA_INDEX_SIGNATURE	"PG-Strom:ArrowIdx"
+#define ARROW_METADATA_INDEX_VERSION	1
+#define ARROW_METADATA_INDEX_MAGIC		0x41524958		/* 'ARIX' */
+#define ARROW_METADATA_INDEX_COMPACTION_MIN	(4UL << 20)	/* 4MB */
+
+typedef struct
+{
+	char		signature[24];
+	uint32		version;
+	uint32		field_sz;	/* sizeof(RecordBatchFieldState) */
+} arrowMetadataIndexHeader;
+
+typedef struct
+{
+	uint32		length;		/* length of this batch, MAXALIGN'ed */
+	int			rb_index;	/* index of the RecordBatch */
+	off_t		rb_offset;	/* offset from the head */
+	size_t		rb_length;	/* length of the entire RecordBatch */
+	int64		rb_nitems;	/* number of items */
+	bool		rb_compressed;	/* true, if buffers are compressed */
+	ArrowCompressionType rb_codec;	/* codec of the compressed buffers */
+	int			ncols;
+	int			nfields;	/* length of fstate[] array */
+	RecordBatchFieldState fstate[FLEXIBLE_ARRAY_MEMBER];
+} arrowMetadataIndexBatch;
+
+typedef struct
+{
+	uint32		magic;		/* ARROW_METADATA_INDEX_MAGIC */
+	uint32		length;		/* length of this record, MAXALIGN'ed */
+	pg_crc32c	crc;		/* CRC32C of the record from 'nbatches' */
+	int			nbatches;	/* number of arrowMetadataIndexBatch */
+	uint32		batch_head;	/* offset of the first batch */
+	dev_t		st_dev;
+	ino_t		st_ino;
+	off_t		st_size;
+	struct timespec st_mtim;
+	char		pathname[FLEXIBLE_ARRAY_MEMBER];
+} arrowMetadataIndexRecord;
+
+typedef struct
+{
+	dev_t		st_dev;		/* hash key */
+	ino_t		st_ino;		/* hash key */
+	size_t		offset;		/* offset of the latest record */
+} arrowMetadataIndexEntry;
+
 #define ARROW_METADATA_HASH_NSLOTS		2048
 #define ARROW_GPUBUF_HASH_NSLOTS		512
+#define ARROW_BUFCACHE_HASH_NSLOTS		512
 typedef struct
 {
 	slock_t		lru_lock;
 	dlist_head	lru_list;
-	pg_atomic_uint64 consumed;
+	pg_atomic_uint64 consumed;	/* including the retired entries */
+	/* for release of the entries detached from the hash_slots */
+	pg_atomic_uint64 reader_epoch;
+	slock_t		retire_lock;
+	dlist_head	retire_list;
 
 	LWLock		lock_slots[ARROW_METADATA_HASH_NSLOTS];
 	dlist_head	hash_slots[ARROW_METADATA_HASH_NSLOTS];
@@ -96,8 +194,45 @@ typedef struct
 	/* for ArrowGpuBuffer links */
 	LWLock		gpubuf_locks[ARROW_GPUBUF_HASH_NSLOTS];
 	dlist_head	gpubuf_slots[ARROW_GPUBUF_HASH_NSLOTS];
+
+	/* for shared RecordBatch buffer cache */
+	slock_t		bufcache_lru_lock;
+	dlist_head	bufcache_lru_list;
+	pg_atomic_uint64 bufcache_consumed;
+	LWLock		bufcache_locks[ARROW_BUFCACHE_HASH_NSLOTS];
+	dlist_head	bufcache_slots[ARROW_BUFCACHE_HASH_NSLOTS];
 } arrowMetadataState;
 
+/*
+ * arrowMetadataReader - per process slot for lock-free readers of the
+ * metadata cache. 'epoch' is non-zero only during the lookup. It is padded
+ * to a cache line, not to bounce with other processes.
+ */
+typedef union
+{
+	pg_atomic_uint64 epoch;
+	char		__padding[PG_CACHE_LINE_SIZE];
+} arrowMetadataReader;
+
+/*
+ * RecordBatch buffer cache (on shared memory)
+ */
+typedef struct
+{
+	dlist_node	chain;		/* link to bufcache_slots[] */
+	dlist_node	lru_chain;	/* link to bufcache_lru_list */
+	uint32		hash;
+	dev_t		st_dev;
+	ino_t		st_ino;
+	struct timespec st_mtim;
+	Oid			table_oid;
+	int			rb_index;
+	size_t		length;		/* consumption of the shared memory */
+	pgstrom_data_store *pds;	/* loaded RecordBatch */
+	int			nattrs;
+	AttrNumber	attnums[FLEXIBLE_ARRAY_MEMBER];	/* loaded columns */
+} arrowBufferCache;
+
 /*
  * MVCC state for the pending writes
  */
@@ -123,6 +258,7 @@ typedef struct
 	bool		is_truncate;
 	/* for TRUNCATE */
 	uint32		suffix;
+	bool		has_bloom;		/* sidecar file is also moved to the backup */
 	/* for INSERT */
 	loff_t		footer_offset;
 	size_t		footer_length;
@@ -136,12 +272,144 @@ typedef struct
 {
 	MemoryContext memcxt;
 	File		file;
+	File		bloom_file;		/* sidecar file of bloom filters, if any */
 	MetadataCacheKey key;
 	uint32		hash;
+	TransactionId xid;			/* transaction that writes the rows */
 	bool		redo_log_written;
+	/* group commit (see arrowFdwFlushPendingWrites) */
+	bool		group_commit;	/* written out at end of transaction */
+	bool		pending_footer;	/* Footer is not up-to-date yet */
+	int			nusers;			/* # of ResultRelInfo using this state */
+	Oid			relid;
+	dlist_node	pending_chain;
 	SQLtable	sql_table;
 } arrowWriteState;
 
+/*
+ * arrowStatsHint - RecordBatch skipping by min/max statistics and bloom filter
+ */
+typedef struct
+{
+	int			anum;		/* index of the column (0-origin) */
+	bool		use_max;	/* compare stat_max, instead of stat_min */
+	FmgrInfo	opcode;		/* btree comparison operator */
+	Oid			collid;
+	ExprState  *arg_state;	/* Const or stable expression */
+	Datum		arg_value;
+	bool		arg_isnull;
+	/* (Var = Expr) by bloom filter */
+	bool		use_bloom;	/* probe bloom filter, instead of min/max */
+	Oid			bloom_type;	/* type of the Var and Expr */
+	uint64		bloom_hash;	/* hash value of the arg_value */
+	off_t		bloom_last_offset;	/* cache of the last probe */
+	bool		bloom_last_result;
+} arrowStatsHintItem;
+
+typedef struct
+{
+	List	   *hint_quals;	/* original qualifiers, for EXPLAIN */
+	ExprContext *econtext;
+	bool		args_ready;	/* arg_value/arg_isnull are valid */
+	/* sidecar file of bloom filters, for the arrow file (st_dev, st_ino) */
+	File		bloom_file;
+	bool		bloom_file_valid;
+	dev_t		bloom_st_dev;
+	ino_t		bloom_st_ino;
+	int			nitems;
+	arrowStatsHintItem items[FLEXIBLE_ARRAY_MEMBER];
+} arrowStatsHint;
+
+/*
+ * arrowFdwRelInfo - estimation by the planner, saved at baserel->fdw_private
+ */
+typedef struct
+{
+	int			optimal_gpu;	/* optimal GPU for the files, or -1 */
+	double		ntuples_scan;	/* rows in RecordBatches not to be skipped */
+	double		npages_cached;	/* pages to be read, already in page cache */
+} arrowFdwRelInfo;
+
+/*
+ * arrowVectorFilter - vectorized pre-filter for CPU scan
+ */
+#define ARROW_VFILTER__NULLTEST		1	/* Var IS NULL */
+#define ARROW_VFILTER__NOTNULLTEST	2	/* Var IS NOT NULL */
+#define ARROW_VFILTER__INTEGER		3	/* Var OP Expr, compared as int64 */
+#define ARROW_VFILTER__FLOAT		4	/* Var OP Expr, compared as float8 */
+#define ARROW_VFILTER__DICTIONARY	5	/* Var OP Expr or Var OP ANY(array),
+										 * evaluated per dictionary entry */
+
+typedef struct
+{
+	int			anum;		/* index of the column (0-origin) */
+	int			kind;		/* one of ARROW_VFILTER__* */
+	int			strategy;	/* btree strategy number */
+	Oid			argtype;	/* type of the argument */
+	ExprState  *arg_state;	/* Const or stable expression */
+	Datum		arg_value;
+	bool		arg_isnull;
+	/* ARROW_VFILTER__DICTIONARY */
+	FmgrInfo	opfunc;		/* function of the operator */
+	Oid			collid;		/* collation of the operator */
+	bool		useOr;		/* true, if Var OP ANY(array) */
+	uint64		dict_serial;	/* dictionary dict_match is built for */
+	int64		dict_nmatched;	/* number of the entries matched */
+	uint8	   *dict_match;		/* 1, if the dictionary entry matches */
+} arrowVectorFilterItem;
+
+typedef struct
+{
+	List	   *filter_quals;	/* original qualifiers, for EXPLAIN */
+	ExprContext *econtext;
+	bool		args_ready;	/* arg_value/arg_isnull are valid */
+	int			nitems;
+	arrowVectorFilterItem items[FLEXIBLE_ARRAY_MEMBER];
+} arrowVectorFilter;
+
+/*
+ * arrowAggregateState - ungrouped aggregates answered by the metadata
+ */
+#define ARROW_AGGREGATE__COUNT_STAR	1	/* COUNT(*) */
+#define ARROW_AGGREGATE__COUNT		2	/* COUNT(Var) */
+#define ARROW_AGGREGATE__MIN		3	/* MIN(Var) */
+#define ARROW_AGGREGATE__MAX		4	/* MAX(Var) */
+
+typedef struct
+{
+	int			kind;		/* one of ARROW_AGGREGATE__* */
+	int			anum;		/* index of the column (0-origin) */
+	FmgrInfo	opcode;		/* sort operator of MIN/MAX */
+	Oid			collid;
+	int64		count;		/* COUNT(*) or COUNT(Var) */
+} arrowAggregateItem;
+
+typedef struct
+{
+	Relation	relation;
+	bool		done;		/* true, if result row is already returned */
+	uint64		nloaded;	/* # of RecordBatches loaded for MIN/MAX */
+	int			nitems;
+	arrowAggregateItem items[FLEXIBLE_ARRAY_MEMBER];
+} arrowAggregateState;
+
+/*
+ * arrowPruneContext - pruning of hive-style partition directories
+ */
+typedef struct
+{
+	TupleDesc	tupdesc;
+	Index		relid;		/* varno of the foreign table */
+	List	   *quals;		/* quals that reference user columns only */
+	List	   *qual_attrs;	/* Bitmapset of attnums for each qual */
+	PlannerInfo *root;		/* valid, if planning time */
+	EState	   *estate;		/* valid, if execution time */
+	Bitmapset  *key_attrs;	/* attnums with the partition key values */
+	Const	  **key_values;	/* partition key values by attnum-1 */
+	uint64		npruned;	/* # of directories pruned */
+	uint64		nunparsable;	/* # of directories not prunable */
+} arrowPruneContext;
+
 /*
  * ArrowFdwState
  */
@@ -149,13 +417,31 @@ struct ArrowFdwState
 {
 	List	   *fdescList;
 	Bitmapset  *referenced;
+	uint64		prune_ndirs;		/* # of partition directories pruned */
+	arrowStatsHint *stats_hint;
+	uint64		stats_nloaded;		/* # of RecordBatches actually loaded */
+	uint64		stats_nskipped;		/* # of RecordBatches skipped */
+	arrowVectorFilter *vfilter;
+	uint64		vfilter_nremoved;	/* # of rows removed by vfilter */
 	pg_atomic_uint32   *rbatch_index;
 	pg_atomic_uint32	__rbatch_index_local;	/* if single process exec */
+	uint32	   *rbatch_run_end;		/* end of the run from each index */
+	uint32		run_next;			/* next RecordBatch of the current run */
+	uint32		run_end;			/* end of the current run */
+	uint32		prefetch_index;		/* next RecordBatch to be prefetched */
 	pgstrom_data_store *curr_pds;	/* current focused buffer */
 	cl_ulong	curr_index;			/* current index to row on KDS */
+	uint8	   *curr_selvec;		/* selection vector by vfilter */
+	uint32		curr_selvec_nrooms;
+	/* LIMIT bound; RecordBatches are loaded by growing row-ranges */
+	int64		scan_bound;			/* 0, if no bound */
+	RecordBatchState *bound_rb_state;	/* RecordBatch partially loaded */
+	int64		bound_row_next;		/* next row of the bound_rb_state */
+	int64		bound_nrows;		/* size of the next row-range */
+	uint64		bound_nslices;		/* # of row-ranges loaded */
 	/* state of RecordBatches */
 	uint32		num_rbatches;
-	RecordBatchState *rbatches[FLEXIBLE_ARRAY_MEMBER];
+	RecordBatchState **rbatches;
 };
 
 /*
@@ -189,17 +475,62 @@ typedef struct
 	char		ident[FLEXIBLE_ARRAY_MEMBER];
 } ArrowGpuBufferTracker;
 
+typedef struct
+{
+	dlist_node	chain;
+	pgstrom_data_store *pds;
+} arrowBufferCacheTracker;
+
+/*
+ * arrowDictionary - values of DictionaryBatch (per backend cache)
+ */
+#define ARROW_DICTIONARY_CACHE_NITEMS	32
+
+typedef struct
+{
+	dlist_node	chain;
+	dev_t		st_dev;
+	ino_t		st_ino;
+	struct timespec st_mtim;
+	off_t		values_offset;	/* location of the dictionary in the file */
+	uint64		serial;			/* unique identifier in this backend */
+	int64		nitems;
+	cl_uint	   *offsets;
+	char	   *extra;
+} arrowDictionary;
+
 /* ---------- static variables ---------- */
 static FdwRoutine		pgstrom_arrow_fdw_routine;
 static shmem_startup_hook_type shmem_startup_next = NULL;
 static arrowMetadataState *arrow_metadata_state = NULL;
+static arrowMetadataReader *arrow_metadata_readers = NULL;
+static int				arrow_metadata_nreaders = 0;
+static int				arrow_metadata_index_fdesc = -1;
+static char			   *arrow_metadata_index_map = NULL;
+static size_t			arrow_metadata_index_mapsz = 0;
+static size_t			arrow_metadata_index_scanned = 0;
+static size_t			arrow_metadata_index_live_sz = 0;
+static HTAB			   *arrow_metadata_index_htab = NULL;
 static dlist_head		arrow_write_redo_list;
+static dlist_head		arrow_write_pending_list;
 static bool				arrow_fdw_enabled;				/* GUC */
 static int				arrow_metadata_cache_size_kb;	/* GUC */
 static size_t			arrow_metadata_cache_size;
+static char			   *arrow_metadata_index_file;		/* GUC */
 static char			   *arrow_debug_row_numbers_hint;	/* GUC */
 static int				arrow_record_batch_size_kb;		/* GUC */
+static bool				arrow_enable_group_commit;		/* GUC */
+static bool				arrow_enable_vector_filter;		/* GUC */
+static bool				arrow_enable_metadata_aggregate;	/* GUC */
+static int				arrow_prefetch_depth;			/* GUC */
+static bool				arrow_enable_mmap;				/* GUC */
+static int				arrow_buffer_cache_size_kb;		/* GUC */
+static int				arrow_parallel_split_size_kb;	/* GUC */
+static dlist_head		arrow_buffer_cache_tracker_list;
 static dlist_head		arrow_gpu_buffer_tracker_list;
+static dlist_head		arrow_dictionary_list;
+static int				arrow_dictionary_count = 0;
+static uint64			arrow_dictionary_serial = 0;
 
 /* ---------- static functions ---------- */
 static bool		arrowTypeIsEqual(ArrowField *a, ArrowField *b, int depth);
@@ -210,28 +541,60 @@ static bool		arrowSchemaCompatibilityCheck(TupleDesc tupdesc,
 											  RecordBatchState *rb_state);
 static List	   *__arrowFdwExtractFilesList(List *options_list,
 										   int *p_parallel_nworkers,
-										   bool *p_writable);
+										   bool *p_writable,
+										   arrowPruneContext *prune);
 static List	   *arrowFdwExtractFilesList(List *options_list);
-static RecordBatchState *makeRecordBatchState(ArrowSchema *schema,
+static arrowPruneContext *arrowFdwSetupPruneContext(TupleDesc tupdesc,
+													Index relid,
+													List *quals,
+													PlannerInfo *root,
+													EState *estate);
+static RecordBatchState *makeRecordBatchState(ArrowFileInfo *af_info,
 											  ArrowBlock *block,
 											  ArrowRecordBatch *rbatch);
 static List	   *arrowLookupOrBuildMetadataCache(File fdesc);
+static arrowStatsHint *__arrowFdwSetupStatsHint(PlannerInfo *root,
+												ScanState *ss,
+												TupleDesc tupdesc,
+												Index scanrelid,
+												List *outer_quals);
+static bool		arrowFdwCheckStatsHint(arrowStatsHint *stats_hint,
+									   RecordBatchState *rb_state);
+static int		__arrowFdwFieldUnitSize(Oid atttypid,
+										ArrowTypeOptions *attopts);
+static uint32	arrowFdwNextRecordBatchIndex(ArrowFdwState *af_state);
 static void		pg_datum_arrow_ref(kern_data_store *kds,
 								   kern_colmeta *cmeta,
 								   size_t index,
 								   Datum *p_datum,
 								   bool *p_isnull);
+/* routines for aggregates answered by the metadata */
+static ForeignScan *arrowFdwMakeAggregatePlan(RelOptInfo *upper_rel,
+											  ForeignPath *best_path,
+											  List *tlist,
+											  Plan *outer_plan);
+static void		arrowFdwBeginAggregate(ForeignScanState *node, int eflags);
 /* routines for writable arrow_fdw foreign tables */
 static arrowWriteState *createArrowWriteState(Relation frel, File file,
 											  bool redo_log_written);
-static void createArrowWriteRedoLog(File filp, bool is_newfile);
+static void createArrowWriteRedoLog(File filp, bool is_newfile,
+									TransactionId curr_xid);
 static void writeOutArrowRecordBatch(arrowWriteState *aw_state,
 									 bool with_footer);
+static arrowWriteState *lookupArrowWritePending(Oid relid);
+static void arrowFdwFlushPendingWrites(void);
+static void setupArrowSQLbufferSchema(SQLtable *table, TupleDesc tupdesc);
+static void __setupArrowSQLbufferBloomColumns(SQLtable *table,
+											  TupleDesc tupdesc,
+											  const char *columns);
+static void arrowFdwRetirePendingWrites(TransactionId curr_xid,
+										bool is_commit);
 
 Datum	pgstrom_arrow_fdw_handler(PG_FUNCTION_ARGS);
 Datum	pgstrom_arrow_fdw_validator(PG_FUNCTION_ARGS);
 Datum	pgstrom_arrow_fdw_precheck_schema(PG_FUNCTION_ARGS);
 Datum	pgstrom_arrow_fdw_truncate(PG_FUNCTION_ARGS);
+Datum	pgstrom_arrow_fdw_compaction(PG_FUNCTION_ARGS);
 Datum	pgstrom_arrow_fdw_export_cupy(PG_FUNCTION_ARGS);
 Datum	pgstrom_arrow_fdw_export_cupy_pinned(PG_FUNCTION_ARGS);
 Datum	pgstrom_arrow_fdw_unpin_gpu_buffer(PG_FUNCTION_ARGS);
@@ -378,6 +741,122 @@ apply_debug_row_numbers_hint(PlannerInfo *root,
 	pfree(config);
 }
 
+/*
+ * arrowFdwEstimateCachedRatio
+ *
+ * It estimates the ratio of the referenced buffers already in the page cache,
+ * by mincore(2) on a few pages distributed over the buffers, as if they were
+ * concatenated in the order of RecordBatchFieldLength.
+ */
+#define ARROW_CACHED_RATIO_NSAMPLES		32
+
+typedef struct
+{
+	char	   *mmap_addr;
+	size_t		mmap_size;
+	size_t		step;		/* distance between the samples */
+	size_t		curr;		/* virtual position of the current buffer */
+	size_t		next;		/* virtual position of the next sample */
+	int			nsamples;
+	int			nresident;
+} arrowCachedRatioContext;
+
+static void
+__arrowFdwSampleCachedBuffer(arrowCachedRatioContext *con,
+							 off_t offset, size_t length)
+{
+	while (con->next < con->curr + length)
+	{
+		size_t		pos = offset + (con->next - con->curr);
+		unsigned char vec;
+
+		pos = TYPEALIGN_DOWN(PAGE_SIZE, pos);
+		if (pos < con->mmap_size &&
+			mincore(con->mmap_addr + pos, PAGE_SIZE, &vec) == 0)
+		{
+			con->nsamples++;
+			if ((vec & 1) != 0)
+				con->nresident++;
+		}
+		con->next += con->step;
+	}
+	con->curr += length;
+}
+
+static void
+__arrowFdwSampleCachedField(arrowCachedRatioContext *con,
+							off_t rb_offset,
+							RecordBatchFieldState *fstate)
+{
+	int		j;
+
+	if (fstate->nullmap_offset > 0)
+		__arrowFdwSampleCachedBuffer(con, rb_offset + fstate->nullmap_offset,
+									 fstate->nullmap_length);
+	if (fstate->values_offset > 0)
+		__arrowFdwSampleCachedBuffer(con, rb_offset + fstate->values_offset,
+									 fstate->values_length);
+	if (fstate->extra_offset > 0)
+		__arrowFdwSampleCachedBuffer(con, rb_offset + fstate->extra_offset,
+									 fstate->extra_length);
+	for (j=0; j < fstate->num_children; j++)
+		__arrowFdwSampleCachedField(con, rb_offset, &fstate->children[j]);
+}
+
+static double
+arrowFdwEstimateCachedRatio(File fdesc, List *rb_state_list,
+							Bitmapset *referenced, size_t length)
+{
+	arrowCachedRatioContext con;
+	RecordBatchState *rb_state;
+	ListCell   *lc;
+	int			j, k;
+
+	if (rb_state_list == NIL || length == 0)
+		return 0.0;
+	rb_state = linitial(rb_state_list);
+
+	memset(&con, 0, sizeof(arrowCachedRatioContext));
+	con.mmap_size = TYPEALIGN(PAGE_SIZE, rb_state->stat_buf.st_size);
+	con.mmap_addr = mmap(NULL, con.mmap_size,
+						 PROT_READ, MAP_SHARED,
+						 FileGetRawDesc(fdesc), 0);
+	if (con.mmap_addr == MAP_FAILED)
+		return 0.0;		/* assume nothing is cached */
+	con.step = Max(length / ARROW_CACHED_RATIO_NSAMPLES, 1);
+	con.next = con.step / 2;
+
+	foreach (lc, rb_state_list)
+	{
+		rb_state = lfirst(lc);
+		if (bms_is_member(-FirstLowInvalidHeapAttributeNumber, referenced))
+		{
+			for (j=0; j < rb_state->ncols; j++)
+				__arrowFdwSampleCachedField(&con, rb_state->rb_offset,
+											&rb_state->columns[j]);
+		}
+		else
+		{
+			for (k = bms_next_member(referenced, -1);
+				 k >= 0;
+				 k = bms_next_member(referenced, k))
+			{
+				j = k + FirstLowInvalidHeapAttributeNumber - 1;
+				if (j < 0 || j >= rb_state->ncols)
+					continue;
+				__arrowFdwSampleCachedField(&con, rb_state->rb_offset,
+											&rb_state->columns[j]);
+			}
+		}
+	}
+	if (munmap(con.mmap_addr, con.mmap_size) != 0)
+		elog(WARNING, "failed on munmap: %m");
+
+	if (con.nsamples == 0)
+		return 0.0;
+	return (double)con.nresident / (double)con.nsamples;
+}
+
 /*
  * ArrowGetForeignRelSize
  */
@@ -387,11 +866,18 @@ ArrowGetForeignRelSize(PlannerInfo *root,
 					   Oid foreigntableid)
 {
 	ForeignTable   *ft = GetForeignTable(foreigntableid);
+	Relation		frel;
+	arrowPruneContext *prune;
+	arrowStatsHint *stats_hint;
+	arrowFdwRelInfo *rel_info;
+	List		   *scan_quals;
 	List		   *filesList;
 	Size			filesSizeTotal = 0;
 	Bitmapset	   *referenced = NULL;
-	BlockNumber		npages = 0;
+	double			npages = 0.0;
+	double			npages_cached = 0.0;
 	double			ntuples = 0.0;
+	double			ntuples_scan = 0.0;
 	ListCell	   *lc;
 	int				parallel_nworkers;
 	bool			writable;
@@ -407,14 +893,34 @@ ArrowGetForeignRelSize(PlannerInfo *root,
 	}
 	referenced = pgstrom_pullup_outer_refs(root, baserel, referenced);
 
+	/* partition directories never matched are not walked */
+	frel = relation_open(foreigntableid, NoLock);
+	scan_quals = extract_actual_clauses(baserel->baserestrictinfo, false);
+	prune = arrowFdwSetupPruneContext(RelationGetDescr(frel),
+									  baserel->relid,
+									  scan_quals,
+									  root, NULL);
+	/* RecordBatches to be skipped by the min/max statistics */
+	stats_hint = __arrowFdwSetupStatsHint(root, NULL,
+										  RelationGetDescr(frel),
+										  baserel->relid,
+										  scan_quals);
 	filesList = __arrowFdwExtractFilesList(ft->options,
 										   &parallel_nworkers,
-										   &writable);
+										   &writable,
+										   prune);
+	relation_close(frel, NoLock);
+#if PG_VERSION_NUM < 160000
+	/* see __arrowFdwPruneInputValue; workers cannot run subtransactions */
+	if (prune && prune->nunparsable > 0)
+		baserel->consider_parallel = false;
+#endif
 	foreach (lc, filesList)
 	{
 		char	   *fname = strVal(lfirst(lc));
 		File		fdesc;
 		List	   *rb_cached;
+		List	   *rb_scan = NIL;
 		ListCell   *cell;
 		size_t		len = 0;
 
@@ -439,6 +945,9 @@ ArrowGetForeignRelSize(PlannerInfo *root,
 
 			if (cell == list_head(rb_cached))
 				filesSizeTotal += BLCKALIGN(rb_state->stat_buf.st_size);
+			ntuples += rb_state->rb_nitems;
+			if (stats_hint && !arrowFdwCheckStatsHint(stats_hint, rb_state))
+				continue;
 
 			if (bms_is_member(-FirstLowInvalidHeapAttributeNumber, referenced))
 			{
@@ -451,15 +960,18 @@ ArrowGetForeignRelSize(PlannerInfo *root,
 					 k >= 0;
 					 k = bms_next_member(referenced, k))
 				{
-					j = k + FirstLowInvalidHeapAttributeNumber;
+					j = k + FirstLowInvalidHeapAttributeNumber - 1;
 					if (j < 0 || j >= rb_state->ncols)
 						continue;
 					len += RecordBatchFieldLength(&rb_state->columns[j]);
 				}
 			}
-			ntuples += rb_state->rb_nitems;
+			ntuples_scan += rb_state->rb_nitems;
+			rb_scan = lappend(rb_scan, rb_state);
 		}
-		npages = len / BLCKSZ;
+		npages += (double)(len / BLCKSZ);
+		npages_cached += (double)(len / BLCKSZ) *
+			arrowFdwEstimateCachedRatio(fdesc, rb_scan, referenced, len);
 		FileClose(fdesc);
 	}
 	bms_free(referenced);
@@ -469,13 +981,29 @@ ArrowGetForeignRelSize(PlannerInfo *root,
 	else if (filesSizeTotal < nvme_strom_threshold())
 		optimal_gpu = -1;
 
+	rel_info = palloc0(sizeof(arrowFdwRelInfo));
+	rel_info->optimal_gpu = optimal_gpu;
+	rel_info->ntuples_scan = ntuples_scan;
+	rel_info->npages_cached = npages_cached;
+
 	baserel->rel_parallel_workers = parallel_nworkers;
-	baserel->fdw_private = makeInteger(optimal_gpu);
-	baserel->pages = npages;
+	baserel->fdw_private = rel_info;
+	baserel->pages = (BlockNumber) Min(npages, (double) MaxBlockNumber);
 	baserel->tuples = ntuples;
+	/* rows in the partitions survived already satisfy the pruning quals */
+	scan_quals = NIL;
+	foreach (lc, baserel->baserestrictinfo)
+	{
+		RestrictInfo   *rinfo = lfirst(lc);
+
+		if (prune && prune->npruned > 0 &&
+			list_member_ptr(prune->quals, rinfo->clause))
+			continue;
+		scan_quals = lappend(scan_quals, rinfo);
+	}
 	baserel->rows = ntuples *
 		clauselist_selectivity(root,
-							   baserel->baserestrictinfo,
+							   scan_quals,
 							   0,
 							   JOIN_INNER,
 							   NULL);
@@ -486,18 +1014,21 @@ ArrowGetForeignRelSize(PlannerInfo *root,
 /*
  * GetOptimalGpuForArrowFdw
  *
- * optimal GPU index is saved at baserel->fdw_private
+ * optimal GPU index is saved at arrowFdwRelInfo of baserel->fdw_private
  */
 cl_int
 GetOptimalGpuForArrowFdw(PlannerInfo *root, RelOptInfo *baserel)
 {
+	arrowFdwRelInfo *rel_info;
+
 	if (!baserel->fdw_private)
 	{
 		RangeTblEntry *rte = root->simple_rte_array[baserel->relid];
 
 		ArrowGetForeignRelSize(root, baserel, rte->relid);
 	}
-	return intVal(baserel->fdw_private);
+	rel_info = baserel->fdw_private;
+	return rel_info->optimal_gpu;
 }
 
 static void
@@ -507,11 +1038,13 @@ cost_arrow_fdw_seqscan(Path *path,
 					   ParamPathInfo *param_info,
 					   int num_workers)
 {
+	arrowFdwRelInfo *rel_info = baserel->fdw_private;
 	Cost		startup_cost = 0.0;
 	Cost		disk_run_cost = 0.0;
 	Cost		cpu_run_cost = 0.0;
 	QualCost	qcost;
 	double		nrows;
+	double		npages_cached;
 	double		spc_seq_page_cost;
 
 	if (param_info)
@@ -526,14 +1059,17 @@ cost_arrow_fdw_seqscan(Path *path,
 	/*
 	 * Storage costs
 	 *
-	 * XXX - smaller number of columns to read shall have less disk cost
-	 * because of columnar format. Right now, we don't discount cost for
-	 * the pages not to be read.
+	 * baserel->pages counts only the referenced columns of the RecordBatches
+	 * not to be skipped by the min/max statistics, because of columnar format.
+	 * Pages already in the page cache need no disk i/o, so we charge them
+	 * only cpu_tuple_cost per page, like a memory copy.
 	 */
 	get_tablespace_page_costs(baserel->reltablespace,
 							  NULL,
 							  &spc_seq_page_cost);
-	disk_run_cost = spc_seq_page_cost * baserel->pages;
+	npages_cached = Min(rel_info->npages_cached, (double)baserel->pages);
+	disk_run_cost = (spc_seq_page_cost * (baserel->pages - npages_cached) +
+					 cpu_tuple_cost * npages_cached);
 
 	/* CPU costs */
 	if (param_info)
@@ -545,7 +1081,7 @@ cost_arrow_fdw_seqscan(Path *path,
 	else
 		qcost = baserel->baserestrictcost;
 	startup_cost += qcost.startup;
-	cpu_run_cost = (cpu_tuple_cost + qcost.per_tuple) * baserel->tuples;
+	cpu_run_cost = (cpu_tuple_cost + qcost.per_tuple) * rel_info->ntuples_scan;
 
 	/* tlist evaluation costs */
 	startup_cost += path->pathtarget->cost.startup;
@@ -640,9 +1176,13 @@ ArrowGetForeignPlan(PlannerInfo *root,
 {
 	Bitmapset  *referenced = NULL;
 	List	   *ref_list = NIL;
+	int64		scan_bound = 0;
 	ListCell   *lc;
 	int			i, j, k;
 
+	if (baserel->reloptkind == RELOPT_UPPER_REL)
+		return arrowFdwMakeAggregatePlan(baserel, best_path,
+										 tlist, outer_plan);
 	Assert(IS_SIMPLE_REL(baserel));
 	/* pick up referenced attributes */
 	foreach (lc, baserel->baserestrictinfo)
@@ -668,11 +1208,23 @@ ArrowGetForeignPlan(PlannerInfo *root,
 	}
 	bms_free(referenced);
 
+	/*
+	 * LIMIT bound, if the scan result is consumed by the Limit node with
+	 * neither join, sort nor aggregation. It is a hint to load the leading
+	 * RecordBatches by small row-ranges, so scan qualifiers don't matter.
+	 * (root->limit_tuples is already -1, if grouping or aggregation.)
+	 */
+	if (root->limit_tuples > 0.0 &&
+		root->parse->sortClause == NIL &&
+		bms_membership(root->all_baserels) == BMS_SINGLETON)
+		scan_bound = (int64)Min(root->limit_tuples, (double)INT_MAX);
+
 	return make_foreignscan(tlist,
 							extract_actual_clauses(scan_clauses, false),
 							baserel->relid,
 							NIL,	/* no expressions to evaluate */
-							ref_list, /* list of referenced attnums */
+							list_make2(ref_list,	/* referenced attnums */
+									   makeInteger(scan_bound)),
 							NIL,	/* no custom tlist */
 							NIL,	/* no remote quals */
 							outer_plan);
@@ -680,10 +1232,12 @@ ArrowGetForeignPlan(PlannerInfo *root,
 
 typedef struct
 {
+	ArrowFileInfo  *af_info;
 	ArrowBuffer    *buffer_curr;
 	ArrowBuffer    *buffer_tail;
 	ArrowFieldNode *fnode_curr;
 	ArrowFieldNode *fnode_tail;
+	bool			compressed;	/* buffer length is compressed one */
 } setupRecordBatchContext;
 
 static void
@@ -740,6 +1294,104 @@ assignArrowTypeOptions(ArrowTypeOptions *attopts, const ArrowType *atype)
 	}
 }
 
+/*
+ * setupRecordBatchDictionary
+ *
+ * A dictionary-encoded field has nullmap and indices in the RecordBatch,
+ * and the values are in the DictionaryBatch identified by the dictionary-id.
+ * Only Utf8/Binary values at the top level are supported right now.
+ */
+static void
+setupRecordBatchDictionary(setupRecordBatchContext *con,
+						   RecordBatchFieldState *fstate,
+						   ArrowField *field,
+						   int depth)
+{
+	ArrowDictionaryEncoding *dict = field->dictionary;
+	ArrowFileInfo  *af_info = con->af_info;
+	ArrowBuffer	   *buffer_curr;
+	int				bitWidth = dict->indexType.bitWidth;
+	bool			found = false;
+	int				i;
+
+	if (depth > 0)
+		elog(ERROR, "dictionary-encoded sub-field is not supported");
+	if (field->type.node.tag != ArrowNodeTag__Utf8 &&
+		field->type.node.tag != ArrowNodeTag__Binary)
+		elog(ERROR, "dictionary-encoded Arrow.%s is not supported",
+			 arrowTypeName(field));
+	if (bitWidth == 0)
+		bitWidth = 32;		/* default: Int32 */
+	if (bitWidth != 8 && bitWidth != 16 && bitWidth != 32 && bitWidth != 64)
+		elog(ERROR, "Not a supported index width of dictionary: %d",
+			 bitWidth);
+	fstate->dict_unitsz = bitWidth / BITS_PER_BYTE;
+
+	/* nullmap and indices */
+	if (con->buffer_curr + 2 > con->buffer_tail)
+		elog(ERROR, "RecordBatch has less buffers than expected");
+	buffer_curr = con->buffer_curr++;
+	if (fstate->null_count > 0)
+	{
+		fstate->nullmap_offset = buffer_curr->offset;
+		fstate->nullmap_length = buffer_curr->length;
+		if (!con->compressed &&
+			fstate->nullmap_length < BITMAPLEN(fstate->nitems))
+			elog(ERROR, "nullmap length is smaller than expected");
+		if ((fstate->nullmap_offset & (MAXIMUM_ALIGNOF - 1)) != 0 ||
+			(!con->compressed &&
+			 (fstate->nullmap_length & (MAXIMUM_ALIGNOF - 1)) != 0))
+			elog(ERROR, "nullmap is not aligned well");
+	}
+	buffer_curr = con->buffer_curr++;
+	fstate->values_offset = buffer_curr->offset;
+	fstate->values_length = buffer_curr->length;
+	if (!con->compressed &&
+		fstate->values_length < fstate->dict_unitsz * fstate->nitems)
+		elog(ERROR, "indices array is smaller than expected");
+	if ((fstate->values_offset & (MAXIMUM_ALIGNOF - 1)) != 0 ||
+		(!con->compressed &&
+		 (fstate->values_length & (MAXIMUM_ALIGNOF - 1)) != 0))
+		elog(ERROR, "indices array is not aligned well");
+
+	/* lookup the DictionaryBatch */
+	for (i=0; i < af_info->footer._num_dictionaries; i++)
+	{
+		ArrowBlock	   *block = &af_info->footer.dictionaries[i];
+		ArrowDictionaryBatch *dbatch
+			= &af_info->dictionaries[i].body.dictionaryBatch;
+		ArrowRecordBatch *data = &dbatch->data;
+		off_t			body_offset;
+
+		if (dbatch->id != dict->id)
+			continue;
+		if (found || dbatch->isDelta)
+			elog(ERROR, "delta or replacement of DictionaryBatch (id=%ld) is not supported",
+				 dict->id);
+		if (data->_num_nodes != 1 || data->_num_buffers != 3)
+			elog(ERROR, "DictionaryBatch (id=%ld) has unexpected layout",
+				 dict->id);
+		if (data->compression)
+			elog(ERROR, "compressed DictionaryBatch (id=%ld) is not supported",
+				 dict->id);
+		if (data->nodes[0].null_count > 0)
+			elog(ERROR, "DictionaryBatch (id=%ld) that contains NULL is not supported",
+				 dict->id);
+		body_offset = block->offset + block->metaDataLength;
+		fstate->dict_nitems = data->nodes[0].length;
+		fstate->dict_values_offset = body_offset + data->buffers[1].offset;
+		fstate->dict_values_length = data->buffers[1].length;
+		fstate->dict_extra_offset  = body_offset + data->buffers[2].offset;
+		fstate->dict_extra_length  = data->buffers[2].length;
+		if (fstate->dict_values_length <
+			sizeof(cl_uint) * (fstate->dict_nitems + 1))
+			elog(ERROR, "offset array of DictionaryBatch is smaller than expected");
+		found = true;
+	}
+	if (!found)
+		elog(ERROR, "DictionaryBatch (id=%ld) was not found", dict->id);
+}
+
 static void
 setupRecordBatchField(setupRecordBatchContext *con,
 					  RecordBatchFieldState *fstate,
@@ -756,6 +1408,13 @@ setupRecordBatchField(setupRecordBatchContext *con,
 	fstate->nitems     = fnode->length;
 	fstate->null_count = fnode->null_count;
 
+	if (field->dictionary)
+	{
+		setupRecordBatchDictionary(con, fstate, field, depth);
+		assignArrowTypeOptions(&fstate->attopts, &field->type);
+		return;
+	}
+
 	switch (field->type.node.tag)
 	{
 		case ArrowNodeTag__Int:
@@ -775,19 +1434,23 @@ setupRecordBatchField(setupRecordBatchContext *con,
 			{
 				fstate->nullmap_offset = buffer_curr->offset;
 				fstate->nullmap_length = buffer_curr->length;
-				if (fstate->nullmap_length < BITMAPLEN(fstate->nitems))
+				if (!con->compressed &&
+					fstate->nullmap_length < BITMAPLEN(fstate->nitems))
 					elog(ERROR, "nullmap length is smaller than expected");
 				if ((fstate->nullmap_offset & (MAXIMUM_ALIGNOF - 1)) != 0 ||
-					(fstate->nullmap_length & (MAXIMUM_ALIGNOF - 1)) != 0)
+					(!con->compressed &&
+					 (fstate->nullmap_length & (MAXIMUM_ALIGNOF - 1)) != 0))
 					elog(ERROR, "nullmap is not aligned well");
 			}
 			buffer_curr = con->buffer_curr++;
 			fstate->values_offset = buffer_curr->offset;
 			fstate->values_length = buffer_curr->length;
-			if (fstate->values_length < arrowFieldLength(field,fstate->nitems))
+			if (!con->compressed &&
+				fstate->values_length < arrowFieldLength(field,fstate->nitems))
 				elog(ERROR, "values array is smaller than expected");
 			if ((fstate->values_offset & (MAXIMUM_ALIGNOF - 1)) != 0 ||
-				(fstate->values_length & (MAXIMUM_ALIGNOF - 1)) != 0)
+				(!con->compressed &&
+				 (fstate->values_length & (MAXIMUM_ALIGNOF - 1)) != 0))
 				elog(ERROR, "values array is not aligned well");
 			break;
 
@@ -804,20 +1467,24 @@ setupRecordBatchField(setupRecordBatchContext *con,
 			{
 				fstate->nullmap_offset = buffer_curr->offset;
 				fstate->nullmap_length = buffer_curr->length;
-				if (fstate->nullmap_length < BITMAPLEN(fstate->nitems))
+				if (!con->compressed &&
+					fstate->nullmap_length < BITMAPLEN(fstate->nitems))
 					elog(ERROR, "nullmap length is smaller than expected");
 				if ((fstate->nullmap_offset & (MAXIMUM_ALIGNOF - 1)) != 0 ||
-					(fstate->nullmap_length & (MAXIMUM_ALIGNOF - 1)) != 0)
+					(!con->compressed &&
+					 (fstate->nullmap_length & (MAXIMUM_ALIGNOF - 1)) != 0))
 					elog(ERROR, "nullmap is not aligned well");
 			}
 			/* offset values */
 			buffer_curr = con->buffer_curr++;
 			fstate->values_offset = buffer_curr->offset;
 			fstate->values_length = buffer_curr->length;
-			if (fstate->values_length < arrowFieldLength(field,fstate->nitems))
+			if (!con->compressed &&
+				fstate->values_length < arrowFieldLength(field,fstate->nitems))
 				elog(ERROR, "offset array is smaller than expected");
 			if ((fstate->values_offset & (MAXIMUM_ALIGNOF - 1)) != 0 ||
-				(fstate->values_length & (MAXIMUM_ALIGNOF - 1)) != 0)
+				(!con->compressed &&
+				 (fstate->values_length & (MAXIMUM_ALIGNOF - 1)) != 0))
 				elog(ERROR, "offset array is not aligned well");
 			/* setup array element */
 			fstate->children = palloc0(sizeof(RecordBatchFieldState));
@@ -838,27 +1505,32 @@ setupRecordBatchField(setupRecordBatchContext *con,
 			{
 				fstate->nullmap_offset = buffer_curr->offset;
 				fstate->nullmap_length = buffer_curr->length;
-				if (fstate->nullmap_length < BITMAPLEN(fstate->nitems))
+				if (!con->compressed &&
+					fstate->nullmap_length < BITMAPLEN(fstate->nitems))
 					elog(ERROR, "nullmap length is smaller than expected");
 				if ((fstate->nullmap_offset & (MAXIMUM_ALIGNOF - 1)) != 0 ||
-					(fstate->nullmap_length & (MAXIMUM_ALIGNOF - 1)) != 0)
+					(!con->compressed &&
+					 (fstate->nullmap_length & (MAXIMUM_ALIGNOF - 1)) != 0))
 					elog(ERROR, "nullmap is not aligned well");
 			}
 
 			buffer_curr = con->buffer_curr++;
 			fstate->values_offset = buffer_curr->offset;
 			fstate->values_length = buffer_curr->length;
-			if (fstate->values_length < arrowFieldLength(field,fstate->nitems))
+			if (!con->compressed &&
+				fstate->values_length < arrowFieldLength(field,fstate->nitems))
 				elog(ERROR, "offset array is smaller than expected");
 			if ((fstate->values_offset & (MAXIMUM_ALIGNOF - 1)) != 0 ||
-				(fstate->values_length & (MAXIMUM_ALIGNOF - 1)) != 0)
+				(!con->compressed &&
+				 (fstate->values_length & (MAXIMUM_ALIGNOF - 1)) != 0))
 				elog(ERROR, "offset array is not aligned well");
 
 			buffer_curr = con->buffer_curr++;
 			fstate->extra_offset = buffer_curr->offset;
 			fstate->extra_length = buffer_curr->length;
 			if ((fstate->extra_offset & (MAXIMUM_ALIGNOF - 1)) != 0 ||
-				(fstate->extra_length & (MAXIMUM_ALIGNOF - 1)) != 0)
+				(!con->compressed &&
+				 (fstate->extra_length & (MAXIMUM_ALIGNOF - 1)) != 0))
 				elog(ERROR, "extra buffer is not aligned well");
 			break;
 
@@ -873,10 +1545,12 @@ setupRecordBatchField(setupRecordBatchContext *con,
 			{
 				fstate->nullmap_offset = buffer_curr->offset;
 				fstate->nullmap_length = buffer_curr->length;
-				if (fstate->nullmap_length < BITMAPLEN(fstate->nitems))
+				if (!con->compressed &&
+					fstate->nullmap_length < BITMAPLEN(fstate->nitems))
 					elog(ERROR, "nullmap length is smaller than expected");
 				if ((fstate->nullmap_offset & (MAXIMUM_ALIGNOF - 1)) != 0 ||
-					(fstate->nullmap_length & (MAXIMUM_ALIGNOF - 1)) != 0)
+					(!con->compressed &&
+					 (fstate->nullmap_length & (MAXIMUM_ALIGNOF - 1)) != 0))
 					elog(ERROR, "nullmap is not aligned well");
 			}
 
@@ -904,10 +1578,11 @@ setupRecordBatchField(setupRecordBatchContext *con,
 }
 
 static RecordBatchState *
-makeRecordBatchState(ArrowSchema *schema,
+makeRecordBatchState(ArrowFileInfo *af_info,
 					 ArrowBlock *block,
 					 ArrowRecordBatch *rbatch)
 {
+	ArrowSchema	   *schema = &af_info->footer.schema;
 	setupRecordBatchContext con;
 	RecordBatchState *result;
 	int			j, ncols = schema->_num_fields;
@@ -917,8 +1592,15 @@ makeRecordBatchState(ArrowSchema *schema,
 	result->rb_offset = block->offset + block->metaDataLength;
 	result->rb_length = block->bodyLength;
 	result->rb_nitems = rbatch->length;
+	if (rbatch->compression)
+	{
+		result->rb_compressed = true;
+		result->rb_codec = rbatch->compression->codec;
+	}
 
 	memset(&con, 0, sizeof(setupRecordBatchContext));
+	con.af_info     = af_info;
+	con.compressed  = result->rb_compressed;
 	con.buffer_curr = rbatch->buffers;
 	con.buffer_tail = rbatch->buffers + rbatch->_num_buffers;
 	con.fnode_curr  = rbatch->nodes;
@@ -939,441 +1621,4224 @@ makeRecordBatchState(ArrowSchema *schema,
 }
 
 /*
- * ExecInitArrowFdw
+ * setupRecordBatchStatistics
+ *
+ * Arrow files may have per-RecordBatch min/max statistics of the fields in
+ * the custom_metadata of the Footer schema, using "min_values" and
+ * "max_values" keys. Each value is a comma separated list with one token
+ * per RecordBatch, in the native representation of the Arrow type (e.g,
+ * Timestamp is a number of 'unit' since the UNIX epoch). An empty token
+ * means the RecordBatch has no statistics on the field.
+ * Likewise, "bloom_filter" key has the offsets of the bloom filters in the
+ * sidecar file (see arrow_ipc.h).
  */
-ArrowFdwState *
-ExecInitArrowFdw(Relation relation, Bitmapset *outer_refs)
+static char **
+__splitArrowStatsValues(const char *values, int nitems)
 {
-	TupleDesc		tupdesc = RelationGetDescr(relation);
-	ForeignTable   *ft = GetForeignTable(RelationGetRelid(relation));
-	List		   *filesList = NIL;
-	List		   *fdescList = NIL;
-	Bitmapset	   *referenced = NULL;
-	bool			whole_row_ref = false;
-	ArrowFdwState  *af_state;
-	List		   *rb_state_list = NIL;
-	ListCell	   *lc;
-	bool			writable;
-	int				i, num_rbatches;
+	char	  **tokens = palloc0(sizeof(char *) * nitems);
+	char	   *tok = pstrdup(values);
+	char	   *pos;
+	char	   *tail;
+	int			count = 0;
 
-	Assert(RelationGetForm(relation)->relkind == RELKIND_FOREIGN_TABLE &&
-		   memcmp(GetFdwRoutineForRelation(relation, false),
-				  &pgstrom_arrow_fdw_routine, sizeof(FdwRoutine)) == 0);
-	/* expand 'referenced' if it has whole-row reference */
-	if (bms_is_member(-FirstLowInvalidHeapAttributeNumber, outer_refs))
-		whole_row_ref = true;
-	for (i=0; i < tupdesc->natts; i++)
+	for (;;)
 	{
-		Form_pg_attribute attr = tupleDescAttr(tupdesc, i);
-		int		k = attr->attnum - FirstLowInvalidHeapAttributeNumber;
-
-		if (attr->attisdropped)
-			continue;
-		if (whole_row_ref || bms_is_member(k, outer_refs))
-			referenced = bms_add_member(referenced, k);
+		pos = strchr(tok, ',');
+		if (pos)
+			*pos = '\0';
+		if (count >= nitems)
+			return NULL;	/* too many tokens */
+		while (isspace(*tok))
+			tok++;
+		tail = tok + strlen(tok);
+		while (tail > tok && isspace(tail[-1]))
+			*--tail = '\0';
+		tokens[count++] = tok;
+		if (!pos)
+			break;
+		tok = pos + 1;
 	}
+	if (count != nitems)
+		return NULL;	/* too short tokens */
+	return tokens;
+}
 
-	filesList = __arrowFdwExtractFilesList(ft->options,
-										   NULL,
-										   &writable);
-	foreach (lc, filesList)
+static bool
+__parseArrowStatsDatum(ArrowField *field, RecordBatchFieldState *fstate,
+					   const char *token, Datum *p_datum)
+{
+	ArrowType  *t = &field->type;
+	char	   *end;
+	int64		ival = 0;
+	double		fval = 0.0;
+
+	if (*token == '\0')
+		return false;
+	errno = 0;
+	if (t->node.tag == ArrowNodeTag__FloatingPoint)
+		fval = strtod(token, &end);
+	else
+		ival = strtol(token, &end, 10);
+	if (*end != '\0' || errno != 0)
+		return false;
+
+	switch (t->node.tag)
 	{
-		char	   *fname = strVal(lfirst(lc));
-		File		fdesc;
-		List	   *rb_cached = NIL;
-		ListCell   *cell;
+		case ArrowNodeTag__Int:
+			switch (fstate->atttypid)
+			{
+				case INT2OID:
+					if (ival < SHRT_MIN || ival > SHRT_MAX)
+						return false;
+					*p_datum = Int16GetDatum(ival);
+					break;
+				case INT4OID:
+					if (ival < INT_MIN || ival > INT_MAX)
+						return false;
+					*p_datum = Int32GetDatum(ival);
+					break;
+				case INT8OID:
+					*p_datum = Int64GetDatum(ival);
+					break;
+				default:
+					return false;
+			}
+			break;
 
-		fdesc = PathNameOpenFile(fname, O_RDONLY | PG_BINARY);
-		if (fdesc < 0)
-		{
-			if (writable && errno == ENOENT)
-				continue;
-			elog(ERROR, "failed to open '%s' on behalf of '%s'",
-				 fname, RelationGetRelationName(relation));
-		}
-		fdescList = lappend_int(fdescList, fdesc);
+		case ArrowNodeTag__FloatingPoint:
+			if (fstate->atttypid == FLOAT4OID)
+				*p_datum = Float4GetDatum((float4)fval);
+			else if (fstate->atttypid == FLOAT8OID)
+				*p_datum = Float8GetDatum(fval);
+			else
+				return false;	/* float2 is not supported */
+			break;
 
-		rb_cached = arrowLookupOrBuildMetadataCache(fdesc);
-		/* check schema compatibility */
-		foreach (cell, rb_cached)
-		{
-			RecordBatchState   *rb_state = lfirst(cell);
+		case ArrowNodeTag__Date:
+			/* see pg_date_arrow_ref */
+			if (t->Date.unit != ArrowDateUnit__Day ||
+				ival < INT_MIN || ival > INT_MAX)
+				return false;
+			ival -= (POSTGRES_EPOCH_JDATE - UNIX_EPOCH_JDATE);
+			*p_datum = DateADTGetDatum(ival);
+			break;
 
-			if (!arrowSchemaCompatibilityCheck(tupdesc, rb_state))
-				elog(ERROR, "arrow file '%s' on behalf of foreign table '%s' has incompatible schema definition",
-					 fname, RelationGetRelationName(relation));
-		}
-		rb_state_list = list_concat(rb_state_list, rb_cached);
+		case ArrowNodeTag__Time:
+			/* see pg_time_arrow_ref */
+			switch (t->Time.unit)
+			{
+				case ArrowTimeUnit__Second:
+					ival *= 1000000L;
+					break;
+				case ArrowTimeUnit__MilliSecond:
+					ival *= 1000L;
+					break;
+				case ArrowTimeUnit__MicroSecond:
+					break;
+				case ArrowTimeUnit__NanoSecond:
+					ival /= 1000L;
+					break;
+				default:
+					return false;
+			}
+			*p_datum = TimeADTGetDatum(ival);
+			break;
+
+		case ArrowNodeTag__Timestamp:
+			/* see pg_timestamp_arrow_ref */
+			switch (t->Timestamp.unit)
+			{
+				case ArrowTimeUnit__Second:
+					ival *= 1000000L;
+					break;
+				case ArrowTimeUnit__MilliSecond:
+					ival *= 1000L;
+					break;
+				case ArrowTimeUnit__MicroSecond:
+					break;
+				case ArrowTimeUnit__NanoSecond:
+					ival /= 1000L;
+					break;
+				default:
+					return false;
+			}
+			ival -= (POSTGRES_EPOCH_JDATE - UNIX_EPOCH_JDATE) * USECS_PER_DAY;
+			*p_datum = TimestampGetDatum(ival);
+			break;
+
+		default:
+			return false;
+	}
+	return true;
+}
+
+static void
+setupRecordBatchStatistics(List *rb_state_list, ArrowSchema *schema)
+{
+	int			nitems = list_length(rb_state_list);
+	int			i, j, k;
+
+	if (nitems == 0)
+		return;
+	for (j=0; j < schema->_num_fields; j++)
+	{
+		ArrowField *field = &schema->fields[j];
+		const char *min_values = NULL;
+		const char *max_values = NULL;
+		const char *bloom_offsets = NULL;
+		char	  **min_tokens;
+		char	  **max_tokens;
+		char	  **bloom_tokens;
+		ListCell   *lc;
+
+		for (k=0; k < field->_num_custom_metadata; k++)
+		{
+			ArrowKeyValue *kv = &field->custom_metadata[k];
+
+			if (!kv->key || !kv->value)
+				continue;
+			if (strcmp(kv->key, ARROW_STATS_MIN_VALUES) == 0)
+				min_values = kv->value;
+			else if (strcmp(kv->key, ARROW_STATS_MAX_VALUES) == 0)
+				max_values = kv->value;
+			else if (strcmp(kv->key, ARROW_BLOOM_FILTER) == 0)
+				bloom_offsets = kv->value;
+		}
+
+		if (bloom_offsets)
+		{
+			bloom_tokens = __splitArrowStatsValues(bloom_offsets, nitems);
+			if (!bloom_tokens)
+				elog(DEBUG2, "arrow_fdw: bloom filter of field '%s' mismatch to the number of RecordBatches (%d), ignored",
+					 field->name, nitems);
+			else
+			{
+				i = 0;
+				foreach (lc, rb_state_list)
+				{
+					RecordBatchState *rb_state = lfirst(lc);
+					char	   *end;
+					long		offset;
+
+					errno = 0;
+					offset = strtol(bloom_tokens[i], &end, 10);
+					if (*bloom_tokens[i] != '\0' &&
+						*end == '\0' && errno == 0 && offset > 0)
+						rb_state->columns[j].bloom_offset = offset;
+					i++;
+				}
+			}
+		}
+
+		if (!min_values || !max_values)
+			continue;
+
+		min_tokens = __splitArrowStatsValues(min_values, nitems);
+		max_tokens = __splitArrowStatsValues(max_values, nitems);
+		if (!min_tokens || !max_tokens)
+		{
+			elog(DEBUG2, "arrow_fdw: min/max statistics of field '%s' mismatch to the number of RecordBatches (%d), ignored",
+				 field->name, nitems);
+			continue;
+		}
+
+		i = 0;
+		foreach (lc, rb_state_list)
+		{
+			RecordBatchState *rb_state = lfirst(lc);
+			RecordBatchFieldState *fstate = &rb_state->columns[j];
+			Datum		min_datum;
+			Datum		max_datum;
+
+			if (__parseArrowStatsDatum(field, fstate,
+									   min_tokens[i], &min_datum) &&
+				__parseArrowStatsDatum(field, fstate,
+									   max_tokens[i], &max_datum))
+			{
+				fstate->stat_valid = true;
+				fstate->stat_min = min_datum;
+				fstate->stat_max = max_datum;
+			}
+			i++;
+		}
+	}
+}
+
+/*
+ * arrowFdwSetupStatsHint
+ *
+ * It picks up qualifiers in the form of (Var OP Expr) from the scan quals,
+ * where OP is a btree comparison operator and Expr contains no Vars and no
+ * volatile functions, to skip RecordBatches that never match according to
+ * the min/max statistics.
+ * If 'ss' is NULL, it is built by the planner to estimate the RecordBatches
+ * to be skipped, so only Expr which can be reduced to Const are picked up.
+ * Equality operators are also checked with the bloom filter of RecordBatch
+ * on the executor, if any.
+ */
+static bool
+__arrowStatsHintIsSupportedType(Oid type_oid)
+{
+	switch (type_oid)
+	{
+		case INT2OID:
+		case INT4OID:
+		case INT8OID:
+		case FLOAT4OID:
+		case FLOAT8OID:
+		case DATEOID:
+		case TIMEOID:
+		case TIMESTAMPOID:
+		case TIMESTAMPTZOID:
+			return true;
+		default:
+			return false;
+	}
+}
+
+static bool
+__arrowBloomHintIsSupportedType(Oid type_oid)
+{
+	switch (type_oid)
+	{
+		case INT2OID:
+		case INT4OID:
+		case INT8OID:
+		case TEXTOID:
+		case VARCHAROID:
+		case BYTEAOID:
+			return true;
+		default:
+			return false;
+	}
+}
+
+static Var *
+__arrowStatsHintGetVar(Node *node, Oid *p_vartype)
+{
+	Oid		vartype = exprType(node);
+
+	/* binary compatible relabeling, like varchar -> text */
+	if (IsA(node, RelabelType))
+		node = (Node *)((RelabelType *)node)->arg;
+	if (!IsA(node, Var))
+		return NULL;
+	*p_vartype = vartype;
+	return (Var *)node;
+}
+
+static void
+__addArrowBloomHintItem(arrowStatsHint *stats_hint, ScanState *ss,
+						AttrNumber attnum, Oid vartype, Expr *arg)
+{
+	arrowStatsHintItem *item = &stats_hint->items[stats_hint->nitems++];
+
+	Assert(ss != NULL);
+	item->anum = attnum - 1;
+	item->use_bloom = true;
+	item->bloom_type = vartype;
+	item->arg_state = ExecInitExpr(arg, &ss->ps);
+}
+
+static void
+__addArrowStatsHintItem(arrowStatsHint *stats_hint, ScanState *ss,
+						AttrNumber attnum, bool use_max,
+						Oid opno, Oid collid, Expr *arg)
+{
+	arrowStatsHintItem *item = &stats_hint->items[stats_hint->nitems++];
+
+	item->anum = attnum - 1;
+	item->use_max = use_max;
+	fmgr_info(get_opcode(opno), &item->opcode);
+	item->collid = collid;
+	if (ss)
+		item->arg_state = ExecInitExpr(arg, &ss->ps);
+	else
+	{
+		item->arg_value = ((Const *)arg)->constvalue;
+		item->arg_isnull = ((Const *)arg)->constisnull;
+	}
+}
+
+static arrowStatsHint *
+__arrowFdwSetupStatsHint(PlannerInfo *root, ScanState *ss,
+						 TupleDesc tupdesc, Index scanrelid,
+						 List *outer_quals)
+{
+	arrowStatsHint *stats_hint;
+	ListCell   *lc;
+
+	stats_hint = palloc0(offsetof(arrowStatsHint,
+								  items[3 * list_length(outer_quals)]));
+	stats_hint->bloom_file = -1;
+	if (ss)
+		stats_hint->econtext = ss->ps.ps_ExprContext;
+	else
+		stats_hint->args_ready = true;
+	foreach (lc, outer_quals)
+	{
+		OpExpr	   *op = lfirst(lc);
+		Var		   *var;
+		Oid			vartype;
+		Expr	   *arg;
+		Oid			opno;
+		bool		stats_ok;
+		bool		bloom_ok;
+		List	   *bti_list;
+		ListCell   *cell;
+
+		if (!IsA(op, OpExpr) || list_length(op->args) != 2)
+			continue;
+		if ((var = __arrowStatsHintGetVar(linitial(op->args),
+										  &vartype)) != NULL)
+		{
+			arg = lsecond(op->args);
+			opno = op->opno;
+		}
+		else if ((var = __arrowStatsHintGetVar(lsecond(op->args),
+											   &vartype)) != NULL)
+		{
+			arg = linitial(op->args);
+			opno = get_commutator(op->opno);
+			if (!OidIsValid(opno))
+				continue;
+		}
+		else
+			continue;
+
+		stats_ok = __arrowStatsHintIsSupportedType(vartype);
+		/* bloom filter is probed only by the executor */
+		bloom_ok = (ss != NULL && __arrowBloomHintIsSupportedType(vartype));
+#if PG_VERSION_NUM >= 120000
+		/* bloom filter hashes the binary image, so collation must agree */
+		if (bloom_ok &&
+			OidIsValid(op->inputcollid) &&
+			!get_collation_isdeterministic(op->inputcollid))
+			bloom_ok = false;
+#endif
+		if (var->varno != scanrelid ||
+			var->varlevelsup > 0 ||
+			var->varattno <= 0 ||
+			var->varattno > tupdesc->natts ||
+			(!stats_ok && !bloom_ok) ||
+			contain_var_clause((Node *)arg) ||
+			contain_volatile_functions((Node *)arg))
+			continue;
+		if (!ss)
+		{
+			arg = (Expr *)estimate_expression_value(root, (Node *)arg);
+			if (!IsA(arg, Const))
+				continue;
+		}
+
+		bti_list = get_op_btree_interpretation(opno);
+		foreach (cell, bti_list)
+		{
+			OpBtreeInterpretation *bti = lfirst(cell);
+			Oid		le_opno;
+			Oid		ge_opno;
+			int		nitems_saved = stats_hint->nitems;
+
+			if (bti->oplefttype != vartype)
+				continue;
+			switch (bti->strategy)
+			{
+				case BTLessStrategyNumber:
+				case BTLessEqualStrategyNumber:
+					/* (Var < Expr) may be true only if (min < Expr) */
+					if (!stats_ok)
+						continue;
+					__addArrowStatsHintItem(stats_hint, ss,
+											var->varattno, false,
+											opno, op->inputcollid, arg);
+					break;
+				case BTGreaterStrategyNumber:
+				case BTGreaterEqualStrategyNumber:
+					/* (Var > Expr) may be true only if (max > Expr) */
+					if (!stats_ok)
+						continue;
+					__addArrowStatsHintItem(stats_hint, ss,
+											var->varattno, true,
+											opno, op->inputcollid, arg);
+					break;
+				case BTEqualStrategyNumber:
+					/* (Var = Expr) may be true only if min <= Expr <= max */
+					le_opno = get_opfamily_member(bti->opfamily_id,
+												  bti->oplefttype,
+												  bti->oprighttype,
+												  BTLessEqualStrategyNumber);
+					ge_opno = get_opfamily_member(bti->opfamily_id,
+												  bti->oplefttype,
+												  bti->oprighttype,
+												  BTGreaterEqualStrategyNumber);
+					if (stats_ok &&
+						OidIsValid(le_opno) && OidIsValid(ge_opno))
+					{
+						__addArrowStatsHintItem(stats_hint, ss,
+												var->varattno, false,
+												le_opno, op->inputcollid, arg);
+						__addArrowStatsHintItem(stats_hint, ss,
+												var->varattno, true,
+												ge_opno, op->inputcollid, arg);
+					}
+					/* ...and only if bloom filter may contain Expr */
+					if (bloom_ok && bti->oprighttype == vartype)
+						__addArrowBloomHintItem(stats_hint, ss,
+												var->varattno, vartype, arg);
+					if (stats_hint->nitems == nitems_saved)
+						continue;
+					break;
+				default:
+					continue;
+			}
+			stats_hint->hint_quals = lappend(stats_hint->hint_quals, op);
+			break;
+		}
+		list_free_deep(bti_list);
+	}
+
+	if (stats_hint->nitems == 0)
+	{
+		pfree(stats_hint);
+		return NULL;
+	}
+	return stats_hint;
+}
+
+static arrowStatsHint *
+arrowFdwSetupStatsHint(ScanState *ss, List *outer_quals)
+{
+	return __arrowFdwSetupStatsHint(NULL, ss,
+									RelationGetDescr(ss->ss_currentRelation),
+									((Scan *)ss->ps.plan)->scanrelid,
+									outer_quals);
+}
+
+/*
+ * arrowFdwCheckBloomFilter
+ *
+ * It returns false if the bloom filter of the RecordBatch never contains
+ * the argument of the hint item. Only the words of the bitmap to be probed
+ * are read from the sidecar file.
+ */
+static uint64
+__arrowBloomHintHash(Oid type_oid, Datum datum)
+{
+	struct varlena *vl;
+	int64		ival;
+
+	switch (type_oid)
+	{
+		case INT2OID:
+			ival = DatumGetInt16(datum);
+			break;
+		case INT4OID:
+			ival = DatumGetInt32(datum);
+			break;
+		case INT8OID:
+			ival = DatumGetInt64(datum);
+			break;
+		case TEXTOID:
+		case VARCHAROID:
+		case BYTEAOID:
+			vl = pg_detoast_datum_packed((struct varlena *)
+										 DatumGetPointer(datum));
+			return arrowBloomFilterHash(VARDATA_ANY(vl),
+										VARSIZE_ANY_EXHDR(vl));
+		default:
+			elog(ERROR, "Bug? unexpected type for bloom filter: %s",
+				 format_type_be(type_oid));
+	}
+	return arrowBloomFilterHash(&ival, sizeof(int64));
+}
+
+static bool
+__arrowFdwCheckBloomFilter(arrowStatsHint *stats_hint,
+						   RecordBatchState *rb_state,
+						   arrowStatsHintItem *item)
+{
+	RecordBatchFieldState *fstate = &rb_state->columns[item->anum];
+	ArrowBloomFilter bloom;
+	off_t		base = fstate->bloom_offset;
+	int			fdesc;
+	int			k;
+
+	/* open the sidecar file of the arrow file, if not yet */
+	if (!stats_hint->bloom_file_valid ||
+		stats_hint->bloom_st_dev != rb_state->stat_buf.st_dev ||
+		stats_hint->bloom_st_ino != rb_state->stat_buf.st_ino)
+	{
+		char   *fname = psprintf("%s%s", FilePathName(rb_state->fdesc),
+								 ARROW_BLOOM_FILTER_SUFFIX);
+
+		if (stats_hint->bloom_file >= 0)
+			FileClose(stats_hint->bloom_file);
+		stats_hint->bloom_file = PathNameOpenFile(fname, O_RDONLY | PG_BINARY);
+		if (stats_hint->bloom_file < 0)
+			elog(DEBUG2, "arrow_fdw: could not open bloom filter \"%s\": %m",
+				 fname);
+		stats_hint->bloom_file_valid = true;
+		stats_hint->bloom_st_dev = rb_state->stat_buf.st_dev;
+		stats_hint->bloom_st_ino = rb_state->stat_buf.st_ino;
+		for (k=0; k < stats_hint->nitems; k++)
+			stats_hint->items[k].bloom_last_offset = 0;
+		pfree(fname);
+	}
+	if (stats_hint->bloom_file < 0)
+		return true;
+	/* RecordBatch might be split into multiple slices */
+	if (item->bloom_last_offset == base)
+		return item->bloom_last_result;
+
+	fdesc = FileGetRawDesc(stats_hint->bloom_file);
+	if (__preadFile(fdesc, &bloom, offsetof(ArrowBloomFilter, bitmap),
+					base) != offsetof(ArrowBloomFilter, bitmap))
+		return true;
+	/* sanity checks, to ignore the sidecar file not in sync */
+	if (bloom.magic != ARROW_BLOOM_FILTER_MAGIC ||
+		bloom.field_index != item->anum ||
+		bloom.rb_offset != rb_state->rb_offset ||
+		(!rb_state->rb_sliced && bloom.rb_nitems != rb_state->rb_nitems) ||
+		bloom.nhashes == 0 || bloom.nhashes > 32 || bloom.nwords == 0)
+	{
+		elog(DEBUG2, "arrow_fdw: bloom filter of \"%s\" at %ld is not valid",
+			 FilePathName(stats_hint->bloom_file), (long)base);
+		return true;
+	}
+
+	item->bloom_last_offset = base;
+	item->bloom_last_result = true;
+	for (k=0; k < bloom.nhashes; k++)
+	{
+		uint64	bit = arrowBloomFilterBitIndex(&bloom, item->bloom_hash, k);
+		uint64	word;
+		off_t	f_pos = (base + offsetof(ArrowBloomFilter, bitmap) +
+						 sizeof(uint64) * (bit >> 6));
+
+		if (__preadFile(fdesc, &word, sizeof(uint64),
+						f_pos) != sizeof(uint64))
+			break;
+		if ((word & (1UL << (bit & 63))) == 0)
+		{
+			item->bloom_last_result = false;
+			break;
+		}
+	}
+	return item->bloom_last_result;
+}
+
+/*
+ * arrowFdwCheckStatsHint
+ *
+ * It returns false if the RecordBatch never contains any rows that satisfy
+ * the qualifiers, according to the min/max statistics and bloom filter.
+ */
+static bool
+arrowFdwCheckStatsHint(arrowStatsHint *stats_hint, RecordBatchState *rb_state)
+{
+	int		i;
+
+	if (!stats_hint->args_ready)
+	{
+		ExprContext *econtext = stats_hint->econtext;
+
+		for (i=0; i < stats_hint->nitems; i++)
+		{
+			arrowStatsHintItem *item = &stats_hint->items[i];
+
+			item->arg_value = ExecEvalExpr(item->arg_state,
+										   econtext,
+										   &item->arg_isnull);
+			if (item->use_bloom)
+			{
+				if (!item->arg_isnull)
+					item->bloom_hash = __arrowBloomHintHash(item->bloom_type,
+															item->arg_value);
+				item->bloom_last_offset = 0;
+			}
+		}
+		stats_hint->args_ready = true;
+	}
+
+	for (i=0; i < stats_hint->nitems; i++)
+	{
+		arrowStatsHintItem *item = &stats_hint->items[i];
+		RecordBatchFieldState *fstate;
+		Datum		datum;
+
+		/* comparison operators are strict, so NULL never matches */
+		if (item->arg_isnull)
+			return false;
+		if (item->anum >= rb_state->ncols)
+			continue;
+		fstate = &rb_state->columns[item->anum];
+		if (item->use_bloom)
+		{
+			if (fstate->bloom_offset > 0 &&
+				!__arrowFdwCheckBloomFilter(stats_hint, rb_state, item))
+				return false;
+			continue;
+		}
+		if (!fstate->stat_valid)
+			continue;
+		datum = (item->use_max ? fstate->stat_max : fstate->stat_min);
+		if (!DatumGetBool(FunctionCall2Coll(&item->opcode,
+											item->collid,
+											datum,
+											item->arg_value)))
+			return false;
+	}
+	return true;
+}
+
+/*
+ * arrowLookupDictionary
+ *
+ * It returns the values of DictionaryBatch referenced by the field.
+ * Dictionaries are usually much smaller than the RecordBatches, and shared
+ * by all the RecordBatches in the file, so a few recently used ones are
+ * kept in the local memory.
+ */
+static arrowDictionary *
+arrowLookupDictionary(RecordBatchState *rb_state,
+					  RecordBatchFieldState *fstate)
+{
+	struct stat *stat_buf = &rb_state->stat_buf;
+	arrowDictionary *dict;
+	dlist_iter	iter;
+	int			fdesc = FileGetRawDesc(rb_state->fdesc);
+	int64		k, nitems = fstate->dict_nitems;
+	size_t		length;
+
+	Assert(fstate->dict_unitsz > 0);
+	dlist_foreach(iter, &arrow_dictionary_list)
+	{
+		dict = dlist_container(arrowDictionary, chain, iter.cur);
+		if (dict->st_dev == stat_buf->st_dev &&
+			dict->st_ino == stat_buf->st_ino &&
+			dict->st_mtim.tv_sec == stat_buf->st_mtim.tv_sec &&
+			dict->st_mtim.tv_nsec == stat_buf->st_mtim.tv_nsec &&
+			dict->values_offset == fstate->dict_values_offset)
+		{
+			dlist_move_head(&arrow_dictionary_list, &dict->chain);
+			return dict;
+		}
+	}
+
+	/* release the least recently used one, if too many */
+	if (arrow_dictionary_count >= ARROW_DICTIONARY_CACHE_NITEMS)
+	{
+		dict = dlist_container(arrowDictionary, chain,
+							   dlist_tail_node(&arrow_dictionary_list));
+		dlist_delete(&dict->chain);
+		pfree(dict->offsets);
+		pfree(dict->extra);
+		pfree(dict);
+		arrow_dictionary_count--;
+	}
+
+	/* load the DictionaryBatch */
+	dict = MemoryContextAllocZero(CacheMemoryContext,
+								  sizeof(arrowDictionary));
+	dict->offsets = MemoryContextAllocHuge(CacheMemoryContext,
+										   sizeof(cl_uint) * (nitems + 1));
+	length = sizeof(cl_uint) * (nitems + 1);
+	if (__preadFile(fdesc, dict->offsets, length,
+					fstate->dict_values_offset) != length)
+	{
+		pfree(dict->offsets);
+		pfree(dict);
+		elog(ERROR, "failed on pread('%s'): %m",
+			 FilePathName(rb_state->fdesc));
+	}
+	for (k=0; k < nitems; k++)
+	{
+		if (dict->offsets[k] > dict->offsets[k+1])
+			break;
+	}
+	if (k < nitems || dict->offsets[nitems] > fstate->dict_extra_length)
+	{
+		pfree(dict->offsets);
+		pfree(dict);
+		elog(ERROR, "arrow file '%s' has corrupted DictionaryBatch",
+			 FilePathName(rb_state->fdesc));
+	}
+	length = dict->offsets[nitems];
+	dict->extra = MemoryContextAllocHuge(CacheMemoryContext, length + 1);
+	if (__preadFile(fdesc, dict->extra, length,
+					fstate->dict_extra_offset) != length)
+	{
+		pfree(dict->extra);
+		pfree(dict->offsets);
+		pfree(dict);
+		elog(ERROR, "failed on pread('%s'): %m",
+			 FilePathName(rb_state->fdesc));
+	}
+	dict->st_dev = stat_buf->st_dev;
+	dict->st_ino = stat_buf->st_ino;
+	dict->st_mtim = stat_buf->st_mtim;
+	dict->values_offset = fstate->dict_values_offset;
+	dict->serial = ++arrow_dictionary_serial;
+	dict->nitems = nitems;
+	dlist_push_head(&arrow_dictionary_list, &dict->chain);
+	arrow_dictionary_count++;
+
+	return dict;
+}
+
+/*
+ * arrowFdwSetupVectorFilter
+ *
+ * It picks up simple qualifiers that can be evaluated over the value buffers
+ * of RecordBatch directly; comparison between a fixed-length column and
+ * a constant (or stable expression), and NULL test of the columns.
+ * Comparison of text/bytea columns, including IN-list, is evaluated only
+ * on the dictionary-encoded ones; the operator is applied on each entry of
+ * the dictionary once, then rows are checked by the indices.
+ * This is just a pre-filter to skip materialization of the rows that never
+ * satisfy the qualifiers, so the scan qualifiers are still evaluated on
+ * the rows survived.
+ */
+static bool
+__arrowVectorFilterIsSupportedType(Oid vartype, Oid argtype, int *p_kind)
+{
+	switch (vartype)
+	{
+		case INT2OID:
+		case INT4OID:
+		case INT8OID:
+			if (argtype != INT2OID &&
+				argtype != INT4OID &&
+				argtype != INT8OID)
+				return false;
+			*p_kind = ARROW_VFILTER__INTEGER;
+			return true;
+		case FLOAT4OID:
+		case FLOAT8OID:
+			if (argtype != FLOAT4OID &&
+				argtype != FLOAT8OID)
+				return false;
+			*p_kind = ARROW_VFILTER__FLOAT;
+			return true;
+		case DATEOID:
+		case TIMEOID:
+		case TIMESTAMPOID:
+		case TIMESTAMPTZOID:
+			if (argtype != vartype)
+				return false;
+			*p_kind = ARROW_VFILTER__INTEGER;
+			return true;
+		case TEXTOID:
+		case BYTEAOID:
+			/* only if dictionary-encoded */
+			if (argtype != vartype)
+				return false;
+			*p_kind = ARROW_VFILTER__DICTIONARY;
+			return true;
+		default:
+			return false;
+	}
+}
+
+static arrowVectorFilter *
+arrowFdwSetupVectorFilter(ScanState *ss, List *outer_quals)
+{
+	Relation	relation = ss->ss_currentRelation;
+	TupleDesc	tupdesc = RelationGetDescr(relation);
+	Index		scanrelid = ((Scan *)ss->ps.plan)->scanrelid;
+	arrowVectorFilter *vfilter;
+	arrowVectorFilterItem *item;
+	ListCell   *lc;
+
+	if (!arrow_enable_vector_filter || outer_quals == NIL)
+		return NULL;
+	vfilter = palloc0(offsetof(arrowVectorFilter,
+							   items[list_length(outer_quals)]));
+	vfilter->econtext = ss->ps.ps_ExprContext;
+	foreach (lc, outer_quals)
+	{
+		Node	   *qual = lfirst(lc);
+		Var		   *var;
+
+		if (IsA(qual, NullTest))
+		{
+			NullTest   *nulltest = (NullTest *)qual;
+
+			var = (Var *)nulltest->arg;
+			if (!IsA(var, Var) ||
+				nulltest->argisrow ||
+				var->varno != scanrelid ||
+				var->varlevelsup > 0 ||
+				var->varattno <= 0 ||
+				var->varattno > tupdesc->natts ||
+				type_is_rowtype(var->vartype))
+				continue;
+			item = &vfilter->items[vfilter->nitems++];
+			item->anum = var->varattno - 1;
+			item->kind = (nulltest->nulltesttype == IS_NULL
+						  ? ARROW_VFILTER__NULLTEST
+						  : ARROW_VFILTER__NOTNULLTEST);
+		}
+		else if (IsA(qual, OpExpr))
+		{
+			OpExpr	   *op = (OpExpr *)qual;
+			Expr	   *arg;
+			Oid			opno;
+			Oid			argtype;
+			Oid			opclass;
+			Oid			opfamily;
+			Oid			lefttype;
+			Oid			righttype;
+			int			strategy;
+			int			kind;
+
+			if (list_length(op->args) != 2)
+				continue;
+			if (IsA(linitial(op->args), Var))
+			{
+				var = linitial(op->args);
+				arg = lsecond(op->args);
+				opno = op->opno;
+			}
+			else if (IsA(lsecond(op->args), Var))
+			{
+				var = lsecond(op->args);
+				arg = linitial(op->args);
+				opno = get_commutator(op->opno);
+				if (!OidIsValid(opno))
+					continue;
+			}
+			else
+				continue;
+
+			argtype = exprType((Node *)arg);
+			if (var->varno != scanrelid ||
+				var->varlevelsup > 0 ||
+				var->varattno <= 0 ||
+				var->varattno > tupdesc->natts ||
+				!__arrowVectorFilterIsSupportedType(var->vartype,
+													argtype, &kind) ||
+				contain_var_clause((Node *)arg) ||
+				contain_volatile_functions((Node *)arg))
+				continue;
+			/* operator must be a member of the default btree opfamily */
+			opclass = GetDefaultOpClass(var->vartype, BTREE_AM_OID);
+			if (!OidIsValid(opclass))
+				continue;
+			opfamily = get_opclass_family(opclass);
+			if (!op_in_opfamily(opno, opfamily))
+				continue;
+			get_op_opfamily_properties(opno, opfamily, false,
+									   &strategy,
+									   &lefttype,
+									   &righttype);
+			if (lefttype != var->vartype || righttype != argtype)
+				continue;
+
+			item = &vfilter->items[vfilter->nitems++];
+			item->anum = var->varattno - 1;
+			item->kind = kind;
+			item->strategy = strategy;
+			item->argtype = argtype;
+			item->arg_state = ExecInitExpr(arg, &ss->ps);
+			if (kind == ARROW_VFILTER__DICTIONARY)
+			{
+				fmgr_info(get_opcode(opno), &item->opfunc);
+				item->collid = op->inputcollid;
+			}
+		}
+		else if (IsA(qual, ScalarArrayOpExpr))
+		{
+			ScalarArrayOpExpr *saop = (ScalarArrayOpExpr *)qual;
+			Expr	   *arg;
+			Oid			argtype;
+			Oid			opclass;
+			Oid			opfamily;
+			Oid			lefttype;
+			Oid			righttype;
+			int			strategy;
+
+			if (!saop->useOr || list_length(saop->args) != 2)
+				continue;
+			var = linitial(saop->args);
+			arg = lsecond(saop->args);
+			if (!IsA(var, Var))
+				continue;
+			argtype = exprType((Node *)arg);
+			if (var->varno != scanrelid ||
+				var->varlevelsup > 0 ||
+				var->varattno <= 0 ||
+				var->varattno > tupdesc->natts ||
+				(var->vartype != TEXTOID && var->vartype != BYTEAOID) ||
+				get_element_type(argtype) != var->vartype ||
+				contain_var_clause((Node *)arg) ||
+				contain_volatile_functions((Node *)arg))
+				continue;
+			/* operator must be a member of the default btree opfamily */
+			opclass = GetDefaultOpClass(var->vartype, BTREE_AM_OID);
+			if (!OidIsValid(opclass))
+				continue;
+			opfamily = get_opclass_family(opclass);
+			if (!op_in_opfamily(saop->opno, opfamily))
+				continue;
+			get_op_opfamily_properties(saop->opno, opfamily, false,
+									   &strategy,
+									   &lefttype,
+									   &righttype);
+			if (lefttype != var->vartype || righttype != var->vartype)
+				continue;
+
+			item = &vfilter->items[vfilter->nitems++];
+			item->anum = var->varattno - 1;
+			item->kind = ARROW_VFILTER__DICTIONARY;
+			item->strategy = strategy;
+			item->argtype = argtype;
+			item->arg_state = ExecInitExpr(arg, &ss->ps);
+			fmgr_info(get_opcode(saop->opno), &item->opfunc);
+			item->collid = saop->inputcollid;
+			item->useOr = true;
+		}
+		else
+			continue;
+		vfilter->filter_quals = lappend(vfilter->filter_quals, qual);
+	}
+
+	if (vfilter->nitems == 0)
+	{
+		pfree(vfilter);
+		return NULL;
+	}
+	return vfilter;
+}
+
+/*
+ * __arrowVectorFilterIntegerRange
+ *
+ * It transforms (Var OP Expr) into the range of the raw values in the value
+ * buffer, according to the unit of the column. It returns false if no rows
+ * can satisfy the qualifier, or sets *p_unitsz = 0 if the column is not
+ * supported.
+ */
+static bool
+__arrowVectorFilterIntegerRange(arrowVectorFilterItem *item,
+								kern_colmeta *cmeta,
+								int64 *p_lower, int64 *p_upper,
+								int *p_unitsz)
+{
+	int64		value;
+	int64		lower = PG_INT64_MIN;	/* unbounded */
+	int64		upper = PG_INT64_MAX;	/* unbounded */
+	int			unitsz;
+	int64		shift = 0;
+	int64		scale = 1;
+	int128		temp;
+
+	*p_unitsz = 0;
+	/* the raw value is: PostgreSQL value = raw * scale - shift */
+	switch (cmeta->atttypid)
+	{
+		case INT2OID:
+		case INT4OID:
+		case INT8OID:
+			unitsz = cmeta->attlen;
+			break;
+		case DATEOID:
+			if (cmeta->attopts.date.unit != ArrowDateUnit__Day)
+				goto not_supported;
+			unitsz = sizeof(cl_int);
+			shift = (POSTGRES_EPOCH_JDATE - UNIX_EPOCH_JDATE);
+			break;
+		case TIMEOID:
+			switch (cmeta->attopts.time.unit)
+			{
+				case ArrowTimeUnit__Second:
+					unitsz = sizeof(cl_int);
+					scale = 1000000L;
+					break;
+				case ArrowTimeUnit__MilliSecond:
+					unitsz = sizeof(cl_int);
+					scale = 1000L;
+					break;
+				case ArrowTimeUnit__MicroSecond:
+					unitsz = sizeof(cl_long);
+					break;
+				default:
+					goto not_supported;
+			}
+			break;
+		case TIMESTAMPOID:
+		case TIMESTAMPTZOID:
+			switch (cmeta->attopts.timestamp.unit)
+			{
+				case ArrowTimeUnit__Second:
+					scale = 1000000L;
+					break;
+				case ArrowTimeUnit__MilliSecond:
+					scale = 1000L;
+					break;
+				case ArrowTimeUnit__MicroSecond:
+					break;
+				default:
+					goto not_supported;
+			}
+			unitsz = sizeof(cl_long);
+			shift = (POSTGRES_EPOCH_JDATE - UNIX_EPOCH_JDATE) * USECS_PER_DAY;
+			break;
+		default:
+			goto not_supported;
+	}
+
+	switch (item->argtype)
+	{
+		case INT2OID:
+			value = DatumGetInt16(item->arg_value);
+			break;
+		case INT4OID:
+			value = DatumGetInt32(item->arg_value);
+			break;
+		case INT8OID:
+			value = DatumGetInt64(item->arg_value);
+			break;
+		case DATEOID:
+			value = DatumGetDateADT(item->arg_value);
+			break;
+		case TIMEOID:
+			value = DatumGetTimeADT(item->arg_value);
+			break;
+		case TIMESTAMPOID:
+		case TIMESTAMPTZOID:
+			value = DatumGetTimestamp(item->arg_value);
+			break;
+		default:
+			goto not_supported;
+	}
+
+	switch (item->strategy)
+	{
+		case BTLessStrategyNumber:
+			if (value == PG_INT64_MIN)
+				return false;
+			upper = value - 1;
+			break;
+		case BTLessEqualStrategyNumber:
+			upper = value;
+			break;
+		case BTEqualStrategyNumber:
+			lower = upper = value;
+			break;
+		case BTGreaterEqualStrategyNumber:
+			lower = value;
+			break;
+		case BTGreaterStrategyNumber:
+			if (value == PG_INT64_MAX)
+				return false;
+			lower = value + 1;
+			break;
+		default:
+			goto not_supported;
+	}
+
+	/* lower <= raw * scale - shift  =>  ceil((lower + shift) / scale) <= raw */
+	if (lower != PG_INT64_MIN)
+	{
+		temp = (int128)lower + (int128)shift;
+		if (temp >= 0)
+			temp = (temp + scale - 1) / scale;
+		else
+			temp = temp / scale;
+		lower = (temp < PG_INT64_MIN ? PG_INT64_MIN :
+				 temp > PG_INT64_MAX ? PG_INT64_MAX : (int64)temp);
+	}
+	/* raw * scale - shift <= upper  =>  raw <= floor((upper + shift) / scale) */
+	if (upper != PG_INT64_MAX)
+	{
+		temp = (int128)upper + (int128)shift;
+		if (temp >= 0)
+			temp = temp / scale;
+		else
+			temp = (temp - scale + 1) / scale;
+		upper = (temp < PG_INT64_MIN ? PG_INT64_MIN :
+				 temp > PG_INT64_MAX ? PG_INT64_MAX : (int64)temp);
+	}
+	/* clamp to the range of the raw values */
+	if (unitsz == sizeof(cl_short))
+	{
+		lower = Max(lower, SHRT_MIN);
+		upper = Min(upper, SHRT_MAX);
+	}
+	else if (unitsz == sizeof(cl_int))
+	{
+		lower = Max(lower, INT_MIN);
+		upper = Min(upper, INT_MAX);
+	}
+	else if (unitsz != sizeof(cl_long))
+		goto not_supported;
+	if (lower > upper)
+		return false;
+	*p_lower = lower;
+	*p_upper = upper;
+	*p_unitsz = unitsz;
+not_supported:
+	return true;
+}
+
+#define __ARROW_VFILTER_RANGE_LOOP(TYPE)							\
+	do {															\
+		const TYPE *values = (const TYPE *)base;					\
+		TYPE		__lower = (TYPE)lower;							\
+		TYPE		__upper = (TYPE)upper;							\
+																	\
+		for (i=0; i < nitems; i++)									\
+			selvec[i] &= ((values[i] >= __lower) &					\
+						  (values[i] <= __upper));					\
+	} while(0)
+
+#define __ARROW_VFILTER_FLOAT_LOOP(TYPE)							\
+	do {															\
+		const TYPE *values = (const TYPE *)base;					\
+																	\
+		switch (item->strategy)										\
+		{															\
+			case BTLessStrategyNumber:								\
+				for (i=0; i < nitems; i++)							\
+					selvec[i] &= (values[i] < fval);				\
+				break;												\
+			case BTLessEqualStrategyNumber:							\
+				for (i=0; i < nitems; i++)							\
+					selvec[i] &= (values[i] <= fval);				\
+				break;												\
+			case BTEqualStrategyNumber:								\
+				for (i=0; i < nitems; i++)							\
+					selvec[i] &= (values[i] == fval);				\
+				break;												\
+			case BTGreaterEqualStrategyNumber:						\
+				/* NaN is larger than any other values */			\
+				for (i=0; i < nitems; i++)							\
+					selvec[i] &= ((values[i] >= fval) |				\
+								  (values[i] != values[i]));		\
+				break;												\
+			case BTGreaterStrategyNumber:							\
+				for (i=0; i < nitems; i++)							\
+					selvec[i] &= ((values[i] > fval) |				\
+								  (values[i] != values[i]));		\
+				break;												\
+			default:												\
+				break;												\
+		}															\
+	} while(0)
+
+/*
+ * __arrowVectorFilterDictionaryMatch
+ *
+ * It applies the operator on each entry of the dictionary, then returns
+ * the number of the entries matched. The result is kept until the next
+ * dictionary or argument.
+ */
+static int64
+__arrowVectorFilterDictionaryMatch(arrowVectorFilterItem *item,
+								   RecordBatchState *rb_state,
+								   RecordBatchFieldState *fstate)
+{
+	arrowDictionary *dict = arrowLookupDictionary(rb_state, fstate);
+	MemoryContext	memcxt;
+	MemoryContext	oldcxt;
+	Datum		   *elem_values = NULL;
+	bool		   *elem_isnull = NULL;
+	int				elem_nitems = 0;
+	int64			k, nmatched = 0;
+
+	if (item->dict_serial == dict->serial)
+		return item->dict_nmatched;
+
+	if (item->dict_match)
+		pfree(item->dict_match);
+	item->dict_match = MemoryContextAllocHuge(item->opfunc.fn_mcxt,
+											  Max(dict->nitems, 1));
+	memcxt = AllocSetContextCreate(CurrentMemoryContext,
+								   "arrow dictionary filter",
+								   ALLOCSET_DEFAULT_SIZES);
+	oldcxt = MemoryContextSwitchTo(memcxt);
+	if (item->useOr)
+	{
+		ArrayType  *array = DatumGetArrayTypeP(item->arg_value);
+		int16		elmlen;
+		bool		elmbyval;
+		char		elmalign;
+
+		get_typlenbyvalalign(ARR_ELEMTYPE(array),
+							 &elmlen, &elmbyval, &elmalign);
+		deconstruct_array(array, ARR_ELEMTYPE(array),
+						  elmlen, elmbyval, elmalign,
+						  &elem_values, &elem_isnull, &elem_nitems);
+	}
+	for (k=0; k < dict->nitems; k++)
+	{
+		size_t		len = dict->offsets[k+1] - dict->offsets[k];
+		struct varlena *vl = palloc(VARHDRSZ + len);
+		bool		matched = false;
+		int			i;
+
+		SET_VARSIZE(vl, VARHDRSZ + len);
+		memcpy(VARDATA(vl), dict->extra + dict->offsets[k], len);
+		if (!item->useOr)
+			matched = DatumGetBool(FunctionCall2Coll(&item->opfunc,
+													 item->collid,
+													 PointerGetDatum(vl),
+													 item->arg_value));
+		else
+		{
+			for (i=0; i < elem_nitems && !matched; i++)
+			{
+				if (elem_isnull[i])
+					continue;
+				matched = DatumGetBool(FunctionCall2Coll(&item->opfunc,
+														 item->collid,
+														 PointerGetDatum(vl),
+														 elem_values[i]));
+			}
+		}
+		item->dict_match[k] = (matched ? 1 : 0);
+		nmatched += item->dict_match[k];
+		pfree(vl);
+	}
+	MemoryContextSwitchTo(oldcxt);
+	MemoryContextDelete(memcxt);
+
+	item->dict_serial = dict->serial;
+	item->dict_nmatched = nmatched;
+
+	return nmatched;
+}
+
+#define __ARROW_VFILTER_DICTIONARY_LOOP(TYPE)						\
+	do {															\
+		const TYPE *codes = (const TYPE *)base;						\
+		const uint8 *match = item->dict_match;						\
+		uint64		dict_nitems = fstate->dict_nitems;				\
+																	\
+		for (i=0; i < nitems; i++)									\
+		{															\
+			uint64	code = codes[i];								\
+																	\
+			selvec[i] &= (code < dict_nitems ? match[code] : 0);	\
+		}															\
+	} while(0)
+
+/*
+ * arrowFdwExecVectorFilter
+ *
+ * It sets up the selection vector of the rows in the RecordBatch that may
+ * satisfy the qualifiers, then returns number of the rows survived.
+ * The loops below are written as simple as possible, for auto-vectorization
+ * by the compiler.
+ */
+static uint32
+arrowFdwExecVectorFilter(arrowVectorFilter *vfilter,
+						 kern_data_store *kds,
+						 RecordBatchState *rb_state,
+						 uint8 *selvec)
+{
+	size_t		nitems = kds->nitems;
+	size_t		i;
+	uint32		nvalids = 0;
+	int			j;
+
+	if (!vfilter->args_ready)
+	{
+		ExprContext *econtext = vfilter->econtext;
+
+		for (j=0; j < vfilter->nitems; j++)
+		{
+			arrowVectorFilterItem *item = &vfilter->items[j];
+
+			if (!item->arg_state)
+				continue;
+			item->arg_value = ExecEvalExpr(item->arg_state,
+										   econtext,
+										   &item->arg_isnull);
+			/* dict_match[] must be rebuilt for the new argument */
+			item->dict_serial = 0;
+		}
+		vfilter->args_ready = true;
+	}
+
+	memset(selvec, 1, nitems);
+	for (j=0; j < vfilter->nitems; j++)
+	{
+		arrowVectorFilterItem *item = &vfilter->items[j];
+		kern_colmeta *cmeta;
+		uint8	   *nullmap = NULL;
+		char	   *base;
+
+		if (item->anum >= kds->ncols)
+			continue;
+		cmeta = &kds->colmeta[item->anum];
+		if (cmeta->atttypkind == TYPE_KIND__COMPOSITE ||
+			cmeta->values_offset == 0)
+			continue;
+		base = (char *)kds + __kds_unpack(cmeta->values_offset);
+		if (cmeta->nullmap_offset != 0)
+			nullmap = (uint8 *)kds + __kds_unpack(cmeta->nullmap_offset);
+
+		if (item->kind == ARROW_VFILTER__NULLTEST)
+		{
+			if (!nullmap)
+				goto no_rows;
+			for (i=0; i < nitems; i++)
+				selvec[i] &= ((~nullmap[i>>3] >> (i & 7)) & 1);
+			continue;
+		}
+		/* only NOT NULL rows can satisfy the strict operators also */
+		if (nullmap)
+		{
+			for (i=0; i < nitems; i++)
+				selvec[i] &= ((nullmap[i>>3] >> (i & 7)) & 1);
+		}
+		if (item->kind == ARROW_VFILTER__NOTNULLTEST)
+			continue;
+		/* comparison operators are strict, so NULL never matches */
+		if (item->arg_isnull)
+			goto no_rows;
+
+		if (item->kind == ARROW_VFILTER__INTEGER)
+		{
+			int64	lower;
+			int64	upper;
+			int		unitsz;
+
+			if (!__arrowVectorFilterIntegerRange(item, cmeta,
+												 &lower, &upper,
+												 &unitsz))
+				goto no_rows;
+			if (unitsz == sizeof(cl_short))
+				__ARROW_VFILTER_RANGE_LOOP(cl_short);
+			else if (unitsz == sizeof(cl_int))
+				__ARROW_VFILTER_RANGE_LOOP(cl_int);
+			else if (unitsz == sizeof(cl_long))
+				__ARROW_VFILTER_RANGE_LOOP(cl_long);
+		}
+		else if (item->kind == ARROW_VFILTER__FLOAT)
+		{
+			double	fval;
+
+			if (item->argtype == FLOAT4OID)
+				fval = (double)DatumGetFloat4(item->arg_value);
+			else
+				fval = DatumGetFloat8(item->arg_value);
+			if (isnan(fval))
+				continue;	/* not supported */
+			if (cmeta->atttypid == FLOAT4OID)
+				__ARROW_VFILTER_FLOAT_LOOP(float);
+			else if (cmeta->atttypid == FLOAT8OID)
+				__ARROW_VFILTER_FLOAT_LOOP(double);
+		}
+		else if (item->kind == ARROW_VFILTER__DICTIONARY)
+		{
+			RecordBatchFieldState *fstate = &rb_state->columns[item->anum];
+
+			if (fstate->dict_unitsz == 0)
+				continue;	/* not dictionary-encoded */
+			if (__arrowVectorFilterDictionaryMatch(item, rb_state,
+												   fstate) == 0)
+				goto no_rows;
+			if (fstate->dict_unitsz == sizeof(cl_uchar))
+				__ARROW_VFILTER_DICTIONARY_LOOP(cl_uchar);
+			else if (fstate->dict_unitsz == sizeof(cl_ushort))
+				__ARROW_VFILTER_DICTIONARY_LOOP(cl_ushort);
+			else if (fstate->dict_unitsz == sizeof(cl_uint))
+				__ARROW_VFILTER_DICTIONARY_LOOP(cl_uint);
+			else if (fstate->dict_unitsz == sizeof(cl_ulong))
+				__ARROW_VFILTER_DICTIONARY_LOOP(cl_ulong);
+		}
+	}
+
+	for (i=0; i < nitems; i++)
+		nvalids += selvec[i];
+	return nvalids;
+
+no_rows:
+	memset(selvec, 0, nitems);
+	return 0;
+}
+
+/*
+ * arrowFdwApplyVectorFilter
+ */
+static uint32
+arrowFdwApplyVectorFilter(ArrowFdwState *af_state,
+						  kern_data_store *kds,
+						  RecordBatchState *rb_state,
+						  EState *estate)
+{
+	uint32		nvalids;
+
+	if (kds->nitems == 0)
+		return 0;
+	if (!af_state->curr_selvec ||
+		af_state->curr_selvec_nrooms < kds->nitems)
+	{
+		if (af_state->curr_selvec)
+			pfree(af_state->curr_selvec);
+		af_state->curr_selvec = MemoryContextAlloc(estate->es_query_cxt,
+												   kds->nitems);
+		af_state->curr_selvec_nrooms = kds->nitems;
+	}
+	nvalids = arrowFdwExecVectorFilter(af_state->vfilter, kds, rb_state,
+									   af_state->curr_selvec);
+	af_state->vfilter_nremoved += (kds->nitems - nvalids);
+
+	return nvalids;
+}
+
+/*
+ * ExecInitArrowFdw
+ */
+ArrowFdwState *
+ExecInitArrowFdw(ScanState *ss, List *outer_quals, Bitmapset *outer_refs)
+{
+	Relation		relation = ss->ss_currentRelation;
+	TupleDesc		tupdesc = RelationGetDescr(relation);
+	ForeignTable   *ft = GetForeignTable(RelationGetRelid(relation));
+	List		   *filesList = NIL;
+	List		   *fdescList = NIL;
+	Bitmapset	   *referenced = NULL;
+	bool			whole_row_ref = false;
+	arrowPruneContext *prune;
+	ArrowFdwState  *af_state;
+	List		   *rb_state_list = NIL;
+	ListCell	   *lc;
+	bool			writable;
+	int				i, num_rbatches;
+
+	Assert(RelationGetForm(relation)->relkind == RELKIND_FOREIGN_TABLE &&
+		   memcmp(GetFdwRoutineForRelation(relation, false),
+				  &pgstrom_arrow_fdw_routine, sizeof(FdwRoutine)) == 0);
+	/* pending rows by group commit must be visible to the scan */
+	arrowFdwFlushPendingWrites();
+	/* expand 'referenced' if it has whole-row reference */
+	if (bms_is_member(-FirstLowInvalidHeapAttributeNumber, outer_refs))
+		whole_row_ref = true;
+	for (i=0; i < tupdesc->natts; i++)
+	{
+		Form_pg_attribute attr = tupleDescAttr(tupdesc, i);
+		int		k = attr->attnum - FirstLowInvalidHeapAttributeNumber;
+
+		if (attr->attisdropped)
+			continue;
+		if (whole_row_ref || bms_is_member(k, outer_refs))
+			referenced = bms_add_member(referenced, k);
+	}
+
+	prune = arrowFdwSetupPruneContext(tupdesc,
+									  ((Scan *)ss->ps.plan)->scanrelid,
+									  outer_quals,
+									  NULL, ss->ps.state);
+	filesList = __arrowFdwExtractFilesList(ft->options,
+										   NULL,
+										   &writable,
+										   prune);
+	foreach (lc, filesList)
+	{
+		char	   *fname = strVal(lfirst(lc));
+		File		fdesc;
+		List	   *rb_cached = NIL;
+		ListCell   *cell;
+
+		fdesc = PathNameOpenFile(fname, O_RDONLY | PG_BINARY);
+		if (fdesc < 0)
+		{
+			if (writable && errno == ENOENT)
+				continue;
+			elog(ERROR, "failed to open '%s' on behalf of '%s'",
+				 fname, RelationGetRelationName(relation));
+		}
+		fdescList = lappend_int(fdescList, fdesc);
+
+		rb_cached = arrowLookupOrBuildMetadataCache(fdesc);
+		/* check schema compatibility */
+		foreach (cell, rb_cached)
+		{
+			RecordBatchState   *rb_state = lfirst(cell);
+
+			if (!arrowSchemaCompatibilityCheck(tupdesc, rb_state))
+				elog(ERROR, "arrow file '%s' on behalf of foreign table '%s' has incompatible schema definition",
+					 fname, RelationGetRelationName(relation));
+		}
+		rb_state_list = list_concat(rb_state_list, rb_cached);
+	}
+	num_rbatches = list_length(rb_state_list);
+	af_state = palloc0(sizeof(ArrowFdwState));
+	af_state->fdescList = fdescList;
+	af_state->referenced = referenced;
+	af_state->prune_ndirs = (prune ? prune->npruned : 0);
+	af_state->stats_hint = arrowFdwSetupStatsHint(ss, outer_quals);
+	af_state->vfilter = arrowFdwSetupVectorFilter(ss, outer_quals);
+	af_state->rbatch_index = &af_state->__rbatch_index_local;
+	af_state->rbatches = palloc0(sizeof(RecordBatchState *) * num_rbatches);
+	i = 0;
+	foreach (lc, rb_state_list)
+		af_state->rbatches[i++] = (RecordBatchState *)lfirst(lc);
+	af_state->num_rbatches = num_rbatches;
+
+	return af_state;
+}
+
+/*
+ * ArrowBeginForeignScan
+ */
+static void
+ArrowBeginForeignScan(ForeignScanState *node, int eflags)
+{
+	Relation		relation = node->ss.ss_currentRelation;
+	TupleDesc		tupdesc;
+	ForeignScan	   *fscan = (ForeignScan *) node->ss.ps.plan;
+	ArrowFdwState  *af_state;
+	List		   *ref_list;
+	ListCell	   *lc;
+	Bitmapset	   *referenced = NULL;
+
+	if (fscan->scan.scanrelid == 0)
+	{
+		arrowFdwBeginAggregate(node, eflags);
+		return;
+	}
+	tupdesc = RelationGetDescr(relation);
+	ref_list = linitial(fscan->fdw_private);
+	foreach (lc, ref_list)
+	{
+		int		j = lfirst_int(lc);
+
+		if (j >= 0 && j <= tupdesc->natts)
+			referenced = bms_add_member(referenced, j -
+										FirstLowInvalidHeapAttributeNumber);
+	}
+	af_state = ExecInitArrowFdw(&node->ss,
+								fscan->scan.plan.qual,
+								referenced);
+	af_state->scan_bound = intVal(lsecond(fscan->fdw_private));
+	af_state->bound_nrows = TYPEALIGN(64, af_state->scan_bound);
+	node->fdw_state = af_state;
+}
+
+typedef struct
+{
+	off_t		rb_offset;
+	off_t		f_offset;
+	off_t		m_offset;
+	cl_int		io_index;
+	cl_int      depth;
+	strom_io_chunk ioc[FLEXIBLE_ARRAY_MEMBER];
+} arrowFdwSetupIOContext;
+
+/*
+ * arrowFdwSetupIOvectorField
+ */
+static inline void
+__setupIOvectorField(arrowFdwSetupIOContext *con,
+					 off_t chunk_offset,
+					 size_t chunk_length,
+					 cl_uint *p_cmeta_offset,
+					 cl_uint *p_cmeta_length)
+{
+	off_t		f_pos = con->rb_offset + chunk_offset;
+
+	if (f_pos == con->f_offset &&
+		con->m_offset == MAXALIGN(con->m_offset))
+	{
+		/* good, buffer is continuous */
+		*p_cmeta_offset = __kds_packed(con->m_offset);
+		*p_cmeta_length = __kds_packed(chunk_length);
+
+		con->m_offset += chunk_length;
+		con->f_offset += chunk_length;
+	}
+	else
+	{
+		off_t		f_base = TYPEALIGN_DOWN(PAGE_SIZE, f_pos);
+		off_t		f_tail;
+		off_t		shift = f_pos - f_base;
+		strom_io_chunk *ioc;
+
+		if (con->io_index < 0)
+			con->io_index = 0;	/* no previous i/o chunks */
+		else
+		{
+			ioc = &con->ioc[con->io_index++];
+
+			f_tail = TYPEALIGN(PAGE_SIZE, con->f_offset);
+			ioc->nr_pages = f_tail / PAGE_SIZE - ioc->fchunk_id;
+			con->m_offset += (f_tail - con->f_offset); //safety margin;
+		}
+		ioc = &con->ioc[con->io_index];
+		/* adjust position if con->m_offset is not aligned well */
+		if (con->m_offset + shift != MAXALIGN(con->m_offset + shift))
+			con->m_offset = MAXALIGN(con->m_offset + shift) - shift;
+		ioc->m_offset   = con->m_offset;
+		ioc->fchunk_id  = f_base / PAGE_SIZE;
+
+		*p_cmeta_offset = __kds_packed(con->m_offset + shift);
+		*p_cmeta_length = __kds_packed(chunk_length);
+
+		con->m_offset  += shift + chunk_length;
+		con->f_offset   = f_pos + chunk_length;
+	}
+}
+
+static void
+arrowFdwSetupIOvectorField(arrowFdwSetupIOContext *con,
+						   RecordBatchFieldState *fstate,
+						   kern_data_store *kds,
+						   kern_colmeta *cmeta)
+{
+	//int		index = cmeta - kds->colmeta;
+
+	if (fstate->nullmap_length > 0)
+	{
+		Assert(fstate->null_count > 0);
+		__setupIOvectorField(con,
+							 fstate->nullmap_offset,
+							 fstate->nullmap_length,
+							 &cmeta->nullmap_offset,
+							 &cmeta->nullmap_length);
+		//elog(INFO, "D%d att[%d] nullmap=%lu,%lu m_offset=%lu f_offset=%lu", con->depth, index, fstate->nullmap_offset, fstate->nullmap_length, con->m_offset, con->f_offset);
+	}
+	if (fstate->values_length > 0)
+	{
+		__setupIOvectorField(con,
+							 fstate->values_offset,
+							 fstate->values_length,
+							 &cmeta->values_offset,
+							 &cmeta->values_length);
+		//elog(INFO, "D%d att[%d] values=%lu,%lu m_offset=%lu f_offset=%lu", con->depth, index, fstate->values_offset, fstate->values_length, con->m_offset, con->f_offset);
+	}
+	if (fstate->extra_length > 0)
+	{
+		__setupIOvectorField(con,
+							 fstate->extra_offset,
+							 fstate->extra_length,
+							 &cmeta->extra_offset,
+							 &cmeta->extra_length);
+		//elog(INFO, "D%d att[%d] extra=%lu,%lu m_offset=%lu f_offset=%lu", con->depth, index, fstate->extra_offset, fstate->extra_length, con->m_offset, con->f_offset);
+	}
+
+	/* nested sub-fields if composite types */
+	if (cmeta->atttypkind == TYPE_KIND__ARRAY ||
+		cmeta->atttypkind == TYPE_KIND__COMPOSITE)
+	{
+		kern_colmeta *subattr;
+		int		j;
+
+		Assert(fstate->num_children == cmeta->num_subattrs);
+		con->depth++;
+		for (j=0, subattr = &kds->colmeta[cmeta->idx_subattrs];
+			 j < cmeta->num_subattrs;
+			 j++, subattr++)
+		{
+			RecordBatchFieldState *child = &fstate->children[j];
+
+			arrowFdwSetupIOvectorField(con, child, kds, subattr);
+		}
+		con->depth--;
+	}
+}
+
+/*
+ * arrowFdwSetupIOvector
+ */
+static strom_io_vector *
+arrowFdwSetupIOvector(kern_data_store *kds,
+					  RecordBatchState *rb_state,
+					  Bitmapset *referenced)
+{
+	arrowFdwSetupIOContext *con;
+	strom_io_vector *iovec = NULL;
+	int			j, nr_chunks = 0;
+
+	Assert(kds->nr_colmeta >= kds->ncols);
+	con = alloca(offsetof(arrowFdwSetupIOContext,
+						  ioc[3 * kds->nr_colmeta]));
+	con->rb_offset = rb_state->rb_offset;
+	con->f_offset  = ~0UL;	/* invalid offset */
+	con->m_offset  = TYPEALIGN(PAGE_SIZE, KERN_DATA_STORE_HEAD_LENGTH(kds));
+	con->io_index  = -1;
+	for (j=0; j < kds->ncols; j++)
+	{
+		RecordBatchFieldState *fstate = &rb_state->columns[j];
+		kern_colmeta *cmeta = &kds->colmeta[j];
+		int			attidx = j + 1 - FirstLowInvalidHeapAttributeNumber;
+
+		if (referenced && bms_is_member(attidx, referenced))
+			arrowFdwSetupIOvectorField(con, fstate, kds, cmeta);
+	}
+	if (con->io_index >= 0)
+	{
+		/* close the last I/O chunks */
+		strom_io_chunk *ioc = &con->ioc[con->io_index];
+
+		ioc->nr_pages = (TYPEALIGN(PAGE_SIZE, con->f_offset) / PAGE_SIZE -
+						 ioc->fchunk_id);
+		con->m_offset = ioc->m_offset + PAGE_SIZE * ioc->nr_pages;
+		nr_chunks = con->io_index + 1;
+	}
+	kds->length = con->m_offset;
+
+	iovec = palloc0(offsetof(strom_io_vector, ioc[nr_chunks]));
+	iovec->nr_chunks = nr_chunks;
+	if (nr_chunks > 0)
+		memcpy(iovec->ioc, con->ioc, sizeof(strom_io_chunk) * nr_chunks);
+	return iovec;
+}
+
+/*
+ * __dump_kds_and_iovec - just for debug
+ */
+static inline void
+__dump_kds_and_iovec(kern_data_store *kds, strom_io_vector *iovec)
+{
+#if 0
+	int		j;
+
+	elog(INFO, "nchunks = %d", iovec->nr_chunks);
+	for (j=0; j < iovec->nr_chunks; j++)
+	{
+		strom_io_chunk *ioc = &iovec->ioc[j];
+
+		elog(INFO, "io[%d] [ m_offset=%lu, f_read=%lu...%lu, nr_pages=%u}",
+			 j,
+			 ioc->m_offset,
+			 ioc->fchunk_id * PAGE_SIZE,
+			 (ioc->fchunk_id + ioc->nr_pages) * PAGE_SIZE,
+			 ioc->nr_pages);
+	}
+
+	elog(INFO, "kds {length=%zu nitems=%u typeid=%u typmod=%u table_oid=%u}",
+		 kds->length, kds->nitems,
+		 kds->tdtypeid, kds->tdtypmod, kds->table_oid);
+	for (j=0; j < kds->nr_colmeta; j++)
+	{
+		kern_colmeta *cmeta = &kds->colmeta[j];
+
+		elog(INFO, "%ccol[%d] nullmap=%lu,%lu values=%lu,%lu extra=%lu,%lu",
+			 j < kds->ncols ? ' ' : '*', j,
+			 __kds_unpack(cmeta->nullmap_offset),
+			 __kds_unpack(cmeta->nullmap_length),
+			 __kds_unpack(cmeta->values_offset),
+			 __kds_unpack(cmeta->values_length),
+			 __kds_unpack(cmeta->extra_offset),
+			 __kds_unpack(cmeta->extra_length));
+
+	}
+#endif
+}
+
+/*
+ * arrowFdwHasDictionary - true, if any referenced column is dictionary-encoded
+ */
+static bool
+arrowFdwHasDictionary(RecordBatchState *rb_state, Bitmapset *referenced)
+{
+	int		j;
+
+	for (j=0; j < rb_state->ncols; j++)
+	{
+		int		attidx = j + 1 - FirstLowInvalidHeapAttributeNumber;
+
+		if (rb_state->columns[j].dict_unitsz > 0 &&
+			bms_is_member(attidx, referenced))
+			return true;
+	}
+	return false;
+}
+
+/*
+ * __arrowFdwLoadRecordBatchCompressed
+ *
+ * Each buffer of the compressed RecordBatch (BodyCompression; Arrow V5) has
+ * an int64 prefix of the uncompressed length, or -1 if the buffer is not
+ * actually compressed, followed by the compressed body. So, the referenced
+ * buffers are read at once to lay out the KDS by the prefixes, then they are
+ * decompressed onto the KDS one by one.
+ *
+ * NOTE: decompression runs on the backend itself, not on any threads of its
+ * own, like other CPU scan paths of arrow_fdw. Parallel query distributes
+ * the RecordBatches to the workers if more CPU is needed.
+ */
+typedef struct
+{
+	off_t		f_offset;		/* offset of the buffer from rb_offset */
+	size_t		f_length;		/* length of the buffer in the file */
+	size_t		min_length;		/* expected length at least */
+	cl_uint	   *p_cmeta_offset;
+	cl_uint	   *p_cmeta_length;
+	const char *src;			/* compressed body on the temporary buffer */
+	size_t		src_len;
+	char	   *dest;			/* destination on the KDS */
+	size_t		dest_len;
+	bool		compressed;		/* false, if prefix is -1 */
+} arrowDecompressItem;
+
+static int
+__arrowFdwSetupDecompressItem(arrowDecompressItem *items, int nitems,
+							  off_t f_offset, size_t f_length,
+							  size_t min_length,
+							  cl_uint *p_cmeta_offset,
+							  cl_uint *p_cmeta_length)
+{
+	arrowDecompressItem *item = &items[nitems];
+
+	memset(item, 0, sizeof(arrowDecompressItem));
+	item->f_offset = f_offset;
+	item->f_length = f_length;
+	item->min_length = min_length;
+	item->p_cmeta_offset = p_cmeta_offset;
+	item->p_cmeta_length = p_cmeta_length;
+
+	return nitems + 1;
+}
+
+static int
+__arrowFdwSetupDecompressField(arrowDecompressItem *items, int nitems,
+							   RecordBatchFieldState *fstate,
+							   kern_data_store *kds,
+							   kern_colmeta *cmeta)
+{
+	size_t		min_length = 0;
+	int			unitsz = -1;
+	int			j;
+
+	if (fstate->nullmap_length > 0)
+		nitems = __arrowFdwSetupDecompressItem(items, nitems,
+											   fstate->nullmap_offset,
+											   fstate->nullmap_length,
+											   BITMAPLEN(fstate->nitems),
+											   &cmeta->nullmap_offset,
+											   &cmeta->nullmap_length);
+	if (fstate->values_length > 0)
+	{
+		if (cmeta->atttypkind == TYPE_KIND__BASE)
+			unitsz = (fstate->dict_unitsz > 0
+					  ? fstate->dict_unitsz
+					  : __arrowFdwFieldUnitSize(cmeta->atttypid,
+												&cmeta->attopts));
+		if (unitsz > 0)
+			min_length = unitsz * fstate->nitems;
+		else if (unitsz == 0)
+			min_length = sizeof(cl_uint) * (fstate->nitems + 1);
+		nitems = __arrowFdwSetupDecompressItem(items, nitems,
+											   fstate->values_offset,
+											   fstate->values_length,
+											   min_length,
+											   &cmeta->values_offset,
+											   &cmeta->values_length);
+	}
+	if (fstate->extra_length > 0)
+		nitems = __arrowFdwSetupDecompressItem(items, nitems,
+											   fstate->extra_offset,
+											   fstate->extra_length,
+											   0,
+											   &cmeta->extra_offset,
+											   &cmeta->extra_length);
+	/* nested sub-fields if composite types */
+	if (cmeta->atttypkind == TYPE_KIND__ARRAY ||
+		cmeta->atttypkind == TYPE_KIND__COMPOSITE)
+	{
+		kern_colmeta *subattr;
+
+		Assert(fstate->num_children == cmeta->num_subattrs);
+		for (j=0, subattr = &kds->colmeta[cmeta->idx_subattrs];
+			 j < cmeta->num_subattrs;
+			 j++, subattr++)
+		{
+			nitems = __arrowFdwSetupDecompressField(items, nitems,
+													&fstate->children[j],
+													kds, subattr);
+		}
+	}
+	return nitems;
+}
+
+/*
+ * __arrowFdwDecompressBuffer - returns an error message, if any, instead of
+ * elog(), to release the decompression context of the library.
+ */
+static const char *
+__arrowFdwDecompressBuffer(ArrowCompressionType codec,
+						   char *dest, size_t dest_len,
+						   const char *src, size_t src_len)
+{
+	switch (codec)
+	{
+#ifdef WITH_LZ4
+		case ArrowCompressionType__LZ4_FRAME:
+			{
+				LZ4F_dctx  *dctx;
+				size_t		d_pos = 0;
+				size_t		s_pos = 0;
+				size_t		rv;
+
+				rv = LZ4F_createDecompressionContext(&dctx, LZ4F_VERSION);
+				if (LZ4F_isError(rv))
+					return LZ4F_getErrorName(rv);
+				do {
+					size_t	d_sz = dest_len - d_pos;
+					size_t	s_sz = src_len - s_pos;
+
+					rv = LZ4F_decompress(dctx,
+										 dest + d_pos, &d_sz,
+										 src + s_pos, &s_sz, NULL);
+					if (LZ4F_isError(rv))
+						break;
+					d_pos += d_sz;
+					s_pos += s_sz;
+					if (d_sz == 0 && s_sz == 0)
+						break;		/* no progress */
+				} while (rv != 0 && s_pos < src_len);
+				LZ4F_freeDecompressionContext(dctx);
+				if (LZ4F_isError(rv))
+					return LZ4F_getErrorName(rv);
+				if (d_pos != dest_len)
+					return "LZ4 frame has unexpected length";
+			}
+			return NULL;
+#endif
+#ifdef WITH_ZSTD
+		case ArrowCompressionType__ZSTD:
+			{
+				size_t		rv = ZSTD_decompress(dest, dest_len,
+												 src, src_len);
+				if (ZSTD_isError(rv))
+					return ZSTD_getErrorName(rv);
+				if (rv != dest_len)
+					return "ZSTD frame has unexpected length";
+			}
+			return NULL;
+#endif
+		default:
+			break;
+	}
+	return "compression codec is not supported in this build";
+}
+
+static void
+arrowFdwDecompressBuffers(ArrowCompressionType codec,
+						  arrowDecompressItem *items, int nitems)
+{
+	const char *errmsg;
+	int			i;
+
+	for (i=0; i < nitems; i++)
+	{
+		arrowDecompressItem *item = &items[i];
+
+		if (!item->compressed)
+			memcpy(item->dest, item->src, item->src_len);
+		else
+		{
+			errmsg = __arrowFdwDecompressBuffer(codec,
+												item->dest,
+												item->dest_len,
+												item->src,
+												item->src_len);
+			if (errmsg)
+				elog(ERROR, "arrow_fdw: failed on decompression of RecordBatch: %s",
+					 errmsg);
+		}
+	}
+}
+
+static pgstrom_data_store *
+__arrowFdwLoadRecordBatchCompressed(RecordBatchState *rb_state,
+									Relation relation,
+									Bitmapset *referenced,
+									GpuContext *gcontext,
+									MemoryContext mcontext)
+{
+	TupleDesc			tupdesc = RelationGetDescr(relation);
+	pgstrom_data_store *pds;
+	kern_data_store	   *kds;
+	arrowDecompressItem *items;
+	int					fdesc = FileGetRawDesc(rb_state->fdesc);
+	size_t				head_sz;
+	size_t				total_sz = 0;
+	size_t				m_offset;
+	char			   *temp;
+	char			   *pos;
+	int					i, j, nitems = 0;
+	CUresult			rc;
+
+	/* setup KDS as __arrowFdwLoadRecordBatch doing */
+	head_sz = KDS_calculateHeadSize(tupdesc);
+	kds = alloca(head_sz);
+	init_kernel_data_store(kds, tupdesc, 0, KDS_FORMAT_ARROW, 0);
+	kds->nitems = rb_state->rb_nitems;
+	kds->nrooms = rb_state->rb_nitems;
+	kds->table_oid = RelationGetRelid(relation);
+	Assert(head_sz == KERN_DATA_STORE_HEAD_LENGTH(kds));
+	for (j=0; j < kds->nr_colmeta; j++)
+		kds->colmeta[j].attopts = rb_state->columns[j].attopts;
+
+	/* pick up the referenced buffers */
+	items = palloc(sizeof(arrowDecompressItem) * 3 * kds->nr_colmeta);
+	for (j=0; j < kds->ncols; j++)
+	{
+		int		attidx = j + 1 - FirstLowInvalidHeapAttributeNumber;
+
+		if (referenced && bms_is_member(attidx, referenced))
+			nitems = __arrowFdwSetupDecompressField(items, nitems,
+													&rb_state->columns[j],
+													kds,
+													&kds->colmeta[j]);
+	}
+	Assert(nitems <= 3 * kds->nr_colmeta);
+
+	/* read the compressed buffers, then lay out the KDS by the prefix */
+	for (i=0; i < nitems; i++)
+		total_sz += MAXALIGN(items[i].f_length);
+	temp = MemoryContextAllocHuge(CurrentMemoryContext, total_sz + 1);
+	pos = temp;
+	m_offset = MAXALIGN(head_sz);
+	for (i=0; i < nitems; i++)
+	{
+		arrowDecompressItem *item = &items[i];
+		int64		prefix;
+		size_t		length;
+
+		if (item->f_length < sizeof(int64))
+			elog(ERROR, "arrow file '%s' has corrupted compressed buffer",
+				 FilePathName(rb_state->fdesc));
+		if (__preadFile(fdesc, pos, item->f_length,
+						rb_state->rb_offset +
+						item->f_offset) != item->f_length)
+			elog(ERROR, "failed on pread('%s'): %m",
+				 FilePathName(rb_state->fdesc));
+		memcpy(&prefix, pos, sizeof(int64));
+		item->src = pos + sizeof(int64);
+		item->src_len = item->f_length - sizeof(int64);
+		if (prefix == -1)
+		{
+			item->compressed = false;
+			length = item->src_len;
+		}
+		else if (prefix >= 0)
+		{
+			item->compressed = true;
+			length = prefix;
+		}
+		else
+			elog(ERROR, "arrow file '%s' has corrupted compressed buffer",
+				 FilePathName(rb_state->fdesc));
+		if (length < item->min_length)
+			elog(ERROR, "arrow file '%s' has buffer smaller than expected",
+				 FilePathName(rb_state->fdesc));
+		item->dest_len = length;
+		*item->p_cmeta_offset = __kds_packed(m_offset);
+		*item->p_cmeta_length = __kds_packed(MAXALIGN(length));
+		m_offset += MAXALIGN(length);
+		pos += MAXALIGN(item->f_length);
+	}
+	kds->length = m_offset;
+
+	/* allocation of the KDS */
+	if (gcontext)
+	{
+		rc = gpuMemAllocManaged(gcontext,
+								(CUdeviceptr *)&pds,
+								offsetof(pgstrom_data_store,
+										 kds) + kds->length,
+								CU_MEM_ATTACH_GLOBAL);
+		if (rc != CUDA_SUCCESS)
+			elog(ERROR, "failed on gpuMemAllocManaged: %s", errorText(rc));
+	}
+	else
+	{
+		pds = MemoryContextAllocHuge(mcontext,
+									 offsetof(pgstrom_data_store,
+											  kds) + kds->length);
+	}
+	memset(pds, 0, offsetof(pgstrom_data_store, kds));
+	pds->gcontext = gcontext;
+	pg_atomic_init_u32(&pds->refcnt, 1);
+	pds->nblocks_uncached = 0;
+	pds->filedesc = -1;
+	pds->iovec = NULL;
+	memcpy(&pds->kds, kds, head_sz);
+
+	/* decompress the buffers onto the KDS */
+	for (i=0; i < nitems; i++)
+	{
+		arrowDecompressItem *item = &items[i];
+		size_t		offset = __kds_unpack(*item->p_cmeta_offset);
+		size_t		length = __kds_unpack(*item->p_cmeta_length);
+
+		/* NOTE: p_cmeta_* points the local KDS, not pds->kds */
+		item->dest = (char *)&pds->kds + offset;
+		if (length > item->dest_len)
+			memset(item->dest + item->dest_len, 0, length - item->dest_len);
+	}
+	arrowFdwDecompressBuffers(rb_state->rb_codec, items, nitems);
+
+	pfree(temp);
+	pfree(items);
+
+	return pds;
+}
+
+/*
+ * arrowFdwLoadRecordBatch
+ */
+static pgstrom_data_store *
+__arrowFdwLoadRecordBatch(RecordBatchState *rb_state,
+						  Relation relation,
+						  Bitmapset *referenced,
+						  GpuContext *gcontext,
+						  MemoryContext mcontext,
+						  int optimal_gpu)
+{
+	TupleDesc			tupdesc = RelationGetDescr(relation);
+	pgstrom_data_store *pds;
+	kern_data_store	   *kds;
+	strom_io_vector	   *iovec;
+	size_t				head_sz;
+	int					j, fdesc;
+	CUresult			rc;
+
+	/* compressed RecordBatch is decompressed on the private buffer */
+	if (rb_state->rb_compressed)
+		return __arrowFdwLoadRecordBatchCompressed(rb_state,
+												   relation,
+												   referenced,
+												   gcontext,
+												   mcontext);
+
+	/* setup KDS and I/O-vector */
+	head_sz = KDS_calculateHeadSize(tupdesc);
+	kds = alloca(head_sz);
+	init_kernel_data_store(kds, tupdesc, 0, KDS_FORMAT_ARROW, 0);
+	kds->nitems = rb_state->rb_nitems;
+	kds->nrooms = rb_state->rb_nitems;
+	kds->table_oid = RelationGetRelid(relation);
+	Assert(head_sz == KERN_DATA_STORE_HEAD_LENGTH(kds));
+	for (j=0; j < kds->nr_colmeta; j++)
+		kds->colmeta[j].attopts = rb_state->columns[j].attopts;
+	iovec = arrowFdwSetupIOvector(kds, rb_state, referenced);
+	__dump_kds_and_iovec(kds, iovec);
+
+	fdesc = FileGetRawDesc(rb_state->fdesc);
+	/*
+	 * If SSD-to-GPU Direct SQL is available on the arrow file, setup a small
+	 * PDS on host-pinned memory, with strom_io_vector.
+	 */
+	if (gcontext &&
+		gcontext->cuda_dindex == optimal_gpu &&
+		iovec->nr_chunks > 0 &&
+		kds->length <= gpuMemAllocIOMapMaxLength() &&
+		!arrowFdwHasDictionary(rb_state, referenced))
+	{
+		size_t	iovec_sz = offsetof(strom_io_vector, ioc[iovec->nr_chunks]);
+
+		rc = gpuMemAllocHost(gcontext, (void **)&pds,
+							 offsetof(pgstrom_data_store, kds) +
+							 head_sz + iovec_sz);
+		if (rc != CUDA_SUCCESS)
+			elog(ERROR, "failed on gpuMemAllocHost: %s", errorText(rc));
+
+		pds->gcontext = gcontext;
+		pg_atomic_init_u32(&pds->refcnt, 1);
+		pds->nblocks_uncached = 0;
+		pds->filedesc = fdesc;
+		pds->iovec = (strom_io_vector *)((char *)&pds->kds + head_sz);
+		memcpy(&pds->kds, kds, head_sz);
+		memcpy(pds->iovec, iovec, iovec_sz);
+	}
+	else
+	{
+		/* Elsewhere, load RecordBatch by filesystem */
+		if (gcontext)
+		{
+			rc = gpuMemAllocManaged(gcontext,
+									(CUdeviceptr *)&pds,
+									offsetof(pgstrom_data_store,
+											 kds) + kds->length,
+									CU_MEM_ATTACH_GLOBAL);
+			if (rc != CUDA_SUCCESS)
+				elog(ERROR, "failed on gpuMemAllocManaged: %s", errorText(rc));
+		}
+		else
+		{
+			pds = MemoryContextAllocHuge(mcontext,
+										 offsetof(pgstrom_data_store,
+												  kds) + kds->length);
+		}
+		__PDS_fillup_arrow(pds, gcontext, kds, fdesc, iovec);
+	}
+	pfree(iovec);
+	return pds;
+}
+
+/*
+ * arrowFdwDecodeDictionary
+ *
+ * It materializes the dictionary-encoded columns on the tail of KDS, as
+ * usual variable-length values, so GPU kernels and the tuple fetch don't
+ * need to care about dictionaries. The rows not selected by the selvec are
+ * decoded to empty values, because their indices may not be loaded.
+ */
+static size_t
+__arrowFdwDecodeDictionaryColumn(kern_data_store *kds,
+								 kern_colmeta *cmeta,
+								 RecordBatchFieldState *fstate,
+								 arrowDictionary *dict,
+								 const uint8 *selvec,
+								 char *dest)
+{
+	const char *codes = (const char *)kds + __kds_unpack(cmeta->values_offset);
+	const uint8 *nullmap = NULL;
+	cl_uint	   *offsets = NULL;
+	char	   *extra = NULL;
+	size_t		head_sz = MAXALIGN(sizeof(cl_uint) * (kds->nitems + 1));
+	size_t		usage = 0;
+	size_t		i;
+
+	if (cmeta->nullmap_offset != 0)
+		nullmap = (const uint8 *)kds + __kds_unpack(cmeta->nullmap_offset);
+	if (dest)
+	{
+		offsets = (cl_uint *)dest;
+		extra = dest + head_sz;
+	}
+	for (i=0; i < kds->nitems; i++)
+	{
+		uint64		code;
+		size_t		len;
+
+		if (offsets)
+			offsets[i] = usage;
+		if ((selvec && !selvec[i]) ||
+			(nullmap && ((nullmap[i>>3] >> (i & 7)) & 1) == 0))
+			continue;
+		switch (fstate->dict_unitsz)
+		{
+			case sizeof(cl_uchar):
+				code = ((const cl_uchar *)codes)[i];
+				break;
+			case sizeof(cl_ushort):
+				code = ((const cl_ushort *)codes)[i];
+				break;
+			case sizeof(cl_uint):
+				code = ((const cl_uint *)codes)[i];
+				break;
+			default:
+				code = ((const cl_ulong *)codes)[i];
+				break;
+		}
+		if (code >= dict->nitems)
+			elog(ERROR, "arrow_fdw: index of dictionary is out of range");
+		len = dict->offsets[code+1] - dict->offsets[code];
+		if (extra)
+			memcpy(extra + usage, dict->extra + dict->offsets[code], len);
+		usage += len;
+		if (usage > UINT_MAX)
+			elog(ERROR, "arrow_fdw: too large dictionary-encoded values");
+	}
+	if (offsets)
+	{
+		offsets[kds->nitems] = usage;
+		cmeta->values_offset = __kds_packed((char *)offsets - (char *)kds);
+		cmeta->values_length = __kds_packed(head_sz);
+		cmeta->extra_offset = __kds_packed(extra - (char *)kds);
+		cmeta->extra_length = __kds_packed(MAXALIGN(usage));
+	}
+	return head_sz + MAXALIGN(usage);
+}
+
+static pgstrom_data_store *
+arrowFdwDecodeDictionary(pgstrom_data_store *pds,
+						 RecordBatchState *rb_state,
+						 Bitmapset *referenced,
+						 const uint8 *selvec,
+						 GpuContext *gcontext)
+{
+	size_t	   *lengths = alloca(sizeof(size_t) * rb_state->ncols);
+	size_t		required = 0;
+	size_t		kds_length;
+	char	   *pos;
+	int			j;
+
+	if (!arrowFdwHasDictionary(rb_state, referenced))
+		return pds;
+	/* 1st pass: calculation of the required length */
+	for (j=0; j < rb_state->ncols; j++)
+	{
+		RecordBatchFieldState *fstate = &rb_state->columns[j];
+		arrowDictionary *dict;
+		int		attidx = j + 1 - FirstLowInvalidHeapAttributeNumber;
+
+		lengths[j] = 0;
+		if (fstate->dict_unitsz == 0 ||
+			pds->kds.colmeta[j].values_offset == 0 ||
+			!bms_is_member(attidx, referenced))
+			continue;
+		dict = arrowLookupDictionary(rb_state, fstate);
+		lengths[j] = __arrowFdwDecodeDictionaryColumn(&pds->kds,
+													  &pds->kds.colmeta[j],
+													  fstate, dict,
+													  selvec, NULL);
+		required += lengths[j];
+	}
+	/* expand the buffer */
+	kds_length = pds->kds.length;
+	if (gcontext)
+	{
+		pgstrom_data_store *pds_new;
+		CUresult	rc;
+
+		rc = gpuMemAllocManaged(gcontext,
+								(CUdeviceptr *)&pds_new,
+								offsetof(pgstrom_data_store,
+										 kds) + kds_length + required,
+								CU_MEM_ATTACH_GLOBAL);
+		if (rc != CUDA_SUCCESS)
+			elog(ERROR, "failed on gpuMemAllocManaged: %s", errorText(rc));
+		memcpy(pds_new, pds, offsetof(pgstrom_data_store,
+									  kds) + kds_length);
+		rc = gpuMemFree(gcontext, (CUdeviceptr)pds);
+		if (rc != CUDA_SUCCESS)
+			elog(ERROR, "failed on gpuMemFree: %s", errorText(rc));
+		pds = pds_new;
+	}
+	else
+	{
+		pds = repalloc_huge(pds, offsetof(pgstrom_data_store,
+										  kds) + kds_length + required);
+	}
+	/* 2nd pass: decode the indices */
+	pos = (char *)&pds->kds + kds_length;
+	for (j=0; j < rb_state->ncols; j++)
+	{
+		RecordBatchFieldState *fstate = &rb_state->columns[j];
+		arrowDictionary *dict;
+
+		if (lengths[j] == 0)
+			continue;
+		dict = arrowLookupDictionary(rb_state, fstate);
+		pos += __arrowFdwDecodeDictionaryColumn(&pds->kds,
+												&pds->kds.colmeta[j],
+												fstate, dict,
+												selvec, pos);
+	}
+	Assert(pos == (char *)&pds->kds + kds_length + required);
+	pds->kds.length = kds_length + required;
+
+	return pds;
+}
+
+/*
+ * Zero-copy RecordBatch access for CPU scan
+ *
+ * When arrow_fdw.enable_mmap is on, CPU scan maps the RecordBatch on the
+ * arrow file read-only, and kern_colmeta points the buffers on the mapping
+ * directly, instead of the copy by pread(2) to the private buffer.
+ * The virtual address space is reserved first, then the head portion keeps
+ * PDS/KDS header, and the arrow file is mapped on the rest.
+ */
+static bool
+__arrowFdwSetupMmapField(kern_data_store *kds,
+						 kern_colmeta *cmeta,
+						 RecordBatchFieldState *fstate,
+						 size_t m_base)
+{
+	if (fstate->nullmap_length > 0)
+	{
+		size_t	m_offset = m_base + fstate->nullmap_offset;
+
+		if (m_offset != MAXALIGN(m_offset))
+			return false;
+		cmeta->nullmap_offset = __kds_packed(m_offset);
+		cmeta->nullmap_length = __kds_packed(fstate->nullmap_length);
+	}
+	if (fstate->values_length > 0)
+	{
+		size_t	m_offset = m_base + fstate->values_offset;
+
+		if (m_offset != MAXALIGN(m_offset))
+			return false;
+		cmeta->values_offset = __kds_packed(m_offset);
+		cmeta->values_length = __kds_packed(fstate->values_length);
+	}
+	if (fstate->extra_length > 0)
+	{
+		size_t	m_offset = m_base + fstate->extra_offset;
+
+		if (m_offset != MAXALIGN(m_offset))
+			return false;
+		cmeta->extra_offset = __kds_packed(m_offset);
+		cmeta->extra_length = __kds_packed(fstate->extra_length);
+	}
+
+	/* nested sub-fields if composite types */
+	if (cmeta->atttypkind == TYPE_KIND__ARRAY ||
+		cmeta->atttypkind == TYPE_KIND__COMPOSITE)
+	{
+		kern_colmeta *subattr;
+		int		j;
+
+		Assert(fstate->num_children == cmeta->num_subattrs);
+		for (j=0, subattr = &kds->colmeta[cmeta->idx_subattrs];
+			 j < cmeta->num_subattrs;
+			 j++, subattr++)
+		{
+			if (!__arrowFdwSetupMmapField(kds, subattr,
+										  &fstate->children[j], m_base))
+				return false;
+		}
+	}
+	return true;
+}
+
+static pgstrom_data_store *
+__arrowFdwMmapRecordBatch(RecordBatchState *rb_state,
+						  Relation relation,
+						  Bitmapset *referenced)
+{
+	TupleDesc			tupdesc = RelationGetDescr(relation);
+	pgstrom_data_store *pds;
+	kern_data_store	   *kds;
+	size_t				head_sz;
+	size_t				mmap_head;
+	size_t				mmap_length;
+	size_t				m_base;
+	off_t				f_base;
+	char			   *mmap_addr;
+	int					j, fdesc;
+
+	/* setup KDS that points the buffers on the file mapping */
+	head_sz = KDS_calculateHeadSize(tupdesc);
+	kds = alloca(head_sz);
+	init_kernel_data_store(kds, tupdesc, 0, KDS_FORMAT_ARROW, 0);
+	kds->nitems = rb_state->rb_nitems;
+	kds->nrooms = rb_state->rb_nitems;
+	kds->table_oid = RelationGetRelid(relation);
+	Assert(head_sz == KERN_DATA_STORE_HEAD_LENGTH(kds));
+	for (j=0; j < kds->nr_colmeta; j++)
+		kds->colmeta[j].attopts = rb_state->columns[j].attopts;
+
+	f_base = TYPEALIGN_DOWN(PAGE_SIZE, rb_state->rb_offset);
+	mmap_head = TYPEALIGN(PAGE_SIZE, offsetof(pgstrom_data_store,
+											  kds) + head_sz);
+	mmap_length = TYPEALIGN(PAGE_SIZE, (rb_state->rb_offset - f_base) +
+							rb_state->rb_length);
+	m_base = (mmap_head - offsetof(pgstrom_data_store, kds) +
+			  (rb_state->rb_offset - f_base));
+	for (j=0; j < kds->ncols; j++)
+	{
+		int		attidx = j + 1 - FirstLowInvalidHeapAttributeNumber;
+
+		if (!bms_is_member(attidx, referenced))
+			continue;
+		/* unaligned buffers cannot be pointed by kern_colmeta */
+		if (!__arrowFdwSetupMmapField(kds, &kds->colmeta[j],
+									  &rb_state->columns[j], m_base))
+			return NULL;
+	}
+	kds->length = mmap_head - offsetof(pgstrom_data_store,
+									   kds) + mmap_length;
+
+	/* reserve the address space, then map the arrow file on the tail */
+	mmap_addr = __mmapFile(NULL, mmap_head + mmap_length,
+						   PROT_READ | PROT_WRITE,
+						   MAP_PRIVATE | MAP_ANONYMOUS,
+						   -1, 0);
+	if (mmap_addr == MAP_FAILED)
+		elog(ERROR, "failed on __mmapFile: %m");
+	fdesc = FileGetRawDesc(rb_state->fdesc);
+	if (mmap(mmap_addr + mmap_head, mmap_length,
+			 PROT_READ,
+			 MAP_SHARED | MAP_FIXED,
+			 fdesc, f_base) == MAP_FAILED)
+	{
+		int		errno_saved = errno;
+
+		__munmapFile(mmap_addr);
+		errno = errno_saved;
+		elog(ERROR, "failed on mmap('%s'): %m",
+			 FilePathName(rb_state->fdesc));
+	}
+	pds = (pgstrom_data_store *)mmap_addr;
+	pg_atomic_init_u32(&pds->refcnt, 1);
+	pds->filedesc = -1;
+	pds->is_mmap = true;
+	memcpy(&pds->kds, kds, head_sz);
+
+	return pds;
+}
+
+/*
+ * Shared RecordBatch buffer cache
+ *
+ * When arrow_fdw.buffer_cache_size is configured, CPU scan keeps the loaded
+ * RecordBatch (KDS_FORMAT_ARROW) on the shared memory, then concurrent scans
+ * on the same RecordBatch attach the cached buffer instead of re-reading it.
+ * The buffer is reference counted by pds->refcnt; the cache entry holds one,
+ * and every scan holds one during it is attached. Backend tracks the buffers
+ * it is attaching, to release them on transaction abort.
+ */
+static uint32
+arrowBufferCacheHash(RecordBatchState *rb_state, Oid table_oid)
+{
+	struct {
+		dev_t	st_dev;
+		ino_t	st_ino;
+		Oid		table_oid;
+		int		rb_index;
+	} key;
+
+	memset(&key, 0, sizeof(key));
+	key.st_dev = rb_state->stat_buf.st_dev;
+	key.st_ino = rb_state->stat_buf.st_ino;
+	key.table_oid = table_oid;
+	key.rb_index = rb_state->rb_index;
+
+	return hash_any((unsigned char *)&key, sizeof(key));
+}
+
+static bool
+arrowBufferCacheMatch(arrowBufferCache *bcache,
+					  RecordBatchState *rb_state,
+					  Oid table_oid,
+					  Bitmapset *referenced,
+					  uint32 hash)
+{
+	int		j, k;
+
+	if (bcache->hash != hash ||
+		bcache->st_dev != rb_state->stat_buf.st_dev ||
+		bcache->st_ino != rb_state->stat_buf.st_ino ||
+		bcache->table_oid != table_oid ||
+		bcache->rb_index != rb_state->rb_index ||
+		timespec_comp(&bcache->st_mtim, &rb_state->stat_buf.st_mtim) != 0)
+		return false;
+	/* cached buffer must have all the referenced columns */
+	for (j=0, k=0; j < rb_state->ncols; j++)
+	{
+		int		attidx = j + 1 - FirstLowInvalidHeapAttributeNumber;
+
+		if (!bms_is_member(attidx, referenced))
+			continue;
+		while (k < bcache->nattrs && bcache->attnums[k] < j + 1)
+			k++;
+		if (k >= bcache->nattrs || bcache->attnums[k] != j + 1)
+			return false;
+	}
+	return true;
+}
+
+/*
+ * arrowLookupBufferCache - attach the cached RecordBatch, if any
+ */
+static pgstrom_data_store *
+arrowLookupBufferCache(RecordBatchState *rb_state,
+					   Oid table_oid,
+					   Bitmapset *referenced,
+					   uint32 hash)
+{
+	uint32		index = hash % ARROW_BUFCACHE_HASH_NSLOTS;
+	LWLock	   *lock = &arrow_metadata_state->bufcache_locks[index];
+	pgstrom_data_store *pds = NULL;
+	dlist_iter	iter;
+
+	LWLockAcquire(lock, LW_SHARED);
+	dlist_foreach(iter, &arrow_metadata_state->bufcache_slots[index])
+	{
+		arrowBufferCache *bcache = dlist_container(arrowBufferCache,
+												   chain, iter.cur);
+		if (arrowBufferCacheMatch(bcache, rb_state, table_oid,
+								  referenced, hash))
+		{
+			pds = bcache->pds;
+			pg_atomic_fetch_add_u32(&pds->refcnt, 1);
+
+			SpinLockAcquire(&arrow_metadata_state->bufcache_lru_lock);
+			dlist_move_head(&arrow_metadata_state->bufcache_lru_list,
+							&bcache->lru_chain);
+			SpinLockRelease(&arrow_metadata_state->bufcache_lru_lock);
+			break;
+		}
+	}
+	LWLockRelease(lock);
+
+	return pds;
+}
+
+/*
+ * arrowInvalidateBufferCache
+ *
+ * NOTE: caller must have exclusive lock on bufcache_locks[], and the entry
+ * must be already detached from the LRU list.
+ */
+static uint64
+arrowInvalidateBufferCache(arrowBufferCache *bcache)
+{
+	size_t		length = bcache->length;
+
+	dlist_delete(&bcache->chain);
+	PDS_release(bcache->pds);
+	pfree(bcache);
+
+	return pg_atomic_sub_fetch_u64(&arrow_metadata_state->bufcache_consumed,
+								   length);
+}
+
+/*
+ * arrowReclaimBufferCache - reclaim the LRU entries to make room
+ */
+static void
+arrowReclaimBufferCache(size_t required)
+{
+	size_t		limit = ((size_t)arrow_buffer_cache_size_kb << 10);
+	arrowBufferCache *bcache;
+	LWLock	   *lock;
+	dlist_node *dnode;
+	uint32		lru_hash;
+	uint32		lru_index;
+	uint64		consumed;
+
+	consumed = pg_atomic_read_u64(&arrow_metadata_state->bufcache_consumed);
+	while (consumed + required > limit)
+	{
+		SpinLockAcquire(&arrow_metadata_state->bufcache_lru_lock);
+		if (dlist_is_empty(&arrow_metadata_state->bufcache_lru_list))
+		{
+			SpinLockRelease(&arrow_metadata_state->bufcache_lru_lock);
+			break;
+		}
+		dnode = dlist_tail_node(&arrow_metadata_state->bufcache_lru_list);
+		bcache = dlist_container(arrowBufferCache, lru_chain, dnode);
+		lru_hash = bcache->hash;
+		SpinLockRelease(&arrow_metadata_state->bufcache_lru_lock);
+
+		lru_index = lru_hash % ARROW_BUFCACHE_HASH_NSLOTS;
+		lock = &arrow_metadata_state->bufcache_locks[lru_index];
+		LWLockAcquire(lock, LW_EXCLUSIVE);
+		SpinLockAcquire(&arrow_metadata_state->bufcache_lru_lock);
+		if (dlist_is_empty(&arrow_metadata_state->bufcache_lru_list))
+		{
+			SpinLockRelease(&arrow_metadata_state->bufcache_lru_lock);
+			LWLockRelease(lock);
+			break;
+		}
+		dnode = dlist_tail_node(&arrow_metadata_state->bufcache_lru_list);
+		bcache = dlist_container(arrowBufferCache, lru_chain, dnode);
+		if (bcache->hash == lru_hash)
+		{
+			dlist_delete(&bcache->lru_chain);
+			SpinLockRelease(&arrow_metadata_state->bufcache_lru_lock);
+			consumed = arrowInvalidateBufferCache(bcache);
+		}
+		else
+		{
+			/* LRU-tail was referenced by someone, try again */
+			SpinLockRelease(&arrow_metadata_state->bufcache_lru_lock);
+			consumed = pg_atomic_read_u64(&arrow_metadata_state->bufcache_consumed);
+		}
+		LWLockRelease(lock);
+	}
+}
+
+/*
+ * arrowFdwLoadRecordBatchCached
+ *
+ * It attaches the RecordBatch on the shared buffer cache, or loads the
+ * RecordBatch onto the shared memory and registers it. It returns NULL if
+ * the RecordBatch cannot be cached, then caller loads it privately.
+ */
+static pgstrom_data_store *
+arrowFdwLoadRecordBatchCached(ArrowFdwState *af_state,
+							  RecordBatchState *rb_state,
+							  Relation relation,
+							  EState *estate)
+{
+	TupleDesc			tupdesc = RelationGetDescr(relation);
+	Oid					table_oid = RelationGetRelid(relation);
+	arrowBufferCacheTracker *tracker;
+	arrowBufferCache   *bcache;
+	pgstrom_data_store *pds;
+	kern_data_store	   *kds;
+	strom_io_vector	   *iovec;
+	size_t				head_sz;
+	size_t				length;
+	uint32				hash;
+	uint32				index;
+	LWLock			   *lock;
+	dlist_iter			iter;
+	int					j, nattrs;
+
+	tracker = MemoryContextAlloc(TopMemoryContext,
+								 sizeof(arrowBufferCacheTracker));
+	hash = arrowBufferCacheHash(rb_state, table_oid);
+	pds = arrowLookupBufferCache(rb_state, table_oid,
+								 af_state->referenced, hash);
+	if (pds)
+		goto found;
+
+	/* setup KDS and I/O-vector as __arrowFdwLoadRecordBatch doing */
+	head_sz = KDS_calculateHeadSize(tupdesc);
+	kds = alloca(head_sz);
+	init_kernel_data_store(kds, tupdesc, 0, KDS_FORMAT_ARROW, 0);
+	kds->nitems = rb_state->rb_nitems;
+	kds->nrooms = rb_state->rb_nitems;
+	kds->table_oid = table_oid;
+	Assert(head_sz == KERN_DATA_STORE_HEAD_LENGTH(kds));
+	for (j=0; j < kds->nr_colmeta; j++)
+		kds->colmeta[j].attopts = rb_state->columns[j].attopts;
+	iovec = arrowFdwSetupIOvector(kds, rb_state, af_state->referenced);
+
+	nattrs = 0;
+	for (j=0; j < rb_state->ncols; j++)
+	{
+		int		attidx = j + 1 - FirstLowInvalidHeapAttributeNumber;
+
+		if (bms_is_member(attidx, af_state->referenced))
+			nattrs++;
+	}
+	length = (MAXALIGN(offsetof(arrowBufferCache, attnums[nattrs])) +
+			  MAXALIGN(offsetof(pgstrom_data_store, kds) + kds->length));
+	if (length > ((size_t)arrow_buffer_cache_size_kb << 10))
+		goto bailout;		/* too large RecordBatch to cache */
+	if (offsetof(pgstrom_data_store, kds) + kds->length >
+		SharedMemoryChunkSizeLimit())
+		goto bailout;		/* larger than a shared memory segment */
+	arrowReclaimBufferCache(length);
+
+	bcache = MemoryContextAllocExtended(TopSharedMemoryContext,
+										offsetof(arrowBufferCache,
+												 attnums[nattrs]),
+										MCXT_ALLOC_NO_OOM | MCXT_ALLOC_ZERO);
+	if (!bcache)
+		goto bailout;
+	pds = MemoryContextAllocExtended(TopSharedMemoryContext,
+									 offsetof(pgstrom_data_store,
+											  kds) + kds->length,
+									 MCXT_ALLOC_HUGE | MCXT_ALLOC_NO_OOM);
+	if (!pds)
+	{
+		pfree(bcache);
+		goto bailout;
+	}
+	PG_TRY();
+	{
+		__PDS_fillup_arrow(pds, NULL, kds,
+						   FileGetRawDesc(rb_state->fdesc), iovec);
+	}
+	PG_CATCH();
+	{
+		pfree(pds);
+		pfree(bcache);
+		PG_RE_THROW();
+	}
+	PG_END_TRY();
+	pfree(iovec);
+
+	bcache->hash = hash;
+	bcache->st_dev = rb_state->stat_buf.st_dev;
+	bcache->st_ino = rb_state->stat_buf.st_ino;
+	bcache->st_mtim = rb_state->stat_buf.st_mtim;
+	bcache->table_oid = table_oid;
+	bcache->rb_index = rb_state->rb_index;
+	bcache->length = length;
+	bcache->pds = pds;		/* pds->refcnt = 1 by the cache entry */
+	bcache->nattrs = 0;
+	for (j=0; j < rb_state->ncols; j++)
+	{
+		int		attidx = j + 1 - FirstLowInvalidHeapAttributeNumber;
+
+		if (bms_is_member(attidx, af_state->referenced))
+			bcache->attnums[bcache->nattrs++] = j + 1;
+	}
+
+	/* register the cache entry, unless someone already did */
+	index = hash % ARROW_BUFCACHE_HASH_NSLOTS;
+	lock = &arrow_metadata_state->bufcache_locks[index];
+	LWLockAcquire(lock, LW_EXCLUSIVE);
+	dlist_foreach(iter, &arrow_metadata_state->bufcache_slots[index])
+	{
+		arrowBufferCache *temp = dlist_container(arrowBufferCache,
+												 chain, iter.cur);
+		if (arrowBufferCacheMatch(temp, rb_state, table_oid,
+								  af_state->referenced, hash))
+		{
+			pds = temp->pds;
+			pg_atomic_fetch_add_u32(&pds->refcnt, 1);
+			LWLockRelease(lock);
+
+			pfree(bcache->pds);
+			pfree(bcache);
+			goto found;
+		}
+	}
+	pg_atomic_fetch_add_u32(&pds->refcnt, 1);
+	dlist_push_head(&arrow_metadata_state->bufcache_slots[index],
+					&bcache->chain);
+	SpinLockAcquire(&arrow_metadata_state->bufcache_lru_lock);
+	dlist_push_head(&arrow_metadata_state->bufcache_lru_list,
+					&bcache->lru_chain);
+	SpinLockRelease(&arrow_metadata_state->bufcache_lru_lock);
+	pg_atomic_add_fetch_u64(&arrow_metadata_state->bufcache_consumed, length);
+	LWLockRelease(lock);
+found:
+	tracker->pds = pds;
+	dlist_push_head(&arrow_buffer_cache_tracker_list, &tracker->chain);
+	if (af_state->vfilter)
+		arrowFdwApplyVectorFilter(af_state, &pds->kds, rb_state, estate);
+	return pds;
+
+bailout:
+	pfree(iovec);
+	pfree(tracker);
+	return NULL;
+}
+
+/*
+ * arrowFdwReleaseRecordBatch - release the RecordBatch loaded by CPU scan
+ */
+static void
+arrowFdwReleaseRecordBatch(pgstrom_data_store *pds)
+{
+	dlist_mutable_iter iter;
+
+	dlist_foreach_modify(iter, &arrow_buffer_cache_tracker_list)
+	{
+		arrowBufferCacheTracker *tracker
+			= dlist_container(arrowBufferCacheTracker, chain, iter.cur);
+
+		if (tracker->pds == pds)
+		{
+			dlist_delete(&tracker->chain);
+			pfree(tracker);
+			break;
+		}
+	}
+	PDS_release(pds);
+}
+
+/*
+ * arrowFdwReleaseAllBufferCache - callback on end of transaction
+ */
+static void
+arrowFdwReleaseAllBufferCache(void)
+{
+	while (!dlist_is_empty(&arrow_buffer_cache_tracker_list))
+	{
+		arrowBufferCacheTracker *tracker;
+		dlist_node *dnode;
+
+		dnode = dlist_pop_head_node(&arrow_buffer_cache_tracker_list);
+		tracker = dlist_container(arrowBufferCacheTracker, chain, dnode);
+		PDS_release(tracker->pds);
+		pfree(tracker);
+	}
+}
+
+/*
+ * Late materialization for CPU scan
+ *
+ * When CPU scan has vectorized qualifiers, it loads the columns referenced
+ * by the qualifiers first, then evaluates them to set up the selection
+ * vector. The rest of referenced columns are loaded only for the pages
+ * that contain the rows survived, and never if no rows survived.
+ * The memory layout of KDS is identical to the one by arrowFdwSetupIOvector,
+ * but unread portion is never referenced because only the rows survived
+ * are fetched.
+ */
+static void
+__arrowFdwReadBuffer(int fdesc, kern_data_store *kds, off_t f_pos,
+					 cl_uint m_offset, cl_uint m_length)
+{
+	char	   *dest = (char *)kds + __kds_unpack(m_offset);
+	size_t		length = __kds_unpack(m_length);
+
+	if (m_offset == 0 || length == 0)
+		return;
+	if (__preadFile(fdesc, dest, length, f_pos) != length)
+		elog(ERROR, "failed on pread(2) of arrow file: %m");
+}
+
+static void
+__arrowFdwReadBufferPartial(int fdesc, kern_data_store *kds, off_t f_pos,
+							cl_uint m_offset, cl_uint m_length,
+							const uint8 *selvec, size_t unitsz,
+							size_t width, const cl_uint *offsets)
+{
+	char	   *dest = (char *)kds + __kds_unpack(m_offset);
+	size_t		length = __kds_unpack(m_length);
+	size_t		head = 0;
+	size_t		tail = 0;
+	size_t		i;
+
+	if (m_offset == 0 || length == 0)
+		return;
+	for (i=0; i < kds->nitems; i++)
+	{
+		size_t	start;
+		size_t	end;
+
+		if (!selvec[i])
+			continue;
+		if (offsets)
+		{
+			start = offsets[i];
+			end = offsets[i+1];
+		}
+		else
+		{
+			start = unitsz * i;
+			end = start + width;
+		}
+		/* expand the range to the page boundary */
+		start = TYPEALIGN_DOWN(PAGE_SIZE, start);
+		end = Min(TYPEALIGN(PAGE_SIZE, end), length);
+		if (start >= end)
+			continue;
+		if (head < tail && start >= head && start <= tail)
+			tail = Max(tail, end);
+		else
+		{
+			/* read the previous range, then start a new one */
+			if (head < tail &&
+				__preadFile(fdesc, dest + head, tail - head,
+							f_pos + head) != tail - head)
+				elog(ERROR, "failed on pread(2) of arrow file: %m");
+			head = start;
+			tail = end;
+		}
+	}
+	if (head < tail &&
+		__preadFile(fdesc, dest + head, tail - head,
+					f_pos + head) != tail - head)
+		elog(ERROR, "failed on pread(2) of arrow file: %m");
+}
+
+/*
+ * __arrowFdwFieldUnitSize
+ *
+ * It returns the unit size of the values buffer of fixed-width types, 0 for
+ * the variable length types with 32bit offsets, or -1 for other types.
+ * (see pg_datum_arrow_ref)
+ */
+static int
+__arrowFdwFieldUnitSize(Oid atttypid, ArrowTypeOptions *attopts)
+{
+	switch (atttypid)
+	{
+		case INT2OID:
+		case FLOAT2OID:
+			return sizeof(cl_short);
+		case INT4OID:
+		case FLOAT4OID:
+			return sizeof(cl_int);
+		case INT8OID:
+		case FLOAT8OID:
+		case TIMESTAMPOID:
+		case TIMESTAMPTZOID:
+			return sizeof(cl_long);
+		case NUMERICOID:
+			return sizeof(int128);
+		case DATEOID:
+			if (attopts->date.unit == ArrowDateUnit__Day)
+				return sizeof(cl_int);
+			return sizeof(cl_long);
+		case TIMEOID:
+			if (attopts->time.unit == ArrowTimeUnit__Second ||
+				attopts->time.unit == ArrowTimeUnit__MilliSecond)
+				return sizeof(cl_int);
+			return sizeof(cl_long);
+		case TEXTOID:
+		case BYTEAOID:
+			return 0;		/* variable length */
+		default:
+			break;
 	}
-	num_rbatches = list_length(rb_state_list);
-	af_state = palloc0(offsetof(ArrowFdwState, rbatches[num_rbatches]));
-	af_state->fdescList = fdescList;
-	af_state->referenced = referenced;
-	af_state->rbatch_index = &af_state->__rbatch_index_local;
-	i = 0;
-	foreach (lc, rb_state_list)
-		af_state->rbatches[i++] = (RecordBatchState *)lfirst(lc);
-	af_state->num_rbatches = num_rbatches;
+	return -1;
+}
 
-	return af_state;
+static void
+__arrowFdwReadField(int fdesc, kern_data_store *kds, off_t rb_offset,
+					RecordBatchFieldState *fstate, kern_colmeta *cmeta,
+					const uint8 *selvec)
+{
+	int			unitsz = -1;
+
+	if (selvec && cmeta->atttypkind == TYPE_KIND__BASE)
+		unitsz = (fstate->dict_unitsz > 0
+				  ? fstate->dict_unitsz
+				  : __arrowFdwFieldUnitSize(cmeta->atttypid, &cmeta->attopts));
+
+	if (fstate->nullmap_length > 0)
+		__arrowFdwReadBuffer(fdesc, kds,
+							 rb_offset + fstate->nullmap_offset,
+							 cmeta->nullmap_offset,
+							 cmeta->nullmap_length);
+	if (fstate->values_length > 0)
+	{
+		if (unitsz > 0)
+			__arrowFdwReadBufferPartial(fdesc, kds,
+										rb_offset + fstate->values_offset,
+										cmeta->values_offset,
+										cmeta->values_length,
+										selvec, unitsz, unitsz, NULL);
+		else if (unitsz == 0)
+		{
+			/* row-i needs offsets[i] and offsets[i+1] */
+			if (__kds_unpack(cmeta->values_length) <
+				sizeof(cl_uint) * (kds->nitems + 1))
+				elog(ERROR, "corrupted arrow file? offset buffer is too short");
+			__arrowFdwReadBufferPartial(fdesc, kds,
+										rb_offset + fstate->values_offset,
+										cmeta->values_offset,
+										cmeta->values_length,
+										selvec, sizeof(cl_uint),
+										2 * sizeof(cl_uint), NULL);
+		}
+		else
+			__arrowFdwReadBuffer(fdesc, kds,
+								 rb_offset + fstate->values_offset,
+								 cmeta->values_offset,
+								 cmeta->values_length);
+	}
+	if (fstate->extra_length > 0)
+	{
+		if (unitsz == 0)
+		{
+			cl_uint	   *offsets = (cl_uint *)
+				((char *)kds + __kds_unpack(cmeta->values_offset));
+
+			if (cmeta->values_offset == 0 ||
+				__kds_unpack(cmeta->values_length) <
+				sizeof(cl_uint) * (kds->nitems + 1))
+				elog(ERROR, "corrupted arrow file? offset buffer is too short");
+			__arrowFdwReadBufferPartial(fdesc, kds,
+										rb_offset + fstate->extra_offset,
+										cmeta->extra_offset,
+										cmeta->extra_length,
+										selvec, 0, 0, offsets);
+		}
+		else
+			__arrowFdwReadBuffer(fdesc, kds,
+								 rb_offset + fstate->extra_offset,
+								 cmeta->extra_offset,
+								 cmeta->extra_length);
+	}
+
+	/* nested sub-fields if composite types */
+	if (cmeta->atttypkind == TYPE_KIND__ARRAY ||
+		cmeta->atttypkind == TYPE_KIND__COMPOSITE)
+	{
+		kern_colmeta *subattr;
+		int		j;
+
+		Assert(fstate->num_children == cmeta->num_subattrs);
+		for (j=0, subattr = &kds->colmeta[cmeta->idx_subattrs];
+			 j < cmeta->num_subattrs;
+			 j++, subattr++)
+		{
+			__arrowFdwReadField(fdesc, kds, rb_offset,
+								&fstate->children[j], subattr, NULL);
+		}
+	}
+}
+
+static pgstrom_data_store *
+__arrowFdwLoadRecordBatchLate(ArrowFdwState *af_state,
+							  RecordBatchState *rb_state,
+							  Relation relation,
+							  EState *estate)
+{
+	TupleDesc			tupdesc = RelationGetDescr(relation);
+	arrowVectorFilter  *vfilter = af_state->vfilter;
+	pgstrom_data_store *pds;
+	kern_data_store	   *kds;
+	strom_io_vector	   *iovec;
+	Bitmapset		   *filter_attrs = NULL;
+	size_t				head_sz;
+	uint32				nvalids;
+	int					j, fdesc;
+
+	/* setup KDS with the same layout as __arrowFdwLoadRecordBatch */
+	head_sz = KDS_calculateHeadSize(tupdesc);
+	kds = alloca(head_sz);
+	init_kernel_data_store(kds, tupdesc, 0, KDS_FORMAT_ARROW, 0);
+	kds->nitems = rb_state->rb_nitems;
+	kds->nrooms = rb_state->rb_nitems;
+	kds->table_oid = RelationGetRelid(relation);
+	Assert(head_sz == KERN_DATA_STORE_HEAD_LENGTH(kds));
+	for (j=0; j < kds->nr_colmeta; j++)
+		kds->colmeta[j].attopts = rb_state->columns[j].attopts;
+	iovec = arrowFdwSetupIOvector(kds, rb_state, af_state->referenced);
+	pfree(iovec);
+
+	pds = MemoryContextAllocHuge(estate->es_query_cxt,
+								 offsetof(pgstrom_data_store,
+										  kds) + kds->length);
+	memset(pds, 0, offsetof(pgstrom_data_store, kds));
+	pg_atomic_init_u32(&pds->refcnt, 1);
+	pds->filedesc = -1;
+	memcpy(&pds->kds, kds, head_sz);
+	kds = &pds->kds;
+	fdesc = FileGetRawDesc(rb_state->fdesc);
+
+	/* 1st phase: load the columns referenced by the qualifiers */
+	for (j=0; j < vfilter->nitems; j++)
+	{
+		int		anum = vfilter->items[j].anum;
+
+		if (anum >= kds->ncols ||
+			bms_is_member(anum, filter_attrs))
+			continue;
+		filter_attrs = bms_add_member(filter_attrs, anum);
+		__arrowFdwReadField(fdesc, kds, rb_state->rb_offset,
+							&rb_state->columns[anum],
+							&kds->colmeta[anum], NULL);
+	}
+	nvalids = arrowFdwApplyVectorFilter(af_state, kds, rb_state, estate);
+
+	/* 2nd phase: load the rest of columns only for the rows survived */
+	if (nvalids > 0)
+	{
+		for (j=0; j < kds->ncols; j++)
+		{
+			int		attidx = j + 1 - FirstLowInvalidHeapAttributeNumber;
+
+			if (bms_is_member(j, filter_attrs) ||
+				!bms_is_member(attidx, af_state->referenced))
+				continue;
+			__arrowFdwReadField(fdesc, kds, rb_state->rb_offset,
+								&rb_state->columns[j],
+								&kds->colmeta[j],
+								af_state->curr_selvec);
+		}
+	}
+	bms_free(filter_attrs);
+
+	return arrowFdwDecodeDictionary(pds, rb_state,
+									af_state->referenced,
+									af_state->curr_selvec,
+									NULL);
 }
 
 /*
- * ArrowBeginForeignScan
+ * arrowFdwSplitRecordBatches
+ *
+ * A huge RecordBatch is the unit of parallelism, so it is scanned by a
+ * single worker. It splits the RecordBatches larger than
+ * arrow_fdw.parallel_split_size into row-ranges (slices) that workers can
+ * fetch individually. Slice boundaries are multiple of 64 rows, so the
+ * nullmap and the values of fixed-width types are sliced at 8-bytes aligned
+ * position. The variable-length values are sliced using the offsets at the
+ * boundaries, then the offsets are rebased on loading (extra_base).
+ * Only the RecordBatches whose referenced columns are all fixed-width or
+ * variable-length base types are split. Dictionary-encoded columns are
+ * sliced by the indices.
  */
 static void
-ArrowBeginForeignScan(ForeignScanState *node, int eflags)
+__arrowFdwSliceBuffer(off_t *p_offset, size_t *p_length,
+					  size_t start, size_t length)
 {
-	Relation		relation = node->ss.ss_currentRelation;
-	TupleDesc		tupdesc = RelationGetDescr(relation);
-	ForeignScan	   *fscan = (ForeignScan *) node->ss.ps.plan;
-	ListCell	   *lc;
-	Bitmapset	   *referenced = NULL;
+	Assert(start <= *p_length);
+	*p_offset += start;
+	*p_length = Min(TYPEALIGN(sizeof(cl_ulong), length), *p_length - start);
+}
+
+static RecordBatchState *
+__arrowFdwMakeSlice(RecordBatchState *rb_state,
+					Bitmapset *referenced,
+					int64 row_start, int64 nrows)
+{
+	RecordBatchState *slice;
+	int		fdesc = FileGetRawDesc(rb_state->fdesc);
+	size_t	rb_length = 0;
+	int		j;
 
-	foreach (lc, fscan->fdw_private)
+	slice = palloc(offsetof(RecordBatchState, columns[rb_state->ncols]));
+	memcpy(slice, rb_state, offsetof(RecordBatchState,
+									 columns[rb_state->ncols]));
+	slice->rb_nitems = nrows;
+	slice->rb_sliced = true;
+	for (j=0; j < slice->ncols; j++)
 	{
-		int		j = lfirst_int(lc);
+		RecordBatchFieldState *fstate = &slice->columns[j];
+		int		attidx = j + 1 - FirstLowInvalidHeapAttributeNumber;
+		int		unitsz;
 
-		if (j >= 0 && j <= tupdesc->natts)
-			referenced = bms_add_member(referenced, j -
-										FirstLowInvalidHeapAttributeNumber);
+		if (!bms_is_member(attidx, referenced))
+			continue;
+		unitsz = (fstate->dict_unitsz > 0
+				  ? fstate->dict_unitsz
+				  : __arrowFdwFieldUnitSize(fstate->atttypid,
+											&fstate->attopts));
+		Assert(unitsz >= 0);
+		fstate->nitems = nrows;
+		if (fstate->nullmap_length > 0)
+			__arrowFdwSliceBuffer(&fstate->nullmap_offset,
+								  &fstate->nullmap_length,
+								  row_start / BITS_PER_BYTE,
+								  (nrows + BITS_PER_BYTE - 1) / BITS_PER_BYTE);
+		if (unitsz > 0)
+		{
+			__arrowFdwSliceBuffer(&fstate->values_offset,
+								  &fstate->values_length,
+								  unitsz * row_start,
+								  unitsz * nrows);
+		}
+		else
+		{
+			off_t	f_pos = (rb_state->rb_offset +
+							 fstate->values_offset +
+							 sizeof(cl_uint) * row_start);
+			cl_uint	head;
+			cl_uint	tail;
+			cl_uint	base;
+
+			if (__preadFile(fdesc, &head, sizeof(cl_uint),
+							f_pos) != sizeof(cl_uint) ||
+				__preadFile(fdesc, &tail, sizeof(cl_uint),
+							f_pos + sizeof(cl_uint) * nrows) != sizeof(cl_uint))
+				elog(ERROR, "failed on pread('%s'): %m",
+					 FilePathName(rb_state->fdesc));
+			if (head > tail || tail > fstate->extra_length)
+				elog(ERROR, "arrow file '%s' has corrupted offsets",
+					 FilePathName(rb_state->fdesc));
+			__arrowFdwSliceBuffer(&fstate->values_offset,
+								  &fstate->values_length,
+								  sizeof(cl_uint) * row_start,
+								  sizeof(cl_uint) * (nrows + 1));
+			/*
+			 * The extra buffer must also begin at 8-bytes aligned position,
+			 * so the offsets are rebased to the aligned base, not the head.
+			 */
+			base = TYPEALIGN_DOWN(sizeof(cl_ulong), head);
+			__arrowFdwSliceBuffer(&fstate->extra_offset,
+								  &fstate->extra_length,
+								  base, tail - base);
+			fstate->extra_base = base;
+			rb_length += fstate->extra_length;
+		}
+		rb_length += fstate->nullmap_length + fstate->values_length;
 	}
-	node->fdw_state = ExecInitArrowFdw(relation, referenced);
+	/* i/o size of the slice, not the parent RecordBatch */
+	slice->rb_length = rb_length;
+	return slice;
 }
 
-typedef struct
+static bool
+__arrowFdwRecordBatchIsSplittable(RecordBatchState *rb_state,
+								  Bitmapset *referenced)
 {
-	off_t		rb_offset;
-	off_t		f_offset;
-	off_t		m_offset;
-	cl_int		io_index;
-	cl_int      depth;
-	strom_io_chunk ioc[FLEXIBLE_ARRAY_MEMBER];
-} arrowFdwSetupIOContext;
+	int		j;
+
+	/* compressed buffers cannot be sliced by rows */
+	if (rb_state->rb_compressed || rb_state->rb_sliced)
+		return false;
+	for (j=0; j < rb_state->ncols; j++)
+	{
+		RecordBatchFieldState *fstate = &rb_state->columns[j];
+		int		attidx = j + 1 - FirstLowInvalidHeapAttributeNumber;
+
+		if (bms_is_member(attidx, referenced) &&
+			(fstate->num_children > 0 ||
+			 fstate->nitems != rb_state->rb_nitems ||
+			 (fstate->dict_unitsz == 0 &&
+			  __arrowFdwFieldUnitSize(fstate->atttypid,
+									  &fstate->attopts) < 0)))
+			return false;
+	}
+	return true;
+}
+
+static void
+arrowFdwSplitRecordBatches(ArrowFdwState *af_state)
+{
+	size_t		split_sz = ((size_t)arrow_parallel_split_size_kb << 10);
+	RecordBatchState **rbatches;
+	uint32		nrooms = af_state->num_rbatches;
+	uint32		nitems = 0;
+	uint32		i;
+
+	if (split_sz == 0)
+		return;
+	rbatches = MemoryContextAlloc(GetMemoryChunkContext(af_state),
+								  sizeof(RecordBatchState *) * nrooms);
+	for (i=0; i < af_state->num_rbatches; i++)
+	{
+		RecordBatchState *rb_state = af_state->rbatches[i];
+		int64		nslices = (rb_state->rb_length + split_sz - 1) / split_sz;
+		int64		nrows;
+		int64		row;
+
+		if (nslices > 1 &&
+			!__arrowFdwRecordBatchIsSplittable(rb_state,
+											   af_state->referenced))
+			nslices = 1;
+		nrows = TYPEALIGN(64, (rb_state->rb_nitems + nslices - 1) / nslices);
+		if (nslices < 2 || nrows >= rb_state->rb_nitems)
+		{
+			rbatches[nitems++] = rb_state;
+			continue;
+		}
+		nrooms += (rb_state->rb_nitems + nrows - 1) / nrows;
+		rbatches = repalloc(rbatches, sizeof(RecordBatchState *) * nrooms);
+		for (row=0; row < rb_state->rb_nitems; row += nrows)
+		{
+			rbatches[nitems++] =
+				__arrowFdwMakeSlice(rb_state,
+									af_state->referenced,
+									row,
+									Min(nrows, rb_state->rb_nitems - row));
+		}
+	}
+	Assert(nitems <= nrooms);
+	af_state->rbatches = rbatches;
+	af_state->num_rbatches = nitems;
+}
 
 /*
- * arrowFdwSetupIOvectorField
+ * __arrowFdwRebaseSlice - rebase the offsets of sliced variable-length values
  */
-static inline void
-__setupIOvectorField(arrowFdwSetupIOContext *con,
-					 off_t chunk_offset,
-					 size_t chunk_length,
-					 cl_uint *p_cmeta_offset,
-					 cl_uint *p_cmeta_length)
+static void
+__arrowFdwRebaseSlice(kern_data_store *kds,
+					  RecordBatchState *rb_state,
+					  Bitmapset *referenced)
 {
-	off_t		f_pos = con->rb_offset + chunk_offset;
+	int		j;
 
-	if (f_pos == con->f_offset &&
-		con->m_offset == MAXALIGN(con->m_offset))
+	for (j=0; j < rb_state->ncols; j++)
 	{
-		/* good, buffer is continuous */
-		*p_cmeta_offset = __kds_packed(con->m_offset);
-		*p_cmeta_length = __kds_packed(chunk_length);
+		RecordBatchFieldState *fstate = &rb_state->columns[j];
+		kern_colmeta   *cmeta = &kds->colmeta[j];
+		int		attidx = j + 1 - FirstLowInvalidHeapAttributeNumber;
+		cl_uint *offsets;
+		size_t	i;
 
-		con->m_offset += chunk_length;
-		con->f_offset += chunk_length;
+		if (fstate->extra_base == 0 ||
+			cmeta->values_offset == 0 ||
+			!bms_is_member(attidx, referenced))
+			continue;
+		offsets = (cl_uint *)((char *)kds + __kds_unpack(cmeta->values_offset));
+		for (i=0; i <= kds->nitems; i++)
+			offsets[i] -= fstate->extra_base;
 	}
-	else
+}
+
+/*
+ * arrowFdwPrefetchRecordBatches
+ *
+ * It tells the kernel the file ranges of the RecordBatches to be loaded
+ * soon, to overlap their I/O with the processing of the current one.
+ */
+typedef struct
+{
+	File		fdesc;
+	off_t		f_head;
+	off_t		f_tail;
+} arrowFdwPrefetchContext;
+
+static void
+__arrowFdwPrefetchFlush(arrowFdwPrefetchContext *con)
+{
+	off_t		f_pos = con->f_head;
+
+	while (f_pos < con->f_tail)
 	{
-		off_t		f_base = TYPEALIGN_DOWN(PAGE_SIZE, f_pos);
-		off_t		f_tail;
-		off_t		shift = f_pos - f_base;
-		strom_io_chunk *ioc;
+		int		amount = Min(con->f_tail - f_pos, (off_t)(1UL << 30));
 
-		if (con->io_index < 0)
-			con->io_index = 0;	/* no previous i/o chunks */
+		(void) FilePrefetch(con->fdesc, f_pos, amount,
+							WAIT_EVENT_DATA_FILE_PREFETCH);
+		f_pos += amount;
+	}
+	con->f_head = con->f_tail = 0;
+}
+
+static void
+__arrowFdwPrefetchRange(arrowFdwPrefetchContext *con,
+						off_t f_pos, size_t length)
+{
+	if (length == 0)
+		return;
+	/* merge the range if continuous, or close enough */
+	if (con->f_head < con->f_tail &&
+		f_pos >= con->f_head &&
+		f_pos <= con->f_tail + PAGE_SIZE)
+	{
+		con->f_tail = Max(con->f_tail, f_pos + length);
+		return;
+	}
+	__arrowFdwPrefetchFlush(con);
+	con->f_head = f_pos;
+	con->f_tail = f_pos + length;
+}
+
+static void
+__arrowFdwPrefetchField(arrowFdwPrefetchContext *con,
+						off_t rb_offset,
+						RecordBatchFieldState *fstate)
+{
+	int		j;
+
+	__arrowFdwPrefetchRange(con, rb_offset + fstate->nullmap_offset,
+							fstate->nullmap_length);
+	__arrowFdwPrefetchRange(con, rb_offset + fstate->values_offset,
+							fstate->values_length);
+	__arrowFdwPrefetchRange(con, rb_offset + fstate->extra_offset,
+							fstate->extra_length);
+	for (j=0; j < fstate->num_children; j++)
+		__arrowFdwPrefetchField(con, rb_offset, &fstate->children[j]);
+}
+
+static void
+arrowFdwPrefetchRecordBatches(ArrowFdwState *af_state,
+							  uint32 rb_index, bool late_load)
+{
+	uint32		start = Max(rb_index + 1, af_state->prefetch_index);
+	uint32		end = Min((uint64)rb_index + 1 + arrow_prefetch_depth,
+						  af_state->num_rbatches);
+	uint32		index;
+	int			j;
+
+	for (index = start; index < end; index++)
+	{
+		RecordBatchState *rb_state = af_state->rbatches[index];
+		arrowFdwPrefetchContext con;
+
+		if (af_state->stats_hint &&
+			!arrowFdwCheckStatsHint(af_state->stats_hint, rb_state))
+			continue;
+		memset(&con, 0, sizeof(arrowFdwPrefetchContext));
+		con.fdesc = rb_state->fdesc;
+		if (late_load)
+		{
+			/* only columns referenced by the qualifiers are surely read */
+			for (j=0; j < af_state->vfilter->nitems; j++)
+			{
+				int		anum = af_state->vfilter->items[j].anum;
+
+				if (anum < rb_state->ncols)
+					__arrowFdwPrefetchField(&con, rb_state->rb_offset,
+											&rb_state->columns[anum]);
+			}
+		}
 		else
 		{
-			ioc = &con->ioc[con->io_index++];
+			for (j=0; j < rb_state->ncols; j++)
+			{
+				int		attidx = j + 1 - FirstLowInvalidHeapAttributeNumber;
 
-			f_tail = TYPEALIGN(PAGE_SIZE, con->f_offset);
-			ioc->nr_pages = f_tail / PAGE_SIZE - ioc->fchunk_id;
-			con->m_offset += (f_tail - con->f_offset); //safety margin;
+				if (bms_is_member(attidx, af_state->referenced))
+					__arrowFdwPrefetchField(&con, rb_state->rb_offset,
+											&rb_state->columns[j]);
+			}
 		}
-		ioc = &con->ioc[con->io_index];
-		/* adjust position if con->m_offset is not aligned well */
-		if (con->m_offset + shift != MAXALIGN(con->m_offset + shift))
-			con->m_offset = MAXALIGN(con->m_offset + shift) - shift;
-		ioc->m_offset   = con->m_offset;
-		ioc->fchunk_id  = f_base / PAGE_SIZE;
+		__arrowFdwPrefetchFlush(&con);
+	}
+	af_state->prefetch_index = Max(af_state->prefetch_index, end);
+}
 
-		*p_cmeta_offset = __kds_packed(con->m_offset + shift);
-		*p_cmeta_length = __kds_packed(chunk_length);
+/*
+ * arrowFdwNextBoundSlice
+ *
+ * With LIMIT bound, the leading RecordBatches are loaded by row-ranges
+ * starting from the bound, and the size of row-range is doubled for each,
+ * so the scan stops early when the Limit node is satisfied, but loads at
+ * most twice as many rows as needed otherwise. Once the row-range gets
+ * larger than RecordBatches, they are loaded as usual.
+ */
+static RecordBatchState *
+arrowFdwNextBoundSlice(ArrowFdwState *af_state, EState *estate)
+{
+	RecordBatchState *rb_state = af_state->bound_rb_state;
+	RecordBatchState *slice;
+	MemoryContext oldcxt;
+	int64		nrows;
+
+	nrows = Min(af_state->bound_nrows,
+				rb_state->rb_nitems - af_state->bound_row_next);
+	oldcxt = MemoryContextSwitchTo(estate->es_query_cxt);
+	slice = __arrowFdwMakeSlice(rb_state,
+								af_state->referenced,
+								af_state->bound_row_next,
+								nrows);
+	MemoryContextSwitchTo(oldcxt);
 
-		con->m_offset  += shift + chunk_length;
-		con->f_offset   = f_pos + chunk_length;
-	}
+	af_state->bound_row_next += nrows;
+	af_state->bound_nrows *= 2;
+	af_state->bound_nslices++;
+	if (af_state->bound_row_next >= rb_state->rb_nitems)
+		af_state->bound_rb_state = NULL;
+	return slice;
 }
 
-static void
-arrowFdwSetupIOvectorField(arrowFdwSetupIOContext *con,
-						   RecordBatchFieldState *fstate,
-						   kern_data_store *kds,
-						   kern_colmeta *cmeta)
+static pgstrom_data_store *
+arrowFdwLoadRecordBatch(ArrowFdwState *af_state,
+						Relation relation,
+						EState *estate,
+						GpuContext *gcontext,
+						int optimal_gpu)
 {
-	//int		index = cmeta - kds->colmeta;
+	RecordBatchState *rb_state;
+	pgstrom_data_store *pds;
+	uint32		rb_index;
+	bool		has_dict;
 
-	if (fstate->nullmap_length > 0)
+	/* rest of the RecordBatch partially loaded by LIMIT bound */
+	if (af_state->bound_rb_state)
 	{
-		Assert(fstate->null_count > 0);
-		__setupIOvectorField(con,
-							 fstate->nullmap_offset,
-							 fstate->nullmap_length,
-							 &cmeta->nullmap_offset,
-							 &cmeta->nullmap_length);
-		//elog(INFO, "D%d att[%d] nullmap=%lu,%lu m_offset=%lu f_offset=%lu", con->depth, index, fstate->nullmap_offset, fstate->nullmap_length, con->m_offset, con->f_offset);
+		rb_state = arrowFdwNextBoundSlice(af_state, estate);
+		goto load_slice;
 	}
-	if (fstate->values_length > 0)
+
+	/* fetch next RecordBatch */
+	for (;;)
 	{
-		__setupIOvectorField(con,
-							 fstate->values_offset,
-							 fstate->values_length,
-							 &cmeta->values_offset,
-							 &cmeta->values_length);
-		//elog(INFO, "D%d att[%d] values=%lu,%lu m_offset=%lu f_offset=%lu", con->depth, index, fstate->values_offset, fstate->values_length, con->m_offset, con->f_offset);
+		rb_index = arrowFdwNextRecordBatchIndex(af_state);
+		if (rb_index >= af_state->num_rbatches)
+			return NULL;	/* no more RecordBatch to read */
+		rb_state = af_state->rbatches[rb_index];
+
+		/* skip RecordBatches that never match by min/max statistics */
+		if (!af_state->stats_hint ||
+			arrowFdwCheckStatsHint(af_state->stats_hint, rb_state))
+			break;
+		af_state->stats_nskipped++;
 	}
-	if (fstate->extra_length > 0)
+	af_state->stats_nloaded++;
+
+	/* LIMIT bound loads the leading RecordBatches by row-ranges */
+	if (af_state->scan_bound > 0 && !gcontext &&
+		af_state->bound_nrows < rb_state->rb_nitems &&
+		__arrowFdwRecordBatchIsSplittable(rb_state, af_state->referenced))
 	{
-		__setupIOvectorField(con,
-							 fstate->extra_offset,
-							 fstate->extra_length,
-							 &cmeta->extra_offset,
-							 &cmeta->extra_length);
-		//elog(INFO, "D%d att[%d] extra=%lu,%lu m_offset=%lu f_offset=%lu", con->depth, index, fstate->extra_offset, fstate->extra_length, con->m_offset, con->f_offset);
+		af_state->bound_rb_state = rb_state;
+		af_state->bound_row_next = 0;
+		rb_state = arrowFdwNextBoundSlice(af_state, estate);
+		goto load_slice;
 	}
 
-	/* nested sub-fields if composite types */
-	if (cmeta->atttypkind == TYPE_KIND__ARRAY ||
-		cmeta->atttypkind == TYPE_KIND__COMPOSITE)
+	/*
+	 * read-ahead of the next RecordBatches, unless SSD-to-GPU Direct SQL
+	 * will load them without page cache.
+	 */
+	if (arrow_prefetch_depth > 0 &&
+		(!gcontext || gcontext->cuda_dindex != optimal_gpu))
+		arrowFdwPrefetchRecordBatches(af_state, rb_index,
+									  !gcontext &&
+									  !arrow_enable_mmap &&
+									  af_state->vfilter != NULL);
+
+load_slice:
+	/* sliced RecordBatch is loaded as usual, then offsets are rebased */
+	if (rb_state->rb_sliced)
 	{
-		kern_colmeta *subattr;
-		int		j;
+		Assert(!gcontext);
+		pds = __arrowFdwLoadRecordBatch(rb_state,
+										relation,
+										af_state->referenced,
+										NULL,
+										estate->es_query_cxt,
+										-1);
+		__arrowFdwRebaseSlice(&pds->kds, rb_state, af_state->referenced);
+		if (af_state->vfilter)
+			arrowFdwApplyVectorFilter(af_state, &pds->kds,
+									  rb_state, estate);
+		return arrowFdwDecodeDictionary(pds, rb_state,
+										af_state->referenced,
+										af_state->vfilter
+										? af_state->curr_selvec : NULL,
+										NULL);
+	}
 
-		Assert(fstate->num_children == cmeta->num_subattrs);
-		con->depth++;
-		for (j=0, subattr = &kds->colmeta[cmeta->idx_subattrs];
-			 j < cmeta->num_subattrs;
-			 j++, subattr++)
+	/*
+	 * compressed RecordBatch is decompressed on the private buffer at once,
+	 * so neither file mapping, shared buffer cache nor late loading are
+	 * available. Vectorized qualifiers are applied on the loaded one.
+	 */
+	if (rb_state->rb_compressed)
+	{
+		pds = __arrowFdwLoadRecordBatch(rb_state,
+										relation,
+										af_state->referenced,
+										gcontext,
+										estate->es_query_cxt,
+										optimal_gpu);
+		if (!gcontext && af_state->vfilter)
 		{
-			RecordBatchFieldState *child = &fstate->children[j];
+			arrowFdwApplyVectorFilter(af_state, &pds->kds,
+									  rb_state, estate);
+			return arrowFdwDecodeDictionary(pds, rb_state,
+											af_state->referenced,
+											af_state->curr_selvec,
+											NULL);
+		}
+		return arrowFdwDecodeDictionary(pds, rb_state,
+										af_state->referenced,
+										NULL, gcontext);
+	}
 
-			arrowFdwSetupIOvectorField(con, child, kds, subattr);
+	/*
+	 * dictionary-encoded columns have to be decoded on the private buffer,
+	 * so neither file mapping nor shared buffer cache are available.
+	 */
+	has_dict = arrowFdwHasDictionary(rb_state, af_state->referenced);
+
+	/* CPU scan may map the RecordBatch on the arrow file directly */
+	if (!gcontext && arrow_enable_mmap && !has_dict)
+	{
+		pds = __arrowFdwMmapRecordBatch(rb_state,
+										relation,
+										af_state->referenced);
+		if (pds)
+		{
+			if (af_state->vfilter)
+				arrowFdwApplyVectorFilter(af_state, &pds->kds,
+										  rb_state, estate);
+			return pds;
 		}
-		con->depth--;
 	}
+
+	/* CPU scan may share the RecordBatch cached on the shared memory */
+	if (!gcontext && arrow_buffer_cache_size_kb > 0 && !has_dict)
+	{
+		pds = arrowFdwLoadRecordBatchCached(af_state,
+											rb_state,
+											relation,
+											estate);
+		if (pds)
+			return pds;
+	}
+
+	/* CPU scan with vectorized qualifiers loads the columns late */
+	if (!gcontext && af_state->vfilter)
+		return __arrowFdwLoadRecordBatchLate(af_state,
+											 rb_state,
+											 relation,
+											 estate);
+	pds = __arrowFdwLoadRecordBatch(rb_state,
+									relation,
+									af_state->referenced,
+									gcontext,
+									estate->es_query_cxt,
+									optimal_gpu);
+	return arrowFdwDecodeDictionary(pds, rb_state,
+									af_state->referenced,
+									NULL, gcontext);
 }
 
 /*
- * arrowFdwSetupIOvector
+ * ExecScanChunkArrowFdw
  */
-static strom_io_vector *
-arrowFdwSetupIOvector(kern_data_store *kds,
-					  RecordBatchState *rb_state,
-					  Bitmapset *referenced)
+pgstrom_data_store *
+ExecScanChunkArrowFdw(GpuTaskState *gts)
 {
-	arrowFdwSetupIOContext *con;
-	strom_io_vector *iovec = NULL;
-	int			j, nr_chunks = 0;
+	pgstrom_data_store *pds;
 
-	Assert(kds->nr_colmeta >= kds->ncols);
-	con = alloca(offsetof(arrowFdwSetupIOContext,
-						  ioc[3 * kds->nr_colmeta]));
-	con->rb_offset = rb_state->rb_offset;
-	con->f_offset  = ~0UL;	/* invalid offset */
-	con->m_offset  = TYPEALIGN(PAGE_SIZE, KERN_DATA_STORE_HEAD_LENGTH(kds));
-	con->io_index  = -1;
-	for (j=0; j < kds->ncols; j++)
-	{
-		RecordBatchFieldState *fstate = &rb_state->columns[j];
-		kern_colmeta *cmeta = &kds->colmeta[j];
-		int			attidx = j + 1 - FirstLowInvalidHeapAttributeNumber;
+	InstrStartNode(&gts->outer_instrument);
+	pds = arrowFdwLoadRecordBatch(gts->af_state,
+								  gts->css.ss.ss_currentRelation,
+								  gts->css.ss.ps.state,
+								  gts->gcontext,
+								  gts->optimal_gpu);
+	InstrStopNode(&gts->outer_instrument,
+				  !pds ? 0.0 : (double)pds->kds.nitems);
+	return pds;
+}
 
-		if (referenced && bms_is_member(attidx, referenced))
-			arrowFdwSetupIOvectorField(con, fstate, kds, cmeta);
+/*
+ * Aggregates answered by the metadata
+ *
+ * Ungrouped COUNT(*), COUNT(Var), MIN(Var) and MAX(Var) on a single arrow_fdw
+ * foreign table without any qualifiers are computed from the metadata of
+ * RecordBatches, instead of the scan. COUNT(*) is the sum of rb_nitems, and
+ * COUNT(Var) subtracts null_count of the field. MIN/MAX are pushed down only
+ * if all the RecordBatches that contain non-NULL values have the min/max
+ * statistics on the field at the planning time. If a RecordBatch has no
+ * statistics at the execution time (e.g, the file was rewritten after the
+ * planning), only the column of the RecordBatch is loaded and scanned.
+ */
+static int
+arrowFdwLookupAggregate(Aggref *aggref, Index scanrelid,
+						int *p_anum, Oid *p_sortop)
+{
+	HeapTuple	htup;
+	Form_pg_proc proc;
+	TargetEntry *tle;
+	Var		   *var;
+	int			kind = 0;
+
+	if (aggref->aggfilter != NULL ||
+		aggref->aggdistinct != NIL ||
+		aggref->aggorder != NIL ||
+		aggref->aggdirectargs != NIL ||
+		aggref->agglevelsup != 0 ||
+		aggref->aggkind != AGGKIND_NORMAL ||
+		aggref->aggsplit != AGGSPLIT_SIMPLE)
+		return 0;
+
+	htup = SearchSysCache1(PROCOID, ObjectIdGetDatum(aggref->aggfnoid));
+	if (!HeapTupleIsValid(htup))
+		elog(ERROR, "cache lookup failed for function %u", aggref->aggfnoid);
+	proc = (Form_pg_proc) GETSTRUCT(htup);
+	if (proc->pronamespace == PG_CATALOG_NAMESPACE)
+	{
+		if (strcmp(NameStr(proc->proname), "count") == 0)
+			kind = (aggref->aggstar
+					? ARROW_AGGREGATE__COUNT_STAR
+					: ARROW_AGGREGATE__COUNT);
+		else if (strcmp(NameStr(proc->proname), "min") == 0)
+			kind = ARROW_AGGREGATE__MIN;
+		else if (strcmp(NameStr(proc->proname), "max") == 0)
+			kind = ARROW_AGGREGATE__MAX;
 	}
-	if (con->io_index >= 0)
+	ReleaseSysCache(htup);
+
+	if (kind == ARROW_AGGREGATE__COUNT_STAR)
+		return kind;
+	if (kind == 0 || list_length(aggref->args) != 1)
+		return 0;
+	tle = linitial(aggref->args);
+	var = (Var *)tle->expr;
+	if (!IsA(var, Var) ||
+		var->varno != scanrelid ||
+		var->varlevelsup != 0 ||
+		var->varattno <= 0)
+		return 0;
+	*p_anum = var->varattno - 1;
+
+	if (kind == ARROW_AGGREGATE__MIN || kind == ARROW_AGGREGATE__MAX)
 	{
-		/* close the last I/O chunks */
-		strom_io_chunk *ioc = &con->ioc[con->io_index];
-
-		ioc->nr_pages = (TYPEALIGN(PAGE_SIZE, con->f_offset) / PAGE_SIZE -
-						 ioc->fchunk_id);
-		con->m_offset = ioc->m_offset + PAGE_SIZE * ioc->nr_pages;
-		nr_chunks = con->io_index + 1;
+		Form_pg_aggregate agg;
+
+		/* only the types which min/max statistics supports */
+		if (!__arrowStatsHintIsSupportedType(var->vartype))
+			return 0;
+		htup = SearchSysCache1(AGGFNOID, ObjectIdGetDatum(aggref->aggfnoid));
+		if (!HeapTupleIsValid(htup))
+			elog(ERROR, "cache lookup failed for aggregate %u",
+				 aggref->aggfnoid);
+		agg = (Form_pg_aggregate) GETSTRUCT(htup);
+		*p_sortop = agg->aggsortop;
+		ReleaseSysCache(htup);
+		if (!OidIsValid(*p_sortop))
+			return 0;
 	}
-	kds->length = con->m_offset;
-
-	iovec = palloc0(offsetof(strom_io_vector, ioc[nr_chunks]));
-	iovec->nr_chunks = nr_chunks;
-	if (nr_chunks > 0)
-		memcpy(iovec->ioc, con->ioc, sizeof(strom_io_chunk) * nr_chunks);
-	return iovec;
+	return kind;
 }
 
 /*
- * __dump_kds_and_iovec - just for debug
+ * ArrowGetForeignUpperPaths
  */
-static inline void
-__dump_kds_and_iovec(kern_data_store *kds, strom_io_vector *iovec)
+static void
+ArrowGetForeignUpperPaths(PlannerInfo *root,
+						  UpperRelationKind stage,
+						  RelOptInfo *input_rel,
+						  RelOptInfo *output_rel
+#if PG_VERSION_NUM >= 110000
+						  ,void *extra
+#endif
+	)
 {
-#if 0
-	int		j;
+	Query		   *parse = root->parse;
+	PathTarget	   *target = root->upper_targets[UPPERREL_GROUP_AGG];
+	RangeTblEntry  *rte;
+	ForeignTable   *ft;
+	ForeignPath	   *fpath;
+	List		   *aggList = NIL;
+	List		   *filesList;
+	Bitmapset	   *stats_attrs = NULL;
+	ListCell	   *lc;
+	bool			writable;
+	bool			has_stats = true;
+	int				nrbatches = 0;
+	Cost			total_cost;
 
-	elog(INFO, "nchunks = %d", iovec->nr_chunks);
-	for (j=0; j < iovec->nr_chunks; j++)
+	if (stage != UPPERREL_GROUP_AGG ||
+		!arrow_fdw_enabled ||
+		!arrow_enable_metadata_aggregate)
+		return;
+	/* only ungrouped aggregates on a single arrow_fdw table */
+	if (input_rel->reloptkind != RELOPT_BASEREL ||
+		!baseRelIsArrowFdw(input_rel) ||
+		input_rel->baserestrictinfo != NIL ||
+		!bms_is_empty(input_rel->lateral_relids))
+		return;
+	rte = planner_rt_fetch(input_rel->relid, root);
+	if (rte->inh)
+		return;
+	if (parse->groupClause != NIL ||
+		parse->groupingSets != NIL ||
+		parse->havingQual != NULL ||
+		parse->hasTargetSRFs)
+		return;
+
+	/* all the aggregates must be answered by the metadata */
+	foreach (lc, pull_var_clause((Node *)target->exprs,
+								 PVC_INCLUDE_AGGREGATES |
+								 PVC_INCLUDE_PLACEHOLDERS))
 	{
-		strom_io_chunk *ioc = &iovec->ioc[j];
+		Aggref	   *aggref = lfirst(lc);
+		int			kind;
+		int			anum = -1;
+		Oid			sortop = InvalidOid;
 
-		elog(INFO, "io[%d] [ m_offset=%lu, f_read=%lu...%lu, nr_pages=%u}",
-			 j,
-			 ioc->m_offset,
-			 ioc->fchunk_id * PAGE_SIZE,
-			 (ioc->fchunk_id + ioc->nr_pages) * PAGE_SIZE,
-			 ioc->nr_pages);
+		if (!IsA(aggref, Aggref))
+			return;
+		kind = arrowFdwLookupAggregate(aggref, input_rel->relid,
+									   &anum, &sortop);
+		if (kind == 0)
+			return;
+		if (kind == ARROW_AGGREGATE__MIN || kind == ARROW_AGGREGATE__MAX)
+			stats_attrs = bms_add_member(stats_attrs, anum);
+		aggList = lappend(aggList, aggref);
 	}
+	if (aggList == NIL)
+		return;
 
-	elog(INFO, "kds {length=%zu nitems=%u typeid=%u typmod=%u table_oid=%u}",
-		 kds->length, kds->nitems,
-		 kds->tdtypeid, kds->tdtypmod, kds->table_oid);
-	for (j=0; j < kds->nr_colmeta; j++)
+	/* MIN/MAX needs min/max statistics on all the RecordBatches */
+	ft = GetForeignTable(rte->relid);
+	filesList = __arrowFdwExtractFilesList(ft->options,
+										   NULL,
+										   &writable,
+										   NULL);
+	foreach (lc, filesList)
 	{
-		kern_colmeta *cmeta = &kds->colmeta[j];
+		char	   *fname = strVal(lfirst(lc));
+		File		fdesc;
+		List	   *rb_cached;
+		ListCell   *cell;
+		int			anum;
 
-		elog(INFO, "%ccol[%d] nullmap=%lu,%lu values=%lu,%lu extra=%lu,%lu",
-			 j < kds->ncols ? ' ' : '*', j,
-			 __kds_unpack(cmeta->nullmap_offset),
-			 __kds_unpack(cmeta->nullmap_length),
-			 __kds_unpack(cmeta->values_offset),
-			 __kds_unpack(cmeta->values_length),
-			 __kds_unpack(cmeta->extra_offset),
-			 __kds_unpack(cmeta->extra_length));
+		fdesc = PathNameOpenFile(fname, O_RDONLY | PG_BINARY);
+		if (fdesc < 0)
+		{
+			if (writable && errno == ENOENT)
+				continue;
+			elog(ERROR, "failed to open file '%s' on behalf of '%s'",
+				 fname, get_rel_name(rte->relid));
+		}
+		rb_cached = arrowLookupOrBuildMetadataCache(fdesc);
+		foreach (cell, rb_cached)
+		{
+			RecordBatchState *rb_state = lfirst(cell);
 
+			for (anum = bms_next_member(stats_attrs, -1);
+				 anum >= 0;
+				 anum = bms_next_member(stats_attrs, anum))
+			{
+				RecordBatchFieldState *fstate;
+
+				if (anum >= rb_state->ncols)
+				{
+					has_stats = false;
+					break;
+				}
+				fstate = &rb_state->columns[anum];
+				if (!fstate->stat_valid &&
+					fstate->null_count < rb_state->rb_nitems)
+					has_stats = false;
+			}
+			nrbatches++;
+		}
+		FileClose(fdesc);
+		if (!has_stats)
+			return;
 	}
+
+	total_cost = (cpu_operator_cost * list_length(aggList) * nrbatches +
+				  target->cost.startup + target->cost.per_tuple);
+#if PG_VERSION_NUM < 120000
+	fpath = create_foreignscan_path(root,
+									output_rel,
+									target,
+									1.0,
+									total_cost,
+									total_cost,
+									NIL,	/* no pathkeys */
+									NULL,	/* no required_outer */
+									NULL,	/* no extra plan */
+									aggList);
+#else
+	fpath = create_foreign_upper_path(root,
+									  output_rel,
+									  target,
+									  1.0,
+									  total_cost,
+									  total_cost,
+									  NIL,	/* no pathkeys */
+									  NULL,	/* no extra plan */
+									  aggList);
 #endif
+	add_path(output_rel, (Path *)fpath);
 }
 
 /*
- * arrowFdwLoadRecordBatch
+ * arrowFdwMakeAggregatePlan
  */
-static pgstrom_data_store *
-__arrowFdwLoadRecordBatch(RecordBatchState *rb_state,
-						  Relation relation,
-						  Bitmapset *referenced,
-						  GpuContext *gcontext,
-						  MemoryContext mcontext,
-						  int optimal_gpu)
+static ForeignScan *
+arrowFdwMakeAggregatePlan(RelOptInfo *upper_rel,
+						  ForeignPath *best_path,
+						  List *tlist,
+						  Plan *outer_plan)
 {
-	TupleDesc			tupdesc = RelationGetDescr(relation);
-	pgstrom_data_store *pds;
-	kern_data_store	   *kds;
-	strom_io_vector	   *iovec;
-	size_t				head_sz;
-	int					j, fdesc;
-	CUresult			rc;
+	Assert(upper_rel->reloptkind == RELOPT_UPPER_REL);
+	return make_foreignscan(tlist,
+							NIL,	/* no scan quals */
+							0,		/* no scanrelid */
+							NIL,	/* no expressions to evaluate */
+							NIL,	/* no private */
+							add_to_flat_tlist(NIL, best_path->fdw_private),
+							NIL,	/* no remote quals */
+							outer_plan);
+}
 
-	/* setup KDS and I/O-vector */
-	head_sz = KDS_calculateHeadSize(tupdesc);
-	kds = alloca(head_sz);
-	init_kernel_data_store(kds, tupdesc, 0, KDS_FORMAT_ARROW, 0);
-	kds->nitems = rb_state->rb_nitems;
-	kds->nrooms = rb_state->rb_nitems;
-	kds->table_oid = RelationGetRelid(relation);
-	Assert(head_sz == KERN_DATA_STORE_HEAD_LENGTH(kds));
-	for (j=0; j < kds->nr_colmeta; j++)
-		kds->colmeta[j].attopts = rb_state->columns[j].attopts;
-	iovec = arrowFdwSetupIOvector(kds, rb_state, referenced);
-	__dump_kds_and_iovec(kds, iovec);
+/*
+ * arrowFdwBeginAggregate
+ */
+static void
+arrowFdwBeginAggregate(ForeignScanState *node, int eflags)
+{
+	ForeignScan	   *fscan = (ForeignScan *) node->ss.ps.plan;
+	EState		   *estate = node->ss.ps.state;
+	Index			scanrelid = bms_singleton_member(fscan->fs_relids);
+	RangeTblEntry  *rte = rt_fetch(scanrelid, estate->es_range_table);
+	arrowAggregateState *aa_state;
+	ListCell	   *lc;
 
-	fdesc = FileGetRawDesc(rb_state->fdesc);
-	/*
-	 * If SSD-to-GPU Direct SQL is available on the arrow file, setup a small
-	 * PDS on host-pinned memory, with strom_io_vector.
-	 */
-	if (gcontext &&
-		gcontext->cuda_dindex == optimal_gpu &&
-		iovec->nr_chunks > 0 &&
-		kds->length <= gpuMemAllocIOMapMaxLength())
+	aa_state = palloc0(offsetof(arrowAggregateState,
+								items[list_length(fscan->fdw_scan_tlist)]));
+	aa_state->relation = relation_open(rte->relid, AccessShareLock);
+	foreach (lc, fscan->fdw_scan_tlist)
+	{
+		TargetEntry *tle = lfirst(lc);
+		arrowAggregateItem *item = &aa_state->items[aa_state->nitems++];
+		Aggref	   *aggref = (Aggref *)tle->expr;
+		Oid			sortop = InvalidOid;
+
+		Assert(IsA(aggref, Aggref));
+		item->kind = arrowFdwLookupAggregate(aggref, scanrelid,
+											 &item->anum, &sortop);
+		if (item->kind == 0)
+			elog(ERROR, "Bug? unexpected aggregate function: %s",
+				 nodeToString(aggref));
+		if (OidIsValid(sortop))
+		{
+			fmgr_info(get_opcode(sortop), &item->opcode);
+			item->collid = aggref->inputcollid;
+		}
+	}
+	node->fdw_state = aa_state;
+}
+
+/*
+ * arrowFdwExecAggregate
+ */
+static void
+__arrowFdwExecAggregateUpdate(arrowAggregateItem *item, Datum datum,
+							  Datum *p_value, bool *p_isnull)
+{
+	/* sort operator is '<' for MIN, or '>' for MAX */
+	if (*p_isnull || DatumGetBool(FunctionCall2Coll(&item->opcode,
+													item->collid,
+													datum, *p_value)))
+	{
+		*p_value = datum;
+		*p_isnull = false;
+	}
+}
+
+static void
+__arrowFdwExecAggregateLoad(arrowAggregateState *aa_state,
+							arrowAggregateItem *item,
+							RecordBatchState *rb_state,
+							Datum *p_value, bool *p_isnull)
+{
+	pgstrom_data_store *pds;
+	kern_colmeta   *cmeta;
+	Bitmapset	   *referenced;
+	Datum			datum;
+	bool			isnull;
+	size_t			i;
+
+	referenced = bms_make_singleton(item->anum + 1 -
+									FirstLowInvalidHeapAttributeNumber);
+	pds = __arrowFdwLoadRecordBatch(rb_state,
+									aa_state->relation,
+									referenced,
+									NULL,
+									CurrentMemoryContext,
+									-1);
+	cmeta = &pds->kds.colmeta[item->anum];
+	for (i=0; i < pds->kds.nitems; i++)
 	{
-		size_t	iovec_sz = offsetof(strom_io_vector, ioc[iovec->nr_chunks]);
+		pg_datum_arrow_ref(&pds->kds, cmeta, i, &datum, &isnull);
+		if (!isnull)
+			__arrowFdwExecAggregateUpdate(item, datum, p_value, p_isnull);
+	}
+	PDS_release(pds);
+	bms_free(referenced);
+	aa_state->nloaded++;
+}
 
-		rc = gpuMemAllocHost(gcontext, (void **)&pds,
-							 offsetof(pgstrom_data_store, kds) +
-							 head_sz + iovec_sz);
-		if (rc != CUDA_SUCCESS)
-			elog(ERROR, "failed on gpuMemAllocHost: %s", errorText(rc));
+static void
+arrowFdwExecAggregate(arrowAggregateState *aa_state,
+					  Datum *values, bool *isnull)
+{
+	Relation		relation = aa_state->relation;
+	TupleDesc		tupdesc = RelationGetDescr(relation);
+	ForeignTable   *ft = GetForeignTable(RelationGetRelid(relation));
+	List		   *filesList;
+	List		   *fdescList = NIL;
+	ListCell	   *lc;
+	bool			writable;
+	int				j;
 
-		pds->gcontext = gcontext;
-		pg_atomic_init_u32(&pds->refcnt, 1);
-		pds->nblocks_uncached = 0;
-		pds->filedesc = fdesc;
-		pds->iovec = (strom_io_vector *)((char *)&pds->kds + head_sz);
-		memcpy(&pds->kds, kds, head_sz);
-		memcpy(pds->iovec, iovec, iovec_sz);
+	/* the rows pending by group commit must be visible to the Footer */
+	arrowFdwFlushPendingWrites();
+
+	for (j=0; j < aa_state->nitems; j++)
+	{
+		aa_state->items[j].count = 0;
+		values[j] = 0;
+		isnull[j] = true;
 	}
-	else
+
+	filesList = __arrowFdwExtractFilesList(ft->options,
+										   NULL,
+										   &writable,
+										   NULL);
+	foreach (lc, filesList)
 	{
-		/* Elsewhere, load RecordBatch by filesystem */
-		if (gcontext)
+		char	   *fname = strVal(lfirst(lc));
+		File		fdesc;
+		List	   *rb_cached;
+		ListCell   *cell;
+
+		fdesc = PathNameOpenFile(fname, O_RDONLY | PG_BINARY);
+		if (fdesc < 0)
 		{
-			rc = gpuMemAllocManaged(gcontext,
-									(CUdeviceptr *)&pds,
-									offsetof(pgstrom_data_store,
-											 kds) + kds->length,
-									CU_MEM_ATTACH_GLOBAL);
-			if (rc != CUDA_SUCCESS)
-				elog(ERROR, "failed on gpuMemAllocManaged: %s", errorText(rc));
+			if (writable && errno == ENOENT)
+				continue;
+			elog(ERROR, "failed to open '%s' on behalf of '%s'",
+				 fname, RelationGetRelationName(relation));
 		}
-		else
+		fdescList = lappend_int(fdescList, fdesc);
+
+		rb_cached = arrowLookupOrBuildMetadataCache(fdesc);
+		foreach (cell, rb_cached)
 		{
-			pds = MemoryContextAllocHuge(mcontext,
-										 offsetof(pgstrom_data_store,
-												  kds) + kds->length);
+			RecordBatchState *rb_state = lfirst(cell);
+
+			if (!arrowSchemaCompatibilityCheck(tupdesc, rb_state))
+				elog(ERROR, "arrow file '%s' on behalf of foreign table '%s' has incompatible schema definition",
+					 fname, RelationGetRelationName(relation));
+			for (j=0; j < aa_state->nitems; j++)
+			{
+				arrowAggregateItem *item = &aa_state->items[j];
+				RecordBatchFieldState *fstate;
+				Datum		datum;
+
+				if (item->kind == ARROW_AGGREGATE__COUNT_STAR)
+				{
+					item->count += rb_state->rb_nitems;
+					continue;
+				}
+				fstate = &rb_state->columns[item->anum];
+				if (item->kind == ARROW_AGGREGATE__COUNT)
+				{
+					item->count += rb_state->rb_nitems - fstate->null_count;
+					continue;
+				}
+				if (fstate->null_count >= rb_state->rb_nitems)
+					continue;	/* all NULLs */
+				if (!fstate->stat_valid)
+				{
+					__arrowFdwExecAggregateLoad(aa_state, item, rb_state,
+												&values[j], &isnull[j]);
+					continue;
+				}
+				datum = (item->kind == ARROW_AGGREGATE__MIN
+						 ? fstate->stat_min
+						 : fstate->stat_max);
+				__arrowFdwExecAggregateUpdate(item, datum,
+											  &values[j], &isnull[j]);
+			}
+		}
+	}
+	foreach (lc, fdescList)
+		FileClose((File)lfirst_int(lc));
+
+	for (j=0; j < aa_state->nitems; j++)
+	{
+		arrowAggregateItem *item = &aa_state->items[j];
+
+		if (item->kind == ARROW_AGGREGATE__COUNT_STAR ||
+			item->kind == ARROW_AGGREGATE__COUNT)
+		{
+			values[j] = Int64GetDatum(item->count);
+			isnull[j] = false;
 		}
-		__PDS_fillup_arrow(pds, gcontext, kds, fdesc, iovec);
 	}
-	pfree(iovec);
-	return pds;
 }
 
-static pgstrom_data_store *
-arrowFdwLoadRecordBatch(ArrowFdwState *af_state,
-						Relation relation,
-						EState *estate,
-						GpuContext *gcontext,
-						int optimal_gpu)
+/*
+ * arrowFdwIterateAggregate
+ */
+static TupleTableSlot *
+arrowFdwIterateAggregate(ForeignScanState *node)
 {
-	uint32		rb_index;
-
-	/* fetch next RecordBatch */
-	rb_index = pg_atomic_fetch_add_u32(af_state->rbatch_index, 1);
-	if (rb_index >= af_state->num_rbatches)
-		return NULL;	/* no more RecordBatch to read */
+	arrowAggregateState *aa_state = node->fdw_state;
+	TupleTableSlot *slot = node->ss.ss_ScanTupleSlot;
 
-	return __arrowFdwLoadRecordBatch(af_state->rbatches[rb_index],
-									 relation,
-									 af_state->referenced,
-									 gcontext,
-									 estate->es_query_cxt,
-									 optimal_gpu);
+	ExecClearTuple(slot);
+	if (!aa_state->done)
+	{
+		arrowFdwExecAggregate(aa_state,
+							  slot->tts_values,
+							  slot->tts_isnull);
+		ExecStoreVirtualTuple(slot);
+		aa_state->done = true;
+	}
+	return slot;
 }
 
 /*
- * ExecScanChunkArrowFdw
+ * arrowFdwExplainAggregate
  */
-pgstrom_data_store *
-ExecScanChunkArrowFdw(GpuTaskState *gts)
+static void
+arrowFdwExplainAggregate(ForeignScanState *node, ExplainState *es)
 {
-	pgstrom_data_store *pds;
+	arrowAggregateState *aa_state = node->fdw_state;
+	ForeignScan	   *fscan = (ForeignScan *) node->ss.ps.plan;
+	const char	   *relname = RelationGetRelationName(aa_state->relation);
+	ListCell	   *lc;
+	bool			useprefix;
+	StringInfoData	buf;
 
-	InstrStartNode(&gts->outer_instrument);
-	pds = arrowFdwLoadRecordBatch(gts->af_state,
-								  gts->css.ss.ss_currentRelation,
-								  gts->css.ss.ps.state,
-								  gts->gcontext,
-								  gts->optimal_gpu);
-	InstrStopNode(&gts->outer_instrument,
-				  !pds ? 0.0 : (double)pds->kds.nitems);
-	return pds;
+	initStringInfo(&buf);
+	appendStringInfo(&buf, "Aggregate on %s", quote_identifier(relname));
+	ExplainPropertyText("Relations", buf.data, es);
+
+	resetStringInfo(&buf);
+	useprefix = (list_length(es->rtable) > 1 || es->verbose);
+	foreach (lc, fscan->fdw_scan_tlist)
+	{
+		TargetEntry *tle = lfirst(lc);
+
+		if (buf.len > 0)
+			appendStringInfoString(&buf, ", ");
+		appendStringInfoString(&buf, deparse_expression((Node *)tle->expr,
+														es->deparse_cxt,
+														useprefix, false));
+	}
+	ExplainPropertyText("Metadata-Aggregate", buf.data, es);
+	if (es->analyze)
+		ExplainPropertyInteger("Metadata-Aggregate Loaded", NULL,
+							   aa_state->nloaded, es);
+	pfree(buf.data);
 }
 
 /*
@@ -1386,27 +5851,49 @@ ArrowIterateForeignScan(ForeignScanState *node)
 	Relation		relation = node->ss.ss_currentRelation;
 	TupleTableSlot *slot = node->ss.ss_ScanTupleSlot;
 	pgstrom_data_store *pds;
+	cl_ulong		index;
 
-	while ((pds = af_state->curr_pds) == NULL ||
-		   af_state->curr_index >= pds->kds.nitems)
+	if (!relation)
+		return arrowFdwIterateAggregate(node);
+	for (;;)
 	{
-		EState	   *estate = node->ss.ps.state;
+		while ((pds = af_state->curr_pds) == NULL ||
+			   af_state->curr_index >= pds->kds.nitems)
+		{
+			EState	   *estate = node->ss.ps.state;
+
+			/* unload the previous RecordBatch, if any */
+			if (pds)
+				arrowFdwReleaseRecordBatch(pds);
+			af_state->curr_index = 0;
+			af_state->curr_pds = arrowFdwLoadRecordBatch(af_state,
+														 relation,
+														 estate,
+														 NULL, -1);
+			if (!af_state->curr_pds)
+				return NULL;
+		}
+		Assert(pds && af_state->curr_index < pds->kds.nitems);
+		/* skip rows that never satisfy the vectorized qualifiers */
+		if (af_state->vfilter)
+		{
+			uint8  *selvec = af_state->curr_selvec;
+			uint8  *pos;
 
-		/* unload the previous RecordBatch, if any */
-		if (pds)
-			PDS_release(pds);
-		af_state->curr_index = 0;
-		af_state->curr_pds = arrowFdwLoadRecordBatch(af_state,
-													 relation,
-													 estate,
-													 NULL, -1);
-		if (!af_state->curr_pds)
-			return NULL;
+			pos = memchr(selvec + af_state->curr_index, 1,
+						 pds->kds.nitems - af_state->curr_index);
+			if (!pos)
+			{
+				af_state->curr_index = pds->kds.nitems;
+				continue;
+			}
+			af_state->curr_index = pos - selvec;
+		}
+		index = af_state->curr_index++;
+		if (KDS_fetch_tuple_arrow(slot, &pds->kds, index))
+			return slot;
+		return NULL;
 	}
-	Assert(pds && af_state->curr_index < pds->kds.nitems);
-	if (KDS_fetch_tuple_arrow(slot, &pds->kds, af_state->curr_index++))
-		return slot;
-	return NULL;
 }
 
 /*
@@ -1417,8 +5904,17 @@ ExecReScanArrowFdw(ArrowFdwState *af_state)
 {
 	/* rewind the current scan state */
 	pg_atomic_write_u32(af_state->rbatch_index, 0);
+	af_state->run_next = 0;
+	af_state->run_end = 0;
+	af_state->prefetch_index = 0;
+	af_state->bound_rb_state = NULL;
+	af_state->bound_nrows = TYPEALIGN(64, af_state->scan_bound);
+	if (af_state->stats_hint)
+		af_state->stats_hint->args_ready = false;
+	if (af_state->vfilter)
+		af_state->vfilter->args_ready = false;
 	if (af_state->curr_pds)
-		PDS_release(af_state->curr_pds);
+		arrowFdwReleaseRecordBatch(af_state->curr_pds);
 	af_state->curr_pds = NULL;
 	af_state->curr_index = 0;
 }
@@ -1426,7 +5922,10 @@ ExecReScanArrowFdw(ArrowFdwState *af_state)
 static void
 ArrowReScanForeignScan(ForeignScanState *node)
 {
-	ExecReScanArrowFdw((ArrowFdwState *)node->fdw_state);
+	if (!node->ss.ss_currentRelation)
+		((arrowAggregateState *)node->fdw_state)->done = false;
+	else
+		ExecReScanArrowFdw((ArrowFdwState *)node->fdw_state);
 }
 
 /*
@@ -1437,6 +5936,12 @@ ExecEndArrowFdw(ArrowFdwState *af_state)
 {
 	ListCell   *lc;
 
+	if (af_state->curr_pds)
+		arrowFdwReleaseRecordBatch(af_state->curr_pds);
+	af_state->curr_pds = NULL;
+	if (af_state->stats_hint &&
+		af_state->stats_hint->bloom_file >= 0)
+		FileClose(af_state->stats_hint->bloom_file);
 	foreach (lc, af_state->fdescList)
 		FileClose((File)lfirst_int(lc));
 }
@@ -1444,7 +5949,14 @@ ExecEndArrowFdw(ArrowFdwState *af_state)
 static void
 ArrowEndForeignScan(ForeignScanState *node)
 {
-	ExecEndArrowFdw((ArrowFdwState *)node->fdw_state);
+	if (!node->ss.ss_currentRelation)
+	{
+		arrowAggregateState *aa_state = node->fdw_state;
+
+		relation_close(aa_state->relation, NoLock);
+	}
+	else
+		ExecEndArrowFdw((ArrowFdwState *)node->fdw_state);
 }
 
 /*
@@ -1480,6 +5992,59 @@ ExplainArrowFdw(ArrowFdwState *af_state, Relation frel, ExplainState *es)
 	}
 	ExplainPropertyText("referenced", buf.data, es);
 
+	/* shows partition directories pruned, if any */
+	if (af_state->prune_ndirs > 0)
+		ExplainPropertyInteger("Pruned Directories", NULL,
+							   af_state->prune_ndirs, es);
+
+	/* shows LIMIT bound, if any */
+	if (af_state->scan_bound > 0)
+	{
+		ExplainPropertyInteger("Scan-Bound", NULL,
+							   af_state->scan_bound, es);
+		if (es->analyze)
+			ExplainPropertyInteger("Scan-Bound Row-Ranges", NULL,
+								   af_state->bound_nslices, es);
+	}
+
+	/* shows min/max statistics hint, if any */
+	if (af_state->stats_hint)
+	{
+		arrowStatsHint *stats_hint = af_state->stats_hint;
+		Node	   *expr;
+		bool		useprefix;
+
+		expr = (Node *)make_ands_explicit(stats_hint->hint_quals);
+		useprefix = (list_length(es->rtable) > 1 || es->verbose);
+		ExplainPropertyText("Stats-Hint",
+							deparse_expression(expr, es->deparse_cxt,
+											   useprefix, false), es);
+		if (es->analyze)
+		{
+			ExplainPropertyInteger("Stats-Hint Loaded", NULL,
+								   af_state->stats_nloaded, es);
+			ExplainPropertyInteger("Stats-Hint Skipped", NULL,
+								   af_state->stats_nskipped, es);
+		}
+	}
+
+	/* shows vectorized pre-filter, if any */
+	if (af_state->vfilter)
+	{
+		arrowVectorFilter *vfilter = af_state->vfilter;
+		Node	   *expr;
+		bool		useprefix;
+
+		expr = (Node *)make_ands_explicit(vfilter->filter_quals);
+		useprefix = (list_length(es->rtable) > 1 || es->verbose);
+		ExplainPropertyText("Vector-Filter",
+							deparse_expression(expr, es->deparse_cxt,
+											   useprefix, false), es);
+		if (es->analyze)
+			ExplainPropertyInteger("Rows Removed by Vector-Filter", NULL,
+								   af_state->vfilter_nremoved, es);
+	}
+
 	/* shows files on behalf of the foreign table */
 	foreach (lc, af_state->fdescList)
 	{
@@ -1562,7 +6127,10 @@ ArrowExplainForeignScan(ForeignScanState *node, ExplainState *es)
 {
 	Relation	frel = node->ss.ss_currentRelation;
 
-	ExplainArrowFdw((ArrowFdwState *)node->fdw_state, frel, es);
+	if (!frel)
+		arrowFdwExplainAggregate(node, es);
+	else
+		ExplainArrowFdw((ArrowFdwState *)node->fdw_state, frel, es);
 }
 
 /*
@@ -1588,7 +6156,96 @@ readArrowFile(const char *pathname, ArrowFileInfo *af_info, bool missing_ok)
 
 /*
  * RecordBatchAcquireSampleRows - random sampling
+ *
+ * It picks up the row indexes to be sampled first, then loads only the pages
+ * of the values buffers (and the extra buffers of variable-length values)
+ * that contain the sampled rows, using the same KDS layout as the late
+ * materialization. Nullmaps, dictionaries and sub-fields of composite or
+ * array types are loaded fully. Compressed RecordBatches are always loaded
+ * as a whole, because no partial read is possible.
  */
+static uint8 *
+__arrowFdwSampleRowsSelvec(size_t nitems, int nsamples)
+{
+	uint8	   *selvec = palloc(nitems);
+	bool		inverse = (nsamples > nitems / 2);
+	size_t		count = (inverse ? nitems - nsamples : nsamples);
+
+	Assert(nsamples <= nitems);
+	/* choose the rows to be unselected, if majority is sampled */
+	memset(selvec, (inverse ? 1 : 0), nitems);
+	while (count > 0)
+	{
+		size_t	i = (double)nitems * (((double) random()) /
+									  ((double)MAX_RANDOM_VALUE + 1));
+		Assert(i < nitems);
+		if (selvec[i] == (inverse ? 1 : 0))
+		{
+			selvec[i] = (inverse ? 0 : 1);
+			count--;
+		}
+	}
+	return selvec;
+}
+
+static pgstrom_data_store *
+__arrowFdwLoadRecordBatchSamples(RecordBatchState *rb_state,
+								 Relation relation,
+								 Bitmapset *referenced,
+								 const uint8 *selvec)
+{
+	TupleDesc			tupdesc = RelationGetDescr(relation);
+	pgstrom_data_store *pds;
+	kern_data_store	   *kds;
+	strom_io_vector	   *iovec;
+	size_t				head_sz;
+	int					j, fdesc;
+
+	if (rb_state->rb_compressed)
+	{
+		pds = __arrowFdwLoadRecordBatch(rb_state,
+										relation,
+										referenced,
+										NULL,
+										CurrentMemoryContext,
+										-1);
+		return arrowFdwDecodeDictionary(pds, rb_state, referenced,
+										selvec, NULL);
+	}
+	/* setup KDS with the same layout as __arrowFdwLoadRecordBatch */
+	head_sz = KDS_calculateHeadSize(tupdesc);
+	kds = alloca(head_sz);
+	init_kernel_data_store(kds, tupdesc, 0, KDS_FORMAT_ARROW, 0);
+	kds->nitems = rb_state->rb_nitems;
+	kds->nrooms = rb_state->rb_nitems;
+	kds->table_oid = RelationGetRelid(relation);
+	Assert(head_sz == KERN_DATA_STORE_HEAD_LENGTH(kds));
+	for (j=0; j < kds->nr_colmeta; j++)
+		kds->colmeta[j].attopts = rb_state->columns[j].attopts;
+	iovec = arrowFdwSetupIOvector(kds, rb_state, referenced);
+	pfree(iovec);
+
+	pds = MemoryContextAllocHuge(CurrentMemoryContext,
+								 offsetof(pgstrom_data_store,
+										  kds) + kds->length);
+	memset(pds, 0, offsetof(pgstrom_data_store, kds));
+	pg_atomic_init_u32(&pds->refcnt, 1);
+	pds->filedesc = -1;
+	memcpy(&pds->kds, kds, head_sz);
+	kds = &pds->kds;
+	fdesc = FileGetRawDesc(rb_state->fdesc);
+
+	for (j=0; j < kds->ncols; j++)
+	{
+		__arrowFdwReadField(fdesc, kds, rb_state->rb_offset,
+							&rb_state->columns[j],
+							&kds->colmeta[j],
+							selvec);
+	}
+	return arrowFdwDecodeDictionary(pds, rb_state, referenced,
+									selvec, NULL);
+}
+
 static int
 RecordBatchAcquireSampleRows(Relation relation,
 							 RecordBatchState *rb_state,
@@ -1600,7 +6257,8 @@ RecordBatchAcquireSampleRows(Relation relation,
 	Bitmapset	   *referenced = NULL;
 	Datum		   *values;
 	bool		   *isnull;
-	int				count;
+	uint8		   *selvec;
+	int				count = 0;
 	int				i, j, nwords;
 
 	/* ANALYZE needs to fetch all the attributes */
@@ -1609,35 +6267,34 @@ RecordBatchAcquireSampleRows(Relation relation,
 	referenced = alloca(offsetof(Bitmapset, words[nwords]));
 	referenced->nwords = nwords;
 	memset(referenced->words, -1, sizeof(bitmapword) * nwords);
-	
-	pds = __arrowFdwLoadRecordBatch(rb_state,
-									relation,
-									referenced,
-									NULL,
-									CurrentMemoryContext,
-									-1);
+
+	nsamples = Min(nsamples, rb_state->rb_nitems);
+	selvec = __arrowFdwSampleRowsSelvec(rb_state->rb_nitems, nsamples);
+	pds = __arrowFdwLoadRecordBatchSamples(rb_state,
+										   relation,
+										   referenced,
+										   selvec);
 	values = alloca(sizeof(Datum) * tupdesc->natts);
 	isnull = alloca(sizeof(bool)  * tupdesc->natts);
-	for (count = 0; count < nsamples; count++)
+	for (i=0; i < pds->kds.nitems; i++)
 	{
-		/* fetch a row randomly */
-		i = (double)pds->kds.nitems * (((double) random()) /
-									   ((double)MAX_RANDOM_VALUE + 1));
-		Assert(i < pds->kds.nitems);
-
+		if (!selvec[i])
+			continue;
 		for (j=0; j < pds->kds.ncols; j++)
 		{
 			kern_colmeta   *cmeta = &pds->kds.colmeta[j];
-			
+
 			pg_datum_arrow_ref(&pds->kds,
 							   cmeta,
 							   i,
 							   values + j,
 							   isnull + j);
 		}
-		rows[count] = heap_form_tuple(tupdesc, values, isnull);
+		rows[count++] = heap_form_tuple(tupdesc, values, isnull);
 	}
+	Assert(count == nsamples);
 	PDS_release(pds);
+	pfree(selvec);
 
 	return count;
 }
@@ -1665,9 +6322,11 @@ ArrowAcquireSampleRows(Relation relation,
 	int				nsamples_min = nrooms / 100;
 	int				nitems = 0;
 
+	arrowFdwFlushPendingWrites();
 	filesList = __arrowFdwExtractFilesList(ft->options,
 										   NULL,
-										   &writable);
+										   &writable,
+										   NULL);
 	foreach (lc, filesList)
 	{
 		char	   *fname = strVal(lfirst(lc));
@@ -1702,7 +6361,11 @@ ArrowAcquireSampleRows(Relation relation,
 	}
 	nrooms = Min(nrooms, total_nrows);
 
-	/* fetch samples for each record-batch */
+	/*
+	 * fetch samples for each record-batch; the number of samples are
+	 * assigned in proportion to the number of rows, then the record-batches
+	 * without samples are never loaded.
+	 */
 	foreach (lc, rb_state_list)
 	{
 		RecordBatchState *rb_state = lfirst(lc);
@@ -1887,6 +6550,130 @@ ArrowEstimateDSMForeignScan(ForeignScanState *node,
 	return MAXALIGN(sizeof(pg_atomic_uint32));
 }
 
+/*
+ * arrowFdwScheduleParallelScan
+ *
+ * Parallel workers fetch RecordBatches by the shared rbatch_index, so a huge
+ * RecordBatch fetched at the tail of the scan makes a long pole. It reorders
+ * the RecordBatches largest-first by the power-of-2 class of their size, and
+ * the RecordBatches in the same class keep the original file order. Huge
+ * RecordBatches are already split into row-ranges by
+ * arrowFdwSplitRecordBatches on CPU parallel scan.
+ *
+ * To keep the workers on the same file, a worker claims a run of the
+ * consecutive RecordBatches of a file at once, then reads them sequentially,
+ * so the kernel read-ahead stays effective. A run is up to the largest
+ * RecordBatch, or a quarter of the fair share of a process, whichever is
+ * larger; so the run never makes a longer pole than the largest RecordBatch
+ * unless it is small enough. rbatch_run_end[] is the end of the run that
+ * begins at each index, and the shared rbatch_index always points the head
+ * of a run. All the processes reorder the same array in the same way, so
+ * nothing is needed on the DSM other than the rbatch_index.
+ */
+typedef struct
+{
+	RecordBatchState *rb_state;
+	int			mclass;
+	uint32		index;
+} arrowFdwScheduleItem;
+
+static int
+__arrowFdwScheduleComp(const void *__a, const void *__b)
+{
+	const arrowFdwScheduleItem *a = __a;
+	const arrowFdwScheduleItem *b = __b;
+
+	if (a->mclass != b->mclass)
+		return (a->mclass > b->mclass ? -1 : 1);
+	if (a->index != b->index)
+		return (a->index < b->index ? -1 : 1);
+	return 0;
+}
+
+static void
+arrowFdwScheduleParallelScan(ArrowFdwState *af_state)
+{
+	arrowFdwScheduleItem *items;
+	uint32		nitems = af_state->num_rbatches;
+	uint32	   *run_end;
+	size_t		total_sz = 0;
+	size_t		run_sz = 0;
+	uint32		i, j;
+
+	if (nitems < 2)
+		return;
+	items = palloc(sizeof(arrowFdwScheduleItem) * nitems);
+	for (i=0; i < nitems; i++)
+	{
+		RecordBatchState *rb_state = af_state->rbatches[i];
+
+		items[i].rb_state = rb_state;
+		items[i].mclass = get_next_log2(rb_state->rb_length);
+		items[i].index = i;
+		total_sz += rb_state->rb_length;
+		run_sz = Max(run_sz, rb_state->rb_length);
+	}
+	qsort(items, nitems,
+		  sizeof(arrowFdwScheduleItem),
+		  __arrowFdwScheduleComp);
+	for (i=0; i < nitems; i++)
+		af_state->rbatches[i] = items[i].rb_state;
+	pfree(items);
+
+	/* runs of the consecutive RecordBatches in a file */
+	run_sz = Max(run_sz, total_sz / (4 * (max_parallel_workers_per_gather + 1)));
+	run_end = MemoryContextAlloc(GetMemoryChunkContext(af_state),
+								 sizeof(uint32) * nitems);
+	for (i=0; i < nitems; i++)
+	{
+		RecordBatchState *rb_head = af_state->rbatches[i];
+		size_t		sz = rb_head->rb_length;
+
+		for (j=i+1; j < nitems; j++)
+		{
+			RecordBatchState *rb_state = af_state->rbatches[j];
+
+			if (rb_state->stat_buf.st_dev != rb_head->stat_buf.st_dev ||
+				rb_state->stat_buf.st_ino != rb_head->stat_buf.st_ino ||
+				sz + rb_state->rb_length > run_sz)
+				break;
+			sz += rb_state->rb_length;
+		}
+		run_end[i] = j;
+	}
+	af_state->rbatch_run_end = run_end;
+}
+
+/*
+ * arrowFdwNextRecordBatchIndex
+ *
+ * It returns the index of the next RecordBatch to be read. If the current
+ * run is consumed, it claims the next run by advancing the rbatch_index to
+ * the end of the run.
+ */
+static uint32
+arrowFdwNextRecordBatchIndex(ArrowFdwState *af_state)
+{
+	uint32		curr;
+	uint32		next;
+
+	if (af_state->run_next < af_state->run_end)
+		return af_state->run_next++;
+	if (!af_state->rbatch_run_end)
+		return pg_atomic_fetch_add_u32(af_state->rbatch_index, 1);
+
+	curr = pg_atomic_read_u32(af_state->rbatch_index);
+	do {
+		if (curr >= af_state->num_rbatches)
+			return curr;
+		next = af_state->rbatch_run_end[curr];
+	} while (!pg_atomic_compare_exchange_u32(af_state->rbatch_index,
+											 &curr, next));
+	af_state->run_next = curr + 1;
+	af_state->run_end = next;
+	return curr;
+}
+
 /*
  * ArrowInitializeDSMForeignScan
  */
@@ -1895,6 +6682,7 @@ ExecInitDSMArrowFdw(ArrowFdwState *af_state, pg_atomic_uint32 *rbatch_index)
 {
 	pg_atomic_init_u32(rbatch_index, 0);
 	af_state->rbatch_index = rbatch_index;
+	arrowFdwScheduleParallelScan(af_state);
 }
 
 static void
@@ -1902,6 +6690,8 @@ ArrowInitializeDSMForeignScan(ForeignScanState *node,
 							  ParallelContext *pcxt,
 							  void *coordinate)
 {
+	/* CPU parallel scan may split huge RecordBatches into row-ranges */
+	arrowFdwSplitRecordBatches((ArrowFdwState *)node->fdw_state);
 	ExecInitDSMArrowFdw((ArrowFdwState *)node->fdw_state,
 						(pg_atomic_uint32 *) coordinate);
 }
@@ -1913,6 +6703,9 @@ void
 ExecReInitDSMArrowFdw(ArrowFdwState *af_state)
 {
 	pg_atomic_write_u32(af_state->rbatch_index, 0);
+	af_state->run_next = 0;
+	af_state->run_end = 0;
+	af_state->prefetch_index = 0;
 }
 
 
@@ -1932,6 +6725,7 @@ ExecInitWorkerArrowFdw(ArrowFdwState *af_state,
 					   pg_atomic_uint32 *rbatch_index)
 {
 	af_state->rbatch_index = rbatch_index;
+	arrowFdwScheduleParallelScan(af_state);
 }
 
 static void
@@ -1939,6 +6733,7 @@ ArrowInitializeWorkerForeignScan(ForeignScanState *node,
 								 shm_toc *toc,
 								 void *coordinate)
 {
+	arrowFdwSplitRecordBatches((ArrowFdwState *)node->fdw_state);
 	ExecInitWorkerArrowFdw((ArrowFdwState *)node->fdw_state,
 						   (pg_atomic_uint32 *) coordinate);
 }
@@ -1977,7 +6772,8 @@ ArrowPlanForeignModify(PlannerInfo *root,
 
 	filesList = __arrowFdwExtractFilesList(ft->options,
 										   NULL,
-										   &writable);
+										   &writable,
+										   NULL);
 	if (!writable)
 		elog(ERROR, "arrow_fdw: foreign table \"%s\" is not writable",
 			 get_rel_name(rte->relid));
@@ -2002,12 +6798,28 @@ ArrowBeginForeignModify(ModifyTableState *mtstate,
 	const char	   *fname;
 	File			filp;
 	bool			redo_log_written = false;
+	arrowWriteState *aw_state;
+	MemoryContext	oldcxt = CurrentMemoryContext;
 
 	Assert(list_length(filesList) == 1);
 	fname = strVal(linitial(filesList));
 
 	LockRelation(frel, ShareRowExclusiveLock);
 
+	if (arrow_enable_group_commit)
+	{
+		/* reuse the write state of the former INSERT, if any */
+		aw_state = lookupArrowWritePending(RelationGetRelid(frel));
+		if (aw_state)
+		{
+			aw_state->nusers++;
+			rrinfo->ri_FdwState = aw_state;
+			return;
+		}
+		/* write state must survive until end of the transaction */
+		oldcxt = MemoryContextSwitchTo(TopTransactionContext);
+	}
+
 	filp = PathNameOpenFile(fname, O_RDWR | PG_BINARY);
 	if (filp < 0)
 	{
@@ -2023,7 +6835,7 @@ ArrowBeginForeignModify(ModifyTableState *mtstate,
 					 errmsg("could not open file \"%s\": %m", fname)));
 		PG_TRY();
 		{
-			createArrowWriteRedoLog(filp, true);
+			createArrowWriteRedoLog(filp, true, GetCurrentTransactionId());
 			redo_log_written = true;
 		}
 		PG_CATCH();
@@ -2033,35 +6845,41 @@ ArrowBeginForeignModify(ModifyTableState *mtstate,
 		}
 		PG_END_TRY();
 	}
-	rrinfo->ri_FdwState = createArrowWriteState(frel, filp,
-												redo_log_written);
+	aw_state = createArrowWriteState(frel, filp, redo_log_written);
+	aw_state->nusers = 1;
+	if (arrow_enable_group_commit)
+	{
+		aw_state->group_commit = true;
+		aw_state->pending_footer = true;
+		aw_state->relid = RelationGetRelid(frel);
+		dlist_push_tail(&arrow_write_pending_list, &aw_state->pending_chain);
+		MemoryContextSwitchTo(oldcxt);
+	}
+	rrinfo->ri_FdwState = aw_state;
 }
 
 /*
- * ArrowExecForeignInsert
+ * arrowWriteStatePutValues
+ *
+ * It appends a row to the buffer of arrowWriteState, then returns the usage
+ * of the buffer.
  */
-static TupleTableSlot *
-ArrowExecForeignInsert(EState *estate,
-					   ResultRelInfo *rrinfo,
-					   TupleTableSlot *slot,
-					   TupleTableSlot *planSlot)
+static size_t
+arrowWriteStatePutValues(arrowWriteState *aw_state, TupleDesc tupdesc,
+						 Datum *values, bool *nulls)
 {
-	Relation		frel = rrinfo->ri_RelationDesc;
-	TupleDesc		tupdesc = RelationGetDescr(frel);
-	arrowWriteState *aw_state = rrinfo->ri_FdwState;
 	SQLtable	   *table = &aw_state->sql_table;
 	MemoryContext	oldcxt;
 	size_t			usage = 0;
 	int				j;
 
-	slot_getallattrs(slot);
 	oldcxt = MemoryContextSwitchTo(aw_state->memcxt);
 	for (j=0; j < tupdesc->natts; j++)
 	{
 		Form_pg_attribute attr = tupleDescAttr(tupdesc, j);
 		SQLfield   *column = &table->columns[j];
-		Datum		datum = slot->tts_values[j];
-		bool		isnull = slot->tts_isnull[j];
+		Datum		datum = values[j];
+		bool		isnull = nulls[j];
 
 		if (isnull)
 		{
@@ -2088,13 +6906,38 @@ ArrowExecForeignInsert(EState *estate,
 	table->nitems++;
 	MemoryContextSwitchTo(oldcxt);
 
+	return usage;
+}
+
+/*
+ * ArrowExecForeignInsert
+ */
+static TupleTableSlot *
+ArrowExecForeignInsert(EState *estate,
+					   ResultRelInfo *rrinfo,
+					   TupleTableSlot *slot,
+					   TupleTableSlot *planSlot)
+{
+	Relation		frel = rrinfo->ri_RelationDesc;
+	TupleDesc		tupdesc = RelationGetDescr(frel);
+	arrowWriteState *aw_state = rrinfo->ri_FdwState;
+	SQLtable	   *table = &aw_state->sql_table;
+	size_t			usage;
+
+	slot_getallattrs(slot);
+	usage = arrowWriteStatePutValues(aw_state, tupdesc,
+									 slot->tts_values,
+									 slot->tts_isnull);
 	/*
 	 * If usage exceeds the threshold of record-batch size, make a redo-log
 	 * on demand, and write out the buffer.
 	 */
 	if (usage > table->segment_sz)
+	{
 		writeOutArrowRecordBatch(aw_state, false);
-
+		if (aw_state->group_commit)
+			aw_state->pending_footer = true;
+	}
 	return slot;
 }
 
@@ -2107,7 +6950,17 @@ ArrowEndForeignModify(EState *estate,
 {
 	arrowWriteState *aw_state = rrinfo->ri_FdwState;
 
+	Assert(aw_state->nusers > 0);
+	aw_state->nusers--;
+	/* written out at end of the transaction, if group commit */
+	if (aw_state->group_commit)
+		return;
 	writeOutArrowRecordBatch(aw_state, true);
+	if (aw_state->nusers == 0 && aw_state->bloom_file >= 0)
+	{
+		FileClose(aw_state->bloom_file);
+		aw_state->bloom_file = -1;
+	}
 }
 
 /*
@@ -3126,13 +7979,387 @@ KDS_fetch_tuple_arrow(TupleTableSlot *slot,
 	return true;
 }
 
+/*
+ * arrowFdwSetupPruneContext
+ *
+ * The 'dir' option may have hive-style partition directories, like
+ * dir/date=2026-10-01/region=eu/part-0001.arrow. When the key of the
+ * directory name (key=value) is a column name of the foreign table, the
+ * value is a partition key value of the files under the directory.
+ * The qualifiers that reference the partition key columns only are
+ * evaluated for each directory with the partition key values, and the
+ * directory is not walked if they are never satisfied. It is applied on
+ * the planning (for estimation, using estimate_expression_value) and the
+ * execution (using the actual parameters). Note that the values of the
+ * partition key columns are fetched from the arrow files, so the files
+ * must contain the partition key columns also.
+ */
+static bool
+__arrowFdwPruneQualIsUnsafe(Node *node, void *context)
+{
+	if (!node)
+		return false;
+	/* PARAM_EXEC is not ready on ExecInitNode */
+	if (IsA(node, Param))
+		return (((Param *) node)->paramkind != PARAM_EXTERN);
+	if (IsA(node, SubPlan) ||
+		IsA(node, AlternativeSubPlan) ||
+		IsA(node, SubLink))
+		return true;
+	return expression_tree_walker(node, __arrowFdwPruneQualIsUnsafe, context);
+}
+
+static arrowPruneContext *
+arrowFdwSetupPruneContext(TupleDesc tupdesc, Index relid, List *quals,
+						  PlannerInfo *root, EState *estate)
+{
+	arrowPruneContext *prune;
+	List	   *prune_quals = NIL;
+	List	   *qual_attrs = NIL;
+	ListCell   *lc;
+
+	foreach (lc, quals)
+	{
+		Node	   *qual = lfirst(lc);
+		List	   *vars;
+		ListCell   *cell;
+		Bitmapset  *attrs = NULL;
+		bool		is_valid = true;
+
+		if (contain_volatile_functions(qual) ||
+			__arrowFdwPruneQualIsUnsafe(qual, NULL))
+			continue;
+		vars = pull_var_clause(qual, PVC_RECURSE_PLACEHOLDERS);
+		foreach (cell, vars)
+		{
+			Var	   *var = lfirst(cell);
+
+			if (!IsA(var, Var) ||
+				var->varno != relid ||
+				var->varlevelsup != 0 ||
+				var->varattno <= 0 ||
+				var->varattno > tupdesc->natts)
+			{
+				is_valid = false;
+				break;
+			}
+			attrs = bms_add_member(attrs, var->varattno);
+		}
+		if (!is_valid || bms_is_empty(attrs))
+			continue;
+		prune_quals = lappend(prune_quals, qual);
+		qual_attrs = lappend(qual_attrs, attrs);
+	}
+	if (prune_quals == NIL)
+		return NULL;
+
+	prune = palloc0(sizeof(arrowPruneContext));
+	prune->tupdesc = tupdesc;
+	prune->relid = relid;
+	prune->quals = prune_quals;
+	prune->qual_attrs = qual_attrs;
+	prune->root = root;
+	prune->estate = estate;
+	prune->key_values = palloc0(sizeof(Const *) * tupdesc->natts);
+
+	return prune;
+}
+
+static Node *
+__arrowFdwPruneReplaceVars(Node *node, arrowPruneContext *prune)
+{
+	if (!node)
+		return NULL;
+	if (IsA(node, Var))
+	{
+		Var	   *var = (Var *) node;
+
+		Assert(var->varno == prune->relid &&
+			   bms_is_member(var->varattno, prune->key_attrs));
+		return copyObject(prune->key_values[var->varattno - 1]);
+	}
+	return expression_tree_mutator(node, __arrowFdwPruneReplaceVars, prune);
+}
+
+static bool
+__arrowFdwPruneCheckQual(arrowPruneContext *prune, Node *qual)
+{
+	Node	   *expr = __arrowFdwPruneReplaceVars(qual, prune);
+	Datum		datum;
+	bool		isnull;
+
+	if (prune->root)
+	{
+		expr = estimate_expression_value(prune->root, expr);
+		if (!IsA(expr, Const))
+			return true;
+		datum = ((Const *) expr)->constvalue;
+		isnull = ((Const *) expr)->constisnull;
+	}
+	else
+	{
+		ExprState  *state = ExecPrepareExpr((Expr *) expr, prune->estate);
+
+		datum = ExecEvalExprSwitchContext(state,
+										  GetPerTupleExprContext(prune->estate),
+										  &isnull);
+	}
+	return (!isnull && DatumGetBool(datum));
+}
+
+/*
+ * __arrowFdwPruneInputValue
+ *
+ * It converts the value of partition directory to the Datum of the key
+ * column, and returns false if it is not a valid input for the type.
+ * Prior to PG16, input functions have no soft-error reporting, so we run
+ * the input function on a subtransaction to release the resources on error.
+ * A parallel worker cannot begin any subtransactions, so the planner does not
+ * consider parallel scan if any directories have unparsable values; if the
+ * directory appeared after the planning, the error is raised as usual.
+ */
+static bool
+__arrowFdwPruneInputValue(arrowPruneContext *prune, const char *dname,
+						  char *value, Oid typinput, Oid typioparam,
+						  int32 typmod, Datum *p_datum)
+{
+#if PG_VERSION_NUM >= 160000
+	ErrorSaveContext escontext = {T_ErrorSaveContext};
+	FmgrInfo	flinfo;
+
+	fmgr_info(typinput, &flinfo);
+	if (!InputFunctionCallSafe(&flinfo, value, typioparam, typmod,
+							   (Node *)&escontext, p_datum))
+	{
+		elog(DEBUG2, "arrow_fdw: directory '%s' is not prunable", dname);
+		prune->nunparsable++;
+		return false;
+	}
+	return true;
+#else
+	MemoryContext	memcxt = CurrentMemoryContext;
+	ResourceOwner	owner = CurrentResourceOwner;
+	bool			is_valid = true;
+
+	if (IsInParallelMode())
+	{
+		*p_datum = OidInputFunctionCall(typinput, value, typioparam, typmod);
+		return true;
+	}
+
+	BeginInternalSubTransaction(NULL);
+	MemoryContextSwitchTo(memcxt);
+	PG_TRY();
+	{
+		*p_datum = OidInputFunctionCall(typinput, value, typioparam, typmod);
+		ReleaseCurrentSubTransaction();
+		MemoryContextSwitchTo(memcxt);
+		CurrentResourceOwner = owner;
+	}
+	PG_CATCH();
+	{
+		ErrorData  *edata;
+
+		MemoryContextSwitchTo(memcxt);
+		edata = CopyErrorData();
+		FlushErrorState();
+		RollbackAndReleaseCurrentSubTransaction();
+		MemoryContextSwitchTo(memcxt);
+		CurrentResourceOwner = owner;
+
+		if (ERRCODE_TO_CATEGORY(edata->sqlerrcode) != ERRCODE_DATA_EXCEPTION)
+			ReThrowError(edata);
+		elog(DEBUG2, "arrow_fdw: directory '%s' is not prunable: %s",
+			 dname, edata->message);
+		FreeErrorData(edata);
+		prune->nunparsable++;
+		is_valid = false;
+	}
+	PG_END_TRY();
+
+	return is_valid;
+#endif
+}
+
+/*
+ * __arrowFdwPruneDirectory
+ *
+ * It assigns the partition key value of the directory name (key=value), and
+ * returns false if any qualifiers never match. The previous value of the
+ * key is saved on *p_saved to restore.
+ */
+static bool
+__arrowFdwPruneDirectory(arrowPruneContext *prune, const char *dname,
+						 int *p_anum, Const **p_saved)
+{
+	TupleDesc	tupdesc = prune->tupdesc;
+	const char *pos = strchr(dname, '=');
+	char	   *key = pnstrdup(dname, pos - dname);
+	char	   *value = palloc(strlen(pos));
+	char	   *dst = value;
+	Form_pg_attribute attr = NULL;
+	ListCell   *lc1, *lc2;
+	Datum		datum = 0;
+	bool		isnull = false;
+	int			j;
+
+	*p_anum = -1;
+	for (j=0; j < tupdesc->natts; j++)
+	{
+		attr = tupleDescAttr(tupdesc, j);
+		if (!attr->attisdropped && strcmp(NameStr(attr->attname), key) == 0)
+			break;
+	}
+	pfree(key);
+	if (j >= tupdesc->natts)
+		return true;	/* not a partition key column */
+
+	/* decode %XX escaped characters */
+	for (pos++; *pos != '\0'; pos++)
+	{
+		if (pos[0] == '%' && isxdigit(pos[1]) && isxdigit(pos[2]))
+		{
+			char	hex[3] = { pos[1], pos[2], '\0' };
+
+			*dst++ = (char) strtol(hex, NULL, 16);
+			pos += 2;
+		}
+		else
+			*dst++ = *pos;
+	}
+	*dst = '\0';
+	if (strcmp(value, "__HIVE_DEFAULT_PARTITION__") == 0)
+		isnull = true;
+	else
+	{
+		Oid		typinput;
+		Oid		typioparam;
+		bool	is_valid;
+
+		getTypeInputInfo(attr->atttypid, &typinput, &typioparam);
+		/*
+		 * A stray directory whose value is not valid for the column type
+		 * should not prevent the table from being scanned, so the value is
+		 * just not assigned, and the directory is never pruned by the key.
+		 */
+		is_valid = __arrowFdwPruneInputValue(prune, dname, value,
+											 typinput, typioparam,
+											 attr->atttypmod, &datum);
+		if (!is_valid)
+		{
+			pfree(value);
+			return true;
+		}
+	}
+	pfree(value);
+
+	*p_anum = attr->attnum;
+	*p_saved = prune->key_values[attr->attnum - 1];
+	prune->key_values[attr->attnum - 1] = makeConst(attr->atttypid,
+													attr->atttypmod,
+													attr->attcollation,
+													attr->attlen,
+													datum,
+													isnull,
+													attr->attbyval);
+	prune->key_attrs = bms_add_member(prune->key_attrs, attr->attnum);
+
+	/* evaluate the qualifiers that get evaluable by this key */
+	forboth (lc1, prune->quals, lc2, prune->qual_attrs)
+	{
+		Node	   *qual = lfirst(lc1);
+		Bitmapset  *attrs = lfirst(lc2);
+
+		if (bms_is_member(attr->attnum, attrs) &&
+			bms_is_subset(attrs, prune->key_attrs) &&
+			!__arrowFdwPruneCheckQual(prune, qual))
+		{
+			prune->npruned++;
+			return false;
+		}
+	}
+	return true;
+}
+
+static void
+__arrowFdwPruneRestore(arrowPruneContext *prune, int anum, Const *saved)
+{
+	if (anum <= 0)
+		return;
+	prune->key_values[anum - 1] = saved;
+	if (!saved)
+		prune->key_attrs = bms_del_member(prune->key_attrs, anum);
+}
+
+/*
+ * __arrowFdwWalkDirectory
+ */
+static List *
+__arrowFdwWalkDirectory(List *filesList,
+						const char *dir_path,
+						const char *dir_suffix,
+						arrowPruneContext *prune)
+{
+	struct dirent *dentry;
+	DIR	   *dir;
+	char   *temp;
+
+	dir = AllocateDir(dir_path);
+	while ((dentry = ReadDir(dir, dir_path)) != NULL)
+	{
+		struct stat	st_buf;
+
+		if (strcmp(dentry->d_name, ".") == 0 ||
+			strcmp(dentry->d_name, "..") == 0)
+			continue;
+		temp = psprintf("%s/%s", dir_path, dentry->d_name);
+		/* hive-style partition directory (key=value) */
+		if (strchr(dentry->d_name, '=') != NULL &&
+			stat(temp, &st_buf) == 0 &&
+			S_ISDIR(st_buf.st_mode))
+		{
+			Const  *saved = NULL;
+			int		anum = -1;
+
+			if (!prune ||
+				__arrowFdwPruneDirectory(prune, dentry->d_name,
+										 &anum, &saved))
+				filesList = __arrowFdwWalkDirectory(filesList, temp,
+													dir_suffix, prune);
+			if (prune)
+				__arrowFdwPruneRestore(prune, anum, saved);
+			pfree(temp);
+			continue;
+		}
+		if (dir_suffix)
+		{
+			int		dlen = strlen(dentry->d_name);
+			int		slen = strlen(dir_suffix);
+			int		diff = dlen - slen;
+
+			if (dlen < 2 + slen ||
+				dentry->d_name[diff-1] != '.' ||
+				strcmp(dentry->d_name + diff, dir_suffix) != 0)
+			{
+				pfree(temp);
+				continue;
+			}
+		}
+		filesList = lappend(filesList, makeString(temp));
+	}
+	FreeDir(dir);
+
+	return filesList;
+}
+
 /*
  * arrowFdwExtractFilesList
  */
 static List *
 __arrowFdwExtractFilesList(List *options_list,
 						   int *p_parallel_nworkers,
-						   bool *p_writable)
+						   bool *p_writable,
+						   arrowPruneContext *prune)
 {
 	ListCell   *lc;
 	List	   *filesList = NIL;
@@ -3140,6 +8367,8 @@ __arrowFdwExtractFilesList(List *options_list,
 	char	   *dir_suffix = NULL;
 	int			parallel_nworkers = -1;
 	bool		writable = false;	/* default: read-only */
+	bool		compression = false;
+	bool		bloom_filter = false;
 
 	foreach (lc, options_list)
 	{
@@ -3188,11 +8417,26 @@ __arrowFdwExtractFilesList(List *options_list,
 		{
 			writable = defGetBoolean(defel);
 		}
+		else if (strcmp(defel->defname, "compression") == 0)
+		{
+			/* validation only; applied on createArrowWriteState */
+			makeArrowBodyCompression(strVal(defel->arg));
+			compression = true;
+		}
+		else if (strcmp(defel->defname, "bloom_filter") == 0)
+		{
+			/* columns are checked by arrow_fdw_precheck_schema */
+			bloom_filter = true;
+		}
 		else
 			elog(ERROR, "arrow: unknown option (%s)", defel->defname);
 	}
 	if (dir_suffix && !dir_path)
 		elog(ERROR, "arrow: cannot use 'suffix' option without 'dir'");
+	if (compression && !writable)
+		elog(ERROR, "arrow: cannot use 'compression' option without 'writable'");
+	if (bloom_filter && !writable)
+		elog(ERROR, "arrow: cannot use 'bloom_filter' option without 'writable'");
 
 	if (writable)
 	{
@@ -3205,37 +8449,11 @@ __arrowFdwExtractFilesList(List *options_list,
 	}
 
 	if (dir_path)
-	{
-		struct dirent *dentry;
-		DIR	   *dir;
-		char   *temp;
-
-		dir = AllocateDir(dir_path);
-		while ((dentry = ReadDir(dir, dir_path)) != NULL)
-		{
-			if (strcmp(dentry->d_name, ".") == 0 ||
-				strcmp(dentry->d_name, "..") == 0)
-				continue;
-			if (dir_suffix)
-			{
-				int		dlen = strlen(dentry->d_name);
-				int		slen = strlen(dir_suffix);
-				int		diff;
-
-				if (dlen < 2 + slen)
-					continue;
-				diff = dlen - slen;
-				if (dentry->d_name[diff-1] != '.' ||
-					strcmp(dentry->d_name + diff, dir_suffix) != 0)
-					continue;
-			}
-			temp = psprintf("%s/%s", dir_path, dentry->d_name);
-			filesList = lappend(filesList, makeString(temp));
-		}
-		FreeDir(dir);
-	}
+		filesList = __arrowFdwWalkDirectory(filesList, dir_path,
+											dir_suffix, prune);
 
-	if (filesList == NIL)
+	/* all the files might be pruned by the partition keys */
+	if (filesList == NIL && (!prune || prune->npruned == 0))
 		elog(ERROR, "no files are configured on behalf of the arrow_fdw foreign table");
 	foreach (lc, filesList)
 	{
@@ -3276,7 +8494,7 @@ __arrowFdwExtractFilesList(List *options_list,
 static List *
 arrowFdwExtractFilesList(List *options_list)
 {
-	return __arrowFdwExtractFilesList(options_list, NULL, NULL);
+	return __arrowFdwExtractFilesList(options_list, NULL, NULL, NULL);
 }
 
 
@@ -3360,9 +8578,25 @@ arrow_fdw_precheck_schema(Relation rel)
 				 format_type_be(attr->atttypid));
 	}
 
+	/* check columns of 'bloom_filter' option, if any */
+	foreach (lc, ft->options)
+	{
+		DefElem	   *defel = lfirst(lc);
+
+		if (strcmp(defel->defname, "bloom_filter") == 0)
+		{
+			SQLtable   *table = palloc0(offsetof(SQLtable,
+												 columns[tupdesc->natts]));
+			setupArrowSQLbufferSchema(table, tupdesc);
+			__setupArrowSQLbufferBloomColumns(table, tupdesc,
+											  strVal(defel->arg));
+		}
+	}
+
 	filesList = __arrowFdwExtractFilesList(ft->options,
 										   NULL,
-										   &writable);
+										   &writable,
+										   NULL);
 	foreach (lc, filesList)
 	{
 		const char *fname = strVal(lfirst(lc));
@@ -3438,7 +8672,8 @@ pgstrom_arrow_fdw_precheck_schema(PG_FUNCTION_ARGS)
 
 				if (cmd->subtype == AT_AddColumn ||
 					cmd->subtype == AT_DropColumn ||
-					cmd->subtype == AT_AlterColumnType)
+					cmd->subtype == AT_AlterColumnType ||
+					cmd->subtype == AT_GenericOptions)
 				{
 					has_schema_change = true;
 					break;
@@ -3458,42 +8693,165 @@ pgstrom_arrow_fdw_precheck_schema(PG_FUNCTION_ARGS)
 }
 PG_FUNCTION_INFO_V1(pgstrom_arrow_fdw_precheck_schema);
 
+/*
+ * arrowMetadataCacheSize - consumption by the entry and its siblings
+ */
+static uint64
+arrowMetadataCacheSize(arrowMetadataCache *mcache)
+{
+	arrowMetadataCache *mtemp;
+	dlist_iter	iter;
+	uint64		sz;
+
+	sz = MAXALIGN(offsetof(arrowMetadataCache, fstate[mcache->nfields]));
+	dlist_foreach(iter, &mcache->siblings)
+	{
+		mtemp = dlist_container(arrowMetadataCache, chain, iter.cur);
+		sz += MAXALIGN(offsetof(arrowMetadataCache, fstate[mtemp->nfields]));
+	}
+	return sz;
+}
+
+/*
+ * arrowReleaseRetiredMetadataCache
+ *
+ * It releases the entries in the retire_list, if no lock-free readers which
+ * began prior to the detach from the hash_slots are still running.
+ *
+ * NOTE: the ordering matters. We first pick up the entries retired prior to
+ * the snapshot of reader_epoch, then scan the reader's epoch after the memory
+ * barrier. A reader which is not visible on the scan publishes its epoch
+ * after our barrier, so it shall see the hash_slots after the detach of the
+ * picked-up entries. On the other hands, entries retired after the snapshot
+ * are not picked up, even if no readers are visible, because a reader may
+ * have loaded them prior to the detach.
+ */
+static void
+arrowReleaseRetiredMetadataCache(void)
+{
+	arrowMetadataCache *mcache;
+	arrowMetadataCache *mtemp;
+	dlist_mutable_iter iter;
+	dlist_head	pick_list;
+	dlist_head	keep_list;
+	dlist_node *dnode;
+	uint64		released = 0;
+	uint64		oldest = ULONG_MAX;
+	uint64		snapshot;
+	uint64		epoch;
+	int			i;
+
+	if (dlist_is_empty(&arrow_metadata_state->retire_list))
+		return;
+
+	dlist_init(&pick_list);
+	dlist_init(&keep_list);
+	SpinLockAcquire(&arrow_metadata_state->retire_lock);
+	snapshot = pg_atomic_read_u64(&arrow_metadata_state->reader_epoch);
+	dlist_foreach_modify(iter, &arrow_metadata_state->retire_list)
+	{
+		mcache = dlist_container(arrowMetadataCache, lru_chain, iter.cur);
+		if (mcache->retire_epoch < snapshot)
+		{
+			dlist_delete(&mcache->lru_chain);
+			dlist_push_tail(&pick_list, &mcache->lru_chain);
+		}
+	}
+	SpinLockRelease(&arrow_metadata_state->retire_lock);
+
+	if (dlist_is_empty(&pick_list))
+		return;
+	pg_memory_barrier();
+	for (i=0; i < arrow_metadata_nreaders; i++)
+	{
+		epoch = pg_atomic_read_u64(&arrow_metadata_readers[i].epoch);
+		if (epoch != 0 && epoch < oldest)
+			oldest = epoch;
+	}
+
+	while (!dlist_is_empty(&pick_list))
+	{
+		dnode = dlist_pop_head_node(&pick_list);
+		mcache = dlist_container(arrowMetadataCache, lru_chain, dnode);
+		if (mcache->retire_epoch >= oldest)
+		{
+			dlist_push_tail(&keep_list, &mcache->lru_chain);
+			continue;
+		}
+		released += arrowMetadataCacheSize(mcache);
+		while (!dlist_is_empty(&mcache->siblings))
+		{
+			dnode = dlist_pop_head_node(&mcache->siblings);
+			mtemp = dlist_container(arrowMetadataCache, chain, dnode);
+			pfree(mtemp);
+		}
+		pfree(mcache);
+	}
+	if (released > 0)
+		pg_atomic_sub_fetch_u64(&arrow_metadata_state->consumed, released);
+
+	/* put back the entries still visible to the running readers */
+	if (!dlist_is_empty(&keep_list))
+	{
+		SpinLockAcquire(&arrow_metadata_state->retire_lock);
+		while (!dlist_is_empty(&keep_list))
+		{
+			dnode = dlist_pop_head_node(&keep_list);
+			dlist_push_head(&arrow_metadata_state->retire_list, dnode);
+		}
+		SpinLockRelease(&arrow_metadata_state->retire_lock);
+	}
+}
+
 /*
  * arrowInvalidateMetadataCache
  *
  * NOTE: caller must have lock_slots[] with EXCLUSIVE mode
  */
-static uint64
+static void
 arrowInvalidateMetadataCache(arrowMetadataCache *mcache, bool detach_lru)
 {
-	arrowMetadataCache *mtemp;
-	dlist_node	   *dnode;
-	uint64			released = 0;
-
-	while (!dlist_is_empty(&mcache->siblings))
-	{
-		dnode = dlist_pop_head_node(&mcache->siblings);
-		mtemp = dlist_container(arrowMetadataCache, chain, dnode);
-		Assert(dlist_is_empty(&mtemp->siblings) &&
-			   !mtemp->lru_chain.prev && !mtemp->lru_chain.next);
-		dlist_delete(&mtemp->chain);
-		released += MAXALIGN(offsetof(arrowMetadataCache,
-									  fstate[mtemp->nfields]));
-		pfree(mtemp);
-	}
-	released += MAXALIGN(offsetof(arrowMetadataCache,
-								  fstate[mcache->nfields]));
 	if (detach_lru)
 	{
 		SpinLockAcquire(&arrow_metadata_state->lru_lock);
 		dlist_delete(&mcache->lru_chain);
 		SpinLockRelease(&arrow_metadata_state->lru_lock);
 	}
+	/*
+	 * Lock-free readers may still walk on the entry (and its siblings), so
+	 * it shall be released later. Note that the detached entry keeps its
+	 * 'chain.next', so readers can continue to walk on the hash_slot.
+	 * pg_atomic_fetch_add_u64() also works as a full memory barrier.
+	 */
 	dlist_delete(&mcache->chain);
-	pfree(mcache);
+	mcache->retire_epoch =
+		pg_atomic_fetch_add_u64(&arrow_metadata_state->reader_epoch, 1);
+	SpinLockAcquire(&arrow_metadata_state->retire_lock);
+	dlist_push_tail(&arrow_metadata_state->retire_list, &mcache->lru_chain);
+	SpinLockRelease(&arrow_metadata_state->retire_lock);
+	/* NOTE: 'consumed' shall be decremented on the release */
+}
+
+/*
+ * arrowInvalidateMetadataCacheByKey
+ *
+ * NOTE: caller must have lock_slots[] with EXCLUSIVE mode
+ */
+static void
+arrowInvalidateMetadataCacheByKey(MetadataCacheKey *key)
+{
+	int			index = key->hash % ARROW_METADATA_HASH_NSLOTS;
+	dlist_mutable_iter iter;
+
+	dlist_foreach_modify(iter, &arrow_metadata_state->hash_slots[index])
+	{
+		arrowMetadataCache *mcache
+			= dlist_container(arrowMetadataCache, chain, iter.cur);
 
-	return pg_atomic_sub_fetch_u64(&arrow_metadata_state->consumed,
-								   released);
+		if (mcache->stat_buf.st_dev == key->st_dev &&
+			mcache->stat_buf.st_ino == key->st_ino)
+			arrowInvalidateMetadataCache(mcache, true);
+	}
 }
 
 /*
@@ -3549,6 +8907,8 @@ makeRecordBatchStateFromCache(arrowMetadataCache *mcache, File fdesc)
 	rbstate->rb_offset = mcache->rb_offset;
 	rbstate->rb_length = mcache->rb_length;
 	rbstate->rb_nitems = mcache->rb_nitems;
+	rbstate->rb_compressed = mcache->rb_compressed;
+	rbstate->rb_codec = mcache->rb_codec;
 	rbstate->ncols = mcache->ncols;
 	copyMetadataFieldCache(rbstate->columns,
 						   rbstate->columns + mcache->nfields,
@@ -3559,6 +8919,10 @@ makeRecordBatchStateFromCache(arrowMetadataCache *mcache, File fdesc)
 
 /*
  * arrowReclaimMetadataCache
+ *
+ * It reclaims the metadata cache entries based on the clock algorithm.
+ * Entries referenced since the last sweep get the second chance, so readers
+ * need not to touch the lru_list on cache hit.
  */
 static void
 arrowReclaimMetadataCache(void)
@@ -3570,22 +8934,32 @@ arrowReclaimMetadataCache(void)
 	uint32		lru_index;
 	uint64		consumed;
 
+	/* retired entries are released first, if no readers walk on */
+	arrowReleaseRetiredMetadataCache();
 	consumed = pg_atomic_read_u64(&arrow_metadata_state->consumed);
 	if (consumed <= arrow_metadata_cache_size)
 		return;
 
-	SpinLockAcquire(&arrow_metadata_state->lru_lock);
-	if (dlist_is_empty(&arrow_metadata_state->lru_list))
-	{
+	do {
+		SpinLockAcquire(&arrow_metadata_state->lru_lock);
+		for (;;)
+		{
+			if (dlist_is_empty(&arrow_metadata_state->lru_list))
+			{
+				SpinLockRelease(&arrow_metadata_state->lru_lock);
+				return;
+			}
+			dnode = dlist_tail_node(&arrow_metadata_state->lru_list);
+			mcache = dlist_container(arrowMetadataCache, lru_chain, dnode);
+			if (!mcache->referenced)
+				break;
+			mcache->referenced = false;
+			dlist_move_head(&arrow_metadata_state->lru_list,
+							&mcache->lru_chain);
+		}
+		lru_hash = mcache->hash;
 		SpinLockRelease(&arrow_metadata_state->lru_lock);
-		return;
-	}
-	dnode = dlist_tail_node(&arrow_metadata_state->lru_list);
-	mcache = dlist_container(arrowMetadataCache, lru_chain, dnode);
-	lru_hash = mcache->hash;
-	SpinLockRelease(&arrow_metadata_state->lru_lock);
 
-	do {
 		lru_index = lru_hash % ARROW_METADATA_HASH_NSLOTS;
 		lock = &arrow_metadata_state->lock_slots[lru_index];
 
@@ -3599,20 +8973,25 @@ arrowReclaimMetadataCache(void)
 		}
 		dnode = dlist_tail_node(&arrow_metadata_state->lru_list);
 		mcache = dlist_container(arrowMetadataCache, lru_chain, dnode);
-		if (mcache->hash == lru_hash)
+		if (mcache->hash == lru_hash && !mcache->referenced)
 		{
 			dlist_delete(&mcache->lru_chain);
 			memset(&mcache->lru_chain, 0, sizeof(dlist_node));
 			SpinLockRelease(&arrow_metadata_state->lru_lock);
-			consumed = arrowInvalidateMetadataCache(mcache, false);
+			arrowInvalidateMetadataCache(mcache, false);
 		}
 		else
 		{
 			/* LRU-tail was referenced by someone, try again */
-			lru_hash = mcache->hash;
-            SpinLockRelease(&arrow_metadata_state->lru_lock);
+			SpinLockRelease(&arrow_metadata_state->lru_lock);
 		}
 		LWLockRelease(lock);
+		/*
+		 * The entry just retired is still accounted, until it is released
+		 * after the concurrent lock-free readers have gone.
+		 */
+		arrowReleaseRetiredMetadataCache();
+		consumed = pg_atomic_read_u64(&arrow_metadata_state->consumed);
 	} while (consumed > arrow_metadata_cache_size);
 }
 
@@ -3666,6 +9045,8 @@ __arrowBuildMetadataCache(List *rb_state_list, uint32 hash)
         mtemp->rb_offset = rbstate->rb_offset;
         mtemp->rb_length = rbstate->rb_length;
         mtemp->rb_nitems = rbstate->rb_nitems;
+		mtemp->rb_compressed = rbstate->rb_compressed;
+		mtemp->rb_codec  = rbstate->rb_codec;
         mtemp->ncols     = rbstate->ncols;
 		mtemp->nfields   =
 			copyMetadataFieldCache(mtemp->fstate,
@@ -3711,7 +9092,657 @@ checkArrowRecordBatchIsVisible(RecordBatchState *rbstate,
 				return false;
 		}
 	}
-	return true;
+	return true;
+}
+
+/*
+ * __fixupMetadataFieldChildren
+ *
+ * It restores the 'children' pointers of RecordBatchFieldState array that
+ * was flattened by copyMetadataFieldCache, then returns number of the slots.
+ */
+static int
+__fixupMetadataFieldChildren(RecordBatchFieldState *fstate_curr,
+							 RecordBatchFieldState *fstate_tail,
+							 int nattrs)
+{
+	RecordBatchFieldState *fstate_next = fstate_curr + nattrs;
+	int		j, k, nslots = nattrs;
+
+	if (nattrs < 0 || fstate_next > fstate_tail)
+		return -1;
+
+	for (j=0; j < nattrs; j++)
+	{
+		if (fstate_curr[j].num_children == 0)
+			fstate_curr[j].children = NULL;
+		else
+		{
+			fstate_curr[j].children = fstate_next;
+			k = __fixupMetadataFieldChildren(fstate_next,
+											 fstate_tail,
+											 fstate_curr[j].num_children);
+			if (k < 0)
+				return -1;
+			fstate_next += k;
+			nslots += k;
+		}
+	}
+	return nslots;
+}
+
+/*
+ * __arrowMetadataIndexScan
+ *
+ * It scans the records of the metadata index file from 'pos' to 'tail',
+ * then returns the position of the first broken or incomplete record, if any.
+ */
+static size_t
+__arrowMetadataIndexScan(size_t pos, size_t tail)
+{
+	arrowMetadataIndexRecord *rec;
+	arrowMetadataIndexEntry hkey;
+	arrowMetadataIndexEntry *entry;
+	pg_crc32c	crc;
+	bool		found;
+
+	while (pos + offsetof(arrowMetadataIndexRecord, pathname) < tail)
+	{
+		rec = (arrowMetadataIndexRecord *)(arrow_metadata_index_map + pos);
+		if (rec->magic != ARROW_METADATA_INDEX_MAGIC ||
+			rec->length != MAXALIGN(rec->length) ||
+			rec->length > tail - pos ||
+			rec->batch_head <= offsetof(arrowMetadataIndexRecord, pathname) ||
+			rec->batch_head > rec->length)
+			break;
+		INIT_CRC32C(crc);
+		COMP_CRC32C(crc, &rec->nbatches,
+					rec->length - offsetof(arrowMetadataIndexRecord, nbatches));
+		FIN_CRC32C(crc);
+		if (!EQ_CRC32C(crc, rec->crc) ||
+			((char *)rec)[rec->batch_head - 1] != '\0')
+			break;
+
+		memset(&hkey, 0, sizeof(arrowMetadataIndexEntry));
+		hkey.st_dev = rec->st_dev;
+		hkey.st_ino = rec->st_ino;
+		entry = hash_search(arrow_metadata_index_htab,
+							&hkey, HASH_ENTER, &found);
+		if (found)
+		{
+			arrowMetadataIndexRecord *prev = (arrowMetadataIndexRecord *)
+				(arrow_metadata_index_map + entry->offset);
+			arrow_metadata_index_live_sz -= prev->length;
+		}
+		entry->offset = pos;	/* the latest one wins */
+		arrow_metadata_index_live_sz += rec->length;
+
+		pos += rec->length;
+	}
+	return pos;
+}
+
+/*
+ * __arrowMetadataIndexClose
+ */
+static void
+__arrowMetadataIndexClose(void)
+{
+	if (arrow_metadata_index_htab)
+		hash_destroy(arrow_metadata_index_htab);
+	arrow_metadata_index_htab = NULL;
+	if (arrow_metadata_index_map)
+		munmap(arrow_metadata_index_map, arrow_metadata_index_mapsz);
+	arrow_metadata_index_map = NULL;
+	arrow_metadata_index_mapsz = 0;
+	arrow_metadata_index_scanned = 0;
+	arrow_metadata_index_live_sz = 0;
+	if (arrow_metadata_index_fdesc >= 0)
+		close(arrow_metadata_index_fdesc);
+	arrow_metadata_index_fdesc = -1;
+}
+
+/*
+ * __arrowMetadataIndexOpen
+ *
+ * It opens (or creates) the metadata index file, then maps and scans the
+ * entire file. Broken tail, likely written on the crash, shall be truncated.
+ */
+static bool
+__arrowMetadataIndexOpen(const char *fname)
+{
+	arrowMetadataIndexHeader hdesc;
+	arrowMetadataIndexHeader htemp;
+	struct stat	stat_buf;
+	HASHCTL		hctl;
+	size_t		pos;
+	char	   *map;
+
+	memset(&hdesc, 0, sizeof(arrowMetadataIndexHeader));
+	strcpy(hdesc.signature, ARROW_METADATA_INDEX_SIGNATURE);
+	hdesc.version = ARROW_METADATA_INDEX_VERSION;
+	hdesc.field_sz = sizeof(RecordBatchFieldState);
+
+	arrow_metadata_index_fdesc = open(fname, O_RDWR | O_CREAT | O_APPEND,
+									  S_IRUSR | S_IWUSR);
+	if (arrow_metadata_index_fdesc < 0)
+	{
+		elog(LOG, "arrow_fdw: failed on open('%s'): %m", fname);
+		return false;
+	}
+	if (fstat(arrow_metadata_index_fdesc, &stat_buf) != 0)
+	{
+		elog(LOG, "arrow_fdw: failed on fstat('%s'): %m", fname);
+		goto bailout;
+	}
+	if (stat_buf.st_size < sizeof(arrowMetadataIndexHeader) ||
+		pread(arrow_metadata_index_fdesc, &htemp,
+			  sizeof(arrowMetadataIndexHeader), 0)
+			!= sizeof(arrowMetadataIndexHeader) ||
+		memcmp(&hdesc, &htemp, sizeof(arrowMetadataIndexHeader)) != 0)
+	{
+		/* empty or incompatible file, so re-initialize it */
+		if (stat_buf.st_size > 0)
+			elog(LOG, "arrow_fdw: metadata index file '%s' is not compatible, so re-initialized", fname);
+		if (ftruncate(arrow_metadata_index_fdesc, 0) != 0 ||
+			write(arrow_metadata_index_fdesc, &hdesc,
+				  sizeof(arrowMetadataIndexHeader))
+				!= sizeof(arrowMetadataIndexHeader))
+		{
+			elog(LOG, "arrow_fdw: failed on initialization of '%s': %m",
+				 fname);
+			goto bailout;
+		}
+		stat_buf.st_size = sizeof(arrowMetadataIndexHeader);
+	}
+
+	map = mmap(NULL, stat_buf.st_size, PROT_READ, MAP_SHARED,
+			   arrow_metadata_index_fdesc, 0);
+	if (map == MAP_FAILED)
+	{
+		elog(LOG, "arrow_fdw: failed on mmap('%s'): %m", fname);
+		goto bailout;
+	}
+	arrow_metadata_index_map = map;
+	arrow_metadata_index_mapsz = stat_buf.st_size;
+
+	memset(&hctl, 0, sizeof(HASHCTL));
+	hctl.keysize = offsetof(arrowMetadataIndexEntry, offset);
+	hctl.entrysize = sizeof(arrowMetadataIndexEntry);
+	hctl.hcxt = TopMemoryContext;
+	arrow_metadata_index_htab
+		= hash_create("arrow_fdw metadata index",
+					  4096,
+					  &hctl,
+					  HASH_ELEM | HASH_BLOBS | HASH_CONTEXT);
+
+	pos = __arrowMetadataIndexScan(sizeof(arrowMetadataIndexHeader),
+								   stat_buf.st_size);
+	if (pos < stat_buf.st_size)
+	{
+		/*
+		 * The current mapping is kept as is; pages beyond the new file size
+		 * are never touched until next remap.
+		 */
+		elog(LOG, "arrow_fdw: metadata index file '%s' has a broken record at %zu, so truncated",
+			 fname, pos);
+		if (ftruncate(arrow_metadata_index_fdesc, pos) != 0)
+		{
+			elog(LOG, "arrow_fdw: failed on ftruncate('%s'): %m", fname);
+			goto bailout;
+		}
+	}
+	arrow_metadata_index_scanned = pos;
+
+	return true;
+
+bailout:
+	__arrowMetadataIndexClose();
+	return false;
+}
+
+/*
+ * __arrowMetadataIndexCompaction
+ *
+ * It rewrites the metadata index file with the live records only.
+ * Records appended by other backends during the rewrite may be lost, but
+ * it just leads a cache miss, then re-appended.
+ */
+static void
+__arrowMetadataIndexCompaction(const char *fname)
+{
+	arrowMetadataIndexHeader hdesc;
+	arrowMetadataIndexEntry *entry;
+	arrowMetadataIndexRecord *rec;
+	HASH_SEQ_STATUS	hseq;
+	char	   *temp = psprintf("%s.%d.tmp", fname, MyProcPid);
+	int			fdesc;
+
+	fdesc = open(temp, O_RDWR | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR);
+	if (fdesc < 0)
+	{
+		elog(LOG, "arrow_fdw: failed on open('%s'): %m", temp);
+		pfree(temp);
+		return;
+	}
+	memcpy(&hdesc, arrow_metadata_index_map,
+		   sizeof(arrowMetadataIndexHeader));
+	if (write(fdesc, &hdesc, sizeof(arrowMetadataIndexHeader))
+			!= sizeof(arrowMetadataIndexHeader))
+		goto bailout;
+
+	hash_seq_init(&hseq, arrow_metadata_index_htab);
+	while ((entry = hash_seq_search(&hseq)) != NULL)
+	{
+		rec = (arrowMetadataIndexRecord *)
+			(arrow_metadata_index_map + entry->offset);
+		if (write(fdesc, rec, rec->length) != rec->length)
+		{
+			hash_seq_term(&hseq);
+			goto bailout;
+		}
+	}
+	if (fsync(fdesc) != 0)
+		goto bailout;
+	close(fdesc);
+
+	if (rename(temp, fname) != 0)
+	{
+		elog(LOG, "arrow_fdw: failed on rename('%s','%s'): %m", temp, fname);
+		unlink(temp);
+	}
+	else
+	{
+		__arrowMetadataIndexClose();
+		__arrowMetadataIndexOpen(fname);
+	}
+	pfree(temp);
+	return;
+
+bailout:
+	elog(LOG, "arrow_fdw: failed on compaction of '%s': %m", fname);
+	close(fdesc);
+	unlink(temp);
+	pfree(temp);
+}
+
+/*
+ * arrowMetadataIndexStartup
+ *
+ * It loads the metadata index file on the postmaster startup, then backend
+ * processes inherit the mapping and the hash table. Records of the arrow
+ * files already removed or modified are discarded here, and the file is
+ * rewritten if more than half of its contents are obsolete.
+ */
+static void
+arrowMetadataIndexStartup(void)
+{
+	arrowMetadataIndexEntry *entry;
+	arrowMetadataIndexRecord *rec;
+	HASH_SEQ_STATUS	hseq;
+	struct stat	stat_buf;
+	size_t		total_sz;
+
+	/* cleanup, if shared memory is re-initialized after the crash */
+	__arrowMetadataIndexClose();
+
+	if (!arrow_metadata_index_file || *arrow_metadata_index_file == '\0')
+		return;
+	if (!__arrowMetadataIndexOpen(arrow_metadata_index_file))
+		return;
+
+	hash_seq_init(&hseq, arrow_metadata_index_htab);
+	while ((entry = hash_seq_search(&hseq)) != NULL)
+	{
+		rec = (arrowMetadataIndexRecord *)
+			(arrow_metadata_index_map + entry->offset);
+		if (stat(rec->pathname, &stat_buf) != 0 ||
+			stat_buf.st_dev  != rec->st_dev ||
+			stat_buf.st_ino  != rec->st_ino ||
+			stat_buf.st_size != rec->st_size ||
+			timespec_comp(&stat_buf.st_mtim, &rec->st_mtim) != 0)
+		{
+			arrow_metadata_index_live_sz -= rec->length;
+			hash_search(arrow_metadata_index_htab,
+						entry, HASH_REMOVE, NULL);
+		}
+	}
+	total_sz = (arrow_metadata_index_scanned -
+				sizeof(arrowMetadataIndexHeader));
+	if (total_sz > 2 * arrow_metadata_index_live_sz)
+		__arrowMetadataIndexCompaction(arrow_metadata_index_file);
+	if (arrow_metadata_index_htab)
+		elog(LOG, "arrow_fdw: metadata index file '%s' has %ld entries",
+			 arrow_metadata_index_file,
+			 hash_get_num_entries(arrow_metadata_index_htab));
+}
+
+/*
+ * __arrowMetadataIndexReopen
+ *
+ * It re-opens the metadata index file if other backend already replaced it
+ * by compaction. Returns false if the index is not available any more.
+ */
+static bool
+__arrowMetadataIndexReopen(void)
+{
+	struct stat	stat_buf;
+	struct stat	fstat_buf;
+
+	if (arrow_metadata_index_fdesc < 0)
+		return false;
+	if (stat(arrow_metadata_index_file, &stat_buf) == 0 &&
+		fstat(arrow_metadata_index_fdesc, &fstat_buf) == 0 &&
+		(stat_buf.st_dev != fstat_buf.st_dev ||
+		 stat_buf.st_ino != fstat_buf.st_ino))
+	{
+		__arrowMetadataIndexClose();
+		return __arrowMetadataIndexOpen(arrow_metadata_index_file);
+	}
+	return true;
+}
+
+/*
+ * __arrowMetadataIndexRefresh
+ *
+ * It maps the records appended by other backends since the last scan.
+ */
+static void
+__arrowMetadataIndexRefresh(void)
+{
+	struct stat	stat_buf;
+	char	   *map;
+
+	if (!__arrowMetadataIndexReopen())
+		return;
+	if (fstat(arrow_metadata_index_fdesc, &stat_buf) != 0 ||
+		stat_buf.st_size <= arrow_metadata_index_scanned)
+		return;
+	map = mmap(NULL, stat_buf.st_size, PROT_READ, MAP_SHARED,
+			   arrow_metadata_index_fdesc, 0);
+	if (map == MAP_FAILED)
+	{
+		elog(LOG, "arrow_fdw: failed on mmap('%s'): %m",
+			 arrow_metadata_index_file);
+		return;
+	}
+	munmap(arrow_metadata_index_map, arrow_metadata_index_mapsz);
+	arrow_metadata_index_map = map;
+	arrow_metadata_index_mapsz = stat_buf.st_size;
+	arrow_metadata_index_scanned
+		= __arrowMetadataIndexScan(arrow_metadata_index_scanned,
+								   stat_buf.st_size);
+}
+
+/*
+ * arrowLookupMetadataIndex
+ *
+ * It looks up the persistent metadata index, then setup the RecordBatchState
+ * list of the arrow file if a record with identical st_size and st_mtim
+ * exists.
+ */
+static bool
+arrowLookupMetadataIndex(File fdesc, struct stat *stat_buf,
+						 List **p_rb_state_list)
+{
+	arrowMetadataIndexEntry hkey;
+	arrowMetadataIndexEntry *entry;
+	arrowMetadataIndexRecord *rec = NULL;
+	List	   *rb_state_list = NIL;
+	size_t		pos;
+	int			i;
+
+	if (!arrow_metadata_index_htab)
+		return false;
+
+	memset(&hkey, 0, sizeof(arrowMetadataIndexEntry));
+	hkey.st_dev = stat_buf->st_dev;
+	hkey.st_ino = stat_buf->st_ino;
+	for (i=0; i < 2 && arrow_metadata_index_htab != NULL; i++)
+	{
+		entry = hash_search(arrow_metadata_index_htab,
+							&hkey, HASH_FIND, NULL);
+		if (entry)
+		{
+			rec = (arrowMetadataIndexRecord *)
+				(arrow_metadata_index_map + entry->offset);
+			if (rec->st_size == stat_buf->st_size &&
+				timespec_comp(&rec->st_mtim, &stat_buf->st_mtim) == 0)
+				break;
+			rec = NULL;
+		}
+		/* other backends may append the latest record */
+		if (i == 0)
+			__arrowMetadataIndexRefresh();
+	}
+	if (!rec)
+		return false;
+
+	pos = rec->batch_head;
+	for (i=0; i < rec->nbatches; i++)
+	{
+		arrowMetadataIndexBatch *batch;
+		RecordBatchState *rb_state;
+
+		if (pos + offsetof(arrowMetadataIndexBatch, fstate) > rec->length)
+			goto corrupted;
+		batch = (arrowMetadataIndexBatch *)((char *)rec + pos);
+		if (batch->ncols < 0 ||
+			batch->nfields < batch->ncols ||
+			batch->length != MAXALIGN(offsetof(arrowMetadataIndexBatch,
+											   fstate[batch->nfields])) ||
+			batch->length > rec->length - pos)
+			goto corrupted;
+
+		rb_state = palloc0(offsetof(RecordBatchState,
+									columns[batch->nfields]));
+		rb_state->fdesc = fdesc;
+		memcpy(&rb_state->stat_buf, stat_buf, sizeof(struct stat));
+		rb_state->rb_index  = batch->rb_index;
+		rb_state->rb_offset = batch->rb_offset;
+		rb_state->rb_length = batch->rb_length;
+		rb_state->rb_nitems = batch->rb_nitems;
+		rb_state->rb_compressed = batch->rb_compressed;
+		rb_state->rb_codec  = batch->rb_codec;
+		rb_state->ncols     = batch->ncols;
+		memcpy(rb_state->columns, batch->fstate,
+			   sizeof(RecordBatchFieldState) * batch->nfields);
+		if (__fixupMetadataFieldChildren(rb_state->columns,
+										 rb_state->columns + batch->nfields,
+										 batch->ncols) != batch->nfields)
+			goto corrupted;
+		rb_state_list = lappend(rb_state_list, rb_state);
+		pos += batch->length;
+	}
+	*p_rb_state_list = rb_state_list;
+	return true;
+
+corrupted:
+	elog(LOG, "arrow_fdw: metadata index record of '%s' is corrupted, ignored",
+		 FilePathName(fdesc));
+	return false;
+}
+
+/*
+ * arrowAppendMetadataIndex
+ *
+ * It appends a record of the arrow file to the persistent metadata index.
+ * A record is written by a single write(2) on the file opened with O_APPEND,
+ * so concurrent writers never interleave. Torn records, if any, are detected
+ * by CRC32C. If obsolete records, like the ones of older versions of writable
+ * arrow files, consume more than half of the file, it is compacted.
+ */
+static void
+arrowAppendMetadataIndex(File fdesc, struct stat *stat_buf,
+						 List *rb_state_list)
+{
+	const char *fname = FilePathName(fdesc);
+	arrowMetadataIndexRecord *rec;
+	size_t		length;
+	size_t		pos;
+	ListCell   *lc;
+
+	if (arrow_metadata_index_fdesc < 0)
+		return;
+
+	pos = MAXALIGN(offsetof(arrowMetadataIndexRecord,
+							pathname[strlen(fname) + 1]));
+	length = pos;
+	foreach (lc, rb_state_list)
+	{
+		RecordBatchState *rb_state = lfirst(lc);
+		int		nfields = RecordBatchFieldCount(rb_state);
+
+		length += MAXALIGN(offsetof(arrowMetadataIndexBatch,
+									fstate[nfields]));
+	}
+	if (!AllocSizeIsValid(length))
+		return;		/* too large to index */
+
+	rec = palloc0(length);
+	rec->magic      = ARROW_METADATA_INDEX_MAGIC;
+	rec->length     = length;
+	rec->nbatches   = list_length(rb_state_list);
+	rec->batch_head = pos;
+	rec->st_dev     = stat_buf->st_dev;
+	rec->st_ino     = stat_buf->st_ino;
+	rec->st_size    = stat_buf->st_size;
+	rec->st_mtim    = stat_buf->st_mtim;
+	strcpy(rec->pathname, fname);
+	foreach (lc, rb_state_list)
+	{
+		RecordBatchState *rb_state = lfirst(lc);
+		arrowMetadataIndexBatch *batch;
+		int		nfields = RecordBatchFieldCount(rb_state);
+		int		j;
+
+		batch = (arrowMetadataIndexBatch *)((char *)rec + pos);
+		batch->length    = MAXALIGN(offsetof(arrowMetadataIndexBatch,
+											 fstate[nfields]));
+		batch->rb_index  = rb_state->rb_index;
+		batch->rb_offset = rb_state->rb_offset;
+		batch->rb_length = rb_state->rb_length;
+		batch->rb_nitems = rb_state->rb_nitems;
+		batch->rb_compressed = rb_state->rb_compressed;
+		batch->rb_codec  = rb_state->rb_codec;
+		batch->ncols     = rb_state->ncols;
+		batch->nfields   =
+			copyMetadataFieldCache(batch->fstate,
+								   batch->fstate + nfields,
+								   rb_state->ncols,
+								   rb_state->columns);
+		Assert(batch->nfields == nfields);
+		/* pointers are meaningless on the file */
+		for (j=0; j < nfields; j++)
+			batch->fstate[j].children = NULL;
+		pos += batch->length;
+	}
+	Assert(pos == length);
+	INIT_CRC32C(rec->crc);
+	COMP_CRC32C(rec->crc, &rec->nbatches,
+				length - offsetof(arrowMetadataIndexRecord, nbatches));
+	FIN_CRC32C(rec->crc);
+
+	if (!__arrowMetadataIndexReopen())
+	{
+		pfree(rec);
+		return;
+	}
+	if (write(arrow_metadata_index_fdesc, rec, length) != length)
+	{
+		elog(LOG, "arrow_fdw: failed on write metadata index of '%s': %m",
+			 fname);
+		pfree(rec);
+		return;
+	}
+	pfree(rec);
+
+	/* compaction, if obsolete records consume more than half */
+	__arrowMetadataIndexRefresh();
+	if (arrow_metadata_index_htab)
+	{
+		size_t	total_sz = (arrow_metadata_index_scanned -
+							sizeof(arrowMetadataIndexHeader));
+
+		if (total_sz > ARROW_METADATA_INDEX_COMPACTION_MIN &&
+			total_sz > 2 * arrow_metadata_index_live_sz)
+			__arrowMetadataIndexCompaction(arrow_metadata_index_file);
+	}
+}
+
+/*
+ * arrowLookupMetadataCacheLockFree
+ *
+ * It looks up the metadata cache without any locks, and without writes on
+ * the shared cache lines unless 'referenced' flag is not set yet. The entries
+ * on the hash_slot are immutable, and never released while this process
+ * announces its epoch on arrow_metadata_readers[]. If the entry is not found,
+ * stale, or MVCC logs exist on the slot, caller falls back to the locked path.
+ */
+static bool
+arrowLookupMetadataCacheLockFree(File fdesc, struct stat *stat_buf,
+								 dlist_head *hash_slot,
+								 dlist_head *mvcc_slot,
+								 List **p_results)
+{
+	arrowMetadataReader *reader;
+	dlist_node *dnode;
+	List	   *results = NIL;
+	bool		found = false;
+
+	if (!MyProc || MyProc->pgprocno >= arrow_metadata_nreaders)
+		return false;
+	reader = &arrow_metadata_readers[MyProc->pgprocno];
+	pg_atomic_write_u64(&reader->epoch,
+						pg_atomic_read_u64(&arrow_metadata_state->reader_epoch));
+	pg_memory_barrier();
+	PG_TRY();
+	{
+		for (dnode = hash_slot->head.next;
+			 dnode != &hash_slot->head;
+			 dnode = dnode->next)
+		{
+			arrowMetadataCache *mcache
+				= dlist_container(arrowMetadataCache, chain, dnode);
+			dlist_iter	iter;
+
+			if (mcache->stat_buf.st_dev != stat_buf->st_dev ||
+				mcache->stat_buf.st_ino != stat_buf->st_ino)
+				continue;
+			if (timespec_comp(&mcache->stat_buf.st_mtim,
+							  &stat_buf->st_mtim) < 0 ||
+				timespec_comp(&mcache->stat_buf.st_ctim,
+							  &stat_buf->st_ctim) < 0 ||
+				!dlist_is_empty(mvcc_slot))
+				break;
+			results = list_make1(makeRecordBatchStateFromCache(mcache, fdesc));
+			dlist_foreach (iter, &mcache->siblings)
+			{
+				arrowMetadataCache *__mcache
+					= dlist_container(arrowMetadataCache, chain, iter.cur);
+				results = lappend(results,
+								  makeRecordBatchStateFromCache(__mcache,
+																fdesc));
+			}
+			if (!mcache->referenced)
+				mcache->referenced = true;
+			found = true;
+			break;
+		}
+	}
+	PG_CATCH();
+	{
+		pg_memory_barrier();
+		pg_atomic_write_u64(&reader->epoch, 0);
+		PG_RE_THROW();
+	}
+	PG_END_TRY();
+	pg_memory_barrier();
+	pg_atomic_write_u64(&reader->epoch, 0);
+
+	if (found)
+		*p_results = results;
+	return found;
 }
 
 /*
@@ -3743,6 +9774,10 @@ arrowLookupOrBuildMetadataCache(File fdesc)
 	hash_slot = &arrow_metadata_state->hash_slots[index];
 	mvcc_slot = &arrow_metadata_state->mvcc_slots[index];
 
+	if (arrowLookupMetadataCacheLockFree(fdesc, &stat_buf,
+										 hash_slot, mvcc_slot, &results))
+		return results;
+
 	LWLockAcquire(lock, LW_SHARED);
 retry:
 	dlist_foreach(iter1, hash_slot)
@@ -3797,10 +9832,8 @@ retry:
 				if (checkArrowRecordBatchIsVisible(rbstate, mvcc_slot))
 					results = lappend(results, rbstate);
 			}
-			SpinLockAcquire(&arrow_metadata_state->lru_lock);
-			dlist_move_head(&arrow_metadata_state->lru_list,
-							&mcache->lru_chain);
-			SpinLockRelease(&arrow_metadata_state->lru_lock);
+			if (!mcache->referenced)
+				mcache->referenced = true;
 			LWLockRelease(lock);
 
 			return results;
@@ -3823,37 +9856,57 @@ retry:
 		ArrowFileInfo	af_info;
 		arrowMetadataCache *mcache;
 		List		   *rb_state_any = NIL;
+		ListCell	   *lc;
 
-		readArrowFileDesc(FileGetRawDesc(fdesc), &af_info);
-		if (af_info.dictionaries != NULL)
-			elog(ERROR, "DictionaryBatch is not supported");
-		Assert(af_info.footer._num_dictionaries == 0);
-
-		if (af_info.recordBatches == NULL)
-			elog(DEBUG2, "arrow file '%s' contains no RecordBatch",
-				 FilePathName(fdesc));
-		for (index = 0; index < af_info.footer._num_recordBatches; index++)
+		/* persistent metadata index allows to skip the file parsing */
+		if (!arrowLookupMetadataIndex(fdesc, &stat_buf, &rb_state_any))
 		{
-			RecordBatchState *rb_state;
-			ArrowBlock       *block
-				= &af_info.footer.recordBatches[index];
-			ArrowRecordBatch *rbatch
-				= &af_info.recordBatches[index].body.recordBatch;
+			readArrowFileDesc(FileGetRawDesc(fdesc), &af_info);
+
+			if (af_info.recordBatches == NULL)
+				elog(DEBUG2, "arrow file '%s' contains no RecordBatch",
+					 FilePathName(fdesc));
+			for (index = 0;
+				 index < af_info.footer._num_recordBatches;
+				 index++)
+			{
+				RecordBatchState *rb_state;
+				ArrowBlock       *block
+					= &af_info.footer.recordBatches[index];
+				ArrowRecordBatch *rbatch
+					= &af_info.recordBatches[index].body.recordBatch;
+
+				rb_state = makeRecordBatchState(&af_info, block, rbatch);
+				rb_state->fdesc = fdesc;
+				memcpy(&rb_state->stat_buf, &stat_buf, sizeof(struct stat));
+				rb_state->rb_index = index;
+				rb_state_any = lappend(rb_state_any, rb_state);
+			}
+			/* min/max statistics, if any */
+			setupRecordBatchStatistics(rb_state_any,
+									   &af_info.footer.schema);
+			/* save the metadata for the next startup */
+			arrowAppendMetadataIndex(fdesc, &stat_buf, rb_state_any);
+		}
 
-			rb_state = makeRecordBatchState(&af_info.footer.schema,
-											block, rbatch);
-			rb_state->fdesc = fdesc;
-			memcpy(&rb_state->stat_buf, &stat_buf, sizeof(struct stat));
-			rb_state->rb_index = index;
+		foreach (lc, rb_state_any)
+		{
+			RecordBatchState *rb_state = lfirst(lc);
 
 			if (checkArrowRecordBatchIsVisible(rb_state, mvcc_slot))
 				results = lappend(results, rb_state);
-			rb_state_any = lappend(rb_state_any, rb_state);
 		}
 		/* try to build a metadata cache for further references */
 		mcache = __arrowBuildMetadataCache(rb_state_any, key.hash);
 		if (mcache)
 		{
+			/*
+			 * lock-free readers may follow the 'chain.next' as soon as
+			 * the entry is linked, so it must be visible prior to the link.
+			 */
+			mcache->chain.next = hash_slot->head.next;
+			mcache->chain.prev = &hash_slot->head;
+			pg_write_barrier();
 			dlist_push_head(hash_slot, &mcache->chain);
 			SpinLockAcquire(&arrow_metadata_state->lru_lock);
             dlist_push_head(&arrow_metadata_state->lru_list,
@@ -3867,6 +9920,8 @@ retry:
 	 * memory consumption exceeds the configured threshold.
 	 */
 	arrowReclaimMetadataCache();
+	/* release the detached entries, if no readers may walk on */
+	arrowReleaseRetiredMetadataCache();
 
 	return results;
 }
@@ -4029,12 +10084,81 @@ setupArrowSQLbufferBatches(SQLtable *table)
 	}
 	else
 		table->recordBatches = NULL;
+	/* restore min/max statistics of the RecordBatches above */
+	restoreArrowFieldStatistics(table, &af_info.footer.schema);
 
 	if (lseek(table->fdesc, pos, SEEK_SET) < 0)
 		elog(ERROR, "failed on lseek('%s',%lu): %m",
 			 table->filename, pos);
 }
 
+/*
+ * setupArrowSQLbufferBloomFilter
+ *
+ * It enables bloom filters on the columns listed in the 'bloom_filter'
+ * option, and opens the sidecar file next to the arrow file.
+ * __setupArrowSQLbufferBloomColumns is also used to check the option on
+ * CREATE/ALTER FOREIGN TABLE.
+ */
+static void
+__setupArrowSQLbufferBloomColumns(SQLtable *table,
+								  TupleDesc tupdesc, const char *columns)
+{
+	char	   *temp = pstrdup(columns);
+	char	   *tok, *pos;
+	char	   *saveptr;
+	int			j;
+
+	for (tok = strtok_r(temp, ",", &saveptr);
+		 tok != NULL;
+		 tok = strtok_r(NULL, ",", &saveptr))
+	{
+		while (isspace(*tok))
+			tok++;
+		pos = tok + strlen(tok) - 1;
+		while (pos >= tok && isspace(*pos))
+			*pos-- = '\0';
+
+		for (j=0; j < tupdesc->natts; j++)
+		{
+			Form_pg_attribute attr = tupleDescAttr(tupdesc, j);
+			SQLfield   *column = &table->columns[j];
+
+			if (strcmp(NameStr(attr->attname), tok) == 0)
+			{
+				if (!arrowFieldBloomFilterIsSupported(column))
+					elog(ERROR, "arrow: 'bloom_filter' does not support column \"%s\" of %s",
+						 tok, format_type_be(attr->atttypid));
+				column->bloom_enabled = true;
+				break;
+			}
+		}
+		if (j == tupdesc->natts)
+			elog(ERROR, "arrow: 'bloom_filter' specified unknown column \"%s\"",
+				 tok);
+	}
+	pfree(temp);
+}
+
+static void
+setupArrowSQLbufferBloomFilter(arrowWriteState *aw_state,
+							   TupleDesc tupdesc, const char *columns)
+{
+	SQLtable   *table = &aw_state->sql_table;
+	char	   *fname;
+
+	__setupArrowSQLbufferBloomColumns(table, tupdesc, columns);
+	fname = psprintf("%s%s", table->filename, ARROW_BLOOM_FILTER_SUFFIX);
+	aw_state->bloom_file = PathNameOpenFile(fname, O_RDWR | O_CREAT | PG_BINARY);
+	if (aw_state->bloom_file < 0)
+		ereport(ERROR,
+				(errcode_for_file_access(),
+				 errmsg("could not open file \"%s\": %m", fname)));
+	table->bloom_filename = FilePathName(aw_state->bloom_file);
+	table->bloom_fdesc = FileGetRawDesc(aw_state->bloom_file);
+	pfree(fname);
+}
+
 /*
  * createArrowWriteState
  */
@@ -4042,10 +10166,13 @@ static arrowWriteState *
 createArrowWriteState(Relation frel, File file, bool redo_log_written)
 {
 	TupleDesc		tupdesc = RelationGetDescr(frel);
+	ForeignTable   *ft = GetForeignTable(RelationGetRelid(frel));
 	arrowWriteState *aw_state;
 	SQLtable	   *table;
 	struct stat		stat_buf;
 	MetadataCacheKey key;
+	const char	   *bloom_filter = NULL;
+	ListCell	   *lc;
 
 	if (fstat(FileGetRawDesc(file), &stat_buf) != 0)
 		elog(ERROR, "failed on fstat('%s'): %m", FilePathName(file));
@@ -4058,13 +10185,26 @@ createArrowWriteState(Relation frel, File file, bool redo_log_written)
 								sql_table.columns[tupdesc->natts]));
 	aw_state->memcxt = CurrentMemoryContext;
 	aw_state->file = file;
+	aw_state->bloom_file = -1;
 	aw_state->key = key;
 	aw_state->hash = key.hash;
+	aw_state->xid = GetCurrentTransactionId();
 	aw_state->redo_log_written = redo_log_written;
 	table = &aw_state->sql_table;
 	table->filename = FilePathName(file);
 	table->fdesc = FileGetRawDesc(file);
+	foreach (lc, ft->options)
+	{
+		DefElem	   *defel = lfirst(lc);
+
+		if (strcmp(defel->defname, "compression") == 0)
+			table->compression = makeArrowBodyCompression(strVal(defel->arg));
+		else if (strcmp(defel->defname, "bloom_filter") == 0)
+			bloom_filter = strVal(defel->arg);
+	}
 	setupArrowSQLbufferSchema(table, tupdesc);
+	if (bloom_filter)
+		setupArrowSQLbufferBloomFilter(aw_state, tupdesc, bloom_filter);
 	if (!redo_log_written)
 		setupArrowSQLbufferBatches(table);
 
@@ -4075,12 +10215,11 @@ createArrowWriteState(Relation frel, File file, bool redo_log_written)
  * createArrowWriteRedoLog
  */
 static void
-createArrowWriteRedoLog(File filp, bool is_newfile)
+createArrowWriteRedoLog(File filp, bool is_newfile, TransactionId curr_xid)
 {
 	arrowWriteRedoLog *redo;
 	int				fdesc = FileGetRawDesc(filp);
 	const char	   *fname = FilePathName(filp);
-	TransactionId	curr_xid = GetCurrentTransactionId();
 	CommandId		curr_cid = GetCurrentCommandId(true);
 	dlist_iter		iter;
 	MetadataCacheKey key;
@@ -4177,6 +10316,10 @@ createArrowWriteRedoLog(File filp, bool is_newfile)
 
 /*
  * writeOutArrowRecordBatch
+ *
+ * It runs on the memory context of the aw_state, because writeArrow*()
+ * expands the buffers and the list of RecordBatches of the SQLtable, and
+ * aw_state may live longer than the current query by group commit.
  */
 static void
 writeOutArrowRecordBatch(arrowWriteState *aw_state, bool with_footer)
@@ -4186,16 +10329,18 @@ writeOutArrowRecordBatch(arrowWriteState *aw_state, bool with_footer)
 	struct stat	stat_buf;
 	ssize_t		nbytes;
 	arrowWriteMVCCLog *mvcc = NULL;
+	MemoryContext oldcxt;
 
 	if (table->nitems > 0)
 	{
 		mvcc = MemoryContextAllocZero(TopSharedMemoryContext,
 									  sizeof(arrowWriteMVCCLog));
 		mvcc->key = aw_state->key;
-		mvcc->xid = GetCurrentTransactionId();
+		mvcc->xid = aw_state->xid;
 		mvcc->cid = GetCurrentCommandId(true);
 	}
 
+	oldcxt = MemoryContextSwitchTo(aw_state->memcxt);
 	PG_TRY();
 	{
 		LWLockAcquire(&arrow_metadata_state->lock_slots[index],
@@ -4206,7 +10351,7 @@ writeOutArrowRecordBatch(arrowWriteState *aw_state, bool with_footer)
 		/* make a REDO log entry */
 		if (!aw_state->redo_log_written)
 		{
-			createArrowWriteRedoLog(aw_state->file, false);
+			createArrowWriteRedoLog(aw_state->file, false, aw_state->xid);
 			aw_state->redo_log_written = true;
 		}
 		/* write out an empty arrow file */
@@ -4236,17 +10381,125 @@ writeOutArrowRecordBatch(arrowWriteState *aw_state, bool with_footer)
 	}
 	PG_CATCH();
 	{
+		MemoryContextSwitchTo(oldcxt);
 		if (mvcc)
 			pfree(mvcc);
 		PG_RE_THROW();
 	}
 	PG_END_TRY();
+	MemoryContextSwitchTo(oldcxt);
 }
 
 /*
- * TRUNCATE support
+ * Group commit of INSERT
+ *
+ * If arrow_fdw.enable_group_commit is on, arrowWriteState is kept until end
+ * of the transaction, and the rows inserted by multiple INSERT commands are
+ * coalesced into RecordBatches up to arrow_fdw.record_batch_size. The rows
+ * and Footer are written out at end of the (sub-)transaction that begins
+ * the write, or prior to any scan on arrow_fdw in this backend; so, we can
+ * see the rows we inserted. Only one arrowWriteState is active for a file,
+ * because each of them has its own list of RecordBatches to be written to
+ * the Footer.
+ *
+ * NOTE: Rows of concurrent transactions are never coalesced. A RecordBatch
+ * is visible according to the arrowWriteMVCCLog of the transaction which
+ * wrote it, and ABORT truncates the file by the REDO log of the transaction,
+ * so a RecordBatch cannot contain the rows of two or more transactions.
+ * Concurrent writers are serialized by ShareRowExclusiveLock until the end
+ * of transaction, then each transaction writes its own RecordBatches.
+ */
+static void
+__flushArrowWritePending(arrowWriteState *aw_state)
+{
+	if (aw_state->sql_table.nitems > 0 || aw_state->pending_footer)
+	{
+		writeOutArrowRecordBatch(aw_state, true);
+		aw_state->pending_footer = false;
+	}
+}
+
+static void
+__retireArrowWritePending(arrowWriteState *aw_state, bool is_commit)
+{
+	dlist_delete(&aw_state->pending_chain);
+	aw_state->group_commit = false;
+	if (is_commit)
+		__flushArrowWritePending(aw_state);
+	/* an active INSERT closes the bloom filter at the end, if any */
+	if ((!is_commit || aw_state->nusers == 0) && aw_state->bloom_file >= 0)
+	{
+		FileClose(aw_state->bloom_file);
+		aw_state->bloom_file = -1;
+	}
+}
+
+static arrowWriteState *
+lookupArrowWritePending(Oid relid)
+{
+	TransactionId	curr_xid = GetCurrentTransactionId();
+	dlist_mutable_iter iter;
+
+	dlist_foreach_modify(iter, &arrow_write_pending_list)
+	{
+		arrowWriteState *aw_state = dlist_container(arrowWriteState,
+													pending_chain,
+													iter.cur);
+		if (aw_state->relid != relid)
+			continue;
+		if (aw_state->xid == curr_xid)
+			return aw_state;
+		/*
+		 * the write state of the parent transaction; write out the rows
+		 * as a part of the parent transaction, prior to the new one.
+		 */
+		__retireArrowWritePending(aw_state, true);
+	}
+	return NULL;
+}
+
+static void
+arrowFdwFlushPendingWrites(void)
+{
+	dlist_iter	iter;
+
+	dlist_foreach(iter, &arrow_write_pending_list)
+	{
+		arrowWriteState *aw_state = dlist_container(arrowWriteState,
+													pending_chain,
+													iter.cur);
+		__flushArrowWritePending(aw_state);
+	}
+}
+
+/*
+ * arrowFdwRetirePendingWrites
+ *
+ * It writes out (on commit) or discards (on abort) the pending writes of
+ * the transaction. InvalidTransactionId means all the pending writes.
  */
 static void
+arrowFdwRetirePendingWrites(TransactionId curr_xid, bool is_commit)
+{
+	dlist_mutable_iter iter;
+
+	dlist_foreach_modify(iter, &arrow_write_pending_list)
+	{
+		arrowWriteState *aw_state = dlist_container(arrowWriteState,
+													pending_chain,
+													iter.cur);
+		if (curr_xid == InvalidTransactionId ||
+			aw_state->xid == curr_xid)
+			__retireArrowWritePending(aw_state, is_commit);
+	}
+}
+
+/*
+ * TRUNCATE support
+ *
+ * It returns the path of the backup file, to be removed on commit.
+ */
+static char *
 __arrowExecTruncateRelation(Relation frel)
 {
 	TupleDesc	tupdesc = RelationGetDescr(frel);
@@ -4264,16 +10517,21 @@ __arrowExecTruncateRelation(Relation frel)
 	int			fdesc = -1;
 	int			nbytes;
 	char		backup_path[MAXPGPATH];
+	char		bloom_path[MAXPGPATH];
+	char		bloom_backup[MAXPGPATH];
 	bool		writable;
 
 	filesList = __arrowFdwExtractFilesList(ft->options,
 										   NULL,
-										   &writable);
+										   &writable,
+										   NULL);
 	if (!writable)
 		elog(ERROR, "arrow_fdw: foreign table \"%s\" is not writable",
 			 RelationGetRelationName(frel));
 	Assert(list_length(filesList) == 1);
 	path_name = strVal(linitial(filesList));
+	/* pending writes must go to the file prior to its rename */
+	arrowFdwRetirePendingWrites(InvalidTransactionId, true);
 	if (stat(path_name, &stat_buf) != 0)
 		elog(ERROR, "failed on stat('%s'): %m", path_name);
 	memset(&key, 0, sizeof(key));
@@ -4321,10 +10579,27 @@ __arrowExecTruncateRelation(Relation frel)
 				 path_name, backup_path);
 
 		/*
-		 * create an empty arrow file
+		 * create an empty arrow file (and the sidecar file of bloom
+		 * filters, if any, because they are appended to the sidecar)
 		 */
+		snprintf(bloom_path, sizeof(bloom_path), "%s%s",
+				 path_name, ARROW_BLOOM_FILTER_SUFFIX);
+		snprintf(bloom_backup, sizeof(bloom_backup), "%s%s",
+				 backup_path, ARROW_BLOOM_FILTER_SUFFIX);
 		PG_TRY();
 		{
+			if (rename(bloom_path, bloom_backup) == 0)
+				redo->has_bloom = true;
+			else if (errno != ENOENT)
+				elog(ERROR, "failed on rename('%s','%s'): %m",
+					 bloom_path, bloom_backup);
+			if (redo->has_bloom)
+			{
+				fdesc = open(bloom_path, O_RDWR | O_CREAT | O_EXCL, 0600);
+				if (fdesc < 0)
+					elog(ERROR, "failed on open('%s'): %m", bloom_path);
+				close(fdesc);
+			}
 			fdesc = open(path_name, O_RDWR | O_CREAT | O_EXCL, 0600);
 			if (fdesc < 0)
 				elog(ERROR, "failed on open('%s'): %m", path_name);
@@ -4343,6 +10618,10 @@ __arrowExecTruncateRelation(Relation frel)
 			if (rename(backup_path, path_name) != 0)
 				elog(WARNING, "failed on rename('%s', '%s'): %m",
 					 backup_path, path_name);
+			if (redo->has_bloom &&
+				rename(bloom_backup, bloom_path) != 0)
+				elog(WARNING, "failed on rename('%s', '%s'): %m",
+					 bloom_backup, bloom_path);
 			PG_RE_THROW();
 		}
 		PG_END_TRY();
@@ -4356,6 +10635,8 @@ __arrowExecTruncateRelation(Relation frel)
 	PG_END_TRY();
 	/* save the REDO log entry */
 	dlist_push_head(&arrow_write_redo_list, &redo->chain);
+
+	return pstrdup(backup_path);
 }
 
 /*
@@ -4388,15 +10669,194 @@ pgstrom_arrow_fdw_truncate(PG_FUNCTION_ARGS)
 }
 PG_FUNCTION_INFO_V1(pgstrom_arrow_fdw_truncate);
 
+/*
+ * Compaction support
+ *
+ * It rewrites the arrow file of a writable foreign table, to coalesce small
+ * RecordBatches written by individual INSERTs into RecordBatches up to
+ * arrow_fdw.record_batch_size. The original file is moved to the backup as
+ * TRUNCATE doing, then its rows are re-written to the new file; so, REDO log
+ * of the TRUNCATE swaps them atomically at end of the transaction.
+ */
+static int
+__arrowExecCompactionRelation(Relation frel)
+{
+	TupleDesc	tupdesc = RelationGetDescr(frel);
+	ForeignTable *ft = GetForeignTable(RelationGetRelid(frel));
+	arrowWriteState *aw_state;
+	List	   *filesList;
+	List	   *rb_cached;
+	ListCell   *lc;
+	const char *path_name;
+	char	   *backup_path;
+	File		backup_file;
+	File		filp;
+	Bitmapset  *referenced;
+	MemoryContext memcxt;
+	MemoryContext oldcxt;
+	Datum	   *values;
+	bool	   *isnull;
+	bool		writable;
+	int			i, j;
+
+	filesList = __arrowFdwExtractFilesList(ft->options,
+										   NULL,
+										   &writable,
+										   NULL);
+	if (!writable)
+		elog(ERROR, "arrow_fdw: foreign table \"%s\" is not writable",
+			 RelationGetRelationName(frel));
+	Assert(list_length(filesList) == 1);
+	path_name = strVal(linitial(filesList));
+	/* pending writes by group commit must be in the file */
+	arrowFdwRetirePendingWrites(InvalidTransactionId, true);
+
+	/* nothing to do, if the file has one RecordBatch at most */
+	filp = PathNameOpenFile(path_name, O_RDONLY | PG_BINARY);
+	if (filp < 0)
+	{
+		if (errno == ENOENT)
+			return 0;
+		ereport(ERROR,
+				(errcode_for_file_access(),
+				 errmsg("could not open file \"%s\": %m", path_name)));
+	}
+	rb_cached = arrowLookupOrBuildMetadataCache(filp);
+	FileClose(filp);
+	if (list_length(rb_cached) <= 1)
+		return list_length(rb_cached);
+
+	/*
+	 * Move the current file to the backup, then re-write its rows to the
+	 * new empty file created by the TRUNCATE.
+	 */
+	backup_path = __arrowExecTruncateRelation(frel);
+	backup_file = PathNameOpenFile(backup_path, O_RDONLY | PG_BINARY);
+	if (backup_file < 0)
+		ereport(ERROR,
+				(errcode_for_file_access(),
+				 errmsg("could not open file \"%s\": %m", backup_path)));
+	filp = PathNameOpenFile(path_name, O_RDWR | PG_BINARY);
+	if (filp < 0)
+		ereport(ERROR,
+				(errcode_for_file_access(),
+				 errmsg("could not open file \"%s\": %m", path_name)));
+	aw_state = createArrowWriteState(frel, filp, false);
+
+	/* compaction needs to fetch all the attributes */
+	referenced = bms_add_range(NULL, 1 - FirstLowInvalidHeapAttributeNumber,
+							   tupdesc->natts - FirstLowInvalidHeapAttributeNumber);
+
+	values = palloc(sizeof(Datum) * tupdesc->natts);
+	isnull = palloc(sizeof(bool)  * tupdesc->natts);
+	memcxt = AllocSetContextCreate(CurrentMemoryContext,
+								   "arrow_fdw compaction",
+								   ALLOCSET_DEFAULT_SIZES);
+	rb_cached = arrowLookupOrBuildMetadataCache(backup_file);
+	foreach (lc, rb_cached)
+	{
+		RecordBatchState *rb_state = lfirst(lc);
+		pgstrom_data_store *pds;
+
+		if (!arrowSchemaCompatibilityCheck(tupdesc, rb_state))
+			elog(ERROR, "arrow file '%s' on behalf of foreign table '%s' has incompatible schema definition",
+				 backup_path, RelationGetRelationName(frel));
+		if (rb_state->rb_nitems == 0)
+			continue;
+		oldcxt = MemoryContextSwitchTo(memcxt);
+		pds = __arrowFdwLoadRecordBatchSamples(rb_state,
+											   frel,
+											   referenced,
+											   NULL);
+		MemoryContextSwitchTo(oldcxt);
+		for (i=0; i < pds->kds.nitems; i++)
+		{
+			size_t	usage;
+
+			oldcxt = MemoryContextSwitchTo(memcxt);
+			for (j=0; j < pds->kds.ncols; j++)
+			{
+				kern_colmeta   *cmeta = &pds->kds.colmeta[j];
+
+				pg_datum_arrow_ref(&pds->kds,
+								   cmeta,
+								   i,
+								   values + j,
+								   isnull + j);
+			}
+			MemoryContextSwitchTo(oldcxt);
+
+			usage = arrowWriteStatePutValues(aw_state, tupdesc,
+											 values, isnull);
+			if (usage > aw_state->sql_table.segment_sz)
+				writeOutArrowRecordBatch(aw_state, false);
+		}
+		PDS_release(pds);
+		MemoryContextReset(memcxt);
+	}
+	writeOutArrowRecordBatch(aw_state, true);
+
+	if (aw_state->bloom_file >= 0)
+		FileClose(aw_state->bloom_file);
+	FileClose(filp);
+	FileClose(backup_file);
+	MemoryContextDelete(memcxt);
+
+	elog(DEBUG1, "arrow_fdw: compaction of '%s' (%d -> %d RecordBatches)",
+		 path_name, list_length(rb_cached),
+		 aw_state->sql_table.numRecordBatches);
+
+	return aw_state->sql_table.numRecordBatches;
+}
+
+/*
+ * pgstrom_arrow_fdw_compaction
+ */
+Datum
+pgstrom_arrow_fdw_compaction(PG_FUNCTION_ARGS)
+{
+	Oid			frel_oid = PG_GETARG_OID(0);
+	Relation	frel;
+	FdwRoutine *routine;
+	int			nbatches;
+
+	frel = table_open(frel_oid, AccessExclusiveLock);
+	if (frel->rd_rel->relkind != RELKIND_FOREIGN_TABLE)
+		ereport(ERROR,
+				(errcode(ERRCODE_WRONG_OBJECT_TYPE),
+				 errmsg("\"%s\" is not arrow_fdw foreign table",
+						RelationGetRelationName(frel))));
+	routine = GetFdwRoutineForRelation(frel, false);
+	if (memcmp(routine, &pgstrom_arrow_fdw_routine, sizeof(FdwRoutine)) != 0)
+		ereport(ERROR,
+				(errcode(ERRCODE_WRONG_OBJECT_TYPE),
+				 errmsg("\"%s\" is not arrow_fdw foreign table",
+						RelationGetRelationName(frel))));
+	nbatches = __arrowExecCompactionRelation(frel);
+
+	table_close(frel, NoLock);
+
+	PG_RETURN_INT32(nbatches);
+}
+PG_FUNCTION_INFO_V1(pgstrom_arrow_fdw_compaction);
+
 static void
 __applyArrowTruncateRedoLog(arrowWriteRedoLog *redo, bool is_commit)
 {
 	char		backup[MAXPGPATH];
+	char		bloom[MAXPGPATH];
+	char		bloom_backup[MAXPGPATH];
 
 	snprintf(backup, MAXPGPATH, "%s.%u.backup",
 			 redo->pathname, redo->suffix);
+	snprintf(bloom, MAXPGPATH, "%s%s",
+			 redo->pathname, ARROW_BLOOM_FILTER_SUFFIX);
+	snprintf(bloom_backup, MAXPGPATH, "%s%s",
+			 backup, ARROW_BLOOM_FILTER_SUFFIX);
 	if (is_commit)
 	{
+		/* metadata cache of the backup file shall be never referenced */
+		arrowInvalidateMetadataCacheByKey(&redo->key);
 		elog(DEBUG2, "arrow-redo: unlink [%s]", backup);
 		if (unlink(backup) != 0)
 			ereport(WARNING,
@@ -4404,6 +10864,12 @@ __applyArrowTruncateRedoLog(arrowWriteRedoLog *redo, bool is_commit)
 					 errmsg("could not remove truncated file \"%s\": %m",
 							backup),
 					 errhint("remove the \"%s\" manually", backup)));
+		if (redo->has_bloom && unlink(bloom_backup) != 0)
+			ereport(WARNING,
+					(errcode_for_file_access(),
+					 errmsg("could not remove truncated file \"%s\": %m",
+							bloom_backup),
+					 errhint("remove the \"%s\" manually", bloom_backup)));
 	}
 	else
 	{
@@ -4415,6 +10881,21 @@ __applyArrowTruncateRedoLog(arrowWriteRedoLog *redo, bool is_commit)
 							backup),
 					 errhint("please restore \"%s\" to \"%s\" manually",
 							 backup, redo->pathname)));
+		if (redo->has_bloom)
+		{
+			elog(DEBUG2, "arrow-redo: rename [%s]->[%s]", bloom_backup, bloom);
+			if (rename(bloom_backup, bloom) != 0)
+				ereport(WARNING,
+						(errcode_for_file_access(),
+						 errmsg("could not restore backup file \"%s\": %m",
+								bloom_backup),
+						 errhint("please restore \"%s\" to \"%s\" manually",
+								 bloom_backup, bloom)));
+		}
+		else if (unlink(bloom) != 0 && errno != ENOENT)
+			ereport(WARNING,
+					(errcode_for_file_access(),
+					 errmsg("could not remove file \"%s\": %m", bloom)));
 	}
 }
 
@@ -4555,10 +11036,23 @@ arrowFdwXactCallback(XactEvent event, void *arg)
 {
 	TransactionId	curr_xid = GetCurrentTransactionIdIfAny();
 
+	/* write out or discard the pending writes by group commit */
+	if (event == XACT_EVENT_PRE_COMMIT ||
+		event == XACT_EVENT_PRE_PREPARE)
+		arrowFdwRetirePendingWrites(InvalidTransactionId, true);
+	else if (event == XACT_EVENT_ABORT)
+		arrowFdwRetirePendingWrites(InvalidTransactionId, false);
+
 	if (event == XACT_EVENT_COMMIT)
 		__arrowFdwXactCallback(curr_xid, true);
 	else if (event == XACT_EVENT_ABORT)
 		__arrowFdwXactCallback(curr_xid, false);
+	/* detach the shared RecordBatch buffer cache, if any */
+	if (event == XACT_EVENT_COMMIT ||
+		event == XACT_EVENT_ABORT ||
+		event == XACT_EVENT_PARALLEL_COMMIT ||
+		event == XACT_EVENT_PARALLEL_ABORT)
+		arrowFdwReleaseAllBufferCache();
 }
 
 /*
@@ -4570,6 +11064,15 @@ arrowFdwSubXactCallback(SubXactEvent event, SubTransactionId mySubid,
 {
 	TransactionId	curr_xid = GetCurrentTransactionIdIfAny();
 
+	/* pending writes by group commit, if begun in this sub-transaction */
+	if (curr_xid != InvalidTransactionId)
+	{
+		if (event == SUBXACT_EVENT_PRE_COMMIT_SUB)
+			arrowFdwRetirePendingWrites(curr_xid, true);
+		else if (event == SUBXACT_EVENT_ABORT_SUB)
+			arrowFdwRetirePendingWrites(curr_xid, false);
+	}
+
 	if (event == SUBXACT_EVENT_COMMIT_SUB)
 		__arrowFdwXactCallback(curr_xid, true);
 	else if (event == SUBXACT_EVENT_ABORT_SUB)
@@ -4913,6 +11416,9 @@ lookupOrBuildArrowGpuBufferCupy(Relation frel, List *attNums,
 		{
 			RecordBatchState *rb_state = lfirst(cell);
 
+			if (rb_state->rb_compressed)
+				elog(ERROR, "arrow_fdw: compressed RecordBatch in '%s' is not supported for GPU buffer",
+					 fname);
 			nrooms += rb_state->rb_nitems;
 			if (timespec_comp(&rb_state->stat_buf.st_mtim, &timestamp) > 0)
 				timestamp = rb_state->stat_buf.st_mtim;
@@ -5372,11 +11878,20 @@ pgstrom_startup_arrow_fdw(void)
 		ShmemInitStruct("arrow_metadata_state",
 						MAXALIGN(sizeof(arrowMetadataState)),
 						&found);
+	arrow_metadata_readers =
+		ShmemInitStruct("arrow_metadata_readers",
+						sizeof(arrowMetadataReader) * arrow_metadata_nreaders,
+						&found);
 	if (!IsUnderPostmaster)
 	{
+		for (i=0; i < arrow_metadata_nreaders; i++)
+			pg_atomic_init_u64(&arrow_metadata_readers[i].epoch, 0UL);
 		SpinLockInit(&arrow_metadata_state->lru_lock);
 		dlist_init(&arrow_metadata_state->lru_list);
 		pg_atomic_init_u64(&arrow_metadata_state->consumed, 0UL);
+		pg_atomic_init_u64(&arrow_metadata_state->reader_epoch, 1UL);
+		SpinLockInit(&arrow_metadata_state->retire_lock);
+		dlist_init(&arrow_metadata_state->retire_list);
 		for (i=0; i < ARROW_METADATA_HASH_NSLOTS; i++)
 		{
 			LWLockInitialize(&arrow_metadata_state->lock_slots[i], -1);
@@ -5389,6 +11904,17 @@ pgstrom_startup_arrow_fdw(void)
 			LWLockInitialize(&arrow_metadata_state->gpubuf_locks[i], -1);
 			dlist_init(&arrow_metadata_state->gpubuf_slots[i]);
 		}
+
+		SpinLockInit(&arrow_metadata_state->bufcache_lru_lock);
+		dlist_init(&arrow_metadata_state->bufcache_lru_list);
+		pg_atomic_init_u64(&arrow_metadata_state->bufcache_consumed, 0UL);
+		for (i=0; i < ARROW_BUFCACHE_HASH_NSLOTS; i++)
+		{
+			LWLockInitialize(&arrow_metadata_state->bufcache_locks[i], -1);
+			dlist_init(&arrow_metadata_state->bufcache_slots[i]);
+		}
+		/* persistent metadata index, if any */
+		arrowMetadataIndexStartup();
 	}
 }
 
@@ -5406,6 +11932,7 @@ pgstrom_init_arrow_fdw(void)
 	r->GetForeignRelSize			= ArrowGetForeignRelSize;
 	r->GetForeignPaths				= ArrowGetForeignPaths;
 	r->GetForeignPlan				= ArrowGetForeignPlan;
+	r->GetForeignUpperPaths			= ArrowGetForeignUpperPaths;
 	r->BeginForeignScan				= ArrowBeginForeignScan;
 	r->IterateForeignScan			= ArrowIterateForeignScan;
 	r->ReScanForeignScan			= ArrowReScanForeignScan;
@@ -5457,6 +11984,15 @@ pgstrom_init_arrow_fdw(void)
 							NULL, NULL, NULL);
 	arrow_metadata_cache_size = (size_t)arrow_metadata_cache_size_kb << 10;
 
+	DefineCustomStringVariable("arrow_fdw.metadata_index_file",
+							   "sidecar file of the persistent metadata index for arrow files",
+							   NULL,
+							   &arrow_metadata_index_file,
+							   NULL,		/* default: disabled */
+							   PGC_POSTMASTER,
+							   GUC_NOT_IN_SAMPLE,
+							   NULL, NULL, NULL);
+
 	/*
 	 * Debug option to hint number of rows
 	 */
@@ -5483,8 +12019,94 @@ pgstrom_init_arrow_fdw(void)
 							GUC_NOT_IN_SAMPLE | GUC_UNIT_KB,
 							NULL, NULL, NULL);
 
-	/* shared memory size */
-	RequestAddinShmemSpace(MAXALIGN(sizeof(arrowMetadataState)));
+	/*
+	 * Turn on/off group commit of INSERT
+	 */
+	DefineCustomBoolVariable("arrow_fdw.enable_group_commit",
+							 "Coalesces rows of INSERTs into RecordBatches written at end of transaction",
+							 NULL,
+							 &arrow_enable_group_commit,
+							 false,
+							 PGC_USERSET,
+							 GUC_NOT_IN_SAMPLE,
+							 NULL, NULL, NULL);
+
+	/*
+	 * Turn on/off vectorized pre-filter on CPU scan
+	 */
+	DefineCustomBoolVariable("arrow_fdw.enable_vector_filter",
+							 "Enables vectorized evaluation of simple qualifiers on CPU scan",
+							 NULL,
+							 &arrow_enable_vector_filter,
+							 true,
+							 PGC_USERSET,
+							 GUC_NOT_IN_SAMPLE,
+							 NULL, NULL, NULL);
+	/* aggregates answered by the metadata */
+	DefineCustomBoolVariable("arrow_fdw.enable_metadata_aggregate",
+							 "Enables COUNT/MIN/MAX by the metadata of arrow files, without scan",
+							 NULL,
+							 &arrow_enable_metadata_aggregate,
+							 true,
+							 PGC_USERSET,
+							 GUC_NOT_IN_SAMPLE,
+							 NULL, NULL, NULL);
+	/* zero-copy RecordBatch access by mmap */
+	DefineCustomBoolVariable("arrow_fdw.enable_mmap",
+							 "Enables to map arrow files on CPU scan, instead of read",
+							 NULL,
+							 &arrow_enable_mmap,
+							 false,
+							 PGC_USERSET,
+							 GUC_NOT_IN_SAMPLE,
+							 NULL, NULL, NULL);
+	/* shared RecordBatch buffer cache */
+	DefineCustomIntVariable("arrow_fdw.buffer_cache_size",
+							"size of shared buffer cache for RecordBatches loaded by CPU scan",
+							NULL,
+							&arrow_buffer_cache_size_kb,
+							0,			/* default: disabled */
+							0,
+							INT_MAX,
+							PGC_SIGHUP,
+							GUC_NOT_IN_SAMPLE | GUC_UNIT_KB,
+							NULL, NULL, NULL);
+	/* row-range splitting of huge RecordBatches on parallel scan */
+	DefineCustomIntVariable("arrow_fdw.parallel_split_size",
+							"RecordBatches larger than this are split into row-ranges on CPU parallel scan",
+							NULL,
+							&arrow_parallel_split_size_kb,
+							256 * 1024,		/* default: 256MB */
+							0,				/* 0 = disabled */
+							INT_MAX,
+							PGC_USERSET,
+							GUC_NOT_IN_SAMPLE | GUC_UNIT_KB,
+							NULL, NULL, NULL);
+	/* read-ahead depth of RecordBatches */
+	DefineCustomIntVariable("arrow_fdw.prefetch_depth",
+							"Number of RecordBatches to be read-ahead",
+							NULL,
+							&arrow_prefetch_depth,
+							4,			/* default: 4 */
+							0,			/* 0 = disabled */
+							256,
+							PGC_USERSET,
+							GUC_NOT_IN_SAMPLE,
+							NULL, NULL, NULL);
+
+	/*
+	 * shared memory size
+	 *
+	 * NOTE: MaxBackends is not initialized yet, so we estimate the number of
+	 * processes which may run arrow_fdw scan in the same manner. Processes
+	 * beyond the slots (e.g, WAL senders) always take the locked path.
+	 */
+	arrow_metadata_nreaders = (MaxConnections +
+							   autovacuum_max_workers + 1 +
+							   max_worker_processes);
+	RequestAddinShmemSpace(MAXALIGN(sizeof(arrowMetadataState)) +
+						   MAXALIGN(sizeof(arrowMetadataReader) *
+									arrow_metadata_nreaders));
 	shmem_startup_next = shmem_startup_hook;
 	shmem_startup_hook = pgstrom_startup_arrow_fdw;
 
@@ -5494,5 +12116,8 @@ pgstrom_init_arrow_fdw(void)
 	
 	/* misc init */
 	dlist_init(&arrow_write_redo_list);
+	dlist_init(&arrow_write_pending_list);
 	dlist_init(&arrow_gpu_buffer_tracker_list);
+	dlist_init(&arrow_buffer_cache_tracker_list);
+	dlist_init(&arrow_dictionary_list);
 }
@@ -29,10 +29,76 @@
 
 #define	ARROWALIGN(LEN)			TYPEALIGN(64, (LEN))
 
+/* custom_metadata keys for per-RecordBatch min/max statistics */
+#define ARROW_STATS_MIN_VALUES	"min_values"
+#define ARROW_STATS_MAX_VALUES	"max_values"
+
+/*
+ * Bloom filter per RecordBatch
+ *
+ * The bloom filters of the top-level fields are written to the sidecar
+ * file, named with ARROW_BLOOM_FILTER_SUFFIX next to the Arrow file, and
+ * the custom_metadata of the Field in the Footer has comma separated
+ * offsets of the filters in the sidecar file, one token per RecordBatch.
+ * An empty token means no bloom filter is available for the RecordBatch.
+ * Int values are hashed as int64, and Utf8/Binary values are hashed as
+ * byte sequence, so readers can build the hash from the native datum.
+ */
+#define ARROW_BLOOM_FILTER				"bloom_filter"
+#define ARROW_BLOOM_FILTER_SUFFIX		".bloom"
+#define ARROW_BLOOM_FILTER_SIGNATURE	"ARWBLM01"
+#define ARROW_BLOOM_FILTER_SIGNATURE_SZ	8
+#define ARROW_BLOOM_FILTER_MAGIC		0x464c4241U		/* 'ABLF' */
+#define ARROW_BLOOM_FILTER_NHASHES		7		/* 1% false positive... */
+#define ARROW_BLOOM_FILTER_BITS_PER_ITEM 10		/* ...with 10bits/item */
+
+typedef struct
+{
+	uint32		magic;			/* ARROW_BLOOM_FILTER_MAGIC */
+	int32		field_index;	/* index of the top-level field */
+	int64		rb_offset;		/* offset of the RecordBatch body */
+	int64		rb_nitems;		/* number of rows in the RecordBatch */
+	uint32		nhashes;		/* number of the hash functions */
+	uint32		nwords;			/* number of 64bit words in the bitmap */
+	uint64		bitmap[FLEXIBLE_ARRAY_MEMBER];
+} ArrowBloomFilter;
+
+static inline uint64
+arrowBloomFilterHash(const void *addr, size_t len)
+{
+	const unsigned char *pos = addr;
+	uint64		hash = 0xcbf29ce484222325UL;	/* FNV-1a */
+
+	while (len-- > 0)
+	{
+		hash ^= *pos++;
+		hash *= 0x100000001b3UL;
+	}
+	/* final mix of MurmurHash3 */
+	hash ^= (hash >> 33);
+	hash *= 0xff51afd7ed558ccdUL;
+	hash ^= (hash >> 33);
+	hash *= 0xc4ceb9fe1a85ec53UL;
+	hash ^= (hash >> 33);
+
+	return hash;
+}
+
+static inline uint64
+arrowBloomFilterBitIndex(const ArrowBloomFilter *bloom,
+						 uint64 hash, uint32 index)
+{
+	uint64		h1 = (hash & 0xffffffffUL);
+	uint64		h2 = (hash >> 32) | 1UL;
+
+	return (h1 + index * h2) % (64UL * (uint64)bloom->nwords);
+}
+
 typedef struct SQLbuffer		SQLbuffer;
 typedef struct SQLtable			SQLtable;
 typedef struct SQLfield			SQLfield;
 typedef struct SQLdictionary	SQLdictionary;
+typedef struct ArrowCompressedBuffer ArrowCompressedBuffer;
 typedef union  SQLtype			SQLtype;
 typedef struct SQLtype__pgsql	SQLtype__pgsql;
 typedef struct SQLtype__mysql	SQLtype__mysql;
@@ -90,6 +156,15 @@ struct SQLfield
 	/* custom metadata(optional) */
 	ArrowKeyValue *customMetadata;
 	int			numCustomMetadata;
+	/* min/max statistics per RecordBatch (only top-level fields) */
+	int			stat_nitems;	/* # of RecordBatches in the statistics */
+	SQLbuffer	stat_min_values; /* comma separated min values */
+	SQLbuffer	stat_max_values; /* comma separated max values */
+	/* bloom filter per RecordBatch (only top-level fields) */
+	bool		bloom_enabled;	/* true, if bloom filter is built */
+	int			bloom_nitems;	/* # of RecordBatches in bloom_offsets */
+	SQLbuffer	bloom_offsets;	/* comma separated offsets in sidecar file */
+	SQLbuffer	bloom_bitmap;	/* working buffer of the bloom filter */
 };
 static inline size_t
 sql_field_put_value(SQLfield *column, const char *addr, int sz)
@@ -111,6 +186,13 @@ struct SQLtable
 	int			numCustomMetadata;
 	SQLdictionary *sql_dict_list; /* list of SQLdictionary */
 	size_t		segment_sz;		/* threshold of the memory usage */
+	ArrowBodyCompression *compression; /* compression of RecordBatch, if any */
+	SQLbuffer	compressed;		/* working buffer for compression */
+	bool		rbatch_built;	/* true, if RecordBatch is built to write */
+	ArrowCompressedBuffer *cbufs; /* buffers switched to compressed images */
+	int			numCBufs;		/* number of cbufs */
+	const char *bloom_filename;	/* sidecar file of bloom filters, if any */
+	int			bloom_fdesc;	/* descriptor of the sidecar file */
 	size_t		nitems;			/* number of items */
 	int			nfields;		/* number of attributes */
 	SQLfield columns[FLEXIBLE_ARRAY_MEMBER];
@@ -141,9 +223,17 @@ struct SQLdictionary
 /* arrow_write.c */
 extern ssize_t	writeArrowSchema(SQLtable *table);
 extern void		writeArrowDictionaryBatches(SQLtable *table);
+extern void		buildArrowRecordBatch(SQLtable *table);
 extern int		writeArrowRecordBatch(SQLtable *table);
+extern void		mergeArrowRecordBatches(SQLtable *dst, SQLtable *src);
+extern SQLtable *sql_table_duplicate(SQLtable *table);
+extern void		sql_table_swap_buffers(SQLtable *a, SQLtable *b);
 extern ssize_t	writeArrowFooter(SQLtable *table);
+extern void		restoreArrowFieldStatistics(SQLtable *table,
+											ArrowSchema *schema);
+extern bool		arrowFieldBloomFilterIsSupported(SQLfield *column);
 extern size_t	estimateArrowBufferLength(SQLfield *column, size_t nitems);
+extern ArrowBodyCompression *makeArrowBodyCompression(const char *method);
 
 /* arrow_nodes.c */
 extern void		__initArrowNode(ArrowNode *node, ArrowNodeTag tag);
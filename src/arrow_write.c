@@ -8,6 +8,13 @@
  */
 #include "postgres.h"
 #include <assert.h>
+#include <math.h>
+#ifdef WITH_LZ4
+#include <lz4frame.h>
+#endif
+#ifdef WITH_ZSTD
+#include <zstd.h>
+#endif
 #include "arrow_ipc.h"
 
 typedef struct
@@ -668,10 +675,21 @@ createArrowSchema(ArrowSchema *node)
 	return makeBufferFlatten(buf);
 }
 
+static FBTableBuf *
+createArrowBodyCompression(ArrowBodyCompression *node)
+{
+	FBTableBuf *buf = allocFBTableBuf(2);
+
+	assert(ArrowNodeIs(node, BodyCompression));
+	addBufferChar(buf, 0, node->codec);
+	addBufferChar(buf, 1, node->method);
+	return makeBufferFlatten(buf);
+}
+
 static FBTableBuf *
 createArrowRecordBatch(ArrowRecordBatch *node)
 {
-	FBTableBuf *buf = allocFBTableBuf(3);
+	FBTableBuf *buf = allocFBTableBuf(4);
 
 	assert(ArrowNodeIs(node, RecordBatch));
 	addBufferLong(buf, 0, node->length);
@@ -681,6 +699,8 @@ createArrowRecordBatch(ArrowRecordBatch *node)
 	addBufferArrowBufferVector(buf, 2,
 							   node->_num_buffers,
 							   node->buffers);
+	if (node->compression)
+		addBufferOffset(buf, 3, createArrowBodyCompression(node->compression));
 	return makeBufferFlatten(buf);
 }
 
@@ -950,7 +970,9 @@ writeArrowSchema(SQLtable *table)
 
 	/* setup Message of Schema */
 	initArrowNode(&message, Message);
-	message.version = ArrowMetadataVersion__V4;
+	message.version = (table->compression
+					   ? ArrowMetadataVersion__V5
+					   : ArrowMetadataVersion__V4);
 	schema = &message.body.schema;
 	initArrowNode(schema, Schema);
 	schema->endianness = ArrowEndianness__Little;
@@ -1361,6 +1383,182 @@ writeArrowBuffer(int fdesc, SQLfield *column)
 	}
 }
 
+/*
+ * compressArrowBuffer
+ *
+ * It appends the compressed image of the buffer on the 'dest', with int64
+ * prefix of the uncompressed length. If compression does not make the buffer
+ * smaller, it puts the raw image with -1 prefix, as Arrow format allows.
+ */
+static size_t
+compressArrowBuffer(SQLbuffer *dest, SQLbuffer *buf,
+					ArrowCompressionType codec)
+{
+	size_t		base = dest->usage;
+	size_t		clen = 0;
+	int64		prefix;
+
+	switch (codec)
+	{
+#ifdef WITH_LZ4
+		case ArrowCompressionType__LZ4_FRAME:
+			{
+				size_t	bound = LZ4F_compressFrameBound(buf->usage, NULL);
+
+				sql_buffer_expand(dest, base + sizeof(int64) + bound);
+				clen = LZ4F_compressFrame(dest->data + base + sizeof(int64),
+										  bound, buf->data, buf->usage, NULL);
+				if (LZ4F_isError(clen))
+					Elog("failed on LZ4F_compressFrame: %s",
+						 LZ4F_getErrorName(clen));
+			}
+			break;
+#endif
+#ifdef WITH_ZSTD
+		case ArrowCompressionType__ZSTD:
+			{
+				size_t	bound = ZSTD_compressBound(buf->usage);
+
+				sql_buffer_expand(dest, base + sizeof(int64) + bound);
+				clen = ZSTD_compress(dest->data + base + sizeof(int64),
+									 bound, buf->data, buf->usage,
+									 ZSTD_CLEVEL_DEFAULT);
+				if (ZSTD_isError(clen))
+					Elog("failed on ZSTD_compress: %s",
+						 ZSTD_getErrorName(clen));
+			}
+			break;
+#endif
+		default:
+			Elog("Arrow compression codec (%d) is not supported in this build",
+				 (int)codec);
+			break;
+	}
+
+	if (clen < buf->usage)
+		prefix = buf->usage;
+	else
+	{
+		/* no benefit, so put the uncompressed image */
+		sql_buffer_expand(dest, base + sizeof(int64) + buf->usage);
+		memcpy(dest->data + base + sizeof(int64), buf->data, buf->usage);
+		clen = buf->usage;
+		prefix = -1;
+	}
+	memcpy(dest->data + base, &prefix, sizeof(int64));
+	dest->usage = base + sizeof(int64) + clen;
+
+	return base;
+}
+
+/*
+ * compressArrowFieldBuffers
+ *
+ * It compresses the buffers of the column to be written, in the same order
+ * as writeArrowBuffer() doing, then returns number of the compressed buffers.
+ * The compressed images are kept in table->compressed, so the caller has to
+ * switch the buffers to point them once all the buffers are compressed.
+ */
+struct ArrowCompressedBuffer
+{
+	SQLbuffer  *buf;		/* buffer to be written */
+	SQLbuffer	saved;		/* original (uncompressed) buffer */
+	size_t		offset;		/* offset of the image in table->compressed */
+	size_t		length;		/* length of the image */
+};
+
+static int
+__compressArrowFieldBuffer(SQLtable *table, SQLbuffer *buf,
+						   ArrowCompressedBuffer *cbufs, int ncbufs)
+{
+	ArrowCompressedBuffer *cbuf = &cbufs[ncbufs];
+
+	/* Arrow format allows empty buffer without the length prefix */
+	if (buf->usage == 0)
+		return ncbufs;
+	cbuf->buf = buf;
+	cbuf->saved = *buf;
+	cbuf->offset = compressArrowBuffer(&table->compressed, buf,
+									   table->compression->codec);
+	cbuf->length = table->compressed.usage - cbuf->offset;
+
+	return ncbufs + 1;
+}
+
+static int
+compressArrowFieldBuffers(SQLtable *table, SQLfield *column,
+						  ArrowCompressedBuffer *cbufs, int ncbufs)
+{
+	int		j;
+
+	if (column->nullcount > 0)
+		ncbufs = __compressArrowFieldBuffer(table, &column->nullmap,
+											cbufs, ncbufs);
+	if (column->element)
+	{
+		ncbufs = __compressArrowFieldBuffer(table, &column->values,
+											cbufs, ncbufs);
+		ncbufs = compressArrowFieldBuffers(table, column->element,
+										   cbufs, ncbufs);
+	}
+	else if (column->subfields)
+	{
+		for (j=0; j < column->nfields; j++)
+			ncbufs = compressArrowFieldBuffers(table, &column->subfields[j],
+											   cbufs, ncbufs);
+	}
+	else
+	{
+		ncbufs = __compressArrowFieldBuffer(table, &column->values,
+											cbufs, ncbufs);
+		if (!column->enumdict &&
+			(column->arrow_type.node.tag == ArrowNodeTag__Utf8 ||
+			 column->arrow_type.node.tag == ArrowNodeTag__Binary ||
+			 column->arrow_type.node.tag == ArrowNodeTag__LargeUtf8 ||
+			 column->arrow_type.node.tag == ArrowNodeTag__LargeBinary))
+			ncbufs = __compressArrowFieldBuffer(table, &column->extra,
+												cbufs, ncbufs);
+	}
+	return ncbufs;
+}
+
+/*
+ * makeArrowBodyCompression
+ *
+ * It returns BodyCompression node for the supplied compression method;
+ * one of 'none', 'lz4' or 'zstd'. NULL means no compression.
+ */
+ArrowBodyCompression *
+makeArrowBodyCompression(const char *method)
+{
+	ArrowBodyCompression *compression;
+
+	if (strcasecmp(method, "none") == 0)
+		return NULL;
+
+	compression = palloc0(sizeof(ArrowBodyCompression));
+	initArrowNode(compression, BodyCompression);
+	if (strcasecmp(method, "lz4") == 0)
+	{
+#ifndef WITH_LZ4
+		Elog("LZ4 compression is not supported in this build");
+#endif
+		compression->codec = ArrowCompressionType__LZ4_FRAME;
+	}
+	else if (strcasecmp(method, "zstd") == 0)
+	{
+#ifndef WITH_ZSTD
+		Elog("ZSTD compression is not supported in this build");
+#endif
+		compression->codec = ArrowCompressionType__ZSTD;
+	}
+	else
+		Elog("unknown compression method: %s", method);
+	compression->method = ArrowBodyCompressionMethod__BUFFER;
+
+	return compression;
+}
+
 static void
 sql_field_clear(SQLfield *column)
 {
@@ -1382,6 +1580,585 @@ sql_field_clear(SQLfield *column)
 	}
 }
 
+/*
+ * sql_table_duplicate / sql_table_swap_buffers
+ *
+ * They allow to fill up the data buffers of a SQLtable, while the previous
+ * RecordBatch is written out from the other one. The duplicated SQLtable
+ * has identical field definitions with empty buffers, and only the data
+ * buffers are swapped; so, the original SQLtable keeps the RecordBatches
+ * and the statistics written in the past.
+ */
+static void
+__sql_field_duplicate(SQLfield *dest, const SQLfield *src)
+{
+	int		j;
+
+	memcpy(dest, src, sizeof(SQLfield));
+	dest->nitems = 0;
+	dest->nullcount = 0;
+	sql_buffer_init(&dest->nullmap);
+	sql_buffer_init(&dest->values);
+	sql_buffer_init(&dest->extra);
+	dest->__curr_usage__ = 0;
+	dest->stat_nitems = 0;
+	sql_buffer_init(&dest->stat_min_values);
+	sql_buffer_init(&dest->stat_max_values);
+	dest->bloom_nitems = 0;
+	sql_buffer_init(&dest->bloom_offsets);
+	sql_buffer_init(&dest->bloom_bitmap);
+
+	if (src->element)
+	{
+		dest->element = palloc(sizeof(SQLfield));
+		__sql_field_duplicate(dest->element, src->element);
+	}
+	if (src->nfields > 0)
+	{
+		dest->subfields = palloc(sizeof(SQLfield) * src->nfields);
+		for (j=0; j < src->nfields; j++)
+			__sql_field_duplicate(&dest->subfields[j], &src->subfields[j]);
+	}
+}
+
+SQLtable *
+sql_table_duplicate(SQLtable *table)
+{
+	SQLtable   *dest;
+	int			j;
+
+	dest = palloc(offsetof(SQLtable, columns[table->nfields]));
+	memcpy(dest, table, offsetof(SQLtable, columns));
+	dest->recordBatches = NULL;
+	dest->numRecordBatches = 0;
+	dest->dictionaries = NULL;
+	dest->numDictionaries = 0;
+	sql_buffer_init(&dest->compressed);
+	dest->rbatch_built = false;
+	dest->cbufs = NULL;
+	dest->numCBufs = 0;
+	dest->nitems = 0;
+	for (j=0; j < table->nfields; j++)
+		__sql_field_duplicate(&dest->columns[j], &table->columns[j]);
+
+	return dest;
+}
+
+static void
+__sql_field_swap_buffers(SQLfield *a, SQLfield *b)
+{
+	SQLfield	temp;
+	int			j;
+
+	memcpy(&temp, a, sizeof(SQLfield));
+	a->nitems = b->nitems;
+	a->nullcount = b->nullcount;
+	a->nullmap = b->nullmap;
+	a->values = b->values;
+	a->extra = b->extra;
+	a->__curr_usage__ = b->__curr_usage__;
+
+	b->nitems = temp.nitems;
+	b->nullcount = temp.nullcount;
+	b->nullmap = temp.nullmap;
+	b->values = temp.values;
+	b->extra = temp.extra;
+	b->__curr_usage__ = temp.__curr_usage__;
+
+	if (a->element)
+		__sql_field_swap_buffers(a->element, b->element);
+	for (j=0; j < a->nfields; j++)
+		__sql_field_swap_buffers(&a->subfields[j], &b->subfields[j]);
+}
+
+void
+sql_table_swap_buffers(SQLtable *a, SQLtable *b)
+{
+	size_t		nitems = a->nitems;
+	int			j;
+
+	assert(a->nfields == b->nfields);
+	a->nitems = b->nitems;
+	b->nitems = nitems;
+	for (j=0; j < a->nfields; j++)
+		__sql_field_swap_buffers(&a->columns[j], &b->columns[j]);
+}
+
+/*
+ * Min/Max statistics per RecordBatch
+ *
+ * Statistics of the top-level fields are written to the custom_metadata
+ * of the Field in the Footer, as comma separated values for each
+ * RecordBatch. Values are in the native representation of Apache Arrow
+ * (e.g, days since the UNIX epoch for Date), and an empty token means
+ * no statistics are available for the RecordBatch.
+ */
+static void
+__appendArrowFieldStatsToken(SQLbuffer *buf, const char *token, bool first)
+{
+	size_t		len = strlen(token) + 2;	/* ',' and '\0' */
+
+	if (buf->usage + len > buf->length)
+	{
+		size_t	length = Max(buf->length, 256);
+
+		while (buf->usage + len > length)
+			length *= 2;
+		if (!buf->data)
+			buf->data = palloc(length);
+		else
+			buf->data = repalloc(buf->data, length);
+		if (!buf->data)
+			Elog("out of memory (sz=%zu)", length);
+		buf->length = length;
+	}
+	if (!first)
+		buf->data[buf->usage++] = ',';
+	strcpy(buf->data + buf->usage, token);
+	buf->usage += len - 2;
+}
+
+static int
+__arrowFieldStatsUnitSize(SQLfield *column)
+{
+	ArrowType  *t = &column->arrow_type;
+
+	if (column->element || column->subfields || column->enumdict)
+		return 0;
+	switch (t->node.tag)
+	{
+		case ArrowNodeTag__Int:
+			/* uint64 may not fit to int64 */
+			if (!t->Int.is_signed && t->Int.bitWidth == 64)
+				return 0;
+			return t->Int.bitWidth / BITS_PER_BYTE;
+		case ArrowNodeTag__FloatingPoint:
+			if (t->FloatingPoint.precision == ArrowPrecision__Single)
+				return sizeof(float);
+			if (t->FloatingPoint.precision == ArrowPrecision__Double)
+				return sizeof(double);
+			return 0;
+		case ArrowNodeTag__Date:
+			if (t->Date.unit == ArrowDateUnit__Day)
+				return sizeof(int32);
+			return 0;
+		case ArrowNodeTag__Time:
+			return t->Time.bitWidth / BITS_PER_BYTE;
+		case ArrowNodeTag__Timestamp:
+			return sizeof(int64);
+		default:
+			break;
+	}
+	return 0;
+}
+
+static bool
+__computeArrowFieldStats(SQLfield *column, int unitsz,
+						 char *min_token, char *max_token, size_t token_sz)
+{
+	const uint8 *nullmap = (const uint8 *)column->nullmap.data;
+	const char *values = column->values.data;
+	bool		is_signed = true;
+	bool		is_float = false;
+	bool		found = false;
+	int64		imin = 0, imax = 0;
+	double		fmin = 0.0, fmax = 0.0;
+	long		i;
+
+	if (column->arrow_type.node.tag == ArrowNodeTag__Int)
+		is_signed = column->arrow_type.Int.is_signed;
+	else if (column->arrow_type.node.tag == ArrowNodeTag__FloatingPoint)
+		is_float = true;
+	if (column->values.usage < unitsz * column->nitems)
+		return false;
+
+	for (i=0; i < column->nitems; i++)
+	{
+		const char *addr = values + unitsz * i;
+
+		if (column->nullcount > 0 &&
+			(!nullmap || (nullmap[i>>3] & (1 << (i & 7))) == 0))
+			continue;
+		if (is_float)
+		{
+			double	fval = (unitsz == sizeof(float)
+							? (double)*((const float *)addr)
+							: *((const double *)addr));
+			/* NaN is larger than any other values, like PostgreSQL */
+			if (!found)
+				fmin = fmax = fval;
+			else if (isnan(fval))
+				fmax = fval;
+			else
+			{
+				if (isnan(fmin) || fval < fmin)
+					fmin = fval;
+				if (!isnan(fmax) && fval > fmax)
+					fmax = fval;
+			}
+		}
+		else
+		{
+			int64	ival;
+
+			switch (unitsz)
+			{
+				case sizeof(int8):
+					ival = (is_signed
+							? (int64)*((const int8 *)addr)
+							: (int64)*((const uint8 *)addr));
+					break;
+				case sizeof(int16):
+					ival = (is_signed
+							? (int64)*((const int16 *)addr)
+							: (int64)*((const uint16 *)addr));
+					break;
+				case sizeof(int32):
+					ival = (is_signed
+							? (int64)*((const int32 *)addr)
+							: (int64)*((const uint32 *)addr));
+					break;
+				case sizeof(int64):
+					ival = *((const int64 *)addr);
+					break;
+				default:
+					return false;
+			}
+			if (!found)
+				imin = imax = ival;
+			else
+			{
+				imin = Min(imin, ival);
+				imax = Max(imax, ival);
+			}
+		}
+		found = true;
+	}
+	if (!found)
+		return false;
+	if (!is_float)
+	{
+		snprintf(min_token, token_sz, "%ld", (long)imin);
+		snprintf(max_token, token_sz, "%ld", (long)imax);
+	}
+	else if (unitsz == sizeof(float))
+	{
+		snprintf(min_token, token_sz, "%.9g", fmin);
+		snprintf(max_token, token_sz, "%.9g", fmax);
+	}
+	else
+	{
+		snprintf(min_token, token_sz, "%.17g", fmin);
+		snprintf(max_token, token_sz, "%.17g", fmax);
+	}
+	return true;
+}
+
+static void
+updateArrowFieldStats(SQLfield *column, int index)
+{
+	int			unitsz = __arrowFieldStatsUnitSize(column);
+	char		min_token[64];
+	char		max_token[64];
+
+	if (unitsz == 0)
+		return;		/* not supported */
+	/* fill up empty tokens for the RecordBatches without statistics */
+	while (column->stat_nitems < index)
+	{
+		__appendArrowFieldStatsToken(&column->stat_min_values, "",
+									 column->stat_nitems == 0);
+		__appendArrowFieldStatsToken(&column->stat_max_values, "",
+									 column->stat_nitems == 0);
+		column->stat_nitems++;
+	}
+	assert(column->stat_nitems == index);
+	if (!__computeArrowFieldStats(column, unitsz,
+								  min_token, max_token, sizeof(min_token)))
+	{
+		/* all-null RecordBatch */
+		min_token[0] = '\0';
+		max_token[0] = '\0';
+	}
+	__appendArrowFieldStatsToken(&column->stat_min_values, min_token,
+								 column->stat_nitems == 0);
+	__appendArrowFieldStatsToken(&column->stat_max_values, max_token,
+								 column->stat_nitems == 0);
+	column->stat_nitems++;
+}
+
+/*
+ * Bloom filter per RecordBatch
+ *
+ * It is built on the columns with bloom_enabled, if the SQLtable has
+ * the sidecar file (bloom_filename). The filter is built on the values
+ * prior to the compression, then written out to the sidecar file once
+ * the offset of the RecordBatch gets determined.
+ */
+bool
+arrowFieldBloomFilterIsSupported(SQLfield *column)
+{
+	if (column->element || column->subfields || column->enumdict)
+		return false;
+	switch (column->arrow_type.node.tag)
+	{
+		case ArrowNodeTag__Int:
+		case ArrowNodeTag__Utf8:
+		case ArrowNodeTag__Binary:
+			return true;
+		default:
+			break;
+	}
+	return false;
+}
+
+static void
+buildArrowFieldBloomFilter(SQLfield *column)
+{
+	const uint8 *nullmap = (const uint8 *)column->nullmap.data;
+	const char *values = column->values.data;
+	const char *extra = column->extra.data;
+	ArrowBloomFilter *bloom;
+	ArrowType  *t = &column->arrow_type;
+	long		nvalues = column->nitems - column->nullcount;
+	uint64		nwords;
+	uint64		hash;
+	uint64		bit;
+	long		i;
+	int			k;
+
+	nwords = (Max(nvalues, 1) * ARROW_BLOOM_FILTER_BITS_PER_ITEM + 63) / 64;
+	sql_buffer_clear(&column->bloom_bitmap);
+	sql_buffer_append_zero(&column->bloom_bitmap,
+						   offsetof(ArrowBloomFilter, bitmap[nwords]));
+	bloom = (ArrowBloomFilter *)column->bloom_bitmap.data;
+	bloom->magic = ARROW_BLOOM_FILTER_MAGIC;
+	bloom->nhashes = ARROW_BLOOM_FILTER_NHASHES;
+	bloom->nwords = nwords;
+
+	for (i=0; i < column->nitems; i++)
+	{
+		if (column->nullcount > 0 &&
+			(!nullmap || (nullmap[i>>3] & (1 << (i & 7))) == 0))
+			continue;
+		if (t->node.tag == ArrowNodeTag__Int)
+		{
+			int		unitsz = t->Int.bitWidth / BITS_PER_BYTE;
+			const char *addr = values + unitsz * i;
+			int64	ival;
+
+			switch (unitsz)
+			{
+				case sizeof(int8):
+					ival = (t->Int.is_signed
+							? (int64)*((const int8 *)addr)
+							: (int64)*((const uint8 *)addr));
+					break;
+				case sizeof(int16):
+					ival = (t->Int.is_signed
+							? (int64)*((const int16 *)addr)
+							: (int64)*((const uint16 *)addr));
+					break;
+				case sizeof(int32):
+					ival = (t->Int.is_signed
+							? (int64)*((const int32 *)addr)
+							: (int64)*((const uint32 *)addr));
+					break;
+				case sizeof(int64):
+					ival = *((const int64 *)addr);
+					break;
+				default:
+					Elog("unexpected Int bitWidth: %d", t->Int.bitWidth);
+			}
+			hash = arrowBloomFilterHash(&ival, sizeof(int64));
+		}
+		else
+		{
+			const uint32 *offset = (const uint32 *)values;
+
+			hash = arrowBloomFilterHash(extra + offset[i],
+										offset[i+1] - offset[i]);
+		}
+		for (k=0; k < bloom->nhashes; k++)
+		{
+			bit = arrowBloomFilterBitIndex(bloom, hash, k);
+			bloom->bitmap[bit >> 6] |= (1UL << (bit & 63));
+		}
+	}
+}
+
+static void
+writeArrowFieldBloomFilter(SQLtable *table, int field_index,
+						   int rb_index, off_t rb_offset, long rb_nitems)
+{
+	SQLfield   *column = &table->columns[field_index];
+	ArrowBloomFilter *bloom = (ArrowBloomFilter *)column->bloom_bitmap.data;
+	off_t		pos;
+	char		token[64];
+
+	/* fill up empty tokens for the RecordBatches without bloom filter */
+	while (column->bloom_nitems < rb_index)
+	{
+		__appendArrowFieldStatsToken(&column->bloom_offsets, "",
+									 column->bloom_nitems == 0);
+		column->bloom_nitems++;
+	}
+	assert(column->bloom_nitems == rb_index);
+
+	pos = lseek(table->bloom_fdesc, 0, SEEK_END);
+	if (pos < 0)
+		Elog("unable to seek the sidecar file '%s': %m",
+			 table->bloom_filename);
+	if (pos == 0)
+	{
+		if (write(table->bloom_fdesc,
+				  ARROW_BLOOM_FILTER_SIGNATURE,
+				  ARROW_BLOOM_FILTER_SIGNATURE_SZ)
+			!= ARROW_BLOOM_FILTER_SIGNATURE_SZ)
+			Elog("unable to write the sidecar file '%s': %m",
+				 table->bloom_filename);
+		pos += ARROW_BLOOM_FILTER_SIGNATURE_SZ;
+	}
+	bloom->field_index = field_index;
+	bloom->rb_offset = rb_offset;
+	bloom->rb_nitems = rb_nitems;
+	sql_buffer_write(table->bloom_fdesc, &column->bloom_bitmap);
+
+	snprintf(token, sizeof(token), "%ld", (long)pos);
+	__appendArrowFieldStatsToken(&column->bloom_offsets, token,
+								 column->bloom_nitems == 0);
+	column->bloom_nitems++;
+}
+
+static int
+__countArrowFieldStatsTokens(const char *values)
+{
+	int			i, count = 1;
+
+	for (i=0; values[i] != '\0'; i++)
+	{
+		if (values[i] == ',')
+			count++;
+	}
+	return count;
+}
+
+/*
+ * restoreArrowFieldStatistics
+ *
+ * It restores the min/max statistics and the offsets of bloom filters of
+ * the RecordBatches already in the file, prior to append new RecordBatches.
+ * table->numRecordBatches must be already set up.
+ */
+void
+restoreArrowFieldStatistics(SQLtable *table, ArrowSchema *schema)
+{
+	int			j, k;
+
+	for (j=0; j < table->nfields && j < schema->_num_fields; j++)
+	{
+		SQLfield   *column = &table->columns[j];
+		ArrowField *field = &schema->fields[j];
+		const char *min_values = NULL;
+		const char *max_values = NULL;
+		const char *bloom_offsets = NULL;
+
+		for (k=0; k < field->_num_custom_metadata; k++)
+		{
+			ArrowKeyValue *kv = &field->custom_metadata[k];
+
+			if (!kv->key || !kv->value)
+				continue;
+			if (strcmp(kv->key, ARROW_STATS_MIN_VALUES) == 0)
+				min_values = kv->value;
+			else if (strcmp(kv->key, ARROW_STATS_MAX_VALUES) == 0)
+				max_values = kv->value;
+			else if (strcmp(kv->key, ARROW_BLOOM_FILTER) == 0)
+				bloom_offsets = kv->value;
+		}
+
+		/* ignore broken statistics */
+		if (min_values && max_values &&
+			__countArrowFieldStatsTokens(min_values) == table->numRecordBatches &&
+			__countArrowFieldStatsTokens(max_values) == table->numRecordBatches)
+		{
+			sql_buffer_clear(&column->stat_min_values);
+			sql_buffer_clear(&column->stat_max_values);
+			__appendArrowFieldStatsToken(&column->stat_min_values,
+										 min_values, true);
+			__appendArrowFieldStatsToken(&column->stat_max_values,
+										 max_values, true);
+			column->stat_nitems = table->numRecordBatches;
+		}
+
+		if (bloom_offsets &&
+			__countArrowFieldStatsTokens(bloom_offsets) == table->numRecordBatches)
+		{
+			sql_buffer_clear(&column->bloom_offsets);
+			__appendArrowFieldStatsToken(&column->bloom_offsets,
+										 bloom_offsets, true);
+			column->bloom_nitems = table->numRecordBatches;
+		}
+	}
+}
+
+/*
+ * buildArrowRecordBatch
+ *
+ * It updates the min/max statistics, builds the bloom filters and compresses
+ * the buffers of the RecordBatch to be written. It touches only the 'table',
+ * so callers that share the output file with other threads can build the
+ * RecordBatch without locks, then write it out under the lock.
+ * writeArrowRecordBatch() also builds the RecordBatch, if not yet.
+ */
+void
+buildArrowRecordBatch(SQLtable *table)
+{
+	int		i, j;
+
+	assert(table->nitems > 0 && !table->rbatch_built);
+	/*
+	 * update min/max statistics of the fields; it must be done prior to
+	 * the compression below, because it looks at the uncompressed values.
+	 */
+	for (j=0; j < table->nfields; j++)
+	{
+		SQLfield   *column = &table->columns[j];
+
+		updateArrowFieldStats(column, table->numRecordBatches);
+		if (table->bloom_filename && column->bloom_enabled)
+			buildArrowFieldBloomFilter(column);
+	}
+
+	/*
+	 * compress the buffers, if required. The buffers to be written are
+	 * switched to the compressed images, then restored after the write.
+	 */
+	table->numCBufs = 0;
+	if (table->compression)
+	{
+		if (!table->cbufs)
+			table->cbufs = palloc(sizeof(ArrowCompressedBuffer) *
+								  table->numBuffers);
+		sql_buffer_clear(&table->compressed);
+		for (j=0; j < table->nfields; j++)
+			table->numCBufs = compressArrowFieldBuffers(table,
+														&table->columns[j],
+														table->cbufs,
+														table->numCBufs);
+		assert(table->numCBufs <= table->numBuffers);
+		for (i=0; i < table->numCBufs; i++)
+		{
+			ArrowCompressedBuffer *cbuf = &table->cbufs[i];
+
+			cbuf->buf->data   = table->compressed.data + cbuf->offset;
+			cbuf->buf->usage  = cbuf->length;
+			cbuf->buf->length = cbuf->length;
+		}
+	}
+	table->rbatch_built = true;
+}
+
 int
 writeArrowRecordBatch(SQLtable *table)
 {
@@ -1397,6 +2174,8 @@ writeArrowRecordBatch(SQLtable *table)
 	size_t			bodyLength = 0;
 
 	assert(table->nitems > 0);
+	if (!table->rbatch_built)
+		buildArrowRecordBatch(table);
 	/* adjust current file position */
 	currPos = lseek(table->fdesc, 0, SEEK_CUR);
 	if (currPos < 0)
@@ -1430,7 +2209,9 @@ writeArrowRecordBatch(SQLtable *table)
 
 	/* setup Message of Schema */
 	initArrowNode(&message, Message);
-	message.version = ArrowMetadataVersion__V4;
+	message.version = (table->compression
+					   ? ArrowMetadataVersion__V5
+					   : ArrowMetadataVersion__V4);
 	message.bodyLength = bodyLength;
 
 	rbatch = &message.body.recordBatch;
@@ -1440,11 +2221,18 @@ writeArrowRecordBatch(SQLtable *table)
 	rbatch->_num_nodes = table->numFieldNodes;
 	rbatch->buffers = buffers;
 	rbatch->_num_buffers = table->numBuffers;
+	rbatch->compression = table->compression;
 	/* serialization */
 	metaLength = writeFlatBufferMessage(table->fdesc, &message);
 	for (j=0; j < table->nfields; j++)
 		writeArrowBuffer(table->fdesc, &table->columns[j]);
 
+	/* restore the uncompressed buffers */
+	for (i=0; i < table->numCBufs; i++)
+		*table->cbufs[i].buf = table->cbufs[i].saved;
+	table->numCBufs = 0;
+	table->rbatch_built = false;
+
 	/* save the offset/length at ArrowBlock */
 	index = table->numRecordBatches++;
 	if (index == 0)
@@ -1458,6 +2246,18 @@ writeArrowRecordBatch(SQLtable *table)
 	block->metaDataLength = metaLength;
 	block->bodyLength = bodyLength;
 
+	/* write out the bloom filters, if any */
+	if (table->bloom_filename)
+	{
+		for (j=0; j < table->nfields; j++)
+		{
+			if (table->columns[j].bloom_enabled)
+				writeArrowFieldBloomFilter(table, j, index,
+										   currPos + metaLength,
+										   table->nitems);
+		}
+	}
+
 	/* make the local buffer empty again */
 	for (j=0; j < table->nfields; j++)
 		sql_field_clear(&table->columns[j]);
@@ -1466,6 +2266,153 @@ writeArrowRecordBatch(SQLtable *table)
 	return index;
 }
 
+/*
+ * mergeArrowRecordBatches
+ *
+ * It moves the RecordBatches written by the 'src' table to the 'dst' table,
+ * with their min/max statistics and offsets of bloom filters. Both tables
+ * must have the identical schema, and must write out the same file; it is
+ * used to assemble the RecordBatches written by multiple workers into one
+ * Footer. Order of the RecordBatches in the Footer is not necessary to be
+ * identical to the order in the file.
+ */
+void
+mergeArrowRecordBatches(SQLtable *dst, SQLtable *src)
+{
+	int			nbatches = dst->numRecordBatches + src->numRecordBatches;
+	int			j;
+
+	assert(dst->nfields == src->nfields);
+	assert(dst->nitems == 0 && src->nitems == 0);
+	if (src->numRecordBatches == 0)
+		return;
+
+	for (j=0; j < dst->nfields; j++)
+	{
+		SQLfield   *d_column = &dst->columns[j];
+		SQLfield   *s_column = &src->columns[j];
+
+		/* min/max statistics are available only if both have them */
+		if (d_column->stat_nitems == dst->numRecordBatches &&
+			s_column->stat_nitems == src->numRecordBatches)
+		{
+			__appendArrowFieldStatsToken(&d_column->stat_min_values,
+										 s_column->stat_min_values.data,
+										 d_column->stat_nitems == 0);
+			__appendArrowFieldStatsToken(&d_column->stat_max_values,
+										 s_column->stat_max_values.data,
+										 d_column->stat_nitems == 0);
+			d_column->stat_nitems = nbatches;
+		}
+		else
+			d_column->stat_nitems = -1;		/* drop statistics */
+
+		/* bloom filters; RecordBatches without bloom filter get empty token */
+		if (s_column->bloom_nitems > 0)
+		{
+			while (d_column->bloom_nitems < dst->numRecordBatches)
+			{
+				__appendArrowFieldStatsToken(&d_column->bloom_offsets, "",
+											 d_column->bloom_nitems == 0);
+				d_column->bloom_nitems++;
+			}
+			while (s_column->bloom_nitems < src->numRecordBatches)
+			{
+				__appendArrowFieldStatsToken(&s_column->bloom_offsets, "",
+											 false);
+				s_column->bloom_nitems++;
+			}
+			__appendArrowFieldStatsToken(&d_column->bloom_offsets,
+										 s_column->bloom_offsets.data,
+										 d_column->bloom_nitems == 0);
+			d_column->bloom_nitems = nbatches;
+		}
+	}
+
+	if (dst->numRecordBatches == 0)
+		dst->recordBatches = palloc(sizeof(ArrowBlock) * nbatches);
+	else
+		dst->recordBatches = repalloc(dst->recordBatches,
+									  sizeof(ArrowBlock) * nbatches);
+	memcpy(dst->recordBatches + dst->numRecordBatches,
+		   src->recordBatches,
+		   sizeof(ArrowBlock) * src->numRecordBatches);
+	dst->numRecordBatches = nbatches;
+	src->numRecordBatches = 0;
+}
+
+/*
+ * setupArrowFieldStats
+ *
+ * It adds min/max statistics to the custom_metadata of the Field in Footer,
+ * if available.
+ */
+static void
+setupArrowFieldStats(ArrowField *field, SQLfield *column, int nbatches)
+{
+	ArrowKeyValue *kv;
+	int			nitems = field->_num_custom_metadata;
+
+	if (nbatches == 0 || column->stat_nitems != nbatches)
+		return;
+
+	kv = palloc0(sizeof(ArrowKeyValue) * (nitems + 2));
+	if (nitems > 0)
+		memcpy(kv, field->custom_metadata, sizeof(ArrowKeyValue) * nitems);
+	initArrowNode(&kv[nitems], KeyValue);
+	kv[nitems].key = ARROW_STATS_MIN_VALUES;
+	kv[nitems]._key_len = strlen(ARROW_STATS_MIN_VALUES);
+	kv[nitems].value = column->stat_min_values.data;
+	kv[nitems]._value_len = column->stat_min_values.usage;
+	nitems++;
+	initArrowNode(&kv[nitems], KeyValue);
+	kv[nitems].key = ARROW_STATS_MAX_VALUES;
+	kv[nitems]._key_len = strlen(ARROW_STATS_MAX_VALUES);
+	kv[nitems].value = column->stat_max_values.data;
+	kv[nitems]._value_len = column->stat_max_values.usage;
+	nitems++;
+
+	field->custom_metadata = kv;
+	field->_num_custom_metadata = nitems;
+}
+
+/*
+ * setupArrowFieldBloomFilter
+ *
+ * It adds offsets of the bloom filters to the custom_metadata of the Field
+ * in Footer, if available.
+ */
+static void
+setupArrowFieldBloomFilter(ArrowField *field, SQLfield *column, int nbatches)
+{
+	ArrowKeyValue *kv;
+	int			nitems = field->_num_custom_metadata;
+
+	if (nbatches == 0 || column->bloom_nitems == 0)
+		return;
+	/* fill up empty tokens for the RecordBatches without bloom filter */
+	while (column->bloom_nitems < nbatches)
+	{
+		__appendArrowFieldStatsToken(&column->bloom_offsets, "", false);
+		column->bloom_nitems++;
+	}
+	if (column->bloom_nitems != nbatches)
+		return;
+
+	kv = palloc0(sizeof(ArrowKeyValue) * (nitems + 1));
+	if (nitems > 0)
+		memcpy(kv, field->custom_metadata, sizeof(ArrowKeyValue) * nitems);
+	initArrowNode(&kv[nitems], KeyValue);
+	kv[nitems].key = ARROW_BLOOM_FILTER;
+	kv[nitems]._key_len = strlen(ARROW_BLOOM_FILTER);
+	kv[nitems].value = column->bloom_offsets.data;
+	kv[nitems]._value_len = column->bloom_offsets.usage;
+	nitems++;
+
+	field->custom_metadata = kv;
+	field->_num_custom_metadata = nitems;
+}
+
 /*
  * writeArrowFooter
  */
@@ -1478,7 +2425,9 @@ writeArrowFooter(SQLtable *table)
 
 	/* setup Footer */
 	initArrowNode(&footer, Footer);
-	footer.version = ArrowMetadataVersion__V4;
+	footer.version = (table->compression
+					  ? ArrowMetadataVersion__V5
+					  : ArrowMetadataVersion__V4);
 
 	/* setup Schema of Footer */
 	schema = &footer.schema;
@@ -1487,7 +2436,13 @@ writeArrowFooter(SQLtable *table)
 	schema->fields = alloca(sizeof(ArrowField) * table->nfields);
 	schema->_num_fields = table->nfields;
 	for (i=0; i < table->nfields; i++)
+	{
 		setupArrowField(&schema->fields[i], &table->columns[i]);
+		setupArrowFieldStats(&schema->fields[i], &table->columns[i],
+							 table->numRecordBatches);
+		setupArrowFieldBloomFilter(&schema->fields[i], &table->columns[i],
+								   table->numRecordBatches);
+	}
 	schema->custom_metadata = table->customMetadata;
 	schema->_num_custom_metadata = table->numCustomMetadata;
 
@@ -19,6 +19,9 @@
 #include "pg_strom.h"
 #include "cuda_numeric.h"
 #include "nvme_strom.h"
+#ifdef WITH_LIBURING
+#include <liburing.h>
+#endif
 
 /*
  * estimate_num_chunks
@@ -331,7 +334,10 @@ PDS_release(pgstrom_data_store *pds)
 		if (!pds->gcontext)
 		{
 			Assert(pds->kds.format == KDS_FORMAT_ARROW);
-			pfree(pds);
+			if (!pds->is_mmap)
+				pfree(pds);
+			else if (__munmapFile(pds) != 0)
+				elog(WARNING, "failed on __munmapFile: %m");
 		}
 #if 0
 		else if ((pds->kds.format == KDS_FORMAT_BLOCK) ||
@@ -1364,6 +1370,257 @@ PDS_fillup_blocks(pgstrom_data_store *pds)
 	pds->nblocks_uncached = 0;
 }
 
+/*
+ * __PDS_fillup_arrow_chunk - reads a strom_io_chunk using pread(2)
+ */
+static void
+__PDS_fillup_arrow_chunk(char *dest, int fdesc, off_t f_pos, size_t len)
+{
+	ssize_t		sz;
+
+	while (len > 0)
+	{
+		if (!GpuWorkerCurrentContext)
+			CHECK_FOR_INTERRUPTS();
+		else
+			CHECK_WORKER_TERMINATION();
+
+		sz = pread(fdesc, dest, len, f_pos);
+		if (sz > 0)
+		{
+			Assert(sz <= len);
+			dest += sz;
+			f_pos += sz;
+			len -= sz;
+		}
+		else if (sz == 0)
+		{
+			/*
+			 * Due to the page_sz alignment, we may try to read the file
+			 * over its tail. So, pread(2) may tell us unable to read
+			 * any more. The expected scenario happend only when remained
+			 * length is less than PAGE_SIZE.
+			 */
+			if (len >= PAGE_SIZE)
+				werror("unable to read arrow file any more");
+			memset(dest, 0, len);
+			break;
+		}
+		else if (errno != EINTR)
+		{
+			werror("failed on pread(2) of arrow file: %m");
+		}
+	}
+	/*
+	 * NOTE: Due to the page_sz alignment, we may try to read the file
+	 * over the its tail. So, above loop may terminate with non-zero
+	 * remaining length.
+	 */
+	if (len > 0)
+	{
+		Assert(len < PAGE_SIZE);
+		memset(dest, 0, len);
+	}
+}
+
+#ifdef WITH_LIBURING
+/*
+ * io_uring for __PDS_fillup_arrow
+ *
+ * A ring is set up on the first use per thread (backend or GPU worker),
+ * then kept until exit of the thread; so, a RecordBatch needs no system
+ * calls to set up / tear down the ring. If io_uring is not available for
+ * any reasons (not supported, prohibited by seccomp, no resources, ...),
+ * it is disabled and we fallback to the pread(2) loop.
+ */
+#define PDS_FILLUP_ARROW_URING_DEPTH	128
+static bool		pds_fillup_arrow_uring_disabled = false;
+static pthread_once_t pds_fillup_arrow_uring_once = PTHREAD_ONCE_INIT;
+static pthread_key_t pds_fillup_arrow_uring_key;
+static __thread struct io_uring *pds_fillup_arrow_uring = NULL;
+
+static void
+__PDS_release_arrow_uring(void *arg)
+{
+	struct io_uring *ring = arg;
+
+	io_uring_queue_exit(ring);
+	free(ring);
+}
+
+static void
+__PDS_init_arrow_uring_key(void)
+{
+	if (pthread_key_create(&pds_fillup_arrow_uring_key,
+						   __PDS_release_arrow_uring) != 0)
+		pds_fillup_arrow_uring_disabled = true;
+}
+
+static struct io_uring *
+__PDS_get_arrow_uring(void)
+{
+	struct io_uring *ring;
+
+	if (pds_fillup_arrow_uring)
+		return pds_fillup_arrow_uring;
+	pthread_once(&pds_fillup_arrow_uring_once,
+				 __PDS_init_arrow_uring_key);
+	if (pds_fillup_arrow_uring_disabled)
+		return NULL;
+	ring = malloc(sizeof(struct io_uring));
+	if (!ring)
+		return NULL;
+	if (io_uring_queue_init(PDS_FILLUP_ARROW_URING_DEPTH, ring, 0) < 0)
+	{
+		free(ring);
+		pds_fillup_arrow_uring_disabled = true;
+		return NULL;
+	}
+	pthread_setspecific(pds_fillup_arrow_uring_key, ring);
+	pds_fillup_arrow_uring = ring;
+
+	return ring;
+}
+
+static void
+__PDS_drop_arrow_uring(void)
+{
+	struct io_uring *ring = pds_fillup_arrow_uring;
+
+	if (ring)
+	{
+		pthread_setspecific(pds_fillup_arrow_uring_key, NULL);
+		pds_fillup_arrow_uring = NULL;
+		__PDS_release_arrow_uring(ring);
+	}
+}
+
+/*
+ * __PDS_drain_arrow_uring - waits for completion of the in-flight requests,
+ * because they still write to the buffer that shall be released on error.
+ */
+static void
+__PDS_drain_arrow_uring(struct io_uring *ring, int ninflights)
+{
+	struct io_uring_cqe *cqe;
+	int			rv;
+
+	while (ninflights > 0)
+	{
+		rv = io_uring_wait_cqe(ring, &cqe);
+		if (rv == -EINTR)
+			continue;
+		if (rv < 0)
+		{
+			/* unable to wait; closing the ring cancels the requests */
+			__PDS_drop_arrow_uring();
+			return;
+		}
+		io_uring_cqe_seen(ring, cqe);
+		ninflights--;
+	}
+}
+
+/*
+ * __PDS_fillup_arrow_uring - submits all the strom_io_chunks at once
+ * using io_uring, then waits for their completion. It returns false if
+ * io_uring is not available, to fallback the pread(2) loop.
+ */
+static bool
+__PDS_fillup_arrow_uring(pgstrom_data_store *pds_dst,
+						 int fdesc, strom_io_vector *iovec)
+{
+	struct io_uring *ring = __PDS_get_arrow_uring();
+	volatile int ninflights = 0;
+	int			next = 0;
+	int			errcode = 0;
+	int			rv;
+
+	if (!ring)
+		return false;
+
+	STROM_TRY();
+	{
+		while (ninflights > 0 || (next < iovec->nr_chunks && errcode == 0))
+		{
+			struct io_uring_cqe *cqe;
+
+			/* submit the chunks as much as the ring can accept */
+			while (next < iovec->nr_chunks &&
+				   ninflights < PDS_FILLUP_ARROW_URING_DEPTH &&
+				   errcode == 0)
+			{
+				strom_io_chunk *ioc = &iovec->ioc[next];
+				struct io_uring_sqe *sqe = io_uring_get_sqe(ring);
+
+				if (!sqe)
+					break;
+				io_uring_prep_read(sqe, fdesc,
+								   (char *)&pds_dst->kds + ioc->m_offset,
+								   (size_t)ioc->nr_pages * PAGE_SIZE,
+								   (off_t)ioc->fchunk_id * PAGE_SIZE);
+				io_uring_sqe_set_data(sqe, ioc);
+				next++;
+				ninflights++;
+			}
+			rv = io_uring_submit_and_wait(ring, 1);
+			if (rv < 0)
+			{
+				if (rv == -EINTR)
+					continue;
+				/*
+				 * Unsubmitted SQEs may remain in the ring, so it is not
+				 * reusable any more. Closing the ring cancels the requests.
+				 */
+				__PDS_drop_arrow_uring();
+				ninflights = 0;
+				errno = -rv;
+				werror("failed on io_uring_submit_and_wait: %m");
+			}
+
+			/* reap the completed chunks */
+			while (io_uring_peek_cqe(ring, &cqe) == 0)
+			{
+				strom_io_chunk *ioc = io_uring_cqe_get_data(cqe);
+				int			res = cqe->res;
+				size_t		len = (size_t)ioc->nr_pages * PAGE_SIZE;
+
+				io_uring_cqe_seen(ring, cqe);
+				ninflights--;
+				if (res < 0)
+				{
+					/* wait for the in-flight chunks, then raise an error */
+					if (errcode == 0)
+						errcode = -res;
+				}
+				else if (res < len && errcode == 0)
+				{
+					/* short read; read the remaining portion by pread(2) */
+					__PDS_fillup_arrow_chunk((char *)&pds_dst->kds +
+											 ioc->m_offset + res,
+											 fdesc,
+											 (off_t)ioc->fchunk_id * PAGE_SIZE + res,
+											 len - res);
+				}
+			}
+		}
+	}
+	STROM_CATCH();
+	{
+		__PDS_drain_arrow_uring(ring, ninflights);
+		STROM_RE_THROW();
+	}
+	STROM_END_TRY();
+
+	if (errcode != 0)
+	{
+		errno = errcode;
+		werror("failed on io_uring read of arrow file: %m");
+	}
+	return true;
+}
+#endif	/* WITH_LIBURING */
+
 /*
  * PDS_fillup_arrow
  */
@@ -1385,57 +1642,20 @@ __PDS_fillup_arrow(pgstrom_data_store *pds_dst,
 	pds_dst->iovec = NULL;
 	memcpy(&pds_dst->kds, kds_head, head_sz);
 
+#ifdef WITH_LIBURING
+	/* many chunks are submitted at once, if io_uring is available */
+	if (iovec->nr_chunks > 1 &&
+		__PDS_fillup_arrow_uring(pds_dst, fdesc, iovec))
+		return;
+#endif
 	for (j=0; j < iovec->nr_chunks; j++)
 	{
 		strom_io_chunk *ioc = &iovec->ioc[j];
-		char   *dest = (char *)&pds_dst->kds + ioc->m_offset;
-		off_t	f_pos = (size_t)ioc->fchunk_id * PAGE_SIZE;
-		size_t	len = (size_t)ioc->nr_pages * PAGE_SIZE;
-		ssize_t	sz;
 
-		while (len > 0)
-		{
-			if (!GpuWorkerCurrentContext)
-				CHECK_FOR_INTERRUPTS();
-			else
-				CHECK_WORKER_TERMINATION();
-
-			sz = pread(fdesc, dest, len, f_pos);
-			if (sz > 0)
-			{
-				Assert(sz <= len);
-				dest += sz;
-				f_pos += sz;
-				len -= sz;
-			}
-			else if (sz == 0)
-			{
-				/*
-				 * Due to the page_sz alignment, we may try to read the file
-				 * over its tail. So, pread(2) may tell us unable to read
-				 * any more. The expected scenario happend only when remained
-				 * length is less than PAGE_SIZE.
-				 */
-				if (len >= PAGE_SIZE)
-					werror("unable to read arrow file any more");
-				memset(dest, 0, len);
-				break;
-			}
-			else if (errno != EINTR)
-			{
-				werror("failed on pread(2) of arrow file: %m");
-			}
-		}
-		/*
-		 * NOTE: Due to the page_sz alignment, we may try to read the file
-		 * over the its tail. So, above loop may terminate with non-zero
-		 * remaining length.
-		 */
-		if (len > 0)
-		{
-			Assert(len < PAGE_SIZE);
-			memset(dest, 0, len);
-		}
+		__PDS_fillup_arrow_chunk((char *)&pds_dst->kds + ioc->m_offset,
+								 fdesc,
+								 (off_t)ioc->fchunk_id * PAGE_SIZE,
+								 (size_t)ioc->nr_pages * PAGE_SIZE);
 	}
 }
 
@@ -263,7 +263,7 @@ pgstromInitGpuTaskState(GpuTaskState *gts,
 		}
 		/* setup ArrowFdwState, if foreign-table */
 		if (RelationGetForm(relation)->relkind == RELKIND_FOREIGN_TABLE)
-			gts->af_state = ExecInitArrowFdw(relation, outer_refs);
+			gts->af_state = ExecInitArrowFdw(&gts->css.ss, NIL, outer_refs);
 	}
 	gts->outer_refs = outer_refs;
 	gts->scan_done = false;
@@ -1355,8 +1355,8 @@ pgstrom_abort_if(PG_FUNCTION_ARGS)
 PG_FUNCTION_INFO_V1(pgstrom_abort_if);
 
 /*
- * Simple wrapper for read(2) and write(2) to ensure full-buffer read and
- * write, regardless of i/o-size and signal interrupts.
+ * Simple wrapper for read(2), pread(2) and write(2) to ensure full-buffer
+ * read and write, regardless of i/o-size and signal interrupts.
  */
 ssize_t
 __readFile(int fdesc, void *buffer, size_t nbytes)
@@ -1382,6 +1382,31 @@ __readFile(int fdesc, void *buffer, size_t nbytes)
 	return count;
 }
 
+ssize_t
+__preadFile(int fdesc, void *buffer, size_t nbytes, off_t f_pos)
+{
+	ssize_t		rv, count = 0;
+
+	do {
+		rv = pread(fdesc, (char *)buffer + count, nbytes - count,
+				   f_pos + count);
+		if (rv < 0)
+		{
+			if (errno == EINTR)
+			{
+				CHECK_FOR_INTERRUPTS();
+				continue;
+			}
+			return rv;
+		}
+		else if (rv == 0)
+			break;
+		count += rv;
+	} while (count < nbytes);
+
+	return count;
+}
+
 ssize_t
 __writeFile(int fdesc, const void *buffer, size_t nbytes)
 {
@@ -91,6 +91,9 @@
 #include "nodes/execnodes.h"
 #include "nodes/extensible.h"
 #include "nodes/makefuncs.h"
+#if PG_VERSION_NUM >= 160000
+#include "nodes/miscnodes.h"
+#endif
 #include "nodes/nodeFuncs.h"
 #include "nodes/pg_list.h"
 #include "nodes/plannodes.h"
@@ -124,6 +127,8 @@
 #include "parser/scansup.h"
 #include "pgstat.h"
 #include "port/atomics.h"
+#include "port/pg_crc32c.h"
+#include "postmaster/autovacuum.h"
 #include "postmaster/bgworker.h"
 #include "postmaster/postmaster.h"
 #include "storage/buf.h"
@@ -595,10 +600,13 @@ typedef struct pgstrom_data_store
 	 * If NULL, KDS is preliminary loaded by CPU and filesystem, and
 	 * PDS is also allocated on managed memory area. So, worker don't
 	 * need to kick DMA operations explicitly.
+	 * @is_mmap is true, if PDS is mapped on the arrow file directly by
+	 * CPU scan. It has to be released by __munmapFile, not pfree.
 	 */
 	cl_uint				nblocks_uncached;	/* for KDS_FORMAT_BLOCK */
 	cl_int				filedesc;
 	strom_io_vector	   *iovec;				/* for KDS_FORMAT_ARROW */
+	cl_bool				is_mmap;			/* for KDS_FORMAT_ARROW */
 
 	/* data chunk in kernel portion */
 	kern_data_store kds	__attribute__ ((aligned (STROMALIGN_LEN)));
@@ -666,6 +674,7 @@ extern CUresult gpuOptimalBlockSize(int *p_grid_sz,
  * shmbuf.c
  */
 extern MemoryContext	SharedMemoryContextCreate(const char *name);
+extern Size				SharedMemoryChunkSizeLimit(void);
 extern void				pgstrom_init_shmbuf(void);
 extern MemoryContext	TopSharedMemoryContext;
 
@@ -1368,7 +1377,8 @@ extern bool KDS_fetch_tuple_arrow(TupleTableSlot *slot,
 								  kern_data_store *kds,
 								  size_t row_index);
 
-extern ArrowFdwState *ExecInitArrowFdw(Relation relation,
+extern ArrowFdwState *ExecInitArrowFdw(ScanState *ss,
+									   List *outer_quals,
 									   Bitmapset *outer_refs);
 extern pgstrom_data_store *ExecScanChunkArrowFdw(GpuTaskState *gts);
 extern void ExecReScanArrowFdw(ArrowFdwState *af_state);
@@ -1413,6 +1423,8 @@ extern Path *pgstrom_copy_pathnode(const Path *pathnode);
 extern const char *errorText(int errcode);
 
 extern ssize_t	__readFile(int fdesc, void *buffer, size_t nbytes);
+extern ssize_t	__preadFile(int fdesc, void *buffer, size_t nbytes,
+							off_t f_pos);
 extern ssize_t	__writeFile(int fdesc, const void *buffer, size_t nbytes);
 extern void	   *__mmapFile(void *addr, size_t length,
 						   int prot, int flags, int fdesc, off_t offset);
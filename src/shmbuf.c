@@ -1276,6 +1276,20 @@ pgstrom_shmbuf_info(PG_FUNCTION_ARGS)
 }
 PG_FUNCTION_INFO_V1(pgstrom_shmbuf_info);
 
+/*
+ * SharedMemoryChunkSizeLimit
+ *
+ * It returns the largest size of a chunk; a chunk shall be allocated within
+ * a segment, so shared memory context raises an error on the larger request
+ * even if MCXT_ALLOC_NO_OOM is given.
+ */
+Size
+SharedMemoryChunkSizeLimit(void)
+{
+	return shmbuf_segment_size - (offsetof(shmBufferChunk, data) +
+								  sizeof(uint32));
+}
+
 /*
  * SharedMemoryContextCreate
  */
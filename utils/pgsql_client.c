@@ -7,7 +7,9 @@
  * it under the terms of the PostgreSQL License. See the LICENSE file.
  */
 #include "sql2arrow.h"
+#include <arpa/inet.h>
 #include <limits.h>
+#include <pthread.h>
 #include <libpq-fe.h>
 
 #define CURSOR_NAME		"curr_pg2arrow"
@@ -34,8 +36,22 @@ typedef struct
 	PGresult   *res;
 	uint32		nitems;
 	uint32		index;
+	bool		in_xact;	/* transaction is already open */
+	/* prefetch of the next results */
+	pthread_t	fetcher;
+	bool		fetcher_active;
+	PGresult   *fetcher_res;
+	/* COPY BINARY mode */
+	bool		copy_mode;
+	bool		copy_header;	/* header of the stream was parsed */
+	char	   *copy_buf;		/* the next row from PQgetCopyData */
+	const char *copy_pos;		/* current position in the copy_buf */
+	const char *copy_end;		/* end of the copy_buf */
 } PGSTATE;
 
+#define PGCOPY_SIGNATURE		"PGCOPY\n\377\r\n"
+#define PGCOPY_SIGNATURE_SZ		11
+
 static inline bool
 pg_strtobool(const char *v)
 {
@@ -120,25 +136,86 @@ pgsql_server_connect(const char *sqldb_hostname,
 	return conn;
 }
 
+/*
+ * pgsql_fetch_next
+ */
+static PGresult *
+pgsql_fetch_next(PGconn *conn)
+{
+	const char *query = "FETCH FORWARD 500000 FROM " CURSOR_NAME;
+	PGresult   *res;
+
+	res = PQexecParams(conn, query, 0, NULL, NULL, NULL, NULL,
+					   1);  /* results in binary mode */
+	if (PQresultStatus(res) != PGRES_TUPLES_OK)
+		Elog("SQL execution failed: %s", PQresultErrorMessage(res));
+	return res;
+}
+
+/*
+ * pgsql_start_prefetch
+ *
+ * It launches a thread to fetch the next results, while the caller converts
+ * the current results to Apache Arrow. The PGconn shall not be used by
+ * others until the fetcher gets joined.
+ */
+static void *
+pgsql_fetcher_main(void *__pgstate)
+{
+	PGSTATE	   *pgstate = __pgstate;
+
+	pgstate->fetcher_res = pgsql_fetch_next(pgstate->conn);
+	return NULL;
+}
+
+static void
+pgsql_start_prefetch(PGSTATE *pgstate)
+{
+	int		rc;
+
+	assert(!pgstate->fetcher_active);
+	rc = pthread_create(&pgstate->fetcher, NULL,
+						pgsql_fetcher_main, pgstate);
+	if (rc != 0)
+		Elog("failed on pthread_create: %s", strerror(rc));
+	pgstate->fetcher_active = true;
+}
+
+static PGresult *
+pgsql_join_prefetch(PGSTATE *pgstate)
+{
+	PGresult   *res;
+	int			rc;
+
+	assert(pgstate->fetcher_active);
+	rc = pthread_join(pgstate->fetcher, NULL);
+	if (rc != 0)
+		Elog("failed on pthread_join: %s", strerror(rc));
+	res = pgstate->fetcher_res;
+	pgstate->fetcher_active = false;
+	pgstate->fetcher_res = NULL;
+
+	return res;
+}
+
 /*
  * pgsql_next_result
  */
 static PGresult *
 pgsql_next_result(PGSTATE *pgstate)
 {
-	const char *query = "FETCH FORWARD 500000 FROM " CURSOR_NAME;
-	PGconn	   *conn = pgstate->conn;
 	PGresult   *res;
+	bool		prefetched = pgstate->fetcher_active;
 
 	if (pgstate->res)
 	{
 		PQclear(pgstate->res);
 		pgstate->res = NULL;
 	}
-	res = PQexecParams(conn, query, 0, NULL, NULL, NULL, NULL,
-					   1);  /* results in binary mode */
-	if (PQresultStatus(res) != PGRES_TUPLES_OK)
-		Elog("SQL execution failed: %s", PQresultErrorMessage(res));
+	if (prefetched)
+		res = pgsql_join_prefetch(pgstate);
+	else
+		res = pgsql_fetch_next(pgstate->conn);
 	pgstate->nitems = PQntuples(res);
 	pgstate->index  = 0;
 	if (pgstate->nitems == 0)
@@ -146,6 +223,11 @@ pgsql_next_result(PGSTATE *pgstate)
 		PQclear(res);
 		res = NULL;
 	}
+	else if (prefetched)
+	{
+		/* fetch the next results in the background */
+		pgsql_start_prefetch(pgstate);
+	}
 	pgstate->res = res;
 	return res;
 }
@@ -536,6 +618,190 @@ pgsql_create_buffer(PGconn *conn, PGresult *res,
 	return table;
 }
 
+/*
+ * COPY BINARY mode
+ *
+ * It runs COPY (query) TO STDOUT with binary format, instead of the binary
+ * cursor, and parses the rows from PQgetCopyData() incrementally; so, no
+ * PGresult is built for the query results, and client memory consumption
+ * is independent from the number of rows fetched at once. Each value has
+ * the identical binary format to the binary cursor, thus put_value handlers
+ * are applied as is.
+ */
+static inline int16
+pgsql_copy_fetch_int16(PGSTATE *pgstate)
+{
+	uint16		value;
+
+	if (pgstate->copy_pos + sizeof(uint16) > pgstate->copy_end)
+		Elog("COPY BINARY stream is truncated");
+	memcpy(&value, pgstate->copy_pos, sizeof(uint16));
+	pgstate->copy_pos += sizeof(uint16);
+	return (int16)ntohs(value);
+}
+
+static inline int32
+pgsql_copy_fetch_int32(PGSTATE *pgstate)
+{
+	uint32		value;
+
+	if (pgstate->copy_pos + sizeof(uint32) > pgstate->copy_end)
+		Elog("COPY BINARY stream is truncated");
+	memcpy(&value, pgstate->copy_pos, sizeof(uint32));
+	pgstate->copy_pos += sizeof(uint32);
+	return (int32)ntohl(value);
+}
+
+/*
+ * pgsql_copy_next_row
+ *
+ * It reads the next row of the COPY stream to the copy_buf, then returns
+ * the number of fields. -1 means the end of the stream.
+ */
+static int
+pgsql_copy_next_row(PGSTATE *pgstate)
+{
+	PGconn	   *conn = pgstate->conn;
+	PGresult   *res;
+	char	   *buf;
+	int			nbytes;
+	int			nfields;
+
+	if (pgstate->copy_buf)
+	{
+		PQfreemem(pgstate->copy_buf);
+		pgstate->copy_buf = NULL;
+	}
+	for (;;)
+	{
+		nbytes = PQgetCopyData(conn, &buf, 0);
+		if (nbytes == -1)
+			break;		/* end of the COPY */
+		if (nbytes < 0)
+			Elog("failed on PQgetCopyData: %s", PQerrorMessage(conn));
+		pgstate->copy_buf = buf;
+		pgstate->copy_pos = buf;
+		pgstate->copy_end = buf + nbytes;
+		/* the first row follows the header of the stream */
+		if (!pgstate->copy_header)
+		{
+			int32		flags;
+			int32		extlen;
+
+			if (nbytes < PGCOPY_SIGNATURE_SZ ||
+				memcmp(buf, PGCOPY_SIGNATURE, PGCOPY_SIGNATURE_SZ) != 0)
+				Elog("COPY BINARY stream has unexpected signature");
+			pgstate->copy_pos += PGCOPY_SIGNATURE_SZ;
+			flags = pgsql_copy_fetch_int32(pgstate);
+			if ((flags & (1 << 16)) != 0)
+				Elog("COPY BINARY stream contains OIDs");
+			extlen = pgsql_copy_fetch_int32(pgstate);
+			if (extlen < 0 || pgstate->copy_pos + extlen > pgstate->copy_end)
+				Elog("COPY BINARY stream has corrupted header extension");
+			pgstate->copy_pos += extlen;
+			pgstate->copy_header = true;
+			if (pgstate->copy_pos == pgstate->copy_end)
+			{
+				PQfreemem(pgstate->copy_buf);
+				pgstate->copy_buf = NULL;
+				continue;
+			}
+		}
+		nfields = pgsql_copy_fetch_int16(pgstate);
+		if (nfields >= 0)
+			return nfields;
+		/* file trailer; wait for the end of the COPY */
+		PQfreemem(pgstate->copy_buf);
+		pgstate->copy_buf = NULL;
+	}
+	/* ensure the COPY command completed successfully */
+	while ((res = PQgetResult(conn)) != NULL)
+	{
+		if (PQresultStatus(res) != PGRES_COMMAND_OK)
+			Elog("failed on COPY BINARY: %s", PQresultErrorMessage(res));
+		PQclear(res);
+	}
+	return -1;
+}
+
+static SQLtable *
+pgsql_begin_copy(PGSTATE *pgstate,
+				 const char *sqldb_command,
+				 ArrowFileInfo *af_info,
+				 SQLdictionary *dictionary_list)
+{
+	PGconn	   *conn = pgstate->conn;
+	PGresult   *res;
+	SQLtable   *table;
+	char	   *query;
+
+	/* describe the results of the query without execution */
+	res = PQprepare(conn, "", sqldb_command, 0, NULL);
+	if (PQresultStatus(res) != PGRES_COMMAND_OK)
+		Elog("unable to prepare the SQL command: %s",
+			 PQresultErrorMessage(res));
+	PQclear(res);
+	res = PQdescribePrepared(conn, "");
+	if (PQresultStatus(res) != PGRES_COMMAND_OK)
+		Elog("unable to describe the SQL command: %s",
+			 PQresultErrorMessage(res));
+	table = pgsql_create_buffer(conn, res, af_info, dictionary_list);
+	PQclear(res);
+
+	/* kick COPY BINARY */
+	query = palloc(strlen(sqldb_command) + 1024);
+	sprintf(query, "COPY (%s) TO STDOUT (FORMAT binary)", sqldb_command);
+	res = PQexec(conn, query);
+	if (PQresultStatus(res) != PGRES_COPY_OUT)
+		Elog("unable to run COPY BINARY: %s", PQresultErrorMessage(res));
+	PQclear(res);
+
+	/* fetch the first row */
+	if (pgsql_copy_next_row(pgstate) < 0)
+		return NULL;
+	return table;
+}
+
+static ssize_t
+pgsql_copy_fetch_results(PGSTATE *pgstate, SQLtable *table)
+{
+	int			j, nfields;
+	size_t		usage = 0;
+
+	if (!pgstate->copy_buf)
+		return -1;		/* end of the scan */
+	/* the number of fields is already fetched by pgsql_copy_next_row */
+	table->nitems++;
+	for (j=0; j < table->nfields; j++)
+	{
+		SQLfield   *column = &table->columns[j];
+		const char *addr;
+		int32		sz;
+
+		sz = pgsql_copy_fetch_int32(pgstate);
+		if (sz < 0)
+		{
+			addr = NULL;
+			sz = 0;
+		}
+		else
+		{
+			addr = pgstate->copy_pos;
+			if (addr + sz > pgstate->copy_end)
+				Elog("COPY BINARY stream is truncated");
+			pgstate->copy_pos += sz;
+		}
+		usage += sql_field_put_value(column, addr, sz);
+		assert(table->nitems == column->nitems);
+	}
+	/* move to the next row */
+	nfields = pgsql_copy_next_row(pgstate);
+	if (nfields >= 0 && nfields != table->nfields)
+		Elog("COPY BINARY stream has unexpected number of fields: %d",
+			 nfields);
+	return usage;
+}
+
 /*
  * sqldb_server_connect - open and init session
  */
@@ -613,13 +879,23 @@ sqldb_begin_query(void *sqldb_state,
 	PGSTATE	   *pgstate = sqldb_state;
 	PGconn	   *conn = pgstate->conn;
 	PGresult   *res;
+	SQLtable   *table;
 	char	   *query;
 
-	/* begin read-only transaction */
-	res = PQexec(conn, "BEGIN READ ONLY");
-	if (PQresultStatus(res) != PGRES_COMMAND_OK)
-		Elog("unable to begin transaction: %s", PQresultErrorMessage(res));
-	PQclear(res);
+	/* begin read-only transaction, unless snapshot is exported/imported */
+	if (!pgstate->in_xact)
+	{
+		res = PQexec(conn, "BEGIN READ ONLY");
+		if (PQresultStatus(res) != PGRES_COMMAND_OK)
+			Elog("unable to begin transaction: %s",
+				 PQresultErrorMessage(res));
+		PQclear(res);
+		pgstate->in_xact = true;
+	}
+
+	if (pgstate->copy_mode)
+		return pgsql_begin_copy(pgstate, sqldb_command,
+								af_info, dictionary_list);
 
 	/* declare cursor */
 	query = palloc(strlen(sqldb_command) + 1024);
@@ -635,8 +911,126 @@ sqldb_begin_query(void *sqldb_state,
 	if (!res)
 		return NULL;
 	pgstate->res = res;
+	table = pgsql_create_buffer(conn, res, af_info, dictionary_list);
+	/* no more catalog queries, so the next results can be prefetched */
+	pgsql_start_prefetch(pgstate);
+
+	return table;
+}
+
+/*
+ * sqldb_enable_copy_mode - use COPY BINARY instead of the binary cursor
+ */
+void
+sqldb_enable_copy_mode(void *sqldb_state)
+{
+	PGSTATE	   *pgstate = sqldb_state;
 
-	return pgsql_create_buffer(conn, res, af_info, dictionary_list);
+	pgstate->copy_mode = true;
+}
+
+/*
+ * sqldb_export_snapshot - begin a transaction and export its snapshot
+ *
+ * It is used by --parallel mode to dump a table by multiple connections
+ * on the identical snapshot. The transaction is kept until the cursor is
+ * closed, so the snapshot is valid until the end of the dump.
+ */
+char *
+sqldb_export_snapshot(void *sqldb_state)
+{
+	PGSTATE	   *pgstate = sqldb_state;
+	PGconn	   *conn = pgstate->conn;
+	PGresult   *res;
+	char	   *snapshot;
+
+	assert(!pgstate->in_xact);
+	res = PQexec(conn, "BEGIN ISOLATION LEVEL REPEATABLE READ READ ONLY");
+	if (PQresultStatus(res) != PGRES_COMMAND_OK)
+		Elog("unable to begin transaction: %s", PQresultErrorMessage(res));
+	PQclear(res);
+	pgstate->in_xact = true;
+
+	res = PQexec(conn, "SELECT pg_catalog.pg_export_snapshot()");
+	if (PQresultStatus(res) != PGRES_TUPLES_OK ||
+		PQntuples(res) != 1 ||
+		PQgetisnull(res, 0, 0))
+		Elog("unable to export snapshot: %s", PQresultErrorMessage(res));
+	snapshot = pstrdup(PQgetvalue(res, 0, 0));
+	PQclear(res);
+
+	return snapshot;
+}
+
+/*
+ * sqldb_import_snapshot - begin a transaction on the exported snapshot
+ */
+void
+sqldb_import_snapshot(void *sqldb_state, const char *snapshot)
+{
+	PGSTATE	   *pgstate = sqldb_state;
+	PGconn	   *conn = pgstate->conn;
+	PGresult   *res;
+	char		query[1024];
+
+	assert(!pgstate->in_xact);
+	res = PQexec(conn, "BEGIN ISOLATION LEVEL REPEATABLE READ READ ONLY");
+	if (PQresultStatus(res) != PGRES_COMMAND_OK)
+		Elog("unable to begin transaction: %s", PQresultErrorMessage(res));
+	PQclear(res);
+	pgstate->in_xact = true;
+
+	snprintf(query, sizeof(query),
+			 "SET TRANSACTION SNAPSHOT '%s'", snapshot);
+	res = PQexec(conn, query);
+	if (PQresultStatus(res) != PGRES_COMMAND_OK)
+		Elog("unable to import snapshot '%s': %s",
+			 snapshot, PQresultErrorMessage(res));
+	PQclear(res);
+}
+
+/*
+ * sqldb_table_nblocks - number of blocks of the table to be dumped
+ *
+ * It is used to split the table into ctid block ranges. Only regular
+ * tables and materialized views are supported, because other relations
+ * (e.g, partitioned tables, views) have no physical blocks.
+ */
+uint64
+sqldb_table_nblocks(void *sqldb_state, const char *table_name)
+{
+	PGSTATE	   *pgstate = sqldb_state;
+	PGconn	   *conn = pgstate->conn;
+	PGresult   *res;
+	char	   *relname;
+	char	   *query;
+	uint64		nblocks;
+
+	relname = PQescapeLiteral(conn, table_name, strlen(table_name));
+	if (!relname)
+		Elog("failed on PQescapeLiteral: %s", PQerrorMessage(conn));
+	query = palloc(strlen(relname) + 1024);
+	sprintf(query,
+			"SELECT relkind,"
+			"       pg_catalog.pg_relation_size(oid) /"
+			"       pg_catalog.current_setting('block_size')::bigint"
+			"  FROM pg_catalog.pg_class"
+			" WHERE oid = %s::regclass", relname);
+	PQfreemem(relname);
+
+	res = PQexec(conn, query);
+	if (PQresultStatus(res) != PGRES_TUPLES_OK ||
+		PQntuples(res) != 1)
+		Elog("unable to get number of blocks of '%s': %s",
+			 table_name, PQresultErrorMessage(res));
+	if (strcmp(PQgetvalue(res, 0, 0), "r") != 0 &&
+		strcmp(PQgetvalue(res, 0, 0), "m") != 0)
+		Elog("'%s' is neither regular table nor materialized view",
+			 table_name);
+	nblocks = strtoul(PQgetvalue(res, 0, 1), NULL, 10);
+	PQclear(res);
+
+	return nblocks;
 }
 
 ssize_t
@@ -644,9 +1038,14 @@ sqldb_fetch_results(void *sqldb_state, SQLtable *table)
 {
 	PGSTATE	   *pgstate = sqldb_state;
 	PGresult   *res = pgstate->res;
-	int			j, index = pgstate->index++;
+	int			j, index;
 	size_t		usage = 0;
 
+	if (pgstate->copy_mode)
+		return pgsql_copy_fetch_results(pgstate, table);
+
+	index = pgstate->index++;
+
 	if (index >= pgstate->nitems)
 	{
 		res = pgsql_next_result(pgstate);
@@ -687,8 +1086,18 @@ sqldb_close_connection(void *sqldb_state)
 	PGconn	   *conn = pgstate->conn;
 	PGresult   *res;
 
+	if (pgstate->fetcher_active)
+		PQclear(pgsql_join_prefetch(pgstate));
 	if (pgstate->res)
 		PQclear(pgstate->res);
+	if (pgstate->copy_mode)
+	{
+		/* COPY stream is already consumed */
+		if (pgstate->copy_buf)
+			PQfreemem(pgstate->copy_buf);
+		PQfinish(conn);
+		return;
+	}
 	/* close the cursor */
 	res = PQexec(conn, "CLOSE " CURSOR_NAME);
 	if (PQresultStatus(res) != PGRES_COMMAND_OK)
@@ -11,6 +11,7 @@
 #include <ctype.h>
 #include <getopt.h>
 #include <limits.h>
+#include <pthread.h>
 #include <signal.h>
 #include <stdlib.h>
 #include <stdio.h>
@@ -18,9 +19,12 @@
 
 /* command options */
 static char	   *sqldb_command = NULL;
+static char	   *sqldb_table_name = NULL;
 static char	   *output_filename = NULL;
 static char	   *append_filename = NULL;
 static size_t	batch_segment_sz = 0;
+static ArrowBodyCompression *batch_compression = NULL;
+static char	   *bloom_filter_columns = NULL;
 static char	   *sqldb_hostname = NULL;
 static char	   *sqldb_port_num = NULL;
 static char	   *sqldb_username = NULL;
@@ -28,6 +32,8 @@ static char	   *sqldb_password = NULL;
 static char	   *sqldb_database = NULL;
 static char	   *dump_arrow_filename = NULL;
 static int		shows_progress = 0;
+static int		num_workers = 1;
+static int		copy_mode = 0;
 static userConfigOption *sqldb_session_configs = NULL;
 
 /*
@@ -101,7 +107,8 @@ loadArrowDictionaryBatches(int fdesc, ArrowFileInfo *af_info)
 		dbatch = &af_info->dictionaries[i].body.dictionaryBatch;
 		if (dbatch->node.tag != ArrowNodeTag__DictionaryBatch ||
 			dbatch->data._num_nodes != 1 ||
-			dbatch->data._num_buffers != 3)
+			dbatch->data._num_buffers != 3 ||
+			dbatch->data.compression != NULL)
 			Elog("DictionaryBatch (dictionary_id=%ld) has unexpected format",
 				 dbatch->id);
 		message_head = mmap_head + block->offset;
@@ -120,6 +127,13 @@ loadArrowDictionaryBatches(int fdesc, ArrowFileInfo *af_info)
  * already overwritten with --append mode. The callback below tries to
  * revert the arrow file using UNDO log; that is Footer portion saved
  * before any writing stuff.
+ *
+ * RecordBatches may be written by the writer thread or the --parallel
+ * workers concurrently, under the write_mutex. So, the UNDO log is applied
+ * under the write_mutex (unless the current thread already holds it), then
+ * the lock is never released, to prevent any further writes on the file.
+ * It also uses pwrite(2) at the explicit offset, because the file position
+ * is shared with other threads.
  */
 typedef struct
 {
@@ -130,6 +144,8 @@ typedef struct
 } arrowFileUndoLog;
 
 static arrowFileUndoLog	   *arrow_file_undo_log = NULL;
+static pthread_mutex_t		write_mutex = PTHREAD_MUTEX_INITIALIZER;
+static __thread bool		write_mutex_held = false;
 
 /*
  * fixup_append_file_on_exit
@@ -146,23 +162,24 @@ fixup_append_file_on_exit(int status, void *p)
 	/* avoid infinite recursion */
 	arrow_file_undo_log = NULL;
 
-	if (lseek(undo->append_fdesc,
-			  undo->footer_offset, SEEK_SET) != undo->footer_offset)
+	/* wait for the concurrent write, then block any further writes */
+	if (!write_mutex_held)
 	{
-		fprintf(stderr, "failed on lseek(2) on applying undo log.\n");
-		return;
+		pthread_mutex_lock(&write_mutex);
+		write_mutex_held = true;
 	}
 
 	while (count < undo->footer_length)
 	{
-		nbytes = write(undo->append_fdesc,
-					   undo->footer_backup + count,
-					   undo->footer_length - count);
+		nbytes = pwrite(undo->append_fdesc,
+						undo->footer_backup + count,
+						undo->footer_length - count,
+						undo->footer_offset + count);
 		if (nbytes > 0)
 			count += nbytes;
 		else if (errno != EINTR)
 		{
-			fprintf(stderr, "failed on write(2) on applying undo log.\n");
+			fprintf(stderr, "failed on pwrite(2) on applying undo log.\n");
 			return;
 		}
 	}
@@ -229,6 +246,8 @@ setup_append_file(SQLtable *table, ArrowFileInfo *af_info)
 	memcpy(table->recordBatches,
 		   af_info->footer.recordBatches,
 		   sizeof(ArrowBlock) * nitems);
+	/* restore min/max statistics of the RecordBatches above */
+	restoreArrowFieldStatistics(table, &af_info->footer.schema);
 
 	/* move to the file offset in front of the Footer portion */
 	nbytes = sizeof(int32) + 6;		/* strlen("ARROW1") */
@@ -314,6 +333,58 @@ setup_output_file(SQLtable *table, const char *output_filename)
 	writeArrowSchema(table);
 }
 
+/*
+ * setup_bloom_filter
+ */
+static void
+setup_bloom_filter(SQLtable *table, bool is_append)
+{
+	char	   *temp = pstrdup(bloom_filter_columns);
+	char	   *tok, *pos;
+	char	   *saveptr;
+	char	   *bloom_filename;
+	int			j;
+
+	for (tok = strtok_r(temp, ",", &saveptr);
+		 tok != NULL;
+		 tok = strtok_r(NULL, ",", &saveptr))
+	{
+		while (isspace(*tok))
+			tok++;
+		pos = tok + strlen(tok) - 1;
+		while (pos >= tok && isspace(*pos))
+			*pos-- = '\0';
+
+		for (j=0; j < table->nfields; j++)
+		{
+			SQLfield   *column = &table->columns[j];
+
+			if (strcmp(column->field_name, tok) == 0)
+			{
+				if (!arrowFieldBloomFilterIsSupported(column))
+					Elog("--bloom-filter does not support column '%s' of %s",
+						 tok, column->arrow_typename);
+				column->bloom_enabled = true;
+				break;
+			}
+		}
+		if (j == table->nfields)
+			Elog("--bloom-filter specified unknown column '%s'", tok);
+	}
+	/* open the sidecar file next to the result file */
+	bloom_filename = palloc(strlen(table->filename) +
+							strlen(ARROW_BLOOM_FILTER_SUFFIX) + 1);
+	sprintf(bloom_filename, "%s%s",
+			table->filename, ARROW_BLOOM_FILTER_SUFFIX);
+	table->bloom_fdesc = open(bloom_filename,
+							  is_append
+							  ? O_RDWR | O_CREAT
+							  : O_RDWR | O_CREAT | O_TRUNC, 0644);
+	if (table->bloom_fdesc < 0)
+		Elog("failed on open('%s'): %m", bloom_filename);
+	table->bloom_filename = bloom_filename;
+}
+
 static void
 shows_record_batch_progress(SQLtable *table, size_t nitems)
 {
@@ -384,9 +455,19 @@ usage(void)
 		  "      --append=FILENAME result Apache Arrow file to be appended\n"
 		  "      (--output and --append are exclusive. If neither of them\n"
 		  "       are given, it creates a temporary file.)\n"
+#ifdef __PG2ARROW__
+		  "      --parallel=N      dumps the table by N connections\n"
+		  "      (-t must be given; the table is split by ctid ranges)\n"
+		  "      --copy            fetch results by COPY BINARY, instead\n"
+		  "                        of the binary cursor\n"
+#endif
 		  "\n"
 		  "Arrow format options:\n"
 		  "  -s, --segment-size=SIZE size of record batch for each\n"
+		  "      --compress=METHOD compression method of record batch\n"
+		  "      (METHOD is one of 'none', 'lz4' or 'zstd')\n"
+		  "      --bloom-filter=COLUMN[,...] builds bloom filters of\n"
+		  "      the columns for each record batch\n"
 		  "\n"
 		  "Connection options:\n"
 		  "  -h, --host=HOSTNAME  database server host\n"
@@ -434,6 +515,12 @@ parse_options(int argc, char * const argv[])
 		{"dump",         required_argument, NULL, 1001},
 		{"progress",     no_argument,       NULL, 1002},
 		{"set",          required_argument, NULL, 1003},
+		{"compress",     required_argument, NULL, 1004},
+		{"bloom-filter", required_argument, NULL, 1005},
+#ifdef __PG2ARROW__
+		{"parallel",     required_argument, NULL, 1006},
+		{"copy",         no_argument,       NULL, 1007},
+#endif /* __PG2ARROW__ */
 		{"help",         no_argument,       NULL, 9999},
 		{NULL, 0, NULL, 0},
 	};
@@ -472,6 +559,7 @@ parse_options(int argc, char * const argv[])
 				if (!sqldb_command)
 					Elog("out of memory");
 				sprintf(sqldb_command, "SELECT * FROM %s", optarg);
+				sqldb_table_name = optarg;
 				break;
 
 			case 'o':
@@ -511,6 +599,39 @@ parse_options(int argc, char * const argv[])
 					Elog("segment size is not valid: %s", optarg);
 				break;
 
+			case 1004:		/* --compress */
+				if (batch_compression)
+					Elog("--compress option was supplied twice");
+				batch_compression = makeArrowBodyCompression(optarg);
+				break;
+
+			case 1005:		/* --bloom-filter */
+				if (bloom_filter_columns)
+					Elog("--bloom-filter option was supplied twice");
+				bloom_filter_columns = optarg;
+				break;
+#ifdef __PG2ARROW__
+			case 1006:		/* --parallel */
+				{
+					char   *end;
+					long	nworkers;
+
+					if (num_workers > 1)
+						Elog("--parallel option was supplied twice");
+					nworkers = strtol(optarg, &end, 10);
+					if (*end != '\0' || nworkers < 1 || nworkers > 256)
+						Elog("--parallel must be 1..256: %s", optarg);
+					num_workers = nworkers;
+				}
+				break;
+
+			case 1007:		/* --copy */
+				if (copy_mode)
+					Elog("--copy option was supplied twice");
+				copy_mode = 1;
+				break;
+#endif	/* __PG2ARROW__ */
+
 			case 'h':
 				if (sqldb_hostname)
 					Elog("-h option was supplied twice");
@@ -622,10 +743,144 @@ parse_options(int argc, char * const argv[])
 	}
 	if (!sqldb_command)
 		Elog("Neither -c nor -t options are supplied");
+	if (num_workers > 1 && !sqldb_table_name)
+		Elog("--parallel option requires -t option");
 	if (batch_segment_sz == 0)
 		batch_segment_sz = (1UL << 28);		/* 256MB in default */
 }
 
+/*
+ * Parallel dump support
+ *
+ * --parallel=N option opens N connections that share the snapshot exported
+ * by the first one, and each worker dumps a range of ctid blocks of the
+ * table. RecordBatches are built by each worker concurrently, then written
+ * to the single result file under the write_mutex, and merged into one
+ * Footer at the end.
+ */
+typedef struct
+{
+	pthread_t	thread;
+	void	   *sqldb_state;
+	SQLtable   *table;		/* NULL, if empty results */
+} dumpWorker;
+
+#ifdef __PG2ARROW__
+static char *
+build_parallel_command(int index, uint64 nblocks)
+{
+	uint64		unitsz = (nblocks + num_workers - 1) / num_workers;
+	char	   *command = palloc(strlen(sqldb_table_name) + 200);
+
+	if (index == 0)
+		sprintf(command, "SELECT * FROM %s WHERE ctid < '(%lu,0)'::tid",
+				sqldb_table_name, unitsz * (index + 1));
+	else if (index == num_workers - 1)
+		sprintf(command, "SELECT * FROM %s WHERE ctid >= '(%lu,0)'::tid",
+				sqldb_table_name, unitsz * index);
+	else
+		sprintf(command, "SELECT * FROM %s WHERE ctid >= '(%lu,0)'::tid"
+				"   AND ctid < '(%lu,0)'::tid",
+				sqldb_table_name, unitsz * index, unitsz * (index + 1));
+	return command;
+}
+#endif	/* __PG2ARROW__ */
+
+static void
+setup_worker_table(SQLtable *table, SQLtable *primary)
+{
+	int		j;
+
+	table->segment_sz = primary->segment_sz;
+	table->compression = primary->compression;
+	table->fdesc = primary->fdesc;
+	table->filename = primary->filename;
+	table->bloom_fdesc = primary->bloom_fdesc;
+	table->bloom_filename = primary->bloom_filename;
+	for (j=0; j < table->nfields; j++)
+		table->columns[j].bloom_enabled = primary->columns[j].bloom_enabled;
+}
+
+static void
+write_record_batch(SQLtable *table)
+{
+	size_t		nitems = table->nitems;
+
+	/* statistics, bloom filters and compression are built without locks */
+	buildArrowRecordBatch(table);
+	pthread_mutex_lock(&write_mutex);
+	write_mutex_held = true;
+	writeArrowRecordBatch(table);
+	shows_record_batch_progress(table, nitems);
+	write_mutex_held = false;
+	pthread_mutex_unlock(&write_mutex);
+}
+
+/*
+ * Pipelined write of RecordBatches
+ *
+ * Query results are filled up on the duplicated SQLtable, while the writer
+ * thread writes out the previous RecordBatch from the primary SQLtable that
+ * owns the RecordBatches and statistics written in the past. The data
+ * buffers are swapped between them for each RecordBatch, so fetch/encode
+ * and write of the RecordBatch run concurrently.
+ */
+static void *
+write_record_batch_async(void *__table)
+{
+	write_record_batch((SQLtable *)__table);
+	return NULL;
+}
+
+static void
+dump_query_results(void *sqldb_state, SQLtable *table)
+{
+	SQLtable   *buffer = sql_table_duplicate(table);
+	pthread_t	writer;
+	bool		writer_active = false;
+	ssize_t		usage;
+	int			rc;
+
+	while ((usage = sqldb_fetch_results(sqldb_state, buffer)) >= 0)
+	{
+		if (usage > batch_segment_sz)
+		{
+			if (writer_active)
+			{
+				rc = pthread_join(writer, NULL);
+				if (rc != 0)
+					Elog("failed on pthread_join: %s", strerror(rc));
+			}
+			sql_table_swap_buffers(table, buffer);
+			rc = pthread_create(&writer, NULL,
+								write_record_batch_async, table);
+			if (rc != 0)
+				Elog("failed on pthread_create: %s", strerror(rc));
+			writer_active = true;
+		}
+	}
+	if (writer_active)
+	{
+		rc = pthread_join(writer, NULL);
+		if (rc != 0)
+			Elog("failed on pthread_join: %s", strerror(rc));
+	}
+	if (buffer->nitems > 0)
+	{
+		sql_table_swap_buffers(table, buffer);
+		write_record_batch(table);
+	}
+}
+
+static void *
+dump_worker_main(void *__worker)
+{
+	dumpWorker *worker = __worker;
+
+	dump_query_results(worker->sqldb_state, worker->table);
+	return NULL;
+}
+
 /*
  * Entrypoint of mysql2arrow
  */
@@ -633,11 +888,14 @@ int main(int argc, char * const argv[])
 {
 	int				append_fdesc = -1;
 	ArrowFileInfo	af_info;
-	void		   *sqldb_state;
-	SQLtable	   *table;
+	dumpWorker	   *workers;
+	SQLtable	   *table = NULL;
 	ArrowKeyValue  *kv;
-	ssize_t			usage;
 	SQLdictionary  *sql_dict_list = NULL;
+	int				i, rc;
+#ifdef __PG2ARROW__
+	uint64			nblocks = 0;
+#endif
 	
 	parse_options(argc, argv);
 
@@ -645,13 +903,21 @@ int main(int argc, char * const argv[])
 	if (dump_arrow_filename)
 		return dumpArrowFile(dump_arrow_filename);
 
-	/* open connection */
-	sqldb_state = sqldb_server_connect(sqldb_hostname,
-									   sqldb_port_num,
-									   sqldb_username,
-									   sqldb_password,
-									   sqldb_database,
-									   sqldb_session_configs);
+	/* open connection(s) */
+	workers = palloc0(sizeof(dumpWorker) * num_workers);
+	for (i=0; i < num_workers; i++)
+	{
+		workers[i].sqldb_state = sqldb_server_connect(sqldb_hostname,
+													  sqldb_port_num,
+													  sqldb_username,
+													  sqldb_password,
+													  sqldb_database,
+													  sqldb_session_configs);
+#ifdef __PG2ARROW__
+		if (copy_mode)
+			sqldb_enable_copy_mode(workers[i].sqldb_state);
+#endif	/* __PG2ARROW__ */
+	}
 	/* read the original arrow file, if --append mode */
 	if (append_filename)
 	{
@@ -661,14 +927,46 @@ int main(int argc, char * const argv[])
 		readArrowFileDesc(append_fdesc, &af_info);
 		sql_dict_list = loadArrowDictionaryBatches(append_fdesc, &af_info);
 	}
-	/* begin SQL command execution */
-	table = sqldb_begin_query(sqldb_state,
-							  sqldb_command,
-							  append_filename ? &af_info : NULL,
-							  sql_dict_list);
+#ifdef __PG2ARROW__
+	/* share the snapshot of the first connection, if --parallel mode */
+	if (num_workers > 1)
+	{
+		char	   *snapshot;
+
+		snapshot = sqldb_export_snapshot(workers[0].sqldb_state);
+		nblocks = sqldb_table_nblocks(workers[0].sqldb_state,
+									  sqldb_table_name);
+		for (i=1; i < num_workers; i++)
+			sqldb_import_snapshot(workers[i].sqldb_state, snapshot);
+	}
+#endif	/* __PG2ARROW__ */
+	/*
+	 * begin SQL command execution
+	 *
+	 * The first non-empty results become the primary table; the others
+	 * share its dictionaries, thus enum values are encoded consistently.
+	 */
+	for (i=0; i < num_workers; i++)
+	{
+		const char *command = sqldb_command;
+
+#ifdef __PG2ARROW__
+		if (num_workers > 1)
+			command = build_parallel_command(i, nblocks);
+#endif	/* __PG2ARROW__ */
+		workers[i].table = sqldb_begin_query(workers[i].sqldb_state,
+											 command,
+											 append_filename ? &af_info : NULL,
+											 table
+											 ? table->sql_dict_list
+											 : sql_dict_list);
+		if (!table)
+			table = workers[i].table;
+	}
 	if (!table)
 		Elog("Empty results by the query: %s", sqldb_command);
 	table->segment_sz = batch_segment_sz;
+	table->compression = batch_compression;
 
 	/* save the SQL command as custom metadata */
 	kv = palloc0(sizeof(ArrowKeyValue));
@@ -689,32 +987,47 @@ int main(int argc, char * const argv[])
 		table->filename = append_filename;
 		setup_append_file(table, &af_info);
 	}
+	/* open the sidecar file of bloom filters, if any */
+	if (bloom_filter_columns)
+		setup_bloom_filter(table, append_filename != NULL);
 	/* write out dictionary batch, if any */
 	writeArrowDictionaryBatches(table);
 	/* main loop to fetch and write result */
-	while ((usage = sqldb_fetch_results(sqldb_state, table)) >= 0)
+	if (num_workers == 1)
+		dump_query_results(workers[0].sqldb_state, table);
+	else
 	{
-		if (usage > batch_segment_sz)
+		for (i=0; i < num_workers; i++)
 		{
-			size_t		nitems = table->nitems;
-
-			writeArrowRecordBatch(table);
-			shows_record_batch_progress(table, nitems);
+			if (!workers[i].table)
+				continue;
+			if (workers[i].table != table)
+				setup_worker_table(workers[i].table, table);
+			rc = pthread_create(&workers[i].thread, NULL,
+								dump_worker_main, &workers[i]);
+			if (rc != 0)
+				Elog("failed on pthread_create: %s", strerror(rc));
+		}
+		for (i=0; i < num_workers; i++)
+		{
+			if (!workers[i].table)
+				continue;
+			rc = pthread_join(workers[i].thread, NULL);
+			if (rc != 0)
+				Elog("failed on pthread_join: %s", strerror(rc));
+			if (workers[i].table != table)
+				mergeArrowRecordBatches(table, workers[i].table);
 		}
-	}
-	if (table->nitems > 0)
-	{
-		size_t		nitems = table->nitems;
-
-		writeArrowRecordBatch(table);
-		shows_record_batch_progress(table, nitems);
 	}
 	/* write out footer portion */
 	writeArrowFooter(table);
 
 	/* cleanup */
-	sqldb_close_connection(sqldb_state);
+	for (i=0; i < num_workers; i++)
+		sqldb_close_connection(workers[i].sqldb_state);
 	close(table->fdesc);
+	if (table->bloom_filename)
+		close(table->bloom_fdesc);
 
 	return 0;
 }
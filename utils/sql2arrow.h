@@ -28,6 +28,18 @@ sqldb_fetch_results(void *sqldb_state, SQLtable *table);
 extern void
 sqldb_close_connection(void *sqldb_state);
 
+#ifdef __PG2ARROW__
+extern void
+sqldb_enable_copy_mode(void *sqldb_state);
+/* parallel dump support */
+extern char *
+sqldb_export_snapshot(void *sqldb_state);
+extern void
+sqldb_import_snapshot(void *sqldb_state, const char *snapshot);
+extern uint64
+sqldb_table_nblocks(void *sqldb_state, const char *table_name);
+#endif	/* __PG2ARROW__ */
+
 /* misc functions */
 extern void	   *palloc(Size sz);
 extern void	   *palloc0(Size sz);